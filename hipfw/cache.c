@@ -34,6 +34,7 @@
 #define _BSD_SOURCE
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,6 +57,179 @@
 
 static HIP_HASHTABLE *firewall_cache_db = NULL;
 
+/**
+ * Serializes access to ::firewall_cache_db from the netfilter queue workers
+ * and the hipd message handler. Entries are updated in place, so they must
+ * only be read with this lock held; hipfw_cache_db_match() hands out copies.
+ */
+static pthread_mutex_t firewall_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Entry of ::cache_lsi_index and ::cache_ip_index. It maps a local and peer
+ * LSI or IP address to a cache entry with these identifiers. LSIs are stored
+ * as IPv4-mapped addresses.
+ */
+struct cache_index_entry {
+    struct in6_addr                  local;
+    struct in6_addr                  peer;
+    struct hip_hadb_user_info_state *ha;
+    /** number of cache entries with this key */
+    unsigned int                     refs;
+};
+
+/** Index of ::firewall_cache_db by local and peer LSI */
+static HIP_HASHTABLE *cache_lsi_index = NULL;
+
+/** Index of ::firewall_cache_db by local and peer IP address */
+static HIP_HASHTABLE *cache_ip_index = NULL;
+
+/**
+ * Hash the addresses of a cache index entry.
+ *
+ * @param entry the index entry
+ * @return      the hash value
+ */
+static unsigned long cache_index_hash(const struct cache_index_entry *entry)
+{
+    const uint32_t *const local = entry->local.s6_addr32;
+    const uint32_t *const peer  = entry->peer.s6_addr32;
+
+    return local[0] ^ local[1] ^ local[2] ^ local[3] ^
+           ((peer[0] ^ peer[1] ^ peer[2] ^ peer[3]) * 0x9E3779B1UL);
+}
+
+/**
+ * Compare the addresses of two cache index entries.
+ *
+ * @param entry1 first index entry
+ * @param entry2 second index entry
+ * @return       0 if the entries have the same key, non-zero otherwise
+ */
+static int cache_index_cmp(const struct cache_index_entry *entry1,
+                           const struct cache_index_entry *entry2)
+{
+    return ipv6_addr_cmp(&entry1->local, &entry2->local) ||
+           ipv6_addr_cmp(&entry1->peer, &entry2->peer);
+}
+
+STATIC_IMPLEMENT_LHASH_HASH_FN(cache_index, struct cache_index_entry)
+STATIC_IMPLEMENT_LHASH_COMP_FN(cache_index, struct cache_index_entry)
+
+/**
+ * Build the key of a cache entry in one of the indexes.
+ *
+ * @param index ::cache_lsi_index or ::cache_ip_index
+ * @param ha    the cache entry
+ * @param key   receives the local and peer address
+ */
+static void cache_index_key(const HIP_HASHTABLE *const index,
+                            const struct hip_hadb_user_info_state *const ha,
+                            struct cache_index_entry *const key)
+{
+    if (index == cache_lsi_index) {
+        IPV4_TO_IPV6_MAP(&ha->lsi_our, &key->local);
+        IPV4_TO_IPV6_MAP(&ha->lsi_peer, &key->peer);
+    } else {
+        key->local = ha->ip_our;
+        key->peer  = ha->ip_peer;
+    }
+}
+
+/**
+ * Add a cache entry to an index.
+ *
+ * @param index ::cache_lsi_index or ::cache_ip_index
+ * @param ha    the cache entry
+ * @return      0 on success, -1 on error
+ */
+static int cache_index_add(HIP_HASHTABLE *const index,
+                           struct hip_hadb_user_info_state *const ha)
+{
+    struct cache_index_entry  key;
+    struct cache_index_entry *entry = NULL;
+
+    cache_index_key(index, ha, &key);
+
+    // an entry already indexed under this key keeps precedence
+    if ((entry = hip_ht_find(index, &key))) {
+        entry->refs++;
+        return 0;
+    }
+
+    if (!(entry = malloc(sizeof(*entry)))) {
+        HIP_ERROR("Allocating cache index entry failed\n");
+        return -1;
+    }
+    *entry      = key;
+    entry->ha   = ha;
+    entry->refs = 1;
+    hip_ht_add(index, entry);
+
+    return 0;
+}
+
+/**
+ * Remove a cache entry from an index. If another cache entry has the same
+ * key, the index entry is passed on to it.
+ *
+ * @param index ::cache_lsi_index or ::cache_ip_index
+ * @param ha    the cache entry
+ */
+static void cache_index_remove(HIP_HASHTABLE *const index,
+                               const struct hip_hadb_user_info_state *const ha)
+{
+    struct cache_index_entry         key;
+    struct cache_index_entry        *entry = NULL;
+    struct hip_hadb_user_info_state *this  = NULL;
+    LHASH_NODE                      *item  = NULL, *tmp = NULL;
+    int                              i;
+
+    cache_index_key(index, ha, &key);
+
+    if (!(entry = hip_ht_find(index, &key))) {
+        return;
+    }
+
+    if (--entry->refs == 0) {
+        hip_ht_delete(index, entry);
+        free(entry);
+        return;
+    }
+
+    if (entry->ha != ha) {
+        return;
+    }
+
+    list_for_each_safe(item, tmp, firewall_cache_db, i) {
+        this = list_entry(item);
+        if (this != ha) {
+            cache_index_key(index, this, &key);
+            if (!cache_index_cmp(&key, entry)) {
+                entry->ha = this;
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Free all entries of an index.
+ *
+ * @param index ::cache_lsi_index or ::cache_ip_index
+ */
+static void cache_index_flush(HIP_HASHTABLE *const index)
+{
+    struct cache_index_entry *this = NULL;
+    LHASH_NODE               *item = NULL, *tmp = NULL;
+    int                       i;
+
+    list_for_each_safe(item, tmp, index, i) {
+        this = list_entry(item);
+        hip_ht_delete(index, this);
+        free(this);
+    }
+}
+
 /**
  * Allocate a cache entry. Caller must free the memory.
  *
@@ -86,17 +260,20 @@ static struct hip_hadb_user_info_state *firewall_add_new_entry(const struct hip_
 
     HIP_ASSERT(ha_entry != NULL);
 
-    new_entry = cache_create_hl_entry();
-    ipv6_addr_copy(&new_entry->hit_our,  &ha_entry->hit_our);
-    ipv6_addr_copy(&new_entry->hit_peer, &ha_entry->hit_peer);
-
-    ipv4_addr_copy(&new_entry->lsi_our,  &ha_entry->lsi_our);
-    ipv4_addr_copy(&new_entry->lsi_peer, &ha_entry->lsi_peer);
-
-    ipv6_addr_copy(&new_entry->ip_our,  &ha_entry->ip_our);
-    ipv6_addr_copy(&new_entry->ip_peer, &ha_entry->ip_peer);
+    if (!(new_entry = cache_create_hl_entry())) {
+        return NULL;
+    }
+    memcpy(new_entry, ha_entry, sizeof(*new_entry));
 
-    new_entry->state = ha_entry->state;
+    if (cache_index_add(cache_lsi_index, new_entry)) {
+        free(new_entry);
+        return NULL;
+    }
+    if (cache_index_add(cache_ip_index, new_entry)) {
+        cache_index_remove(cache_lsi_index, new_entry);
+        free(new_entry);
+        return NULL;
+    }
 
     hip_ht_add(firewall_cache_db, new_entry);
 
@@ -104,68 +281,22 @@ static struct hip_hadb_user_info_state *firewall_add_new_entry(const struct hip_
 }
 
 /**
- * Query HIPD for current HA information and try to match a pair of
- * HITs, LSIs or IPs. If a match is found, insert it in the firewall
- * cache and return the cache entry.
- *
- * @param local local identifier or locator (optional)
- * @param peer peer identifier or locator
- * @param type whether the parameters are HITs, LSIs or IPs
- * @return the cached entry on match, NULL otherwise
- */
-static struct hip_hadb_user_info_state *firewall_cache_hadb_match(const void *local,
-                                                                  const void *peer,
-                                                                  enum fw_cache_query_type type)
-{
-    struct       hip_hadb_user_info_state *err           = NULL;
-    const struct hip_hadb_user_info_state *ha_curr       = NULL;
-    struct       hip_common               *msg           = NULL;
-    const struct hip_tlv_common           *current_param = NULL;
-
-    HIP_IFEL(!(msg = malloc(HIP_MAX_PACKET)), NULL, "malloc failed\n");
-    hip_msg_init(msg);
-    HIP_IFEL(hip_build_user_hdr(msg, HIP_MSG_GET_HA_INFO, 0),
-             NULL, "Building of daemon header failed\n");
-    HIP_IFEL(hip_send_recv_daemon_info(msg, 0, hip_fw_sock),
-             NULL, "send recv daemon info\n");
-
-    while ((current_param = hip_get_next_param(msg, current_param))) {
-        ha_curr = hip_get_param_contents_direct(current_param);
-
-        if ((type == FW_CACHE_HIT && !ipv6_addr_cmp(peer, &ha_curr->hit_peer) &&
-             (!local || !ipv6_addr_cmp(local,  &ha_curr->hit_our))) ||
-            (type == FW_CACHE_LSI && !ipv4_addr_cmp(peer, &ha_curr->lsi_peer) &&
-             (!local || !ipv4_addr_cmp(local, &ha_curr->lsi_our)))  ||
-            (type == FW_CACHE_IP  && !ipv6_addr_cmp(peer, &ha_curr->ip_peer)  &&
-             (!local || !ipv6_addr_cmp(local, &ha_curr->ip_our)))) {
-            err = firewall_add_new_entry(ha_curr);
-            break;
-        }
-    }
-
-out_err:
-    free(msg);
-    return err;
-}
-
-/**
- * Search the cache database for an entry by HITs, LSIs or IPs
+ * Search the cache database for an entry by HITs, LSIs or IPs. Must be
+ * called with ::firewall_cache_lock held.
  *
  * @param local local identifier or locator (optional)
  * @param peer peer identifier or locator
  * @param type whether the parameters are HITs, LSIs or IPs
- * @param query_daemon whether to query the daemon for HA information
- *        if no entry is found in the cache
  * @return the entry on match, NULL otherwise
  */
-struct hip_hadb_user_info_state *hipfw_cache_db_match(const void *local,
-                                                      const void *peer,
-                                                      enum fw_cache_query_type type,
-                                                      int query_daemon)
+static struct hip_hadb_user_info_state *cache_db_match(const void *local,
+                                                       const void *peer,
+                                                       enum fw_cache_query_type type)
 {
     int                              i;
     struct hip_hadb_user_info_state *this = NULL, *ha_match = NULL;
     LHASH_NODE                      *item = NULL, *tmp = NULL;
+    struct cache_index_entry         key, *index_entry = NULL;
 
     if (type == FW_CACHE_HIT) {
         ha_match = hip_ht_find(firewall_cache_db, peer);
@@ -173,6 +304,22 @@ struct hip_hadb_user_info_state *hipfw_cache_db_match(const void *local,
             HIP_DEBUG("Matched using hash\n");
             goto out_err;
         }
+    } else if (local) {
+        /* the indexes cover lookups by address pair; a lookup by peer
+         * address alone falls back to the scan below */
+        if (type == FW_CACHE_LSI) {
+            const struct in_addr *const lsi_local = local, *const lsi_peer = peer;
+
+            IPV4_TO_IPV6_MAP(lsi_local, &key.local);
+            IPV4_TO_IPV6_MAP(lsi_peer, &key.peer);
+            index_entry = hip_ht_find(cache_lsi_index, &key);
+        } else {
+            ipv6_addr_copy(&key.local, local);
+            ipv6_addr_copy(&key.peer, peer);
+            index_entry = hip_ht_find(cache_ip_index, &key);
+        }
+        ha_match = index_entry ? index_entry->ha : NULL;
+        goto out_err;
     }
 
     HIP_DEBUG("Check firewall cache db\n");
@@ -198,11 +345,6 @@ struct hip_hadb_user_info_state *hipfw_cache_db_match(const void *local,
         }
     }
 
-    if (!ha_match && query_daemon) {
-        HIP_DEBUG("No match found in cache, querying daemon\n");
-        ha_match = firewall_cache_hadb_match(local, peer, type);
-    }
-
 out_err:
     if (!ha_match) {
         HIP_DEBUG("No match found\n");
@@ -211,6 +353,32 @@ out_err:
     return ha_match;
 }
 
+/**
+ * Search the cache database for an entry by HITs, LSIs or IPs
+ *
+ * @param local local identifier or locator (optional)
+ * @param peer peer identifier or locator
+ * @param type whether the parameters are HITs, LSIs or IPs
+ * @param entry the matching entry is copied here (optional)
+ * @return 0 on match, -1 otherwise
+ */
+int hipfw_cache_db_match(const void *local,
+                         const void *peer,
+                         enum fw_cache_query_type type,
+                         struct hip_hadb_user_info_state *entry)
+{
+    const struct hip_hadb_user_info_state *ha_match;
+
+    pthread_mutex_lock(&firewall_cache_lock);
+    ha_match = cache_db_match(local, peer, type);
+    if (ha_match && entry) {
+        *entry = *ha_match;
+    }
+    pthread_mutex_unlock(&firewall_cache_lock);
+
+    return ha_match ? 0 : -1;
+}
+
 /**
  * Generate the hash information that is used to index the cache table
  *
@@ -259,6 +427,10 @@ void hipfw_cache_init_hldb(void)
 {
     firewall_cache_db = hip_ht_init(firewall_hash_hit_peer,
                                     firewall_match_hit_peer);
+    cache_lsi_index   = hip_ht_init(LHASH_HASH_FN(cache_index),
+                                    LHASH_COMP_FN(cache_index));
+    cache_ip_index    = hip_ht_init(LHASH_HASH_FN(cache_index),
+                                    LHASH_COMP_FN(cache_index));
 }
 
 /**
@@ -274,6 +446,13 @@ void hipfw_cache_delete_hldb(int exiting)
 
     HIP_DEBUG("Start hldb delete\n");
 
+    pthread_mutex_lock(&firewall_cache_lock);
+    if (cache_lsi_index) {
+        cache_index_flush(cache_lsi_index);
+    }
+    if (cache_ip_index) {
+        cache_index_flush(cache_ip_index);
+    }
     if (firewall_cache_db) {
         list_for_each_safe(item, tmp, firewall_cache_db, i)
         {
@@ -289,7 +468,13 @@ void hipfw_cache_delete_hldb(int exiting)
 
     if (exiting) {
         hip_ht_uninit(firewall_cache_db);
+        hip_ht_uninit(cache_lsi_index);
+        hip_ht_uninit(cache_ip_index);
+        firewall_cache_db = NULL;
+        cache_lsi_index   = NULL;
+        cache_ip_index    = NULL;
     }
+    pthread_mutex_unlock(&firewall_cache_lock);
     HIP_DEBUG("End hldb delete\n");
 }
 
@@ -309,11 +494,92 @@ int hipfw_cache_set_bex_state(const struct in6_addr *hit_our,
 
     HIP_IFEL(!hit_peer, -1, "Need peer HIT to search\n");
 
-    entry = hipfw_cache_db_match(hit_our, hit_peer, FW_CACHE_HIT, 0);
-    HIP_IFEL(!entry, -1, "No cache entry found\n");
+    pthread_mutex_lock(&firewall_cache_lock);
+    entry = cache_db_match(hit_our, hit_peer, FW_CACHE_HIT);
+    if (entry) {
+        entry->state = state;
+    }
+    pthread_mutex_unlock(&firewall_cache_lock);
 
-    entry->state = state;
+    HIP_IFEL(!entry, -1, "No cache entry found\n");
 
 out_err:
     return err;
 }
+
+/**
+ * Add or refresh the host associations carried in a HIP_MSG_FW_HA_UPDATE
+ * message from hipd. Entries are keyed by peer HIT.
+ *
+ * @param msg the message with one or more HIP_PARAM_HA_INFO parameters
+ * @return 0 on success, negative on error
+ */
+int hipfw_cache_handle_ha_update(const struct hip_common *msg)
+{
+    const struct hip_tlv_common           *param = NULL;
+    const struct hip_hadb_user_info_state *ha    = NULL;
+    struct hip_hadb_user_info_state       *entry = NULL;
+    int                                    err   = 0;
+
+    pthread_mutex_lock(&firewall_cache_lock);
+    while ((param = hip_get_next_param(msg, param))) {
+        if (hip_get_param_type(param) != HIP_PARAM_HA_INFO) {
+            continue;
+        }
+        ha = hip_get_param_contents_direct(param);
+
+        if ((entry = hip_ht_find(firewall_cache_db, ha))) {
+            cache_index_remove(cache_lsi_index, entry);
+            cache_index_remove(cache_ip_index, entry);
+            memcpy(entry, ha, sizeof(*entry));
+            if (cache_index_add(cache_lsi_index, entry)) {
+                err = -ENOMEM;
+            } else if (cache_index_add(cache_ip_index, entry)) {
+                cache_index_remove(cache_lsi_index, entry);
+                err = -ENOMEM;
+            }
+            if (err) {
+                // an entry missing from the indices must not stay in the
+                // cache, removing it later would unindex other entries
+                hip_ht_delete(firewall_cache_db, entry);
+                free(entry);
+                break;
+            }
+        } else if (!firewall_add_new_entry(ha)) {
+            err = -ENOMEM;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&firewall_cache_lock);
+
+    return err;
+}
+
+/**
+ * Invalidate the host associations carried in a HIP_MSG_FW_HA_DELETE
+ * message from hipd.
+ *
+ * @param msg the message with one or more HIP_PARAM_HA_INFO parameters
+ * @return 0 on success, negative on error
+ */
+int hipfw_cache_handle_ha_delete(const struct hip_common *msg)
+{
+    const struct hip_tlv_common           *param = NULL;
+    const struct hip_hadb_user_info_state *ha    = NULL;
+    struct hip_hadb_user_info_state       *entry = NULL;
+
+    pthread_mutex_lock(&firewall_cache_lock);
+    while ((param = hip_get_next_param(msg, param))) {
+        if (hip_get_param_type(param) != HIP_PARAM_HA_INFO) {
+            continue;
+        }
+        ha = hip_get_param_contents_direct(param);
+
+        if ((entry = hip_ht_find(firewall_cache_db, ha))) {
+            entry->state = HIP_STATE_NONE;
+        }
+    }
+    pthread_mutex_unlock(&firewall_cache_lock);
+
+    return 0;
+}
@@ -34,10 +34,10 @@
 
 enum fw_cache_query_type { FW_CACHE_HIT, FW_CACHE_LSI, FW_CACHE_IP };
 
-struct hip_hadb_user_info_state *hipfw_cache_db_match(const void *local,
-                                                      const void *peer,
-                                                      enum fw_cache_query_type type,
-                                                      int query_daemon);
+int hipfw_cache_db_match(const void *local,
+                         const void *peer,
+                         enum fw_cache_query_type type,
+                         struct hip_hadb_user_info_state *entry);
 
 void hipfw_cache_init_hldb(void);
 
@@ -47,4 +47,8 @@ int hipfw_cache_set_bex_state(const struct in6_addr *hit_s,
                               const struct in6_addr *hit_r,
                               enum hip_state state);
 
+int hipfw_cache_handle_ha_update(const struct hip_common *msg);
+
+int hipfw_cache_handle_ha_delete(const struct hip_common *msg);
+
 #endif /* HIPL_HIPFW_CACHE_H */
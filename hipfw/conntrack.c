@@ -38,8 +38,10 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
@@ -53,6 +55,7 @@
 
 #include "libcore/builder.h"
 #include "libcore/debug.h"
+#include "libcore/hashtable.h"
 #include "libcore/hip_udp.h"
 #include "libcore/hostid.h"
 #include "libcore/ife.h"
@@ -74,12 +77,69 @@
 #include "helpers.h"
 #include "hslist.h"
 #include "midauth.h"
+#include "nfacct.h"
 #include "reinject.h"
 
 
+/**
+ * Protects the connection tracking state below. Packets of one connection
+ * may arrive on different netfilter queues (e.g. HIP and ESP packets, or
+ * both directions), so the state cannot be sharded per queue. The lock is
+ * taken by the exported entry points only.
+ */
+static pthread_mutex_t conntrack_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static struct dlist *hip_list  = NULL;
 static struct dlist *esp_list  = NULL;
-static struct slist *conn_list = NULL;
+
+/**
+ * All tracked connections ordered by their timestamp, the least recently
+ * active connection first. Connections move to the tail when they see
+ * activity, so hip_fw_conntrack_periodic_cleanup() only visits connections
+ * that actually time out.
+ *
+ * @see touch_connection()
+ */
+static struct dlist *conn_list      = NULL;
+static struct dlist *conn_list_tail = NULL;
+
+/**
+ * Entry of ::esp_index. It maps an SPI and destination address to the ESP
+ * tuple that comes first in ::esp_list among all ESP tuples with this SPI
+ * and destination address.
+ */
+struct esp_index_entry {
+    uint32_t          spi;
+    struct in6_addr   dst_addr;
+    struct esp_tuple *esp_tuple;
+    /** number of ESP tuples with this SPI and destination address */
+    unsigned int      refs;
+};
+
+/**
+ * Index of the ESP tuples in ::esp_list by SPI and destination address.
+ * Kept in sync whenever an ESP tuple gains a destination address, changes
+ * its SPI or is freed, so that ESP packets are matched in constant time.
+ */
+static HIP_HASHTABLE *esp_index = NULL;
+
+/**
+ * Entry of ::hip_index. It maps a source and destination HIT to the HIP
+ * tuple that comes first in ::hip_list among all HIP tuples with these HITs.
+ */
+struct hip_index_entry {
+    struct in6_addr   src_hit;
+    struct in6_addr   dst_hit;
+    struct hip_tuple *hip_tuple;
+    /** number of HIP tuples with these HITs */
+    unsigned int      refs;
+};
+
+/**
+ * Index of the HIP tuples in ::hip_list by source and destination HIT.
+ * ::hip_list itself is kept to preserve the order of the tuples.
+ */
+static HIP_HASHTABLE *hip_index = NULL;
 
 /**
  * Interval between sweeps in hip_fw_conntrack_periodic_cleanup(),
@@ -108,6 +168,12 @@ time_t connection_timeout = 60 * 5; // 5 minutes
  */
 static unsigned int total_esp_rules_count = 0;
 
+/**
+ * Id of the last iptables rule for ESP speedup (-u option).
+ * @see fw_manage_esp_rule();
+ */
+static uint32_t esp_rule_seq = 0;
+
 /*------------print functions-------------*/
 /**
  * prints out the list of addresses of esp_addr_list
@@ -234,6 +300,136 @@ static struct hip_data *get_hip_data(const struct hip_common *common)
     return data;
 }
 
+/**
+ * Hash the HITs of a ::hip_index entry.
+ *
+ * @param entry the index entry
+ * @return      the hash value
+ */
+static unsigned long hip_index_hash(const struct hip_index_entry *entry)
+{
+    const uint32_t *const src = entry->src_hit.s6_addr32;
+    const uint32_t *const dst = entry->dst_hit.s6_addr32;
+
+    /* HITs end in hash output. The multiplication keeps the two directions
+     * of a connection apart. */
+    return src[2] ^ src[3] ^ ((dst[2] ^ dst[3]) * 0x9E3779B1UL);
+}
+
+/**
+ * Compare the HITs of two ::hip_index entries.
+ *
+ * @param entry1 first index entry
+ * @param entry2 second index entry
+ * @return       0 if the entries have the same key, non-zero otherwise
+ */
+static int hip_index_cmp(const struct hip_index_entry *entry1,
+                         const struct hip_index_entry *entry2)
+{
+    return ipv6_addr_cmp(&entry1->src_hit, &entry2->src_hit) ||
+           ipv6_addr_cmp(&entry1->dst_hit, &entry2->dst_hit);
+}
+
+STATIC_IMPLEMENT_LHASH_HASH_FN(hip_index, struct hip_index_entry)
+STATIC_IMPLEMENT_LHASH_COMP_FN(hip_index, struct hip_index_entry)
+
+/**
+ * Look up a source and destination HIT in ::hip_index.
+ *
+ * @param src_hit the source HIT
+ * @param dst_hit the destination HIT
+ * @return        the index entry or NULL if there is none
+ */
+static struct hip_index_entry *hip_index_find(const struct in6_addr *const src_hit,
+                                              const struct in6_addr *const dst_hit)
+{
+    struct hip_index_entry search;
+
+    if (!hip_index) {
+        return NULL;
+    }
+
+    search.src_hit = *src_hit;
+    search.dst_hit = *dst_hit;
+
+    return hip_ht_find(hip_index, &search);
+}
+
+/**
+ * Add a HIP tuple to ::hip_index.
+ *
+ * @param hip_tuple the HIP tuple
+ * @return          0 on success, -1 on error
+ */
+static int hip_index_add(struct hip_tuple *const hip_tuple)
+{
+    const struct hip_data  *const data  = hip_tuple->data;
+    struct hip_index_entry       *entry = NULL;
+    int                           err   = 0;
+
+    if (!hip_index) {
+        HIP_IFEL(!(hip_index = hip_ht_init(LHASH_HASH_FN(hip_index),
+                                           LHASH_COMP_FN(hip_index))),
+                 -1, "Failed to initialize HIP tuple index\n");
+    }
+
+    // an older HIP tuple with the same HITs keeps precedence
+    if ((entry = hip_index_find(&data->src_hit, &data->dst_hit))) {
+        entry->refs++;
+        return 0;
+    }
+
+    HIP_IFEL(!(entry = malloc(sizeof(*entry))), -1,
+             "Allocating HIP tuple index entry failed\n");
+    entry->src_hit   = data->src_hit;
+    entry->dst_hit   = data->dst_hit;
+    entry->hip_tuple = hip_tuple;
+    entry->refs      = 1;
+    hip_ht_add(hip_index, entry);
+
+out_err:
+    return err;
+}
+
+/**
+ * Remove a HIP tuple from ::hip_index. If another HIP tuple has the same
+ * HITs, the index entry is passed on to it.
+ *
+ * @param hip_tuple the HIP tuple
+ */
+static void hip_index_remove(const struct hip_tuple *const hip_tuple)
+{
+    const struct hip_data *const  data  = hip_tuple->data;
+    struct hip_index_entry *const entry = hip_index_find(&data->src_hit,
+                                                         &data->dst_hit);
+    const struct dlist *list;
+
+    if (!entry) {
+        return;
+    }
+
+    if (--entry->refs == 0) {
+        hip_ht_delete(hip_index, entry);
+        free(entry);
+        return;
+    }
+
+    if (entry->hip_tuple != hip_tuple) {
+        return;
+    }
+
+    for (list = hip_list; list; list = list->next) {
+        struct hip_tuple *const other = list->data;
+
+        if (other != hip_tuple &&
+            IN6_ARE_ADDR_EQUAL(&other->data->src_hit, &data->src_hit) &&
+            IN6_ARE_ADDR_EQUAL(&other->data->dst_hit, &data->dst_hit)) {
+            entry->hip_tuple = other;
+            return;
+        }
+    }
+}
+
 /**
  * Replace the pseudo HITs in opportunistic entries with real HITs (once
  * the real HITs are known from the R1 packet)
@@ -244,25 +440,36 @@ static struct hip_data *get_hip_data(const struct hip_common *common)
 static void update_peer_opp_info(const struct hip_data *data,
                                  const struct in6_addr *ip6_from)
 {
-    struct dlist *list = (struct dlist *) hip_list;
-    hip_hit_t     phit;
+    const struct hip_index_entry *entry;
+    hip_hit_t                     phit;
 
     HIP_DEBUG("updating opportunistic entries\n");
     /* the pseudo hit is compared with the hit in the entries */
     hip_opportunistic_ipv6_to_hit(ip6_from, &phit, HIP_HIT_TYPE_HASH100);
 
-    while (list) {
-        struct hip_tuple *tuple = list->data;
+    if (IN6_ARE_ADDR_EQUAL(&phit, &data->src_hit)) {
+        return;
+    }
 
-        if (IN6_ARE_ADDR_EQUAL(&data->dst_hit, &tuple->data->src_hit) &&
-            IN6_ARE_ADDR_EQUAL(&phit, &tuple->data->dst_hit)) {
-            ipv6_addr_copy(&tuple->data->dst_hit, &data->src_hit);
+    /* re-index every tuple whose HITs change; each removal passes the
+     * index entry on to the next tuple with the pseudo HIT */
+    while ((entry = hip_index_find(&data->dst_hit, &phit))) {
+        struct hip_tuple *const tuple = entry->hip_tuple;
+
+        hip_index_remove(tuple);
+        ipv6_addr_copy(&tuple->data->dst_hit, &data->src_hit);
+        if (hip_index_add(tuple)) {
+            HIP_ERROR("Failed to re-index opportunistic HIP tuple\n");
         }
-        if (IN6_ARE_ADDR_EQUAL(&phit, &tuple->data->src_hit) &&
-            IN6_ARE_ADDR_EQUAL(&data->dst_hit, &tuple->data->dst_hit)) {
-            ipv6_addr_copy(&tuple->data->src_hit, &data->src_hit);
+    }
+    while ((entry = hip_index_find(&phit, &data->dst_hit))) {
+        struct hip_tuple *const tuple = entry->hip_tuple;
+
+        hip_index_remove(tuple);
+        ipv6_addr_copy(&tuple->data->src_hit, &data->src_hit);
+        if (hip_index_add(tuple)) {
+            HIP_ERROR("Failed to re-index opportunistic HIP tuple\n");
         }
-        list = list->next;
     }
 }
 
@@ -329,16 +536,200 @@ static struct esp_address *get_esp_address(const struct hip_ll *const addresses,
     return NULL;
 }
 
+/**
+ * Hash the SPI and destination address of an ::esp_index entry.
+ *
+ * @param entry the index entry
+ * @return      the hash value
+ */
+static unsigned long esp_index_hash(const struct esp_index_entry *entry)
+{
+    const uint32_t *const addr = entry->dst_addr.s6_addr32;
+
+    // SPIs are chosen randomly, so mixing in the address words suffices
+    return entry->spi ^ addr[0] ^ addr[1] ^ addr[2] ^ addr[3];
+}
+
+/**
+ * Compare the SPIs and destination addresses of two ::esp_index entries.
+ *
+ * @param entry1 first index entry
+ * @param entry2 second index entry
+ * @return       0 if the entries have the same key, non-zero otherwise
+ */
+static int esp_index_cmp(const struct esp_index_entry *entry1,
+                         const struct esp_index_entry *entry2)
+{
+    if (entry1->spi != entry2->spi) {
+        return 1;
+    }
+    return ipv6_addr_cmp(&entry1->dst_addr, &entry2->dst_addr);
+}
+
+STATIC_IMPLEMENT_LHASH_HASH_FN(esp_index, struct esp_index_entry)
+STATIC_IMPLEMENT_LHASH_COMP_FN(esp_index, struct esp_index_entry)
+
+/**
+ * Look up an SPI and destination address in ::esp_index.
+ *
+ * @param spi      the SPI
+ * @param dst_addr the destination address
+ * @return         the index entry or NULL if there is none
+ */
+static struct esp_index_entry *esp_index_find(const uint32_t spi,
+                                              const struct in6_addr *const dst_addr)
+{
+    struct esp_index_entry search;
+
+    if (!esp_index) {
+        return NULL;
+    }
+
+    search.spi      = spi;
+    search.dst_addr = *dst_addr;
+
+    return hip_ht_find(esp_index, &search);
+}
+
+/**
+ * Add the SPI of an ESP tuple and one of its destination addresses to
+ * ::esp_index.
+ *
+ * @param esp_tuple the ESP tuple
+ * @param dst_addr  the destination address
+ * @return          0 on success, -1 on error
+ */
+static int esp_index_add(struct esp_tuple *const esp_tuple,
+                         const struct in6_addr *const dst_addr)
+{
+    struct esp_index_entry *entry = NULL;
+    int                     err   = 0;
+
+    if (!esp_index) {
+        HIP_IFEL(!(esp_index = hip_ht_init(LHASH_HASH_FN(esp_index),
+                                           LHASH_COMP_FN(esp_index))),
+                 -1, "Failed to initialize ESP index\n");
+    }
+
+    // an older ESP tuple with the same key keeps precedence
+    if ((entry = esp_index_find(esp_tuple->spi, dst_addr))) {
+        entry->refs++;
+        return 0;
+    }
+
+    HIP_IFEL(!(entry = malloc(sizeof(*entry))), -1,
+             "Allocating ESP index entry failed\n");
+    entry->spi       = esp_tuple->spi;
+    entry->dst_addr  = *dst_addr;
+    entry->esp_tuple = esp_tuple;
+    entry->refs      = 1;
+    hip_ht_add(esp_index, entry);
+
+out_err:
+    return err;
+}
+
+/**
+ * Remove the SPI of an ESP tuple and one of its destination addresses from
+ * ::esp_index. If another ESP tuple has the same key, the index entry is
+ * passed on to it.
+ *
+ * @param esp_tuple the ESP tuple
+ * @param dst_addr  the destination address
+ */
+static void esp_index_remove(const struct esp_tuple *const esp_tuple,
+                             const struct in6_addr *const dst_addr)
+{
+    struct esp_index_entry *const entry = esp_index_find(esp_tuple->spi,
+                                                         dst_addr);
+    const struct dlist *list;
+
+    if (!entry) {
+        return;
+    }
+
+    if (--entry->refs == 0) {
+        hip_ht_delete(esp_index, entry);
+        free(entry);
+        return;
+    }
+
+    if (entry->esp_tuple != esp_tuple) {
+        return;
+    }
+
+    for (list = esp_list; list; list = list->next) {
+        struct esp_tuple *const other = list->data;
+
+        if (other != esp_tuple && other->spi == esp_tuple->spi &&
+            get_esp_address(&other->dst_addresses, dst_addr)) {
+            entry->esp_tuple = other;
+            return;
+        }
+    }
+}
+
+/**
+ * Determine the chain of the iptables rules bypassing userspace processing
+ * of @a esp_tuple.
+ *
+ * @param esp_tuple the ESP tuple
+ * @return          the chain, or NULL if the packets of @a esp_tuple must
+ *                  be processed in userspace
+ */
+static const char *esp_rule_chain(const struct esp_tuple *const esp_tuple)
+{
+    if (!esp_speedup || hip_userspace_ipsec) {
+        return NULL;
+    }
+
+    // ESP transforms need packet inspection, ESP relay packet rewriting
+    if (esp_tuple->esp_prot_tfm > ESP_PROT_TFM_UNUSED ||
+        esp_tuple->tuple->esp_relay) {
+        return NULL;
+    }
+
+    switch (esp_tuple->tuple->hook) {
+    case NF_IP_LOCAL_IN:
+        return "HIPFW-INPUT";
+    case NF_IP_FORWARD:
+        return "HIPFW-FORWARD";
+    case NF_IP_LOCAL_OUT:
+        return "HIPFW-OUTPUT";
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * Build the name of the accounting object counting the packets matched by
+ * an iptables rule for ESP speedup.
+ *
+ * @param rule_id the id of the rule, unique among all installed rules
+ * @param name    receives the name
+ */
+static void esp_rule_counter_name(const uint32_t rule_id,
+                                  char name[NFACCT_NAME_MAX])
+{
+    snprintf(name, NFACCT_NAME_MAX, HIPFW_NFACCT_PREFIX "%08X", rule_id);
+}
+
 /**
  * Set up or remove iptables rules to bypass userspace processing of the
  * SPI/destination pairs as specified by @a esp_tuple and @a dest.
  * This can greatly improve firewall throughput.
  *
+ * Each rule gets an id of its own. If kernel packet accounting is
+ * available, the rule counts its packets in an accounting object named
+ * after this id, so that detect_esp_rule_activity() can tell which
+ * connections are still active.
+ *
  * @param esp_tuple Determines the SPI.
- * @param dest      The corresponding destination address to bypass. May be
+ * @param esp_addr  The corresponding destination address to bypass. May be
  *                  a IPv6-mapped IPv4 address.
  * @param insert    Insert new rule if true, remove existing if false.
- * @return          0 if rules were modified, -1 otherwise.
+ * @return          0 if rules were modified or the rule to be inserted
+ *                  already exists, -1 otherwise.
  *
  * @note This feature may be turned off completely by the -u command line option.
  *       It is also automatically deactivated for connections that demand
@@ -355,46 +746,39 @@ static struct esp_address *get_esp_address(const struct hip_ll *const addresses,
  * @see ::esp_speedup
  */
 static int fw_manage_esp_rule(const struct esp_tuple *const esp_tuple,
-                              const struct in6_addr *const dest,
+                              struct esp_address *const esp_addr,
                               const bool insert)
 {
-    int         err   = 0;
-    const char *flag  = insert ? "-I" : "-D";
-    const char *table = NULL;
-
-    if (!esp_speedup || hip_userspace_ipsec) {
-        return -1;
-    }
+    int                          err     = 0;
+    const char                  *flag    = insert ? "-I" : "-D";
+    const char                  *table   = NULL;
+    const struct in6_addr *const dest    = &esp_addr->dst_addr;
+    uint32_t                     rule_id = esp_addr->rule_id;
+    char                         counter[NFACCT_NAME_MAX]    = "";
+    char                         match[NFACCT_NAME_MAX + 32] = "";
 
     HIP_ASSERT(esp_tuple);
-    HIP_ASSERT(dest);
 
-    if (esp_tuple->esp_prot_tfm > ESP_PROT_TFM_UNUSED) {
-        HIP_DEBUG("ESP Transforms requested; not handled via iptables "
-                  "since we need to inspect packets\n");
+    if (!(table = esp_rule_chain(esp_tuple))) {
+        HIP_DEBUG("ESP speedup disabled for this tuple; packets are "
+                  "processed in userspace\n");
         return -1;
     }
 
-    if (esp_tuple->tuple->esp_relay) {
-        HIP_DEBUG("ESP Relay requested; not handled via iptables "
-                  "since we need packet rewriting\n");
+    if (insert && rule_id) {
+        HIP_DEBUG("ESP rule %u already set up\n", rule_id);
+        return 0;
+    } else if (!insert && !rule_id) {
+        HIP_DEBUG("No ESP rule set up for this address\n");
         return -1;
     }
 
-    switch (esp_tuple->tuple->hook) {
-    case NF_IP_LOCAL_IN:
-        table = "HIPFW-INPUT";
-        break;
-    case NF_IP_FORWARD:
-        table = "HIPFW-FORWARD";
-        break;
-    case NF_IP_LOCAL_OUT:
-        table = "HIPFW-OUTPUT";
-        break;
-    default:
-        HIP_ERROR("Packet was received via unsupported netfilter hook %d\n",
-                  esp_tuple->tuple->hook);
-        return -1;
+    if (insert) {
+        // 0 marks addresses without a rule
+        if (++esp_rule_seq == 0) {
+            ++esp_rule_seq;
+        }
+        rule_id = esp_rule_seq;
     }
 
     HIP_DEBUG("insert         = %d\n", insert);
@@ -402,6 +786,19 @@ static int fw_manage_esp_rule(const struct esp_tuple *const esp_tuple,
     HIP_DEBUG("esp_tuple->spi = 0x%08X\n", esp_tuple->spi);
     HIP_DEBUG_IN6ADDR("dest ip", dest);
 
+    if (hipfw_nfacct_available()) {
+        char name[NFACCT_NAME_MAX];
+
+        esp_rule_counter_name(rule_id, name);
+        if (insert) {
+            HIP_IFEL((err = hipfw_nfacct_add(name)), -1,
+                     "Creating accounting object %s failed: %s\n",
+                     name, strerror(-err));
+        }
+        strcpy(counter, name);
+        snprintf(match, sizeof(match), " -m nfacct --nfacct-name %s", counter);
+    }
+
     if (IN6_IS_ADDR_V4MAPPED(dest)) {
         char           daddr[INET_ADDRSTRLEN];
         struct in_addr dest4;
@@ -417,12 +814,12 @@ static int fw_manage_esp_rule(const struct esp_tuple *const esp_tuple,
              */
             err = system_printf("iptables %s %s -p UDP "
                                 "--dport 10500 --sport 10500 -d %s -m u32 "
-                                "--u32 '4&0x1FFF=0 && 0>>22&0x3C@8=0x%08X' -j ACCEPT",
-                                flag, table, daddr, esp_tuple->spi);
+                                "--u32 '4&0x1FFF=0 && 0>>22&0x3C@8=0x%08X'%s -j ACCEPT",
+                                flag, table, daddr, esp_tuple->spi, match);
         } else {
             err = system_printf("iptables %s %s -p 50 "
-                                "-d %s -m esp --espspi 0x%08X -j ACCEPT",
-                                flag, table, daddr, esp_tuple->spi);
+                                "-d %s -m esp --espspi 0x%08X%s -j ACCEPT",
+                                flag, table, daddr, esp_tuple->spi, match);
         }
     } else {
         char daddr[INET6_ADDRSTRLEN];
@@ -431,16 +828,21 @@ static int fw_manage_esp_rule(const struct esp_tuple *const esp_tuple,
 
         HIP_ASSERT(!esp_tuple->tuple->connection->udp_encap);
         err = system_printf("ip6tables %s %s -p 50 "
-                            "-d %s -m esp --espspi 0x%08X -j ACCEPT",
-                            flag, table, daddr, esp_tuple->spi);
+                            "-d %s -m esp --espspi 0x%08X%s -j ACCEPT",
+                            flag, table, daddr, esp_tuple->spi, match);
     }
 
     if (err == EXIT_SUCCESS) {
         total_esp_rules_count += (insert ? 1 : -1);
+        esp_addr->rule_id      = insert ? rule_id : 0;
         HIP_DEBUG("total_esp_rules_count = %d\n", total_esp_rules_count);
     }
 
 out_err:
+    // the kernel keeps accounting objects that are still referenced
+    if (counter[0] && (!insert || err != EXIT_SUCCESS)) {
+        hipfw_nfacct_del(counter);
+    }
     return err == EXIT_SUCCESS ? 0 : -1;
 }
 
@@ -463,6 +865,42 @@ static void fw_manage_esp_tuple(const struct esp_tuple *const esp_tuple,
     }
 }
 
+/**
+ * Change the SPI of an ESP tuple, re-index its destination addresses and
+ * replace the iptables rules for the old SPI.
+ *
+ * @param esp_tuple the ESP tuple
+ * @param spi       the new SPI
+ */
+static void set_esp_tuple_spi(struct esp_tuple *const esp_tuple,
+                              const uint32_t spi)
+{
+    const struct hip_ll_node *node;
+
+    if (esp_tuple->spi == spi) {
+        return;
+    }
+
+    // the iptables rules match the SPI
+    fw_manage_esp_tuple(esp_tuple, false);
+
+    for (node = esp_tuple->dst_addresses.head; node; node = node->next) {
+        const struct esp_address *const esp_addr = node->ptr;
+        esp_index_remove(esp_tuple, &esp_addr->dst_addr);
+    }
+
+    esp_tuple->spi = spi;
+
+    for (node = esp_tuple->dst_addresses.head; node; node = node->next) {
+        const struct esp_address *const esp_addr = node->ptr;
+        if (esp_index_add(esp_tuple, &esp_addr->dst_addr)) {
+            HIP_ERROR("Failed to index ESP tuple with SPI 0x%08X\n", spi);
+        }
+    }
+
+    fw_manage_esp_tuple(esp_tuple, true);
+}
+
 /**
  * Set up or remove iptables rules to bypass userspace processing of all
  * ESP SPI/destination pairs associated with @a tuple.
@@ -514,6 +952,7 @@ static int update_esp_address(struct esp_tuple *const esp_tuple,
         remove_esp_addr     = true;
         esp_addr->dst_addr  = *addr;
         esp_addr->update_id = NULL; // gets set below
+        esp_addr->rule_id   = 0;
         HIP_IFEL(hip_ll_add_first(addresses, esp_addr) != 0, -1,
                  "Inserting ESP address object into list of destination addresses failed");
     }
@@ -527,7 +966,12 @@ static int update_esp_address(struct esp_tuple *const esp_tuple,
         *esp_addr->update_id = *upd_id;
     }
 
-    fw_manage_esp_rule(esp_tuple, addr, true);
+    if (remove_esp_addr) {
+        HIP_IFEL(esp_index_add(esp_tuple, addr), -1,
+                 "Indexing ESP destination address failed\n");
+    }
+
+    fw_manage_esp_rule(esp_tuple, esp_addr, true);
     return err;
 
 out_err:
@@ -547,23 +991,29 @@ out_err:
  * @param dst_addr the optional destination address to be searched for
  * @param spi the SPI number to be searched for
  * @return a tuple matching to the address and SPI or NULL if not found
+ *
+ * @note Lookups with destination address use ::esp_index, lookups by SPI
+ *       only walk ::esp_list.
  */
 static struct tuple *get_tuple_by_esp(const struct in6_addr *dst_addr, const uint32_t spi)
 {
     struct slist *list = (struct slist *) esp_list;
 
-    if (!list) {
+    if (dst_addr) {
+        const struct esp_index_entry *const entry = esp_index_find(spi, dst_addr);
+
+        if (entry) {
+            HIP_DEBUG("connection found by esp\n");
+            return entry->esp_tuple->tuple;
+        }
+        list = NULL;
+    } else if (!list) {
         HIP_DEBUG("Esp tuple list is empty\n");
     }
     while (list) {
         struct esp_tuple *tuple = list->data;
         if (spi == tuple->spi) {
-            if (dst_addr && get_esp_address(&tuple->dst_addresses, dst_addr) != NULL) {
-                HIP_DEBUG("connection found by esp\n");
-                return tuple->tuple;
-            } else if (!dst_addr) {
-                return tuple->tuple;
-            }
+            return tuple->tuple;
         }
         list = list->next;
     }
@@ -601,6 +1051,63 @@ struct esp_tuple *find_esp_tuple(const struct slist *search_list,
     return NULL;
 }
 
+/**
+ * Insert a connection link into ::conn_list according to the timestamp of
+ * its connection. Timestamps usually increase, so the position is found at
+ * the tail right away.
+ *
+ * @param link the link of the connection
+ */
+static void conn_list_link(struct dlist *const link)
+{
+    const struct connection *const conn = link->data;
+    struct dlist                  *pos  = conn_list_tail;
+
+    while (pos && ((const struct connection *) pos->data)->timestamp > conn->timestamp) {
+        pos = pos->prev;
+    }
+
+    // insert after pos
+    link->prev = pos;
+    link->next = pos ? pos->next : conn_list;
+    if (link->next) {
+        link->next->prev = link;
+    } else {
+        conn_list_tail = link;
+    }
+    if (pos) {
+        pos->next = link;
+    } else {
+        conn_list = link;
+    }
+}
+
+/**
+ * Remove a connection link from ::conn_list.
+ *
+ * @param link the link of the connection
+ */
+static void conn_list_unlink(struct dlist *const link)
+{
+    if (link == conn_list_tail) {
+        conn_list_tail = link->prev;
+    }
+    conn_list = remove_link_dlist(conn_list, link);
+}
+
+/**
+ * Record activity on a connection.
+ *
+ * @param conn the connection
+ * @param now  the time of the activity
+ */
+static void touch_connection(struct connection *const conn, const time_t now)
+{
+    conn->timestamp = now;
+    conn_list_unlink(conn->conn_link);
+    conn_list_link(conn->conn_link);
+}
+
 /**
  * Initialize and store a new HIP/ESP connnection into the connection
  * table.
@@ -619,6 +1126,9 @@ static int insert_new_connection(const struct hip_data *const data,
 
     struct connection *const connection = calloc(1, sizeof(struct connection));
     HIP_IFEL(!connection, -1, "Allocating connection object failed");
+    HIP_IFEL(!(connection->conn_link = calloc(1, sizeof(*connection->conn_link))),
+             -1, "Allocating connection list link failed");
+    connection->conn_link->data = connection;
 
     connection->state     = HIP_STATE_UNASSOCIATED;
     connection->udp_encap = ctx->udp_encap_hdr ? true : false;
@@ -658,10 +1168,17 @@ static int insert_new_connection(const struct hip_data *const data,
     connection->reply.hip_tuple->data->src_pub_key  = NULL;
     connection->reply.hip_tuple->data->verify       = NULL;
 
+    HIP_IFEL(hip_index_add(connection->original.hip_tuple), -1,
+             "Indexing HIP tuple failed\n");
+    if (hip_index_add(connection->reply.hip_tuple)) {
+        hip_index_remove(connection->original.hip_tuple);
+        HIP_OUT_ERR(-1, "Indexing HIP tuple failed\n");
+    }
+
     //add tuples to list
-    hip_list  = append_to_list(hip_list, connection->original.hip_tuple);
-    hip_list  = append_to_list(hip_list, connection->reply.hip_tuple);
-    conn_list = append_to_slist(conn_list, connection);
+    hip_list = append_to_list(hip_list, connection->original.hip_tuple);
+    hip_list = append_to_list(hip_list, connection->reply.hip_tuple);
+    conn_list_link(connection->conn_link);
 
     return err;
 
@@ -675,6 +1192,7 @@ out_err:
             free(connection->reply.hip_tuple->data);
             free(connection->reply.hip_tuple);
         }
+        free(connection->conn_link);
         free(connection);
     }
     return err;
@@ -732,7 +1250,8 @@ static void free_esp_tuple(struct esp_tuple *esp_tuple)
 
         // remove all associated addresses
         while ((addr = hip_ll_del_first(&esp_tuple->dst_addresses, NULL))) {
-            fw_manage_esp_rule(esp_tuple, &addr->dst_addr, false);
+            esp_index_remove(esp_tuple, &addr->dst_addr);
+            fw_manage_esp_rule(esp_tuple, addr, false);
             free(addr->update_id);
             free(addr);
         }
@@ -776,7 +1295,8 @@ static void remove_tuple(struct tuple *const tuple)
     if (tuple) {
         struct dlist *tuple_link;
 
-        // remove hip_tuple from helper list
+        // remove hip_tuple from index and helper list
+        hip_index_remove(tuple->hip_tuple);
         tuple_link = find_in_dlist(hip_list, tuple->hip_tuple);
         hip_list   = remove_link_dlist(hip_list, tuple_link);
         // now free hip_tuple list element, the hip_tuple itself and its members
@@ -797,8 +1317,6 @@ static void remove_tuple(struct tuple *const tuple)
  */
 static void remove_connection(struct connection *connection)
 {
-    struct slist *conn_link;
-
     HIP_DEBUG("tuple list before: \n");
     print_tuple_list();
 
@@ -806,9 +1324,8 @@ static void remove_connection(struct connection *connection)
     print_esp_list();
 
     if (connection) {
-        HIP_ASSERT(conn_link = find_in_slist(conn_list, connection));
-        conn_list = remove_link_slist(conn_list, conn_link);
-        free(conn_link);
+        conn_list_unlink(connection->conn_link);
+        free(connection->conn_link);
 
         remove_tuple(&connection->original);
         remove_tuple(&connection->reply);
@@ -1367,7 +1884,7 @@ static int update_esp_tuple(const struct hip_esp_info *esp_info,
             return 0;
         }
 
-        esp_tuple->spi           = ntohl(esp_info->new_spi);
+        set_esp_tuple_spi(esp_tuple, ntohl(esp_info->new_spi));
         esp_tuple->spi_update_id = seq->update_id;
 
         if (hip_get_param_total_len(locator) - sizeof(struct hip_locator) < sizeof(struct hip_locator_type_0)) {
@@ -1386,7 +1903,7 @@ static int update_esp_tuple(const struct hip_esp_info *esp_info,
             return 0;
         }
 
-        esp_tuple->spi           = ntohl(esp_info->new_spi);
+        set_esp_tuple_spi(esp_tuple, ntohl(esp_info->new_spi));
         esp_tuple->spi_update_id = seq->update_id;
     } else if (locator && seq) {
         HIP_DEBUG("locator and seq\n");
@@ -1780,7 +2297,7 @@ static int check_packet(struct hip_common *common,
         // update time_stamp only on valid packets
         // for new connections time_stamp is set when creating
         if (tuple->connection) {
-            tuple->connection->timestamp = time(NULL);
+            touch_connection(tuple->connection, time(NULL));
         } else {
             HIP_DEBUG("Tuple connection NULL, could not timestamp\n");
         }
@@ -1818,13 +2335,14 @@ int hipfw_relay_esp(const struct hip_fw_context *ctx)
     struct iphdr   *iph   = (struct iphdr *) ctx->ipq_packet->payload;
     struct udphdr  *udph  = (struct udphdr *) ((uint8_t *) iph + iph->ihl * 4);
     int             len   = ctx->ipq_packet->data_len - iph->ihl * 4;
-    struct slist   *list  = (struct slist *) esp_list;
     struct tuple   *tuple = NULL;
     struct hip_esp *esp   = ctx->transport_hdr.esp;
     int             err   = 0;
     uint32_t        spi;
 
-    HIP_IFEL(!list, -1, "ESP List is empty\n");
+    pthread_mutex_lock(&conntrack_lock);
+
+    HIP_IFEL(!esp_list, -1, "ESP List is empty\n");
     HIP_IFEL(iph->protocol != IPPROTO_UDP, -1,
              "Protocol is not UDP. Not relaying packet.\n\n");
     HIP_IFEL(!esp, -1, "No ESP header\n");
@@ -1871,6 +2389,7 @@ int hipfw_relay_esp(const struct hip_fw_context *ctx)
                                   iph->protocol);
 
 out_err:
+    pthread_mutex_unlock(&conntrack_lock);
 
     return -err;
 }
@@ -1899,6 +2418,8 @@ int filter_esp_state(const struct hip_fw_context *ctx)
     // needed to de-multiplex ESP traffic
     spi = ntohl(esp->esp_spi);
 
+    pthread_mutex_lock(&conntrack_lock);
+
     // match packet against known connections
     HIP_DEBUG("filtering ESP packet against known connections...\n");
 
@@ -1932,39 +2453,38 @@ int filter_esp_state(const struct hip_fw_context *ctx)
 out_err:
     // if we are going to accept the packet, update time stamp of the connection
     if (err > 0) {
-        tuple->connection->timestamp = time(NULL);
+        touch_connection(tuple->connection, time(NULL));
     }
 
+    pthread_mutex_unlock(&conntrack_lock);
+
     HIP_DEBUG("verdict %d \n", err);
 
     return err;
 }
 
 /**
- * Filter connection tracking state (in general)
+ * Match a control packet against a state option of a rule. Called with the
+ * connection tracking lock held.
  *
  * @param buf           the control packet
+ * @param data          the HIP data extracted from @a buf
  * @param option        special state options to be checked
  * @param must_accept   force accepting of the packet if set to one
  * @param ctx context   for the control packet
  * @return              verdict for the packet (zero means drop, one means pass,
  *                      negative error)
  */
-int filter_state(struct hip_common *buf, const struct state_option *option,
-                 const int must_accept, struct hip_fw_context *ctx)
+static int filter_state_option(struct hip_common *buf,
+                               const struct hip_data *data,
+                               const struct state_option *option,
+                               const int must_accept,
+                               struct hip_fw_context *ctx)
 {
-    struct hip_data *data  = NULL;
-    struct tuple    *tuple = NULL;
+    struct tuple *tuple = NULL;
 
-    // get data form the buffer and put it in a new data structure
-    data = get_hip_data(buf);
-    if (data == NULL) {
-        HIP_ERROR("Failed to get hip_data object.\n");
-        return -1;
-    }
     // look up the tuple in the database
     tuple = get_tuple_by_hip(data, buf->type_hdr, &ctx->src);
-    free(data);
 
     // cases where packet does not match
     if (!tuple) {
@@ -2005,6 +2525,38 @@ int filter_state(struct hip_common *buf, const struct state_option *option,
     return check_packet(buf, tuple, ctx);
 }
 
+/**
+ * Filter connection tracking state (in general)
+ *
+ * @param buf           the control packet
+ * @param option        special state options to be checked
+ * @param must_accept   force accepting of the packet if set to one
+ * @param ctx context   for the control packet
+ * @return              verdict for the packet (zero means drop, one means pass,
+ *                      negative error)
+ */
+int filter_state(struct hip_common *buf, const struct state_option *option,
+                 const int must_accept, struct hip_fw_context *ctx)
+{
+    struct hip_data *data = NULL;
+    int              verdict;
+
+    // get data form the buffer and put it in a new data structure
+    data = get_hip_data(buf);
+    if (data == NULL) {
+        HIP_ERROR("Failed to get hip_data object.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&conntrack_lock);
+    verdict = filter_state_option(buf, data, option, must_accept, ctx);
+    pthread_mutex_unlock(&conntrack_lock);
+
+    free(data);
+
+    return verdict;
+}
+
 /**
  * Packet is accepted by filtering rules but has not been
  * filtered through any state rules. Find the the tuples for the packet
@@ -2028,6 +2580,8 @@ int conntrack(struct hip_common *buf, struct hip_fw_context *ctx)
         HIP_ERROR("Failed to get hip_data object.\n");
         return 0;
     }
+    pthread_mutex_lock(&conntrack_lock);
+
     // look up tuple in the db
     tuple = get_tuple_by_hip(data, buf->type_hdr, &ctx->src);
 
@@ -2035,6 +2589,8 @@ int conntrack(struct hip_common *buf, struct hip_fw_context *ctx)
     // are not filtered here
     verdict = check_packet(buf, tuple, ctx);
 
+    pthread_mutex_unlock(&conntrack_lock);
+
     free(data);
 
     return verdict;
@@ -2050,17 +2606,11 @@ int conntrack(struct hip_common *buf, struct hip_fw_context *ctx)
  */
 struct tuple *get_tuple_by_hits(const struct in6_addr *src_hit, const struct in6_addr *dst_hit)
 {
-    struct dlist *list = hip_list;
+    const struct hip_index_entry *const entry = hip_index_find(src_hit, dst_hit);
 
-    while (list) {
-        struct hip_tuple *tuple = list->data;
-        if (IN6_ARE_ADDR_EQUAL(src_hit, &tuple->data->src_hit) &&
-            IN6_ARE_ADDR_EQUAL(dst_hit, &tuple->data->dst_hit)) {
-            HIP_DEBUG("connection found, \n");
-            //print_data(data);
-            return tuple->tuple;
-        }
-        list = list->next;
+    if (entry) {
+        HIP_DEBUG("connection found, \n");
+        return entry->hip_tuple->tuple;
     }
     HIP_DEBUG("get_tuple_by_hits: no connection found\n");
     return NULL;
@@ -2161,31 +2711,24 @@ static bool parse_iptables_esp_rule(const char *const input,
 
 /**
  * Update timestamps of all ESP tuples where corresponding iptables rules'
- * packet counters are non-zero.
- * Currently, this works by parsing the output of iptables and ip6tables
- * to extract and zero the packet counters.
+ * packet counters are non-zero, by parsing the output of iptables and
+ * ip6tables to extract and zero the packet counters.
+ * This is the fallback if kernel packet accounting is not available.
  *
  * @param now We consider this the current time.
  * @return    Number of rules that were identified with an esp tuple
  *            (not necessarily the number of tuples updated), or -1 if
- *            communication with iptables failed.
- *
- * @note Ugly approach, yes. You may be tempted to statically link in
- *       libiptc, and I'd generally approve of it because while it was never
- *       meant to be used publicly, quite some projects have relied on it
- *       without burning their fingers too badly for a long time now.  On the
- *       other hand, libiptc would blow up iptables communication code at most
- *       other places, and the output format is unlikely to change.
- *       Furthermore, a successor to iptables (namely: nftables) with an actual
- *       API is under consideration by the netfilter team.
+ *            communication with iptables failed for any chain. The
+ *            remaining chains are read nevertheless.
  */
-static int detect_esp_rule_activity(const time_t now)
+static int detect_esp_rule_activity_iptables(const time_t now)
 {
     static const char *const bins[]   = { "iptables", "ip6tables" };
     static const char *const chains[] = { "HIPFW-INPUT", "HIPFW-OUTPUT",
                                           "HIPFW-FORWARD" };
 
     unsigned int chain, bin, ret = 0;
+    bool         failed = false;
 
     for (bin = 0; bin < ARRAY_SIZE(bins); ++bin) {
         for (chain = 0; chain < ARRAY_SIZE(chains); ++chain) {
@@ -2195,7 +2738,8 @@ static int detect_esp_rule_activity(const time_t now)
             snprintf(bfr, sizeof(bfr), "%s -nvL -Z %s", bins[bin], chains[chain]);
             if (!(p = popen(bfr, "r"))) {
                 HIP_ERROR("popen(\"%s\"): %s\n", bfr, strerror(errno));
-                return -1;
+                failed = true;
+                continue;
             }
 
             while (fgets(bfr, sizeof(bfr), p)) {
@@ -2212,7 +2756,7 @@ static int detect_esp_rule_activity(const time_t now)
                             continue;
                         }
 
-                        tuple->connection->timestamp = now;
+                        touch_connection(tuple->connection, now);
                         HIP_DEBUG("Activity detected: SPI = %u\n", spi);
                         HIP_DEBUG_IN6ADDR("dest: ", &dest);
                     }
@@ -2222,15 +2766,141 @@ static int detect_esp_rule_activity(const time_t now)
             if (!feof(p)) {
                 HIP_ERROR("fgets(), bin: %s, chain %s: %s\n",
                           bins[bin], chains[chain], strerror(errno));
-                return -1;
+                failed = true;
             }
 
             pclose(p);
         }
     }
 
-    HIP_DEBUG("-> %u\n", ret);
-    return ret;
+    return failed ? -1 : (int) ret;
+}
+
+/**
+ * Packet counters of the iptables rules for ESP speedup, read from the
+ * accounting objects set up by fw_manage_esp_rule().
+ */
+struct esp_rule_counters {
+    struct hipfw_nfacct_counter *counters; /* sorted by name */
+    int                          count;    /* negative errno if reading failed */
+    uint32_t                     rule_seq; /* ::esp_rule_seq when read */
+};
+
+/**
+ * Compare two accounting object counters by name.
+ *
+ * @param a the first struct hipfw_nfacct_counter
+ * @param b the second struct hipfw_nfacct_counter
+ * @return  less than, equal to or greater than zero like strcmp()
+ */
+static int compare_counter_names(const void *const a, const void *const b)
+{
+    return strcmp(((const struct hipfw_nfacct_counter *) a)->name,
+                  ((const struct hipfw_nfacct_counter *) b)->name);
+}
+
+/**
+ * Read and reset the packet counters of all ESP rules with a single request
+ * to the kernel. ::conntrack_lock is not held while waiting for the kernel,
+ * so that packet processing continues in the meantime.
+ *
+ * @param counters receives the counters. counters->counters must be freed
+ *                 by the caller.
+ */
+static void read_esp_rule_counters(struct esp_rule_counters *const counters)
+{
+    // rules set up later have no counter in the result
+    pthread_mutex_lock(&conntrack_lock);
+    counters->rule_seq = esp_rule_seq;
+    pthread_mutex_unlock(&conntrack_lock);
+
+    counters->count = hipfw_nfacct_read_zero_all(&counters->counters);
+    if (counters->count < 0) {
+        HIP_ERROR("Reading accounting objects failed: %s\n",
+                  strerror(-counters->count));
+    } else if (counters->count > 0) {
+        qsort(counters->counters, counters->count,
+              sizeof(*counters->counters), compare_counter_names);
+    }
+}
+
+/**
+ * Update timestamps of all ESP tuples where corresponding iptables rules'
+ * packet counters are non-zero.
+ * The counters are matched to the rules by the names of their accounting
+ * objects. If kernel packet accounting is not available, the counters are
+ * read from the iptables output instead.
+ *
+ * @param now      We consider this the current time.
+ * @param counters The counters read by read_esp_rule_counters(), or NULL
+ *                 to read them from the iptables output.
+ * @return         Number of rules that were identified with an esp tuple
+ *                 (not necessarily the number of tuples updated), or -1 if
+ *                 any counter could not be read. The other counters are
+ *                 evaluated nevertheless.
+ */
+static int detect_esp_rule_activity(const time_t now,
+                                    const struct esp_rule_counters *const counters)
+{
+    const struct dlist       *iter;
+    const struct hip_ll_node *node;
+    int                       ret    = 0;
+    bool                      failed = false;
+
+    if (!counters) {
+        ret = detect_esp_rule_activity_iptables(now);
+        HIP_DEBUG("-> %d\n", ret);
+        return ret;
+    }
+
+    if (counters->count < 0) {
+        return -1;
+    }
+
+    for (iter = esp_list; iter; iter = iter->next) {
+        const struct esp_tuple *const esp_tuple = iter->data;
+
+        if (!esp_rule_chain(esp_tuple)) {
+            continue;
+        }
+
+        for (node = esp_tuple->dst_addresses.head; node; node = node->next) {
+            const struct esp_address *const    esp_addr = node->ptr;
+            const struct hipfw_nfacct_counter *counter;
+            struct hipfw_nfacct_counter        key;
+
+            if (!esp_addr->rule_id) {
+                // no rule was set up for this address
+                continue;
+            }
+
+            if ((int32_t) (esp_addr->rule_id - counters->rule_seq) > 0) {
+                // set up after the counters were read
+                ret += 1;
+                continue;
+            }
+
+            esp_rule_counter_name(esp_addr->rule_id, key.name);
+            if (!counters->count ||
+                !(counter = bsearch(&key, counters->counters, counters->count,
+                                    sizeof(*counters->counters),
+                                    compare_counter_names))) {
+                HIP_ERROR("Accounting object %s not found\n", key.name);
+                failed = true;
+                continue;
+            }
+
+            ret += 1;
+            if (counter->packets > 0) {
+                touch_connection(esp_tuple->tuple->connection, now);
+                HIP_DEBUG("Activity detected: SPI = %u\n", esp_tuple->spi);
+                HIP_DEBUG_IN6ADDR("dest: ", &esp_addr->dst_addr);
+            }
+        }
+    }
+
+    HIP_DEBUG("-> %d\n", ret);
+    return failed ? -1 : ret;
 }
 
 /**
@@ -2239,14 +2909,17 @@ static int detect_esp_rule_activity(const time_t now)
  * The actual tasks will be run at most once per ::connection_timeout
  * seconds, no matter how often you call the function.
  *
- * @note Don't call this from a thread or timer, since most of hipfw is not
- *       reentrant (and so this function isn't either).
+ * @note Don't call this from a signal handler or timer, since most of hipfw
+ *       is not reentrant (and so this function isn't either).
  */
 void hip_fw_conntrack_periodic_cleanup(void)
 {
-    static time_t      last_check = 0; // timestamp of last call
-    struct slist      *iter_conn;
-    struct connection *conn;
+    static time_t             last_check    = 0; // timestamp of last call
+    struct dlist             *iter_conn;
+    struct connection        *conn;
+    bool                      counters_read = true;
+    struct esp_rule_counters  counters      = { NULL, 0, 0 };
+    struct esp_rule_counters *rule_counters = NULL;
 
     if (connection_timeout == 0 || !filter_traffic) {
         // timeout disabled, or no connections
@@ -2262,37 +2935,59 @@ void hip_fw_conntrack_periodic_cleanup(void)
     }
 
     if (now - last_check >= cleanup_interval) {
+        if (hipfw_nfacct_available()) {
+            read_esp_rule_counters(&counters);
+            rule_counters = &counters;
+        }
+
+        pthread_mutex_lock(&conntrack_lock);
+
         HIP_DEBUG("Checking for connection timeouts\n");
 
+        // Timestamps from the future are all at the tail of conn_list.
+        // Resetting them to now keeps the list ordered.
+        for (iter_conn = conn_list_tail; iter_conn; iter_conn = iter_conn->prev) {
+            conn = iter_conn->data;
+            if (now >= conn->timestamp) {
+                break;
+            }
+            conn->timestamp = now;
+            HIP_ERROR("Packet timestamp skew detected; timestamp reset\n");
+        }
+
         // If connections are covered by iptables rules, we rely on kernel
         // packet counters to update timestamps indirectly for these.
 
         if (total_esp_rules_count > 0) {
             // cast to signed value
-            const int found = detect_esp_rule_activity(now);
-            if (found == -1 || (unsigned int) found != total_esp_rules_count) {
+            const int found = detect_esp_rule_activity(now, rule_counters);
+            if (found == -1) {
+                // the traffic of connections may bypass userspace
+                // unnoticed, so none of them can be considered timed out
+                HIP_ERROR("Reading ESP rule counters failed, "
+                          "skipping connection timeouts\n");
+                counters_read = false;
+            } else if ((unsigned int) found != total_esp_rules_count) {
                 HIP_ERROR("Not all ESP tuples' packet counts were found\n");
             }
         }
 
-        iter_conn = conn_list;
-        while (iter_conn) {
-            conn      = iter_conn->data;
-            iter_conn = iter_conn->next; // iter_conn might get removed
-
-            if (now < conn->timestamp) {
-                conn->timestamp = now;
-                HIP_ERROR("Packet timestamp skew detected; timestamp reset\n");
+        // connections are ordered by timestamp, so stop at the first
+        // one that has not timed out
+        while (counters_read && conn_list) {
+            conn = conn_list->data;
+            if (now - conn->timestamp < connection_timeout) {
+                break;
             }
 
-            if (now - conn->timestamp >= connection_timeout) {
-                HIP_DEBUG("Connection timed out:\n");
-                HIP_DEBUG_HIT("src HIT", &conn->original.hip_tuple->data->src_hit);
-                HIP_DEBUG_HIT("dst HIT", &conn->original.hip_tuple->data->dst_hit);
-                remove_connection(conn);
-            }
+            HIP_DEBUG("Connection timed out:\n");
+            HIP_DEBUG_HIT("src HIT", &conn->original.hip_tuple->data->src_hit);
+            HIP_DEBUG_HIT("dst HIT", &conn->original.hip_tuple->data->dst_hit);
+            remove_connection(conn);
         }
 
+        pthread_mutex_unlock(&conntrack_lock);
+        free(counters.counters);
         last_check = now;
     }
 }
@@ -2303,9 +2998,19 @@ void hip_fw_conntrack_periodic_cleanup(void)
  */
 void hip_fw_uninit_conntrack(void)
 {
+    pthread_mutex_lock(&conntrack_lock);
     while (conn_list) {
         remove_connection(conn_list->data);
     }
+    if (esp_index) {
+        hip_ht_uninit(esp_index);
+        esp_index = NULL;
+    }
+    if (hip_index) {
+        hip_ht_uninit(hip_index);
+        hip_index = NULL;
+    }
+    pthread_mutex_unlock(&conntrack_lock);
 }
 
 /**
@@ -2318,25 +3023,26 @@ void hip_fw_uninit_conntrack(void)
 int hip_fw_handle_get_ha_info(struct hip_common *msg)
 {
     struct hip_hadb_user_info_state hid = { { { { 0 } } } };
-    struct slist                   *iter_conn;
+    struct dlist                   *iter_conn;
     struct connection              *conn;
     struct hip_data                *data;
+    int                             err = 0;
 
     if (!msg) {
         HIP_ERROR("Missing message parameter.\n");
         return -1;
     }
 
+    pthread_mutex_lock(&conntrack_lock);
+
     if (conn_list == NULL) {
         HIP_DEBUG("No tracked connections to return.\n");
-        return 0;
+        goto out_err;
     }
 
     hip_msg_init(msg);
-    if (hip_build_user_hdr(msg, HIP_MSG_GET_HA_INFO, 0) < 0) {
-        HIP_ERROR("Failed to build GET_HA_INFO message header.\n");
-        return -1;
-    }
+    HIP_IFEL(hip_build_user_hdr(msg, HIP_MSG_GET_HA_INFO, 0) < 0, -1,
+             "Failed to build GET_HA_INFO message header.\n");
 
     iter_conn = conn_list;
     while (iter_conn) {
@@ -2350,13 +3056,14 @@ int hip_fw_handle_get_ha_info(struct hip_common *msg)
         hid.nat_udp_port_local = conn->original.src_port;
         hid.nat_udp_port_peer  = conn->original.dst_port;
 
-        if (hip_build_param_contents(msg, &hid, HIP_PARAM_HA_INFO, sizeof(hid)) < 0) {
-            HIP_ERROR("Failed to build initiator HA_INFO parameter.\n");
-            return -1;
-        }
+        HIP_IFEL(hip_build_param_contents(msg, &hid, HIP_PARAM_HA_INFO,
+                                          sizeof(hid)) < 0,
+                 -1, "Failed to build initiator HA_INFO parameter.\n");
 
         iter_conn = iter_conn->next;
     }
 
-    return 0;
+out_err:
+    pthread_mutex_unlock(&conntrack_lock);
+    return err;
 }
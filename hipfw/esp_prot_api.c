@@ -35,6 +35,7 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
 #include <openssl/rand.h>
@@ -46,9 +47,11 @@
 #include "libcore/hashchain_store.h"
 #include "libcore/hashtree.h"
 #include "libcore/ife.h"
+#include "libcore/linkedlist.h"
 #include "libcore/state.h"
 #include "esp_prot_config.h"
 #include "esp_prot_fw_msg.h"
+#include "esp_prot_refill.h"
 #include "user_ipsec_sadb.h"
 #include "esp_prot_api.h"
 
@@ -83,6 +86,9 @@ int num_hierarchies;
 /* determines when to refill a store
  * NOTE this is a reverse threshold -> 1 - never refill, 0 - always */
 double refill_threshold;
+/* store only O(log n) elements of each hchain and recompute the others when
+ * they are used, for long hchains on fast links */
+int pebbled_hchains;
 
 // hash chain update settings
 /* if unused hchain element count of the active_hchain falls below
@@ -112,6 +118,85 @@ static struct hchain_store bex_store;
 // this stores hchains used during UPDATE
 static struct hchain_store update_store;
 
+/* messages for hipd created while holding the sadb lock, they are sent by
+ * esp_prot_send_hipd_msgs() once the lock is released */
+static struct hip_ll hipd_msgs = HIP_LL_INIT;
+
+/**
+ * Queues a message for hipd until the sadb lock is released. The caller has
+ * to hold the sadb lock.
+ *
+ * @param   msg the message, freed on error
+ * @return  0 on success, -1 on error
+ */
+static int esp_prot_queue_hipd_msg(struct hip_common *const msg)
+{
+    if (hip_ll_add_last(&hipd_msgs, msg)) {
+        HIP_ERROR("failed to queue message for hipd\n");
+        free(msg);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Takes the messages for hipd queued while holding the sadb lock. The caller
+ * has to hold the sadb lock.
+ *
+ * @param   msgs receives the queued messages
+ */
+void esp_prot_take_hipd_msgs(struct hip_ll *const msgs)
+{
+    *msgs = hipd_msgs;
+    hip_ll_init(&hipd_msgs);
+}
+
+/**
+ * Sends the messages taken by esp_prot_take_hipd_msgs() to hipd. The caller
+ * must not hold the sadb lock.
+ *
+ * @param   msgs the messages, the list is empty afterwards
+ */
+void esp_prot_send_hipd_msgs(struct hip_ll *const msgs)
+{
+    struct hip_common *msg = NULL;
+
+    while ((msg = hip_ll_del_first(msgs, NULL))) {
+        if (send_esp_prot_msg_to_hipd(msg)) {
+            HIP_ERROR("failed to send esp protection message to hipd\n");
+        }
+    }
+}
+
+/**
+ * Collects the hash structures created by the refill thread, which also
+ * requests new ones for depleted stores, and queues a message telling hipd
+ * about new BEX anchors. The caller has to hold the sadb lock.
+ *
+ * @param   use_hash_trees indicates whether hash chains or hash trees are stored
+ * @return  0 on success, -1 on error
+ */
+static int esp_prot_collect_hash_items(const int use_hash_trees)
+{
+    struct hip_common *msg = NULL;
+    int                err = 0, added = 0;
+
+    HIP_IFEL((added = esp_prot_refill_collect(&bex_store)) < 0, -1,
+             "failed to collect refilled hash structures\n");
+
+    // some elements have been added, tell hipd about them
+    if (added > 0) {
+        HIP_IFEL(!(msg = create_bex_store_update_msg(&bex_store, use_hash_trees)),
+                 -1, "failed to create bex store anchors update message\n");
+        HIP_IFEL(esp_prot_queue_hipd_msg(msg), -1,
+                 "unable to send bex-store update to hipd\n");
+    }
+
+out_err:
+    return err;
+}
+
 /**
  * Adds buffered packet hashes to a protected IPsec packet
  *
@@ -217,18 +302,9 @@ static void *esp_prot_get_bex_item_by_anchor(const unsigned char *item_anchor,
              "unable to retrieve hchain from bex store\n");
 
     // refill bex-store if necessary
-    HIP_IFEL((err = hcstore_refill(&bex_store, use_hash_trees)) < 0, -1,
+    HIP_IFEL(esp_prot_collect_hash_items(use_hash_trees), -1,
              "failed to refill the bex-store\n");
 
-    // some elements have been added, tell hipd about them
-    if (err > 0) {
-        HIP_IFEL(send_bex_store_update_to_hipd(&bex_store, use_hash_trees), -1,
-                 "unable to send bex-store update to hipd\n");
-
-        // this is not an error condition
-        err = 0;
-    }
-
 out_err:
     if (err) {
         return_item = NULL;
@@ -243,12 +319,13 @@ out_err:
  */
 int esp_prot_init(void)
 {
-    int       bex_function_id    = 0, update_function_id = 0;
-    int       bex_hash_length_id = 0, update_hash_length_id = 0;
-    int       use_hash_trees     = 0;
-    int       err                = 0, i, j, g;
-    int       activate           = 1;
-    config_t *config             = NULL;
+    int                        bex_function_id    = 0, update_function_id = 0;
+    int                        bex_hash_length_id = 0, update_hash_length_id = 0;
+    int                        use_hash_trees     = 0;
+    int                        err                = 0, i, j, g;
+    int                        activate           = 1;
+    config_t                  *config             = NULL;
+    struct hchain_store *const stores[]           = { &bex_store, &update_store };
 
     HIP_DEBUG("Initializing the esp protection extension...\n");
 
@@ -280,6 +357,8 @@ int esp_prot_init(void)
     HIP_IFEL(hcstore_init(&update_store, num_hchains_per_item,
                           refill_threshold), -1,
              "failed to initialize the update-store\n");
+    bex_store.pebbled_hchains    = pebbled_hchains;
+    update_store.pebbled_hchains = pebbled_hchains;
 
     HIP_DEBUG("setting up esp_prot_transforms...\n");
 
@@ -394,6 +473,10 @@ int esp_prot_init(void)
     HIP_IFEL(send_bex_store_update_to_hipd(&bex_store, use_hash_trees), -1,
              "failed to send bex-store update to hipd\n");
 
+    /* from now on the stores are refilled in the background */
+    HIP_IFEL(esp_prot_refill_init(stores, 2, use_hash_trees), -1,
+             "failed to start refilling the hchain stores\n");
+
 out_err:
     return err;
 }
@@ -412,6 +495,9 @@ int esp_prot_uninit(void)
         use_hash_trees = 1;
     }
 
+    // stop the refill thread before the stores go away
+    esp_prot_refill_uninit();
+
     // uninit hcstores
     hcstore_uninit(&bex_store, use_hash_trees);
     hcstore_uninit(&update_store, use_hash_trees);
@@ -426,6 +512,26 @@ out_err:
     return err;
 }
 
+/** moves hash structures created in the background into the stores, so that
+ * they are available before the next BEX or UPDATE needs them
+ *
+ * @return  0 on success, -1 on error
+ */
+int esp_prot_periodic_refill(void)
+{
+    int err = 0;
+
+    if (!esp_prot_refill_ready()) {
+        return 0;
+    }
+
+    hip_sadb_lock();
+    err = esp_prot_collect_hash_items(token_transform == ESP_PROT_TFM_TREE);
+    hip_sadb_unlock();
+
+    return err;
+}
+
 /** sets the esp protection-specific information of an IPsec SA
  *
  * @param   entry the corresponding IPsec SA
@@ -1002,6 +1108,9 @@ int esp_prot_get_data_offset(const struct hip_sa_entry *entry)
  * when active one reaches threshold, does the hash structure change when active
  * one is depleted, refills the update store
  *
+ * @note the caller has to hold the sadb lock, the messages for hipd are sent
+ *       when it is released
+ *
  * @param   entry the corresponding outbound IPsec SA
  * @return  0 on success, 1 in case of UNUSED transform, -1 otherwise
  */
@@ -1016,6 +1125,7 @@ int esp_prot_sadb_maintenance(struct hip_sa_entry *entry)
     struct hash_tree    *htree          = NULL;
     struct hash_chain   *hchain         = NULL;
     struct hash_tree    *link_trees[MAX_NUM_PARALLEL_HCHAINS];
+    struct hip_common   *msg              = NULL;
     int                  hash_item_length = 0;
     int                  remaining        = 0, i, j;
     int                  threshold        = 0;
@@ -1157,13 +1267,17 @@ int esp_prot_sadb_maintenance(struct hip_sa_entry *entry)
             }
 
             // finally issue UPDATE message to be sent for combined hchain update
-            HIP_IFEL(send_trigger_update_to_hipd(entry, anchors,
-                                                 hash_item_length, soft_update,
-                                                 anchor_offset, link_trees), -1,
+            HIP_IFEL(!(msg = create_trigger_update_msg(entry, anchors,
+                                                       hash_item_length,
+                                                       soft_update,
+                                                       anchor_offset,
+                                                       link_trees)), -1,
+                     "unable to create update trigger for hipd\n");
+            HIP_IFEL(esp_prot_queue_hipd_msg(msg), -1,
                      "unable to trigger update at hipd\n");
 
             // refill update-store
-            HIP_IFEL((err = hcstore_refill(&update_store, use_hash_trees)) < 0, -1,
+            HIP_IFEL(esp_prot_collect_hash_items(use_hash_trees), -1,
                      "failed to refill the update-store\n");
         }
 
@@ -1185,7 +1299,9 @@ int esp_prot_sadb_maintenance(struct hip_sa_entry *entry)
 
             /* notify hipd about the switch to the next hash-chain for
              * consistency reasons */
-            HIP_IFEL(send_anchor_change_to_hipd(entry), -1,
+            HIP_IFEL(!(msg = create_anchor_change_msg(entry)), -1,
+                     "unable to create hchain change notification\n");
+            HIP_IFEL(esp_prot_queue_hipd_msg(msg), -1,
                      "unable to notify hipd about hchain change\n");
         }
     }
@@ -38,6 +38,7 @@
 #include <stdint.h>
 
 #include "libcore/hashchain.h"
+#include "libcore/linkedlist.h"
 #include "user_ipsec_sadb.h"
 
 /* maps from the transform_id defined above to the hash-function id
@@ -63,6 +64,7 @@ extern int    hash_structure_length;
 extern int    num_hchains_per_item;
 extern int    num_hierarchies;
 extern double refill_threshold;
+extern int    pebbled_hchains;
 extern double update_threshold;
 
 extern int           hash_lengths[NUM_HASH_FUNCTIONS][NUM_HASH_LENGTHS];
@@ -70,6 +72,7 @@ extern hash_function hash_functions[NUM_HASH_FUNCTIONS];
 
 int esp_prot_init(void);
 int esp_prot_uninit(void);
+int esp_prot_periodic_refill(void);
 int esp_prot_sa_entry_set(struct hip_sa_entry *entry,
                           const uint8_t esp_prot_transform,
                           const uint32_t hash_item_length,
@@ -107,5 +110,7 @@ struct esp_prot_tfm *esp_prot_resolve_transform(const uint8_t transform);
 int esp_prot_get_hash_length(const uint8_t transform);
 int esp_prot_get_data_offset(const struct hip_sa_entry *entry);
 int esp_prot_sadb_maintenance(struct hip_sa_entry *entry);
+void esp_prot_take_hipd_msgs(struct hip_ll *const msgs);
+void esp_prot_send_hipd_msgs(struct hip_ll *const msgs);
 
 #endif /* HIPL_HIPFW_ESP_PROT_API_H */
@@ -59,6 +59,7 @@ static const char *path_num_random_elements  = "token_config.token_modes.num_ran
 static const char *path_num_hchains_per_item = "sender.hcstore.num_hchains_per_item";
 static const char *path_num_hierarchies      = "sender.hcstore.num_hierarchies";
 static const char *path_refill_threshold     = "sender.hcstore.refill_threshold";
+static const char *path_pebbled_hchains      = "sender.hcstore.pebbled_hchains";
 static const char *path_update_threshold     = "sender.update_threshold";
 
 static const char *path_window_size = "verifier.window_size";
@@ -310,6 +311,11 @@ int esp_prot_sender_config(const config_t *cfg)
             refill_threshold = 0.5;
         }
 
+        if (!config_lookup_bool(cfg, path_pebbled_hchains,
+                                &pebbled_hchains)) {
+            pebbled_hchains = 0;
+        }
+
         // process update-related settings
         if (!config_lookup_float(cfg, path_update_threshold,
                                  &update_threshold)) {
@@ -327,6 +333,7 @@ int esp_prot_sender_config(const config_t *cfg)
         num_hchains_per_item = 8;
         num_hierarchies      = 1;
         refill_threshold     = 0.5;
+        pebbled_hchains      = 0;
         update_threshold     = 0.5;
     }
 
@@ -351,6 +358,7 @@ int esp_prot_sender_config(const config_t *cfg)
     HIP_DEBUG("num_hchains_per_item: %i\n", num_hchains_per_item);
     HIP_DEBUG("num_hierarchies: %i\n", num_hierarchies);
     HIP_DEBUG("refill_threshold: %f\n", refill_threshold);
+    HIP_DEBUG("pebbled_hchains: %i\n", pebbled_hchains);
     HIP_DEBUG("update_threshold: %f\n", update_threshold);
 
     return 0;
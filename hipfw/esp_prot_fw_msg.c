@@ -63,8 +63,8 @@
  *       this should be set up for the store containing the hchains for the BEX
  * @note the created message contains hash_length and anchors for each transform
  */
-static struct hip_common *create_bex_store_update_msg(struct hchain_store *hcstore,
-                                                      const int use_hash_trees)
+struct hip_common *create_bex_store_update_msg(struct hchain_store *hcstore,
+                                               const int use_hash_trees)
 {
     struct hip_common   *msg         = NULL;
     struct esp_prot_tfm *transform   = NULL;
@@ -259,7 +259,7 @@ int send_esp_prot_to_hipd(const int activate)
     HIP_DUMP_MSG(msg);
 
     /* send msg to hipd and receive corresponding reply */
-    HIP_IFEL(hip_send_recv_daemon_info(msg, 1, hip_fw_sock), -1,
+    HIP_IFEL(hip_fw_send_recv_daemon_info(msg, 1), -1,
              "send_recv msg failed\n");
 
     /* check error value */
@@ -295,7 +295,7 @@ int send_bex_store_update_to_hipd(struct hchain_store *hcstore,
     HIP_DUMP_MSG(msg);
 
     /* send msg to hipd and receive corresponding reply */
-    HIP_IFEL(hip_send_recv_daemon_info(msg, 1, hip_fw_sock), -1, "send_recv msg failed\n");
+    HIP_IFEL(hip_fw_send_recv_daemon_info(msg, 1), -1, "send_recv msg failed\n");
 
     /* check error value */
     HIP_IFEL(hip_get_msg_err(msg), -1, "hipd returned error message!\n");
@@ -308,8 +308,8 @@ out_err:
 }
 
 /**
- * Invokes an UPDATE message containing an anchor element as a hook to
- * next hash structure to be used when the active one depletes
+ * Creates the message invoking an UPDATE message containing an anchor element
+ * as a hook to next hash structure to be used when the active one depletes
  *
  * @param   entry the sadb entry for the outbound direction
  * @param   anchors the anchor elements to be sent
@@ -317,14 +317,15 @@ out_err:
  * @param   soft_update indicates if HHL-based updates should be used
  * @param   anchor_offset the offset of the anchor element in the link tree
  * @param   link_trees the link trees for the anchor elements, in case of HHL
- * @return  0 on success, -1 on error
+ * @return  the message to be sent with send_esp_prot_msg_to_hipd(), NULL on
+ *          error
  */
-int send_trigger_update_to_hipd(const struct hip_sa_entry *entry,
-                                const unsigned char *anchors[MAX_NUM_PARALLEL_HCHAINS],
-                                const int hash_item_length,
-                                const int soft_update,
-                                const int *anchor_offset,
-                                struct hash_tree *link_trees[MAX_NUM_PARALLEL_HCHAINS])
+struct hip_common *create_trigger_update_msg(const struct hip_sa_entry *entry,
+                                             const unsigned char *anchors[MAX_NUM_PARALLEL_HCHAINS],
+                                             const int hash_item_length,
+                                             const int soft_update,
+                                             const int *anchor_offset,
+                                             struct hash_tree *link_trees[MAX_NUM_PARALLEL_HCHAINS])
 {
     int                  err           = 0;
     int                  i             = 0;
@@ -468,28 +469,23 @@ int send_trigger_update_to_hipd(const struct hip_sa_entry *entry,
 
     HIP_DUMP_MSG(msg);
 
-    /* send msg to hipd and receive corresponding reply */
-    HIP_IFEL(hip_send_recv_daemon_info(msg, 1, hip_fw_sock), -1,
-             "send_recv msg failed\n");
-
-    /* check error value */
-    HIP_IFEL(hip_get_msg_err(msg), -1, "hipd returned error message!\n");
-
-    HIP_DEBUG("send_recv msg succeeded\n");
-
 out_err:
-    free(msg);
     free(branch_nodes);
-    return err;
+    if (err) {
+        free(msg);
+        return NULL;
+    }
+    return msg;
 }
 
 /**
- * Notifies the hipd about an anchor change in the hipfw
+ * Creates the message notifying the hipd about an anchor change in the hipfw
  *
  * @param   entry the sadb entry for the outbound direction
- * @return  0 on success, -1 on error, 1 for inbound sadb entry
+ * @return  the message to be sent with send_esp_prot_msg_to_hipd(), NULL on
+ *          error
  */
-int send_anchor_change_to_hipd(const struct hip_sa_entry *entry)
+struct hip_common *create_anchor_change_msg(const struct hip_sa_entry *entry)
 {
     int                err         = 0;
     int                hash_length = 0;
@@ -556,8 +552,30 @@ int send_anchor_change_to_hipd(const struct hip_sa_entry *entry)
 
     HIP_DUMP_MSG(msg);
 
+out_err:
+    if (err) {
+        free(msg);
+        return NULL;
+    }
+    return msg;
+}
+
+/**
+ * Sends a message created by create_bex_store_update_msg(),
+ * create_trigger_update_msg() or create_anchor_change_msg() to the hipd.
+ *
+ * @note the caller must not hold the sadb lock, as this waits for the
+ *       hipd socket
+ *
+ * @param   msg the message, freed by this function
+ * @return  0 on success, -1 on error
+ */
+int send_esp_prot_msg_to_hipd(struct hip_common *msg)
+{
+    int err = 0;
+
     /* send msg to hipd and receive corresponding reply */
-    HIP_IFEL(hip_send_recv_daemon_info(msg, 1, hip_fw_sock), -1,
+    HIP_IFEL(hip_fw_send_recv_daemon_info(msg, 1), -1,
              "send_recv msg failed\n");
 
     /* check error value */
@@ -41,15 +41,18 @@
 #include "user_ipsec_sadb.h"
 
 int send_esp_prot_to_hipd(const int active);
+struct hip_common *create_bex_store_update_msg(struct hchain_store *hcstore,
+                                               const int use_hash_trees);
 int send_bex_store_update_to_hipd(struct hchain_store *hcstore,
                                   const int use_hash_trees);
-int send_trigger_update_to_hipd(const struct hip_sa_entry *entry,
-                                const unsigned char *anchors[MAX_NUM_PARALLEL_HCHAINS],
-                                const int hash_item_length,
-                                const int soft_update,
-                                const int *anchor_offset,
-                                struct hash_tree *link_trees[MAX_NUM_PARALLEL_HCHAINS]);
-int send_anchor_change_to_hipd(const struct hip_sa_entry *entry);
+struct hip_common *create_trigger_update_msg(const struct hip_sa_entry *entry,
+                                             const unsigned char *anchors[MAX_NUM_PARALLEL_HCHAINS],
+                                             const int hash_item_length,
+                                             const int soft_update,
+                                             const int *anchor_offset,
+                                             struct hash_tree *link_trees[MAX_NUM_PARALLEL_HCHAINS]);
+struct hip_common *create_anchor_change_msg(const struct hip_sa_entry *entry);
+int send_esp_prot_msg_to_hipd(struct hip_common *msg);
 int esp_prot_handle_sa_add_request(const struct hip_common *msg,
                                    uint8_t * esp_prot_transform,
                                    uint16_t * num_anchors,
@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Creating hash chains or hash trees takes thousands of hash operations.
+ * Instead of refilling the esp_prot stores on the packet path, a worker
+ * thread keeps a private copy of each store (its workshop) filled and hands
+ * finished hash structures to the packet path on request.
+ *
+ * The packet path calls esp_prot_refill_collect() when it takes hash
+ * structures from a store. This moves all finished structures into their
+ * stores and, for every store item that fell below the refill threshold
+ * of its store (low watermark), asks the worker for enough structures to
+ * fill it up to the item size (high watermark).
+ *
+ * Finished structures travel through a single-producer single-consumer
+ * ring that needs no lock. Requests are rare and are passed under
+ * ::refill_lock, which is never held while hash structures are created.
+ *
+ * @brief Background refill of the esp_prot hash structure stores
+ */
+
+#define _BSD_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "libcore/debug.h"
+#include "libcore/hashchain.h"
+#include "libcore/hashchain_store.h"
+#include "libcore/hashtree.h"
+#include "libcore/ife.h"
+#include "libcore/linkedlist.h"
+#include "esp_prot_refill.h"
+
+
+/* number of finished hash structures in transit, a power of two */
+#define REFILL_RING_SIZE 256
+
+/* time in ms the worker waits before retrying a request it could not serve */
+#define REFILL_RETRY_DELAY 10
+
+/** one item of a store (hash function, hash length, structure length and
+ *  hierarchy level) that is kept filled by the worker */
+struct refill_slot {
+    struct hchain_store *store;      /* store used by the packet path */
+    struct hchain_store *workshop;   /* private store of the worker */
+    int                  function_id;
+    int                  hash_length_id;
+    int                  hchain_length_id;
+    int                  hierarchy_level;
+    unsigned             requested;  /* still to be handed over, see ::refill_lock */
+    unsigned             outstanding; /* requested, but not yet collected */
+};
+
+struct refill_handoff {
+    unsigned slot;
+    void    *item;
+};
+
+static struct hchain_store *workshops     = NULL;
+static int                  num_workshops = 0;
+static struct refill_slot  *slots         = NULL;
+static unsigned             num_slots     = 0;
+static int                  refill_hash_trees;
+
+static struct refill_handoff ring[REFILL_RING_SIZE];
+/* next free ring entry, only written by the worker */
+static unsigned ring_head = 0;
+/* next ring entry to be collected, only written by the collector */
+static unsigned ring_tail = 0;
+
+static pthread_t refill_thread;
+static int       refill_running = 0;
+static int       refill_stop    = 0;
+
+/**
+ * Protects the requests of the slots and ::refill_stop. The worker waits
+ * on ::refill_cond for new requests.
+ */
+static pthread_mutex_t refill_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  refill_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Free a hash chain or hash tree.
+ *
+ * @param item the hash structure
+ */
+static void refill_free_item(void *item)
+{
+    if (refill_hash_trees) {
+        htree_free(item);
+    } else {
+        hchain_free(item);
+    }
+}
+
+/**
+ * Get the list holding the hash structures of a slot.
+ *
+ * @param slot    the slot
+ * @param hcstore the store of the slot or its workshop
+ * @return        the list of hash structures
+ */
+static struct hip_ll *refill_list(const struct refill_slot *slot,
+                                  struct hchain_store *hcstore)
+{
+    return &hcstore->hchain_shelves[slot->function_id][slot->hash_length_id].
+           hchains[slot->hchain_length_id][slot->hierarchy_level];
+}
+
+/**
+ * Append a finished hash structure to the ring. Only called by the worker.
+ *
+ * @param slot index of the slot the structure belongs to
+ * @param item the hash structure
+ * @return     0 on success, -1 if the ring is full
+ */
+static int refill_ring_push(const unsigned slot, void *item)
+{
+    const unsigned tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+
+    if (ring_head - tail == REFILL_RING_SIZE) {
+        return -1;
+    }
+
+    ring[ring_head % REFILL_RING_SIZE].slot = slot;
+    ring[ring_head % REFILL_RING_SIZE].item = item;
+    __atomic_store_n(&ring_head, ring_head + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/**
+ * Take the oldest finished hash structure from the ring. Calls have to be
+ * serialized by the caller.
+ *
+ * @param handoff receives the structure and its slot
+ * @return        0 on success, -1 if the ring is empty
+ */
+static int refill_ring_pop(struct refill_handoff *handoff)
+{
+    const unsigned head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+
+    if (ring_tail == head) {
+        return -1;
+    }
+
+    *handoff = ring[ring_tail % REFILL_RING_SIZE];
+    __atomic_store_n(&ring_tail, ring_tail + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/**
+ * Hand hash structures of a slot over to the packet path.
+ *
+ * @param slot  the slot
+ * @param count the number of structures requested
+ * @return      the number of structures handed over
+ */
+static unsigned refill_serve(struct refill_slot *const slot,
+                             const unsigned count)
+{
+    struct hip_ll *const list = refill_list(slot, slot->workshop);
+    void                *item = NULL;
+    unsigned             done;
+
+    for (done = 0; done < count; done++) {
+        if (ring_head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE)
+            == REFILL_RING_SIZE) {
+            break;
+        }
+
+        if (hip_ll_get_size(list) == 0 &&
+            hcstore_refill(slot->workshop, refill_hash_trees) < 0) {
+            HIP_ERROR("failed to refill hash structure workshop\n");
+            break;
+        }
+
+        if (!(item = hip_ll_del_first(list, NULL))) {
+            break;
+        }
+
+        refill_ring_push(slot - slots, item);
+    }
+
+    return done;
+}
+
+/**
+ * Check for requests the worker has not served yet. The caller has to
+ * hold ::refill_lock.
+ *
+ * @return 1 if there are requests, 0 otherwise
+ */
+static int refill_requested(void)
+{
+    unsigned i;
+
+    for (i = 0; i < num_slots; i++) {
+        if (slots[i].requested) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Wait on ::refill_cond for a limited time. The caller has to hold
+ * ::refill_lock.
+ *
+ * @param ms the time to wait in milliseconds
+ */
+static void refill_wait(const long ms)
+{
+    struct timeval  now;
+    struct timespec until;
+
+    gettimeofday(&now, NULL);
+    until.tv_sec  = now.tv_sec + ms / 1000;
+    until.tv_nsec = now.tv_usec * 1000 + (ms % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_cond_timedwait(&refill_cond, &refill_lock, &until);
+}
+
+/**
+ * Worker thread serving the refill requests of the packet path. While
+ * there are no requests, it keeps the workshops filled so that the next
+ * request can be served right away.
+ *
+ * @param arg unused
+ * @return    NULL
+ */
+static void *refill_worker(void *arg)
+{
+    sigset_t signals;
+    unsigned i, count, done;
+    int      starved, k;
+
+    (void) arg;
+
+    /* termination signals are handled by the main thread */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    pthread_mutex_lock(&refill_lock);
+    while (!refill_stop) {
+        starved = 0;
+
+        for (i = 0; i < num_slots && !refill_stop; i++) {
+            if (!(count = slots[i].requested)) {
+                continue;
+            }
+
+            pthread_mutex_unlock(&refill_lock);
+            done = refill_serve(&slots[i], count);
+            pthread_mutex_lock(&refill_lock);
+
+            slots[i].requested -= done;
+            if (done < count) {
+                starved = 1;
+            }
+        }
+
+        if (refill_stop) {
+            break;
+        }
+
+        if (starved) {
+            // the ring is full or the workshop could not be refilled
+            refill_wait(REFILL_RETRY_DELAY);
+        } else if (!refill_requested()) {
+            pthread_mutex_unlock(&refill_lock);
+            for (k = 0; k < num_workshops; k++) {
+                if (hcstore_refill(&workshops[k], refill_hash_trees) < 0) {
+                    HIP_ERROR("failed to refill hash structure workshop\n");
+                }
+            }
+            pthread_mutex_lock(&refill_lock);
+
+            while (!refill_stop && !refill_requested()) {
+                pthread_cond_wait(&refill_cond, &refill_lock);
+            }
+        }
+    }
+    pthread_mutex_unlock(&refill_lock);
+
+    return NULL;
+}
+
+/**
+ * Start refilling hash structure stores in the background. The stores must
+ * have been set up completely before.
+ *
+ * @param stores         the stores to be kept filled
+ * @param num_stores     number of stores
+ * @param use_hash_trees indicates whether hash chains or hash trees are stored
+ * @return               0 on success, -1 on error
+ */
+int esp_prot_refill_init(struct hchain_store *const stores[],
+                         const int num_stores,
+                         const int use_hash_trees)
+{
+    struct hchain_shelf *shelf = NULL;
+    unsigned             i, j, g, h;
+    int                  k, err = 0;
+
+    HIP_ASSERT(!refill_running);
+
+    refill_hash_trees = use_hash_trees;
+
+    for (k = 0; k < num_stores; k++) {
+        for (i = 0; i < stores[k]->num_functions; i++) {
+            for (j = 0; j < stores[k]->num_hash_lengths[i]; j++) {
+                shelf = &stores[k]->hchain_shelves[i][j];
+                for (g = 0; g < shelf->num_hchain_lengths; g++) {
+                    num_slots += shelf->num_hierarchies[g];
+                }
+            }
+        }
+    }
+
+    HIP_IFEL(!(workshops = calloc(num_stores, sizeof(*workshops))), -1,
+             "failed to allocate memory\n");
+    HIP_IFEL(!(slots = calloc(num_slots, sizeof(*slots))), -1,
+             "failed to allocate memory\n");
+    num_workshops = num_stores;
+    num_slots     = 0;
+
+    // lower hierarchy levels come first, as they are needed for linking
+    for (k = 0; k < num_stores; k++) {
+        hcstore_init_like(&workshops[k], stores[k], 0.0);
+
+        for (i = 0; i < stores[k]->num_functions; i++) {
+            for (j = 0; j < stores[k]->num_hash_lengths[i]; j++) {
+                shelf = &stores[k]->hchain_shelves[i][j];
+                for (g = 0; g < shelf->num_hchain_lengths; g++) {
+                    for (h = 0; h < shelf->num_hierarchies[g]; h++) {
+                        slots[num_slots].store            = stores[k];
+                        slots[num_slots].workshop         = &workshops[k];
+                        slots[num_slots].function_id      = i;
+                        slots[num_slots].hash_length_id   = j;
+                        slots[num_slots].hchain_length_id = g;
+                        slots[num_slots].hierarchy_level  = h;
+                        num_slots++;
+                    }
+                }
+            }
+        }
+    }
+
+    refill_stop = 0;
+    HIP_IFEL(pthread_create(&refill_thread, NULL, refill_worker, NULL), -1,
+             "failed to start hash structure refill thread\n");
+    refill_running = 1;
+
+    HIP_DEBUG("hash structure refill thread started for %u store items\n",
+              num_slots);
+
+out_err:
+    if (err) {
+        esp_prot_refill_uninit();
+    }
+
+    return err;
+}
+
+/**
+ * Stop the refill thread and free all hash structures that have not been
+ * collected yet.
+ */
+void esp_prot_refill_uninit(void)
+{
+    struct refill_handoff handoff;
+    int                   k;
+
+    if (refill_running) {
+        pthread_mutex_lock(&refill_lock);
+        refill_stop = 1;
+        pthread_cond_signal(&refill_cond);
+        pthread_mutex_unlock(&refill_lock);
+
+        pthread_join(refill_thread, NULL);
+        refill_running = 0;
+    }
+
+    while (!refill_ring_pop(&handoff)) {
+        refill_free_item(handoff.item);
+    }
+
+    for (k = 0; k < num_workshops; k++) {
+        hcstore_uninit(&workshops[k], refill_hash_trees);
+    }
+
+    free(workshops);
+    free(slots);
+    workshops     = NULL;
+    num_workshops = 0;
+    slots         = NULL;
+    num_slots     = 0;
+}
+
+/**
+ * Move finished hash structures into their stores and request new ones
+ * for store items below their refill threshold. This never creates hash
+ * structures itself. Calls have to be serialized by the caller, e.g. by
+ * holding the sadb lock.
+ *
+ * @param hcstore the store whose newly added structures should be counted
+ * @return        number of structures added to @a hcstore
+ */
+int esp_prot_refill_collect(const struct hchain_store *hcstore)
+{
+    struct refill_handoff handoff;
+    struct refill_slot   *slot = NULL;
+    unsigned              size, max, i;
+    int                   added = 0, wake = 0;
+
+    while (!refill_ring_pop(&handoff)) {
+        slot = &slots[handoff.slot];
+        slot->outstanding--;
+
+        if (hip_ll_add_last(refill_list(slot, slot->store), handoff.item)) {
+            HIP_ERROR("failed to store refilled hash structure\n");
+            refill_free_item(handoff.item);
+            continue;
+        }
+
+        if (slot->store == hcstore) {
+            added++;
+        }
+    }
+
+    pthread_mutex_lock(&refill_lock);
+    for (i = 0; i < num_slots; i++) {
+        slot = &slots[i];
+        size = hip_ll_get_size(refill_list(slot, slot->store));
+        max  = slot->store->num_hchains_per_item;
+
+        // same threshold as used by hcstore_refill()
+        if (size + slot->outstanding >= max ||
+            max - size < slot->store->refill_threshold * max) {
+            continue;
+        }
+
+        slot->requested   += max - size - slot->outstanding;
+        slot->outstanding  = max - size;
+        wake               = 1;
+    }
+    if (wake) {
+        pthread_cond_signal(&refill_cond);
+    }
+    pthread_mutex_unlock(&refill_lock);
+
+    return added;
+}
+
+/**
+ * Check whether finished hash structures wait to be collected.
+ *
+ * @return 1 if esp_prot_refill_collect() would add hash structures,
+ *         0 otherwise
+ */
+int esp_prot_refill_ready(void)
+{
+    return __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) !=
+           __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Refills the hash structure stores of the ESP protection extension in a
+ * background thread.
+ *
+ * @brief Background refill of the esp_prot hash structure stores
+ */
+
+#ifndef HIPL_HIPFW_ESP_PROT_REFILL_H
+#define HIPL_HIPFW_ESP_PROT_REFILL_H
+
+#include "libcore/hashchain_store.h"
+
+int esp_prot_refill_init(struct hchain_store *const stores[],
+                         const int num_stores,
+                         const int use_hash_trees);
+void esp_prot_refill_uninit(void);
+int esp_prot_refill_collect(const struct hchain_store *store);
+int esp_prot_refill_ready(void);
+
+#endif /* HIPL_HIPFW_ESP_PROT_REFILL_H */
@@ -43,9 +43,13 @@
  */
 
 #define _BSD_SOURCE
+/* recvmmsg() */
+#define _GNU_SOURCE
 
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -88,6 +92,8 @@
 #include "helpers.h"
 #include "lsi.h"
 #include "midauth.h"
+#include "nfacct.h"
+#include "pending_queue.h"
 #include "port_bindings.h"
 #include "reinject.h"
 #include "rewrite.h"
@@ -144,9 +150,10 @@ int esp_speedup               = 0; /**< Enable esp speedup via dynamic iptables
  * to two sockets are sequence numbers but it would have required reworking
  * too much of the firewall.
  *
- * @todo make accessible through send function, no-one should read on that
+ * Access it only through hip_fw_send_recv_daemon_info(), which keeps
+ * concurrent queue workers from interleaving their requests.
  */
-int hip_fw_sock = 0;
+static int hip_fw_sock = 0;
 /**
  * Use this socket *only* for receiving async messages from hipd
  * @todo make static, no-one should read on that
@@ -160,6 +167,137 @@ static int hip_fw_async_sock = 0;
  */
 static struct nlif_handle *nlifh;
 
+/**
+ * Number of netfilter queues opened per address family (-q option).
+ * IPv4 packets are handed to queues [0, n - 1] and IPv6 packets to queues
+ * [n, 2n - 1], so the default of one queue keeps the traditional queue
+ * numbers 0 and 1. Plain ESP packets may use the ESP header queues
+ * [2n, 3n - 1] and [3n, 4n - 1] instead (see ::fw_esp_header_only). With more
+ * than one queue, each queue is served by its own worker thread.
+ */
+unsigned int hipfw_queue_count = 1;
+
+/** Maximum number of packets read from a queue with one recvmmsg() call */
+#define HIPFW_QUEUE_BATCH 16
+
+/** Room for the netlink and nfqueue attributes around a copied packet */
+#define HIPFW_QUEUE_MSG_OVERHEAD 256
+
+/**
+ * Number of bytes copied to userspace from packets on the ESP header queues.
+ * This covers an IPv4 header with options or an IPv6 header, followed by
+ * the ESP header.
+ */
+#define HIPFW_ESP_COPY_RANGE 128
+
+/**
+ * State of one netfilter queue. Everything a worker needs to receive and
+ * classify a packet lives here, so that queues never share buffers.
+ */
+struct hipfw_queue {
+    struct nfq_handle         *handle;
+    struct nfq_q_handle       *q_handle;
+    int                        fd;
+    unsigned int               num;
+    int                        ip_version;
+    unsigned int               copy_range;
+    pthread_t                  thread;
+    bool                       thread_running;
+    /* verdict deferred until the next differing verdict or end of batch */
+    uint32_t                   pending_verdict;
+    uint32_t                   pending_id;
+    unsigned int               pending_count;
+    struct hip_fw_context      ctx;
+    struct hip_ipq_packet_msg  packet;
+    uint8_t                    scratch[HIP_MAX_PACKET];
+    struct mmsghdr             msgs[HIPFW_QUEUE_BATCH];
+    struct iovec               iov[HIPFW_QUEUE_BATCH];
+    char                       buf[HIPFW_QUEUE_BATCH][HIP_MAX_PACKET + HIPFW_QUEUE_MSG_OVERHEAD];
+};
+
+/**
+ * All queues: IPv4 queues, IPv6 queues and, if ::fw_esp_header_only is set,
+ * IPv4 and IPv6 ESP header queues (::fw_queue_total entries).
+ */
+static struct hipfw_queue *fw_queues = NULL;
+
+/** Number of entries in ::fw_queues */
+static unsigned int fw_queue_total = 0;
+
+/**
+ * Plain ESP packets are handed to separate queues that copy only their
+ * headers to userspace. This is possible if no extension needs the ESP
+ * payload (ESP relay, userspace IPsec, ESP protection), which is known at
+ * start-up because these extensions cannot be enabled later on.
+ */
+static bool fw_esp_header_only = false;
+
+/** Serializes request/response round trips with hipd on ::hip_fw_sock */
+static pthread_mutex_t hip_fw_sock_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Protects the lazily queried default HIT and LSI */
+static pthread_mutex_t default_id_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Format an NFQUEUE target for ::hipfw_queue_count consecutive queues.
+ *
+ * @param target buffer for the target string
+ * @param size   size of @a target
+ * @param first  number of the first queue
+ */
+static void fw_format_queue_target(char *const target, const size_t size,
+                                   const unsigned int first)
+{
+    if (hipfw_queue_count > 1) {
+        /* the kernel keeps packets of a flow on the same queue */
+        snprintf(target, size, "NFQUEUE --queue-balance %u:%u",
+                 first, first + hipfw_queue_count - 1);
+    } else {
+        snprintf(target, size, "NFQUEUE --queue-num %u", first);
+    }
+}
+
+/**
+ * Build the iptables target that hands packets of an address family
+ * to the firewall queues.
+ *
+ * @param ip_version 4 or 6
+ * @return           the NFQUEUE target string (static storage)
+ */
+static const char *fw_queue_target(const int ip_version)
+{
+    static char        targets[2][64];
+    const unsigned int first  = ip_version == 4 ? 0 : hipfw_queue_count;
+    char *const        target = targets[ip_version == 4 ? 0 : 1];
+
+    fw_format_queue_target(target, sizeof(targets[0]), first);
+
+    return target;
+}
+
+/**
+ * Build the iptables target for plain ESP packets of an address family.
+ * These go to the ESP header queues if ::fw_esp_header_only is set and to
+ * the regular queues otherwise.
+ *
+ * @param ip_version 4 or 6
+ * @return           the NFQUEUE target string (static storage)
+ */
+static const char *fw_esp_queue_target(const int ip_version)
+{
+    static char        targets[2][64];
+    const unsigned int first  = (ip_version == 4 ? 2 : 3) * hipfw_queue_count;
+    char *const        target = targets[ip_version == 4 ? 0 : 1];
+
+    if (!fw_esp_header_only) {
+        return fw_queue_target(ip_version);
+    }
+
+    fw_format_queue_target(target, sizeof(targets[0]), first);
+
+    return target;
+}
+
 /*----------------INIT FUNCTIONS------------------*/
 
 /**
@@ -188,9 +326,9 @@ static int fw_init_userspace_ipsec(void)
                  "failed to initialize userspace ipsec\n");
 
         // queue incoming ESP over IPv4 and IPv4 UDP encapsulated traffic
-        system_print("iptables -I HIPFW-INPUT -p 50 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-INPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-INPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 0");
+        system_printf("iptables -I HIPFW-INPUT -p 50 -j %s", fw_queue_target(4));
+        system_printf("iptables -I HIPFW-INPUT -p 17 --dport 10500 -j %s", fw_queue_target(4));
+        system_printf("iptables -I HIPFW-INPUT -p 17 --sport 10500 -j %s", fw_queue_target(4));
 
         /* no need to queue outgoing ICMP, TCP and UDP sent to LSIs as
          * this is handled elsewhere */
@@ -198,13 +336,13 @@ static int fw_init_userspace_ipsec(void)
         /* queue incoming ESP over IPv6
          *
          * @note this is where you would want to add IPv6 UDP encapsulation */
-        system_print("ip6tables -I HIPFW-INPUT -p 50 -j NFQUEUE --queue-num 1");
+        system_printf("ip6tables -I HIPFW-INPUT -p 50 -j %s", fw_queue_target(6));
 
         // queue outgoing ICMP, TCP and UDP sent to HITs
-        system_print("ip6tables -I HIPFW-OUTPUT -p 58 -d 2001:0010::/28 -j NFQUEUE --queue-num 1");   // IPv6-ICMP
-        system_print("ip6tables -I HIPFW-OUTPUT -p 6  -d 2001:0010::/28 -j NFQUEUE --queue-num 1");   // TCP
-        system_print("ip6tables -I HIPFW-OUTPUT -p 1  -d 2001:0010::/28 -j NFQUEUE --queue-num 1");   // ICMP
-        system_print("ip6tables -I HIPFW-OUTPUT -p 17 -d 2001:0010::/28 -j NFQUEUE --queue-num 1");   // UDP
+        system_printf("ip6tables -I HIPFW-OUTPUT -p 58 -d 2001:0010::/28 -j %s", fw_queue_target(6));   // IPv6-ICMP
+        system_printf("ip6tables -I HIPFW-OUTPUT -p 6  -d 2001:0010::/28 -j %s", fw_queue_target(6));   // TCP
+        system_printf("ip6tables -I HIPFW-OUTPUT -p 1  -d 2001:0010::/28 -j %s", fw_queue_target(6));   // ICMP
+        system_printf("ip6tables -I HIPFW-OUTPUT -p 17 -d 2001:0010::/28 -j %s", fw_queue_target(6));   // UDP
     } else if (ver_c < 27) {
         HIP_INFO("You are using kernel version %s. Userspace ipsec should"
                  " be used with versions below 2.6.27.\n", name.release);
@@ -230,16 +368,16 @@ static int fw_uninit_userspace_ipsec(void)
         HIP_IFEL(userspace_ipsec_uninit(), -1, "failed to uninit user ipsec\n");
 
         // delete all rules previously set up for this extension
-        system_print("iptables -D HIPFW-INPUT -p 50 -j NFQUEUE --queue-num 0 2> /dev/null");                // ESP
-        system_print("iptables -D HIPFW-INPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 0 2> /dev/null");  // UDP
-        system_print("iptables -D HIPFW-INPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 0 2> /dev/null");  // UDP
+        system_printf("iptables -D HIPFW-INPUT -p 50 -j %s 2> /dev/null", fw_queue_target(4));                // ESP
+        system_printf("iptables -D HIPFW-INPUT -p 17 --dport 10500 -j %s 2> /dev/null", fw_queue_target(4));  // UDP
+        system_printf("iptables -D HIPFW-INPUT -p 17 --sport 10500 -j %s 2> /dev/null", fw_queue_target(4));  // UDP
 
-        system_print("ip6tables -D HIPFW-INPUT -p 50 -j NFQUEUE --queue-num 1 2> /dev/null");               // IPv6-crypt
+        system_printf("ip6tables -D HIPFW-INPUT -p 50 -j %s 2> /dev/null", fw_queue_target(6));               // IPv6-crypt
 
-        system_print("ip6tables -D HIPFW-OUTPUT -p 58 -d 2001:0010::/28 -j NFQUEUE --queue-num 1 2> /dev/null");    // IPv6-ICMP
-        system_print("ip6tables -D HIPFW-OUTPUT -p 6  -d 2001:0010::/28 -j NFQUEUE --queue-num 1 2> /dev/null");    // TCP
-        system_print("ip6tables -D HIPFW-OUTPUT -p 1  -d 2001:0010::/28 -j NFQUEUE --queue-num 1 2> /dev/null");    // ICMP
-        system_print("ip6tables -D HIPFW-OUTPUT -p 17 -d 2001:0010::/28 -j NFQUEUE --queue-num 1 2> /dev/null");    // UDP
+        system_printf("ip6tables -D HIPFW-OUTPUT -p 58 -d 2001:0010::/28 -j %s 2> /dev/null", fw_queue_target(6));    // IPv6-ICMP
+        system_printf("ip6tables -D HIPFW-OUTPUT -p 6  -d 2001:0010::/28 -j %s 2> /dev/null", fw_queue_target(6));    // TCP
+        system_printf("ip6tables -D HIPFW-OUTPUT -p 1  -d 2001:0010::/28 -j %s 2> /dev/null", fw_queue_target(6));    // ICMP
+        system_printf("ip6tables -D HIPFW-OUTPUT -p 17 -d 2001:0010::/28 -j %s 2> /dev/null", fw_queue_target(6));    // UDP
     }
 
 out_err:
@@ -344,18 +482,18 @@ static int fw_init_lsi_support(void)
         }
 
         if (hip_build_user_hdr(msg, HIP_MSG_LSI_ON, 0) ||
-            hip_send_recv_daemon_info(msg, 1, hip_fw_sock)) {
+            hip_fw_send_recv_daemon_info(msg, 1)) {
             HIP_DEBUG("Failed to notify hipd of LSI init.\n");
             err = -1;
         }
         free(msg);
 
         // add the rule
-        system_print("iptables -I HIPFW-OUTPUT -d " HIP_FULL_LSI_STR " -j NFQUEUE --queue-num 0");
+        system_printf("iptables -I HIPFW-OUTPUT -d " HIP_FULL_LSI_STR " -j %s", fw_queue_target(4));
 
         /* LSI support: incoming HIT packets, captured to decide if
          * HITs may be mapped to LSIs */
-        system_print("ip6tables -I HIPFW-INPUT -d 2001:0010::/28 -j NFQUEUE --queue-num 1");
+        system_printf("ip6tables -I HIPFW-INPUT -d 2001:0010::/28 -j %s", fw_queue_target(6));
     }
 
     return err;
@@ -376,9 +514,9 @@ static int fw_uninit_lsi_support(void)
         hip_lsi_support = 0;
 
         // remove the rule
-        system_print("iptables -D HIPFW-OUTPUT -d " HIP_FULL_LSI_STR " -j NFQUEUE --queue-num 0 2> /dev/null");
+        system_printf("iptables -D HIPFW-OUTPUT -d " HIP_FULL_LSI_STR " -j %s 2> /dev/null", fw_queue_target(4));
 
-        system_print("ip6tables -D HIPFW-INPUT -d 2001:0010::/28 -j NFQUEUE --queue-num 1 2> /dev/null");
+        system_printf("ip6tables -D HIPFW-INPUT -d 2001:0010::/28 -j %s 2> /dev/null", fw_queue_target(6));
 
         if (!(msg = hip_msg_alloc())) {
             HIP_ERROR("failed to allocate memory\n");
@@ -386,7 +524,7 @@ static int fw_uninit_lsi_support(void)
         }
 
         if (hip_build_user_hdr(msg, HIP_MSG_LSI_OFF, 0) ||
-            hip_send_recv_daemon_info(msg, 1, hip_fw_sock)) {
+            hip_fw_send_recv_daemon_info(msg, 1)) {
             HIP_DEBUG("Failed to notify hipd of LSI un-init.\n");
             err = -1;
         }
@@ -404,37 +542,37 @@ static void firewall_init_filter_traffic(void)
     if (filter_traffic) {
         // this will allow the firewall to handle HIP traffic
         // HIP protocol
-        system_print("iptables -I HIPFW-FORWARD -p 139 -j NFQUEUE --queue-num 0");
+        system_printf("iptables -I HIPFW-FORWARD -p 139 -j %s", fw_queue_target(4));
         // ESP protocol
-        system_print("iptables -I HIPFW-FORWARD -p 50 -j NFQUEUE --queue-num 0");
+        system_printf("iptables -I HIPFW-FORWARD -p 50 -j %s", fw_esp_queue_target(4));
         // UDP encapsulation for HIP
-        system_print("iptables -I HIPFW-FORWARD -p 17 --dport 10500 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-FORWARD -p 17 --sport 10500 -j NFQUEUE --queue-num 0");
-
-        system_print("iptables -I HIPFW-INPUT -p 139 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-INPUT -p 50 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-INPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-INPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 0");
-
-        system_print("iptables -I HIPFW-OUTPUT -p 139 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-OUTPUT -p 50 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-OUTPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 0");
-        system_print("iptables -I HIPFW-OUTPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 0");
-
-        system_print("ip6tables -I HIPFW-FORWARD -p 139 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-FORWARD -p 50 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-FORWARD -p 17 --dport 10500 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-FORWARD -p 17 --sport 10500 -j NFQUEUE --queue-num 1");
-
-        system_print("ip6tables -I HIPFW-INPUT -p 139 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-INPUT -p 50 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-INPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-INPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 1");
-
-        system_print("ip6tables -I HIPFW-OUTPUT -p 139 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-OUTPUT -p 50 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-OUTPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 1");
-        system_print("ip6tables -I HIPFW-OUTPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 1");
+        system_printf("iptables -I HIPFW-FORWARD -p 17 --dport 10500 -j %s", fw_queue_target(4));
+        system_printf("iptables -I HIPFW-FORWARD -p 17 --sport 10500 -j %s", fw_queue_target(4));
+
+        system_printf("iptables -I HIPFW-INPUT -p 139 -j %s", fw_queue_target(4));
+        system_printf("iptables -I HIPFW-INPUT -p 50 -j %s", fw_esp_queue_target(4));
+        system_printf("iptables -I HIPFW-INPUT -p 17 --dport 10500 -j %s", fw_queue_target(4));
+        system_printf("iptables -I HIPFW-INPUT -p 17 --sport 10500 -j %s", fw_queue_target(4));
+
+        system_printf("iptables -I HIPFW-OUTPUT -p 139 -j %s", fw_queue_target(4));
+        system_printf("iptables -I HIPFW-OUTPUT -p 50 -j %s", fw_esp_queue_target(4));
+        system_printf("iptables -I HIPFW-OUTPUT -p 17 --dport 10500 -j %s", fw_queue_target(4));
+        system_printf("iptables -I HIPFW-OUTPUT -p 17 --sport 10500 -j %s", fw_queue_target(4));
+
+        system_printf("ip6tables -I HIPFW-FORWARD -p 139 -j %s", fw_queue_target(6));
+        system_printf("ip6tables -I HIPFW-FORWARD -p 50 -j %s", fw_esp_queue_target(6));
+        system_printf("ip6tables -I HIPFW-FORWARD -p 17 --dport 10500 -j %s", fw_queue_target(6));
+        system_printf("ip6tables -I HIPFW-FORWARD -p 17 --sport 10500 -j %s", fw_queue_target(6));
+
+        system_printf("ip6tables -I HIPFW-INPUT -p 139 -j %s", fw_queue_target(6));
+        system_printf("ip6tables -I HIPFW-INPUT -p 50 -j %s", fw_esp_queue_target(6));
+        system_printf("ip6tables -I HIPFW-INPUT -p 17 --dport 10500 -j %s", fw_queue_target(6));
+        system_printf("ip6tables -I HIPFW-INPUT -p 17 --sport 10500 -j %s", fw_queue_target(6));
+
+        system_printf("ip6tables -I HIPFW-OUTPUT -p 139 -j %s", fw_queue_target(6));
+        system_printf("ip6tables -I HIPFW-OUTPUT -p 50 -j %s", fw_esp_queue_target(6));
+        system_printf("ip6tables -I HIPFW-OUTPUT -p 17 --dport 10500 -j %s", fw_queue_target(6));
+        system_printf("ip6tables -I HIPFW-OUTPUT -p 17 --sport 10500 -j %s", fw_queue_target(6));
     }
 }
 
@@ -443,35 +581,35 @@ static void firewall_init_filter_traffic(void)
  */
 static void firewall_uninit_filter_traffic(void)
 {
-    system_print("iptables -D HIPFW-FORWARD -p 139 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-FORWARD -p 50 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-FORWARD -p 17 --dport 10500 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-FORWARD -p 17 --sport 10500 -j NFQUEUE --queue-num 0");
-
-    system_print("iptables -D HIPFW-INPUT -p 139 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-INPUT -p 50 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-INPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-INPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 0");
-
-    system_print("iptables -D HIPFW-OUTPUT -p 139 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-OUTPUT -p 50 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-OUTPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 0");
-    system_print("iptables -D HIPFW-OUTPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 0");
-
-    system_print("ip6tables -D HIPFW-FORWARD -p 139 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-FORWARD -p 50 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-FORWARD -p 17 --dport 10500 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-FORWARD -p 17 --sport 10500 -j NFQUEUE --queue-num 1");
-
-    system_print("ip6tables -D HIPFW-INPUT -p 139 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-INPUT -p 50 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-INPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-INPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 1");
-
-    system_print("ip6tables -D HIPFW-OUTPUT -p 139 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-OUTPUT -p 50 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-OUTPUT -p 17 --dport 10500 -j NFQUEUE --queue-num 1");
-    system_print("ip6tables -D HIPFW-OUTPUT -p 17 --sport 10500 -j NFQUEUE --queue-num 1");
+    system_printf("iptables -D HIPFW-FORWARD -p 139 -j %s", fw_queue_target(4));
+    system_printf("iptables -D HIPFW-FORWARD -p 50 -j %s", fw_esp_queue_target(4));
+    system_printf("iptables -D HIPFW-FORWARD -p 17 --dport 10500 -j %s", fw_queue_target(4));
+    system_printf("iptables -D HIPFW-FORWARD -p 17 --sport 10500 -j %s", fw_queue_target(4));
+
+    system_printf("iptables -D HIPFW-INPUT -p 139 -j %s", fw_queue_target(4));
+    system_printf("iptables -D HIPFW-INPUT -p 50 -j %s", fw_esp_queue_target(4));
+    system_printf("iptables -D HIPFW-INPUT -p 17 --dport 10500 -j %s", fw_queue_target(4));
+    system_printf("iptables -D HIPFW-INPUT -p 17 --sport 10500 -j %s", fw_queue_target(4));
+
+    system_printf("iptables -D HIPFW-OUTPUT -p 139 -j %s", fw_queue_target(4));
+    system_printf("iptables -D HIPFW-OUTPUT -p 50 -j %s", fw_esp_queue_target(4));
+    system_printf("iptables -D HIPFW-OUTPUT -p 17 --dport 10500 -j %s", fw_queue_target(4));
+    system_printf("iptables -D HIPFW-OUTPUT -p 17 --sport 10500 -j %s", fw_queue_target(4));
+
+    system_printf("ip6tables -D HIPFW-FORWARD -p 139 -j %s", fw_queue_target(6));
+    system_printf("ip6tables -D HIPFW-FORWARD -p 50 -j %s", fw_esp_queue_target(6));
+    system_printf("ip6tables -D HIPFW-FORWARD -p 17 --dport 10500 -j %s", fw_queue_target(6));
+    system_printf("ip6tables -D HIPFW-FORWARD -p 17 --sport 10500 -j %s", fw_queue_target(6));
+
+    system_printf("ip6tables -D HIPFW-INPUT -p 139 -j %s", fw_queue_target(6));
+    system_printf("ip6tables -D HIPFW-INPUT -p 50 -j %s", fw_esp_queue_target(6));
+    system_printf("ip6tables -D HIPFW-INPUT -p 17 --dport 10500 -j %s", fw_queue_target(6));
+    system_printf("ip6tables -D HIPFW-INPUT -p 17 --sport 10500 -j %s", fw_queue_target(6));
+
+    system_printf("ip6tables -D HIPFW-OUTPUT -p 139 -j %s", fw_queue_target(6));
+    system_printf("ip6tables -D HIPFW-OUTPUT -p 50 -j %s", fw_esp_queue_target(6));
+    system_printf("ip6tables -D HIPFW-OUTPUT -p 17 --dport 10500 -j %s", fw_queue_target(6));
+    system_printf("ip6tables -D HIPFW-OUTPUT -p 17 --sport 10500 -j %s", fw_queue_target(6));
 }
 
 /**
@@ -508,6 +646,7 @@ static int firewall_init_extensions(void)
     firewall_init_filter_traffic();
     // Initializing local cache database
     hipfw_cache_init_hldb();
+    HIP_IFEL(hipfw_pending_init(), -1, "failed to init pending packet queue\n");
     HIP_IFEL(fw_init_lsi_support(), -1, "failed to load extension\n");
     HIP_IFEL(fw_init_userspace_ipsec(), -1, "failed to load extension\n");
     HIP_IFEL(fw_init_esp_prot(), -1, "failed to load extension\n");
@@ -518,6 +657,11 @@ static int firewall_init_extensions(void)
 
     hip_fw_init_esp_relay();
 
+    // without packet accounting, ESP rule activity is read via iptables
+    if (esp_speedup && hipfw_nfacct_init()) {
+        HIP_INFO("Packet accounting unavailable, reading ESP rule counters via iptables\n");
+    }
+
     HIP_IFEL(cert_init(), -1, "failed to load extension (cert)\n");
 
     // Initializing local port cache database
@@ -592,7 +736,7 @@ static int query_default_local_hit_from_hipd(void)
     HIP_IFE(!(msg = hip_msg_alloc()), -1);
     HIP_IFEL(hip_build_user_hdr(msg, HIP_MSG_GET_DEFAULT_HIT, 0), -1,
              "build user hdr\n");
-    HIP_IFEL(hip_send_recv_daemon_info(msg, 0, hip_fw_sock), -1,
+    HIP_IFEL(hip_fw_send_recv_daemon_info(msg, 0), -1,
              "send/recv daemon info\n");
 
     HIP_IFE(!(param = hip_get_param(msg, HIP_PARAM_HIT)), -1);
@@ -645,13 +789,36 @@ static void fw_flush_iptables(void)
     system_print("ip6tables -X HIPFW-FORWARD 2> /dev/null");
 }
 
+/**
+ * Stop the worker threads of all netfilter queues. Blocks until every
+ * worker has finished the packet it is currently processing.
+ */
+static void fw_stop_queue_workers(void)
+{
+    unsigned int i;
+
+    if (!fw_queues) {
+        return;
+    }
+
+    for (i = 0; i < fw_queue_total; i++) {
+        if (fw_queues[i].thread_running) {
+            pthread_cancel(fw_queues[i].thread);
+            pthread_join(fw_queues[i].thread, NULL);
+            fw_queues[i].thread_running = false;
+        }
+    }
+}
+
 /**
  * Firewall signal handler (SIGINT, SIGTERM). Exit firewall gracefully
  * and clean up all packet capture rules.
  */
 static void firewall_exit(void)
 {
+    fw_stop_queue_workers();
     hipfw_cache_delete_hldb(1);
+    hipfw_pending_uninit();
     hip_port_bindings_uninit();
     fw_flush_iptables();
     /* rules have to be removed first, otherwise HIP packets won't pass through
@@ -661,6 +828,7 @@ static void firewall_exit(void)
     fw_uninit_esp_prot_conntrack();
     fw_uninit_lsi_support();
     hip_fw_uninit_conntrack();
+    hipfw_nfacct_uninit();
 
     hip_fw_uninit_esp_relay();
 
@@ -1349,30 +1517,34 @@ static int build_ipq_packet(struct nfq_data *nfa, struct hip_ipq_packet_msg *ptr
  * Unsupported types -> type 0
  *
  * @param  ctx        the context.
+ * @param  packet     storage for the packet meta data referenced by @a ctx
+ * @param  scratch    buffer of ::HIP_MAX_PACKET bytes for rewriting the packet
  * @param  nfa        a pointer to the netfilter packet.
  * @param  ip_version the IP version for this packet
  * @return            One if @c hdr is a HIP packet, zero otherwise.
  */
 static int fw_init_context(struct hip_fw_context *ctx,
+                           struct hip_ipq_packet_msg *packet,
+                           uint8_t *scratch,
                            struct nfq_data *nfa,
                            const int ip_version)
 {
     int err = 0;
     // length of packet starting at udp header
-    uint16_t                         udp_len              = 0;
-    struct udphdr                   *udphdr               = NULL;
-    int                              udp_encap_zero_bytes = 0;
-    static struct hip_ipq_packet_msg packet;
+    uint16_t       udp_len              = 0;
+    struct udphdr *udphdr               = NULL;
+    int            udp_encap_zero_bytes = 0;
 
     // same context memory as for packets before -> re-init
     memset(ctx, 0, sizeof(*ctx));
-    memset(&packet, 0, sizeof(packet));
+    memset(packet, 0, sizeof(*packet));
 
     // default assumption
-    ctx->packet_type = OTHER_PACKET;
+    ctx->packet_type    = OTHER_PACKET;
+    ctx->scratch_buffer = scratch;
 
     // add whole packet to context and ip version
-    ctx->ipq_packet = &packet;
+    ctx->ipq_packet = packet;
     build_ipq_packet(nfa, ctx->ipq_packet);
 
     // check if packet is to big for the buffer
@@ -1587,15 +1759,56 @@ static int fw_init_context(struct hip_fw_context *ctx,
     return err;
 }
 
+/**
+ * Send the verdict deferred by set_verdict() to the kernel. A single batch
+ * verdict covers all packets up to and including the last deferred one.
+ *
+ * @param queue the queue to flush
+ */
+static void flush_verdicts(struct hipfw_queue *const queue)
+{
+    if (queue->pending_count == 1) {
+        nfq_set_verdict(queue->q_handle, queue->pending_id,
+                        queue->pending_verdict, 0, NULL);
+    } else if (queue->pending_count > 1) {
+        nfq_set_verdict_batch(queue->q_handle, queue->pending_id,
+                              queue->pending_verdict);
+    }
+
+    queue->pending_count = 0;
+}
+
+/**
+ * Set the verdict for an unmodified packet. Packets are handled in the
+ * order of their IDs, so the verdict is deferred as long as subsequent
+ * packets receive the same verdict.
+ *
+ * @param queue     the queue the packet was received on
+ * @param packet_id the packet ID
+ * @param verdict   NF_ACCEPT or NF_DROP
+ */
+static void set_verdict(struct hipfw_queue *const queue,
+                        const uint32_t packet_id,
+                        const uint32_t verdict)
+{
+    if (queue->pending_count > 0 && queue->pending_verdict != verdict) {
+        flush_verdicts(queue);
+    }
+
+    queue->pending_verdict = verdict;
+    queue->pending_id      = packet_id;
+    queue->pending_count++;
+}
+
 /**
  * Allow a packet to pass
  *
- * @param handle    the handle for the packets.
+ * @param queue     the queue the packet was received on
  * @param packet_id the packet ID.
  */
-static void allow_packet(struct nfq_q_handle *handle, unsigned long packet_id)
+static void allow_packet(struct hipfw_queue *const queue, const uint32_t packet_id)
 {
-    nfq_set_verdict(handle, packet_id, NF_ACCEPT, 0, NULL);
+    set_verdict(queue, packet_id, NF_ACCEPT);
 
     HIP_DEBUG("Packet accepted \n\n");
 }
@@ -1603,12 +1816,12 @@ static void allow_packet(struct nfq_q_handle *handle, unsigned long packet_id)
 /**
  * Drop a packet
  *
- * @param handle    the handle for the packets.
+ * @param queue     the queue the packet was received on
  * @param packet_id the packet ID.
  */
-static void drop_packet(struct nfq_q_handle *handle, unsigned long packet_id)
+static void drop_packet(struct hipfw_queue *const queue, const uint32_t packet_id)
 {
-    nfq_set_verdict(handle, packet_id, NF_DROP, 0, NULL);
+    set_verdict(queue, packet_id, NF_DROP);
 
     HIP_DEBUG("Packet dropped \n\n");
 }
@@ -1620,76 +1833,200 @@ static void drop_packet(struct nfq_q_handle *handle, unsigned long packet_id)
  * @param qh         the netfilter queue handle
  * @param nfmsg      the netfilter message
  * @param nfa        the netfilter packet, header and payload
- * @param data       custom data given to the callback
- * @param ip_version the IP version used
+ * @param data       the queue (struct hipfw_queue) the packet was received on
  */
 static int fw_handle_packet(struct nfq_q_handle *qh, UNUSED struct nfgenmsg *nfmsg,
-                            struct nfq_data *nfa, UNUSED void *data, const int ip_version)
+                            struct nfq_data *nfa, void *data)
 {
-    static struct hip_fw_context ctx;   // static because of heavy re-use.
+    struct hipfw_queue *const    queue   = data;
+    struct hip_fw_context *const ctx     = &queue->ctx; // re-used per queue
     int                          verdict = 0; // assume DROP
 
-    HIP_DEBUG("Entering netfilter callback for IPv%d\n", ip_version);
+    HIP_DEBUG("Entering netfilter callback for IPv%d (queue %u)\n",
+              queue->ip_version, queue->num);
 
     // set up firewall context
-    if (fw_init_context(&ctx, nfa, ip_version)) {
+    if (fw_init_context(ctx, &queue->packet, queue->scratch, nfa,
+                        queue->ip_version)) {
         goto out_err;
     }
 
-    HIP_DEBUG("packet hook=%d, packet type=%d\n", ctx.ipq_packet->hook,
-              ctx.packet_type);
+    HIP_DEBUG("packet hook=%d, packet type=%d\n", ctx->ipq_packet->hook,
+              ctx->packet_type);
 
     // match context with rules
-    if (fw_handlers[ctx.ipq_packet->hook][ctx.packet_type]) {
-        verdict = (fw_handlers[ctx.ipq_packet->hook][ctx.packet_type])(&ctx);
+    if (fw_handlers[ctx->ipq_packet->hook][ctx->packet_type]) {
+        verdict = (fw_handlers[ctx->ipq_packet->hook][ctx->packet_type])(ctx);
     } else {
         HIP_DEBUG("Ignoring, no handler for hook (%d) with type (%d)\n",
-            ctx.ipq_packet->hook, ctx.packet_type);
+            ctx->ipq_packet->hook, ctx->packet_type);
     }
 
 out_err:
     if (verdict) {
-        if (ctx.modified == 0) {
+        if (ctx->modified == 0) {
             HIP_DEBUG("=== Verdict: allow packet ===\n");
-            allow_packet(qh, ctx.ipq_packet->packet_id);
+            allow_packet(queue, ctx->ipq_packet->packet_id);
         } else {
             HIP_DEBUG("=== Verdict: allow modified packet ===\n");
-            allow_modified_packet(qh, &ctx);
+            // a batch verdict must not cover the modified packet
+            flush_verdicts(queue);
+            allow_modified_packet(qh, ctx);
         }
     } else {
         HIP_DEBUG("=== Verdict: drop packet ===\n");
-        drop_packet(qh, ctx.ipq_packet->packet_id);
+        drop_packet(queue, ctx->ipq_packet->packet_id);
     }
 
     return 0;
 }
 
 /**
- * Wrapper to call the packet handling function as IPv6
+ * Receive up to ::HIPFW_QUEUE_BATCH pending packets on a queue with a single
+ * system call, pass them to fw_handle_packet() and send their verdicts.
  *
- * @param qh         the netfilter queue handle
- * @param nfmsg      the netfilter message
- * @param nfa        the netfilter packet, header and payload
- * @param data       custom data given to the callback
+ * @param queue the queue to read from
+ * @param flags flags for recvmmsg(), e.g. MSG_DONTWAIT or MSG_WAITFORONE
+ * @return      zero on success, an errno value if reading failed
  */
-static int netfilter_callback_ipv4(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg,
-                                   struct nfq_data *nfa, void *data)
+static int fw_read_queue(struct hipfw_queue *const queue, const int flags)
 {
-    return fw_handle_packet(qh, nfmsg, nfa, data, 4);
+    int i, count;
+
+    memset(queue->msgs, 0, sizeof(queue->msgs));
+    for (i = 0; i < HIPFW_QUEUE_BATCH; i++) {
+        queue->iov[i].iov_base            = queue->buf[i];
+        queue->iov[i].iov_len             = sizeof(queue->buf[i]);
+        queue->msgs[i].msg_hdr.msg_iov    = &queue->iov[i];
+        queue->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* workers may only be cancelled while waiting for packets, never while
+     * holding a lock inside a packet handler */
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    count = recvmmsg(queue->fd, queue->msgs, HIPFW_QUEUE_BATCH, flags, NULL);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    if (count == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        HIP_PERROR("Error reading packet from netfilter queue.\n");
+        return errno;
+    }
+
+    HIP_DEBUG("received %d IPv%d packets from queue %u\n",
+              count, queue->ip_version, queue->num);
+
+    for (i = 0; i < count; i++) {
+        if (queue->msgs[i].msg_len > 0) {
+            nfq_handle_packet(queue->handle, queue->buf[i],
+                              queue->msgs[i].msg_len);
+        }
+    }
+
+    // send the ESP packets built for this burst
+    if (hip_userspace_ipsec) {
+        hip_fw_userspace_ipsec_flush_output();
+    }
+
+    flush_verdicts(queue);
+
+    return 0;
 }
 
 /**
- * Wrapper to call the packet handling function as IPv6
+ * Worker thread serving a single netfilter queue. Workers only touch their
+ * own queue state; the firewall modules they call into protect shared state
+ * themselves.
  *
- * @param qh         the netfilter queue handle
- * @param nfmsg      the netfilter message
- * @param nfa        the netfilter packet, header and payload
- * @param data       custom data given to the callback
+ * @param arg the queue (struct hipfw_queue) to serve
+ * @return    NULL
  */
-static int netfilter_callback_ipv6(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg,
-                                   struct nfq_data *nfa, void *data)
+static void *fw_queue_worker(void *arg)
 {
-    return fw_handle_packet(qh, nfmsg, nfa, data, 6);
+    struct hipfw_queue *const queue = arg;
+    sigset_t                  signals;
+
+    /* termination signals are handled by the main thread */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    HIP_DEBUG("worker for IPv%d queue %u running\n",
+              queue->ip_version, queue->num);
+
+    while (1) {
+        if (fw_read_queue(queue, MSG_WAITFORONE) == ENOBUFS) {
+            HIP_ERROR("queue %u: kernel dropped packets, consider more queues\n",
+                      queue->num);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Open one netfilter queue.
+ *
+ * @param queue      the queue state to initialize
+ * @param num        the netfilter queue number
+ * @param ip_version the IP version of the packets on this queue
+ * @param copy_range the number of bytes of each packet copied to userspace
+ * @return           zero on success, -1 on error
+ */
+static int fw_open_queue(struct hipfw_queue *const queue,
+                         const unsigned int num,
+                         const int ip_version,
+                         const unsigned int copy_range)
+{
+    const int af  = ip_version == 4 ? AF_INET : AF_INET6;
+    int       err = 0;
+
+    queue->num        = num;
+    queue->ip_version = ip_version;
+    queue->copy_range = copy_range;
+
+    HIP_IFEL(!(queue->handle = nfq_open()), -1,
+             "nfq_open(): Error during nfq_open(), IPv%d\n", ip_version);
+    // Unbinding any previous handlers
+    HIP_IFEL(nfq_unbind_pf(queue->handle, af) < 0, -1,
+             "nfq_unbind(): Error during Netfilter initialization (IPv%d). "
+             "Is the obsolete 'ip_queue' kernel module loaded?\n", ip_version);
+    HIP_IFEL(nfq_bind_pf(queue->handle, af) < 0, -1,
+             "nfq_bind(): Error during nfq_bind(), IPv%d\n", ip_version);
+    HIP_IFEL(!(queue->q_handle = nfq_create_queue(queue->handle, num,
+                                                  &fw_handle_packet, queue)),
+             -1, "nfq_create_queue(): Error creating queue %u\n", num);
+    HIP_IFEL(nfq_set_mode(queue->q_handle, NFQNL_COPY_PACKET, copy_range) == -1,
+             -1, "nfq_set_mode(): Error during nfq_set_mode(), queue %u\n", num);
+    HIP_IFEL(!(queue->fd = nfq_fd(queue->handle)), -1,
+             "nfq_fd(): Unable to get file descriptor, queue %u\n", num);
+
+    HIP_DEBUG("IPv%d queue %u created (mode COPY_PACKET, %u bytes)\n",
+              ip_version, num, copy_range);
+
+out_err:
+    return err;
+}
+
+/**
+ * Close a netfilter queue opened with fw_open_queue().
+ *
+ * @param queue the queue to close
+ */
+static void fw_close_queue(struct hipfw_queue *const queue)
+{
+    if (queue->q_handle) {
+        nfq_destroy_queue(queue->q_handle);
+        queue->q_handle = NULL;
+    }
+    if (queue->handle) {
+        nfq_close(queue->handle);
+        queue->handle = NULL;
+    }
 }
 
 /**
@@ -1797,7 +2134,10 @@ static void fw_wait_for_hipd(void)
 }
 
 /**
- * Main function that starts the single-threaded hipfw process.
+ * Main function that starts the hipfw process. With more than one queue per
+ * address family (see ::hipfw_queue_count), packets are processed by one
+ * worker thread per queue while the main thread serves hipd and runs the
+ * periodic maintenance tasks.
  *
  * @param rule_file          Initial firewall rules are read from this file.
  * @param kill_old           If another hipfw instance is currently running,
@@ -1811,16 +2151,13 @@ int hipfw_main(const char *const rule_file,
                const bool        kill_old,
                const bool        limit_capabilities)
 {
-    int                  err   = 0, highest_descriptor, i;
-    struct nfq_handle   *h4    = NULL, *h6    = NULL;
-    struct nfq_q_handle *h4_q  = NULL, *h6_q  = NULL;
-    int                  h4_fd = 0,     h6_fd = 0;
-    int                  nfq_packet_length;
-    struct hip_common   *msg       = NULL;
-    struct sockaddr_in6  sock_addr = { 0 };
-    fd_set               read_fdset;
-    struct timeval       timeout;
-    char                 buf[HIP_MAX_PACKET];
+    int                 err = 0, highest_descriptor, i;
+    unsigned int        q;
+    bool                threaded  = hipfw_queue_count > 1;
+    struct hip_common  *msg       = NULL;
+    struct sockaddr_in6 sock_addr = { 0 };
+    fd_set              read_fdset;
+    struct timeval      timeout;
 
 #ifdef CONFIG_HIP_PERFORMANCE
     HIP_DEBUG("Creating perf set\n");
@@ -1897,39 +2234,22 @@ int hipfw_main(const char *const rule_file,
     firewall_increase_netlink_buffers();
     firewall_probe_kernel_modules();
 
-    // create firewall queue handles for IPv4 traffic
-    HIP_IFEL(!(h4 = nfq_open()), -1,
-             "nfq_open(): %s\n", "Error during nfq_open(), IPv4");
-    HIP_IFEL((nfq_unbind_pf(h4, AF_INET) < 0), -1,
-             "nfq_unbind(): %s\n", "Error during Netfilter initialization (IPv4). Is the obsolete 'ip_queue' kernel module loaded?"); // Unbinding any previous handlers
-    HIP_IFEL((nfq_bind_pf(h4, AF_INET) < 0), -1,
-             "nfq_bind(): %s\n", "Error during nfq_bind(), IPv4");
-    HIP_IFEL(!(h4_q = nfq_create_queue(h4, 0, &netfilter_callback_ipv4, NULL)), -1,
-             "nfq_create_queue(): %s\n", "Error during nfq_create_queue(), IPv4");
-    HIP_IFEL(nfq_set_mode(h4_q, NFQNL_COPY_PACKET, HIP_MAX_PACKET) == -1, -1,
-             "nfq_set_mode(): %s\n", "Error during nfq_set_mode(), IPv4");
-    HIP_DEBUG("IPv4 handle created (mode COPY_PACKET)\n");
-
-    // create firewall queue handles for IPv6 traffic
-    HIP_IFEL(!(h6 = nfq_open()), -1,
-             "nfq_open(): %s\n", "Error during nfq_open(), IPv6");
-    HIP_IFEL((nfq_unbind_pf(h6, AF_INET6) < 0), -1,
-             "nfq_unbind(): %s\n", "Error during Netfilter initialization (IPv6). Is the obsolete 'ip6_queue' kernel module loaded?"); // Unbinding any previous handlers
-    HIP_IFEL((nfq_bind_pf(h6, AF_INET6) < 0), -1,
-             "nfq_bind(): %s\n", "Error during nfq_bind(), IPv6");
-    HIP_IFEL(!(h6_q = nfq_create_queue(h6, 1, &netfilter_callback_ipv6, NULL)), -1,
-             "nfq_create_queue(): %s\n", "Error during nfq_create_queue(), IPv6");
-    HIP_IFEL(nfq_set_mode(h6_q, NFQNL_COPY_PACKET, HIP_MAX_PACKET) == -1, -1,
-             "nfq_set_mode(): %s\n", "Error during nfq_set_mode(), IPv6");
-    HIP_DEBUG("IPv6 handle created (mode COPY_PACKET)\n");
-
-    // Create file handles for the queues
-    HIP_IFEL(!(h4_fd = nfq_fd(h4)), -1,
-             "nfq_fd(): %s\n", "Unable to get file descriptor, IPv4");
-    HIP_DEBUG("IPv4 file descriptor created\n");
-    HIP_IFEL(!(h6_fd = nfq_fd(h6)), -1,
-             "nfq_fd(): %s\n", "Unable to get file descriptor, IPv6");
-    HIP_DEBUG("IPv6 file descriptor created\n");
+    // the ESP handlers only look at the headers unless one of these is on
+    fw_esp_header_only = filter_traffic && !esp_relay &&
+                         !hip_userspace_ipsec && !hip_esp_protection;
+
+    // create firewall queue handles, IPv4 queues first
+    fw_queue_total = (fw_esp_header_only ? 4 : 2) * hipfw_queue_count;
+    HIP_IFEL(!(fw_queues = calloc(fw_queue_total, sizeof(*fw_queues))), -1,
+             "Insufficient memory for %u queues\n", fw_queue_total);
+    for (q = 0; q < fw_queue_total; q++) {
+        const int ip_version = (q / hipfw_queue_count) % 2 ? 6 : 4;
+
+        HIP_IFEL(fw_open_queue(&fw_queues[q], q, ip_version,
+                               q < 2 * hipfw_queue_count ? HIP_MAX_PACKET
+                                                         : HIPFW_ESP_COPY_RANGE),
+                 -1, "Failed to open netfilter queue %u\n", q);
+    }
 
     // set up ip(6)tables rules and firewall extensions
     HIP_IFEL(firewall_init(), -1, "Firewall init failed\n");
@@ -1940,8 +2260,22 @@ int hipfw_main(const char *const rule_file,
     }
 #endif /* CONFIG_HIP_ANDROID */
 
-    highest_descriptor = hip_fw_async_sock > h4_fd ? hip_fw_async_sock : h4_fd;
-    highest_descriptor = h6_fd > highest_descriptor ? h6_fd : highest_descriptor;
+    highest_descriptor = hip_fw_async_sock;
+    if (threaded) {
+        for (q = 0; q < fw_queue_total; q++) {
+            HIP_IFEL(pthread_create(&fw_queues[q].thread, NULL,
+                                    fw_queue_worker, &fw_queues[q]),
+                     -1, "Failed to start worker for queue %u\n", q);
+            fw_queues[q].thread_running = true;
+        }
+        HIP_DEBUG("%u queue workers started\n", fw_queue_total);
+    } else {
+        for (q = 0; q < fw_queue_total; q++) {
+            if (fw_queues[q].fd > highest_descriptor) {
+                highest_descriptor = fw_queues[q].fd;
+            }
+        }
+    }
 
     /* Allocate message. */
     HIP_IFEL(!(msg = hip_msg_alloc()), -1, "Insufficient memory\n");
@@ -1957,8 +2291,11 @@ int hipfw_main(const char *const rule_file,
         // set up file descriptors for select
         FD_ZERO(&read_fdset);
         FD_SET(hip_fw_async_sock, &read_fdset);
-        FD_SET(h4_fd, &read_fdset);
-        FD_SET(h6_fd, &read_fdset);
+        if (!threaded) {
+            for (q = 0; q < fw_queue_total; q++) {
+                FD_SET(fw_queues[q].fd, &read_fdset);
+            }
+        }
 
         timeout.tv_sec  = HIP_SELECT_TIMEOUT;
         timeout.tv_usec = 0;
@@ -1971,25 +2308,11 @@ int hipfw_main(const char *const rule_file,
             continue;
         }
 
-        if (FD_ISSET(h4_fd, &read_fdset)) {
-            nfq_packet_length = recv(h4_fd, buf, HIP_MAX_PACKET, 0);
-            if (nfq_packet_length == -1) {
-                err = errno;
-                HIP_PERROR("Error reading received IPv4 packet.\n");
-            } else if (nfq_packet_length > 0) {
-                HIP_DEBUG("received IPv4 packet from iptables queue\n");
-                err = nfq_handle_packet(h4, buf, nfq_packet_length);
-            }
-        }
-
-        if (FD_ISSET(h6_fd, &read_fdset)) {
-            nfq_packet_length = recv(h6_fd, buf, HIP_MAX_PACKET, 0);
-            if (nfq_packet_length == -1) {
-                err = errno;
-                HIP_PERROR("Error reading received IPv6 packet.\n");
-            } else if (nfq_packet_length > 0) {
-                HIP_DEBUG("received IPv6 packet from iptables queue\n");
-                err = nfq_handle_packet(h6, buf, nfq_packet_length);
+        if (!threaded) {
+            for (q = 0; q < fw_queue_total; q++) {
+                if (FD_ISSET(fw_queues[q].fd, &read_fdset)) {
+                    err = fw_read_queue(&fw_queues[q], MSG_DONTWAIT);
+                }
             }
         }
 
@@ -2000,20 +2323,19 @@ int hipfw_main(const char *const rule_file,
 
         hipfw_midauth_update_nonces();
         hip_fw_conntrack_periodic_cleanup();
+        hipfw_pending_expire();
+
+        if (hip_esp_protection) {
+            esp_prot_periodic_refill();
+        }
     }
 
 out_err:
-    if (h4_q) {
-        nfq_destroy_queue(h4_q);
-    }
-    if (h4) {
-        nfq_close(h4);
-    }
-    if (h6_q) {
-        nfq_destroy_queue(h6_q);
-    }
-    if (h6) {
-        nfq_close(h6);
+    if (fw_queues) {
+        fw_stop_queue_workers();
+        for (q = 0; q < fw_queue_total; q++) {
+            fw_close_queue(&fw_queues[q]);
+        }
     }
     if (hip_fw_async_sock) {
         close(hip_fw_async_sock);
@@ -2024,6 +2346,9 @@ out_err:
     free(msg);
 
     firewall_exit();
+    free(fw_queues);
+    fw_queues      = NULL;
+    fw_queue_total = 0;
     return err;
 }
 
@@ -2038,14 +2363,18 @@ out_err:
  */
 hip_hit_t *hip_fw_get_default_hit(void)
 {
+    hip_hit_t *hit = &default_hit;
+
+    pthread_mutex_lock(&default_id_lock);
     // only query for default hit if global variable is not set
     if (ipv6_addr_is_null(&default_hit)) {
         if (query_default_local_hit_from_hipd()) {
-            return NULL;
+            hit = NULL;
         }
     }
+    pthread_mutex_unlock(&default_id_lock);
 
-    return &default_hit;
+    return hit;
 }
 
 /**
@@ -2057,14 +2386,18 @@ hip_hit_t *hip_fw_get_default_hit(void)
  */
 hip_lsi_t *hip_fw_get_default_lsi(void)
 {
+    hip_lsi_t *lsi = &default_lsi;
+
+    pthread_mutex_lock(&default_id_lock);
     // only query for default lsi if global variable is not set
     if (default_lsi.s_addr == 0) {
         if (query_default_local_hit_from_hipd()) {
-            return NULL;
+            lsi = NULL;
         }
     }
+    pthread_mutex_unlock(&default_id_lock);
 
-    return &default_lsi;
+    return lsi;
 }
 
 /**
@@ -2094,3 +2427,25 @@ int hip_fw_send_message(const struct hip_common *const msg,
 
     return 0;
 }
+
+/**
+ * Send a request to hipd over the request/response socket and, unless
+ * @a send_only is set, wait for the response. Requests from concurrent
+ * queue workers are serialized so that every worker receives the
+ * response to its own request.
+ *
+ * @param msg       the request; overwritten with the response
+ * @param send_only 1 if no response is expected, 0 otherwise
+ * @return          zero on success, non-zero on error
+ */
+int hip_fw_send_recv_daemon_info(struct hip_common *const msg,
+                                 const int send_only)
+{
+    int err;
+
+    pthread_mutex_lock(&hip_fw_sock_lock);
+    err = hip_send_recv_daemon_info(msg, send_only, hip_fw_sock);
+    pthread_mutex_unlock(&hip_fw_sock_lock);
+
+    return err;
+}
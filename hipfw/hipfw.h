@@ -30,6 +30,8 @@
 
 #include "libcore/protodefs.h"
 
+/** upper limit for the number of netfilter queues per address family */
+#define HIPFW_MAX_QUEUE_COUNT 64
 
 extern int accept_normal_traffic_by_default;
 extern int accept_hip_esp_traffic_by_default;
@@ -42,9 +44,9 @@ extern int hip_kernel_ipsec_fallback;
 extern int hip_lsi_support;
 extern int esp_relay;
 extern int hip_esp_protection;
-extern int hip_fw_sock;
 extern int system_based_opp_mode;
 extern int esp_speedup;
+extern unsigned int hipfw_queue_count;
 
 int hipfw_main(const char *const rule_file,
                const bool        kill_old,
@@ -55,5 +57,7 @@ hip_hit_t *hip_fw_get_default_hit(void);
 hip_lsi_t *hip_fw_get_default_lsi(void);
 int hip_fw_send_message(const struct hip_common *const msg,
                         const struct sockaddr *const addr);
+int hip_fw_send_recv_daemon_info(struct hip_common *const msg,
+                                 const int send_only);
 
 #endif /* HIPL_HIPFW_FIREWALL_H */
@@ -47,6 +47,7 @@
 #include "cache.h"
 #include "conntrack.h"
 #include "hipfw.h"
+#include "lsi.h"
 #include "user_ipsec_fw_msg.h"
 #include "user_ipsec_sadb.h"
 #include "hipfw_control.h"
@@ -60,9 +61,10 @@
  */
 static int handle_bex_state_update(struct hip_common *msg)
 {
-    const struct in6_addr       *src_hit = NULL, *dst_hit = NULL;
-    const struct hip_tlv_common *param   = NULL;
-    int                          err     = 0, msg_type = 0;
+    const struct in6_addr          *src_hit = NULL, *dst_hit = NULL;
+    const struct hip_tlv_common    *param   = NULL;
+    struct hip_hadb_user_info_state entry;
+    int                             err = 0, msg_type = 0;
 
     msg_type = hip_get_msg_type(msg);
 
@@ -81,6 +83,10 @@ static int handle_bex_state_update(struct hip_common *msg)
     case HIP_MSG_FW_BEX_DONE:
         err = hipfw_cache_set_bex_state(src_hit, dst_hit,
                                         HIP_STATE_ESTABLISHED);
+        if (!err && !hipfw_cache_db_match(src_hit, dst_hit, FW_CACHE_HIT,
+                                          &entry)) {
+            hip_fw_flush_outgoing_lsi(&entry);
+        }
         break;
     case HIP_MSG_FW_UPDATE_DB:
         err = hipfw_cache_set_bex_state(src_hit, dst_hit,
@@ -92,6 +98,29 @@ static int handle_bex_state_update(struct hip_common *msg)
     return err;
 }
 
+/**
+ * Reinject the packets that waited for the host associations which a
+ * HIP_MSG_FW_HA_UPDATE message reports as established.
+ *
+ * @param msg the message with one or more HIP_PARAM_HA_INFO parameters
+ */
+static void flush_established_lsi(const struct hip_common *msg)
+{
+    const struct hip_tlv_common           *param = NULL;
+    const struct hip_hadb_user_info_state *ha    = NULL;
+
+    while ((param = hip_get_next_param(msg, param))) {
+        if (hip_get_param_type(param) != HIP_PARAM_HA_INFO) {
+            continue;
+        }
+        ha = hip_get_param_contents_direct(param);
+
+        if (ha->state == HIP_STATE_ESTABLISHED) {
+            hip_fw_flush_outgoing_lsi(ha);
+        }
+    }
+}
+
 /**
  * distribute a user message to the respective extension handler
  *
@@ -117,6 +146,18 @@ int hip_handle_msg(struct hip_common *msg, struct sockaddr *addr)
             handle_bex_state_update(msg);
         }
         break;
+    case HIP_MSG_FW_HA_UPDATE:
+        if (hip_lsi_support) {
+            HIP_IFEL(hipfw_cache_handle_ha_update(msg), -1,
+                     "Failed to update HA cache\n");
+            flush_established_lsi(msg);
+        }
+        break;
+    case HIP_MSG_FW_HA_DELETE:
+        if (hip_lsi_support) {
+            hipfw_cache_handle_ha_delete(msg);
+        }
+        break;
     case HIP_MSG_IPSEC_ADD_SA:
         HIP_DEBUG("Received add sa request from hipd\n");
         HIP_IFEL(handle_sa_add_request(msg), -1,
@@ -92,6 +92,9 @@ struct hip_fw_context {
     struct udphdr *udp_encap_hdr;
 
     int modified;
+
+    // buffer of ::HIP_MAX_PACKET bytes for rewriting the packet (optional)
+    uint8_t *scratch_buffer;
 };
 
 /********** State table structures **************/
@@ -102,6 +105,7 @@ struct esp_address {
     // that announced this address.
     // when ack with the update id is seen all esp_addresses with
     // NULL update_id can be removed.
+    uint32_t rule_id;           // id of the ESP speedup rule, 0 if there is none
 };
 
 struct esp_tuple {
@@ -165,6 +169,8 @@ struct connection {
     int          verify_responder;
     int          state;
     time_t       timestamp;
+    /* link in the list of connections ordered by timestamp (conntrack.c) */
+    struct dlist *conn_link;
     /* members needed for iptables setup */
     bool udp_encap;         /**< UDP encapsulation enabled? (NAT extension) */
     /* members needed for ESP protection extension */
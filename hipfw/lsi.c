@@ -65,6 +65,7 @@
 #include "port_bindings.h"
 #include "hipfw.h"
 #include "lsi.h"
+#include "pending_queue.h"
 #include "reinject.h"
 
 
@@ -297,14 +298,14 @@ int hip_fw_handle_incoming_hit(const hip_ipq_packet_msg *m,
                                const struct in6_addr *ip_dst,
                                const int lsi_support)
 {
-    int                              err          = 0;
-    int                              verdict      = 1;
-    int                              ip_hdr_size  = 0;
-    int                              port_dest    = 0;
-    struct hip_hadb_user_info_state *entry        = NULL;
-    enum hip_port_binding            port_binding = HIP_PORT_INFO_UNKNOWN;
-    const struct ip6_hdr            *ip6_hdr      = NULL;
-    struct in6_addr                  src_addr, dst_addr;
+    int                             err          = 0;
+    int                             verdict      = 1;
+    int                             ip_hdr_size  = 0;
+    int                             port_dest    = 0;
+    enum hip_port_binding           port_binding = HIP_PORT_INFO_UNKNOWN;
+    const struct ip6_hdr           *ip6_hdr      = NULL;
+    struct hip_hadb_user_info_state entry;
+    struct in6_addr                 src_addr, dst_addr;
 
     ip6_hdr     = (const struct ip6_hdr *) m->payload;
     ip_hdr_size = sizeof(struct ip6_hdr);
@@ -333,16 +334,16 @@ int hip_fw_handle_incoming_hit(const hip_ipq_packet_msg *m,
     } else if (port_binding == HIP_PORT_INFO_IPV6UNBOUND) {
         HIP_DEBUG("Port %d is unbound or bound to an IPv4 address -> looking up in cache\n",
                   port_dest);
-        HIP_IFEL(!(entry = hipfw_cache_db_match(ip_dst, ip_src, FW_CACHE_HIT, 1)),
+        HIP_IFEL(hipfw_cache_db_match(ip_dst, ip_src, FW_CACHE_HIT, &entry),
                  -1, "Failed to obtain from cache\n");
 
         /* Currently preferring LSIs over opp. connections */
         if (lsi_support) {
             HIP_DEBUG("Trying lsi transformation\n");
-            HIP_DEBUG_LSI("lsi_our: ", &entry->lsi_our);
-            HIP_DEBUG_LSI("lsi_peer: ", &entry->lsi_peer);
-            IPV4_TO_IPV6_MAP(&entry->lsi_our, &dst_addr);
-            IPV4_TO_IPV6_MAP(&entry->lsi_peer, &src_addr);
+            HIP_DEBUG_LSI("lsi_our: ", &entry.lsi_our);
+            HIP_DEBUG_LSI("lsi_peer: ", &entry.lsi_peer);
+            IPV4_TO_IPV6_MAP(&entry.lsi_our, &dst_addr);
+            IPV4_TO_IPV6_MAP(&entry.lsi_peer, &src_addr);
             HIP_IFEL(reinject_packet(&src_addr, &dst_addr, m, 6, 1), -1,
                      "Failed to reinject with LSIs\n");
             HIP_DEBUG("Successful LSI transformation.\n");
@@ -354,9 +355,9 @@ int hip_fw_handle_incoming_hit(const hip_ipq_packet_msg *m,
             }
         } else {
             HIP_DEBUG("Trying sys opp transformation\n");
-            HIP_DEBUG_IN6ADDR("ip_src: ", &entry->ip_peer);
-            HIP_DEBUG_IN6ADDR("ip_dst: ", &entry->ip_our);
-            HIP_IFEL(reinject_packet(&entry->ip_peer, &entry->ip_our, m, 6, 1),
+            HIP_DEBUG_IN6ADDR("ip_src: ", &entry.ip_peer);
+            HIP_DEBUG_IN6ADDR("ip_dst: ", &entry.ip_our);
+            HIP_IFEL(reinject_packet(&entry.ip_peer, &entry.ip_our, m, 6, 1),
                      -1, "Failed to reinject with IP addrs\n");
             HIP_DEBUG("Successfull sysopp transformation. Drop orig\n");
             verdict = 0;
@@ -376,8 +377,9 @@ out_err:
 
 /**
  * Checks if the outgoing packet with lsis has already ESTABLISHED the Base Exchange
- * with the peer host. In case the BEX is not done, it triggers it. Otherwise, it looks up
- * in the local database the necessary information for doing the packet reinjection with HITs.
+ * with the peer host. In case the BEX is not done, it queues the packet and triggers
+ * the BEX. Otherwise, it looks up in the local database the necessary information for
+ * doing the packet reinjection with HITs.
  *
  * @param m           pointer to the packet
  * @param lsi_src     source LSI
@@ -388,15 +390,43 @@ int hip_fw_handle_outgoing_lsi(hip_ipq_packet_msg *m, struct in_addr *lsi_src,
                                struct in_addr *lsi_dst)
 {
     int                              err        = 0;
+    int                              queued     = 0;
+    int                              enqueued   = 0;
     struct hip_hadb_user_info_state *entry_peer = NULL;
+    struct hip_hadb_user_info_state  entry;
+    struct in6_addr                  src_addr, dst_addr;
 
     if (lsi_dst) {
         HIP_DEBUG_LSI("lsi dst", lsi_dst);
     }
 
-    entry_peer = hipfw_cache_db_match(lsi_src, lsi_dst, FW_CACHE_LSI, 1);
+    if (!hipfw_cache_db_match(lsi_src, lsi_dst, FW_CACHE_LSI, &entry)) {
+        entry_peer = &entry;
+    }
+
+    if (!entry_peer || entry_peer->state != HIP_STATE_ESTABLISHED) {
+        /* the BEX has already been triggered if other packets are waiting */
+        IPV4_TO_IPV6_MAP(lsi_src, &src_addr);
+        IPV4_TO_IPV6_MAP(lsi_dst, &dst_addr);
+        enqueued = hipfw_pending_enqueue(&src_addr, &dst_addr, m);
+        queued   = enqueued == 0;
+
+        /* The BEX may have completed after the lookup above and its queue
+         * may have been flushed before the packet was added. The cache is
+         * updated before the queue is flushed, so looking again catches
+         * this case. */
+        if (enqueued >= 0 &&
+            !hipfw_cache_db_match(lsi_src, lsi_dst, FW_CACHE_LSI, &entry) &&
+            entry.state == HIP_STATE_ESTABLISHED) {
+            HIP_DEBUG("BEX completed meanwhile, releasing queued packets\n");
+            hip_fw_flush_outgoing_lsi(&entry);
+            queued = 1;
+        }
+    }
 
-    if (!entry_peer) {
+    if (queued) {
+        HIP_DEBUG("Packet queued for pending BEX\n");
+    } else if (!entry_peer) {
         HIP_IFEL(hip_trigger_bex(NULL, NULL, lsi_src, lsi_dst, NULL, NULL),
                  -1, "Base Exchange Trigger failed\n");
     } else if (entry_peer->state == HIP_STATE_NONE ||
@@ -417,3 +447,35 @@ int hip_fw_handle_outgoing_lsi(hip_ipq_packet_msg *m, struct in_addr *lsi_src,
 out_err:
     return err;
 }
+
+/**
+ * Reinjects a packet queued for a pending BEX with HITs.
+ *
+ * @param packet the queued LSI-based packet
+ * @param arg    the established host association
+ */
+static void pending_lsi_output(const hip_ipq_packet_msg *packet, void *arg)
+{
+    const struct hip_hadb_user_info_state *ha = arg;
+
+    if (reinject_packet(&ha->hit_our, &ha->hit_peer, packet, 4, 0)) {
+        HIP_ERROR("Failed to reinject pending packet\n");
+    }
+}
+
+/**
+ * Reinjects the outgoing packets that were queued while the BEX for a pair
+ * of LSIs was in flight.
+ *
+ * @param ha the now established host association
+ */
+void hip_fw_flush_outgoing_lsi(const struct hip_hadb_user_info_state *ha)
+{
+    struct hip_hadb_user_info_state established = *ha;
+    struct in6_addr                 src_addr, dst_addr;
+
+    IPV4_TO_IPV6_MAP(&ha->lsi_our, &src_addr);
+    IPV4_TO_IPV6_MAP(&ha->lsi_peer, &dst_addr);
+
+    hipfw_pending_flush(&src_addr, &dst_addr, pending_lsi_output, &established);
+}
@@ -32,6 +32,7 @@
 #include <libnetfilter_queue/libnetfilter_queue.h>
 
 #include "libcore/protodefs.h"
+#include "libcore/state.h"
 #include "hipfw_defines.h"
 
 int hip_trigger_bex(const struct in6_addr *src_hit,
@@ -49,6 +50,8 @@ int hip_fw_handle_outgoing_lsi(hip_ipq_packet_msg *m,
                                struct in_addr *ip_src,
                                struct in_addr *ip_dst);
 
+void hip_fw_flush_outgoing_lsi(const struct hip_hadb_user_info_state *ha);
+
 int hip_is_packet_lsi_reinjection(hip_lsi_t *lsi);
 
 #endif /* HIPL_HIPFW_LSI_H */
@@ -47,6 +47,7 @@
 #include "conntrack.h"
 #include "hipfw.h"
 #include "midauth.h"
+#include "pending_queue.h"
 
 
 /**
@@ -55,7 +56,7 @@
 static void hipfw_usage(void)
 {
     puts("HIP Firewall");
-    puts("Usage: hipfw [-f file_name] [-d|-v] [-A] [-F] [-H] [-b] [-a] [-c] [-k] [-i|-I|-e] [-l] [-m] [-o] [-p] [-t <seconds>] [-u] [-h] [-V]");
+    puts("Usage: hipfw [-f file_name] [-d|-v] [-A] [-F] [-H] [-b] [-a] [-c] [-k] [-i|-I|-e] [-l] [-m] [-o] [-p] [-q <queues>] [-P <packets>] [-M <kbytes>] [-W <seconds>] [-t <seconds>] [-u] [-h] [-V]");
     puts("");
     puts("      -f file_name = is a path to a file containing firewall filtering rules");
     puts("      -V = print version information and exit");
@@ -72,6 +73,10 @@ static void hipfw_usage(void)
     puts("      -l = activate lsi support");
     puts("      -m = middlebox authentication");
     puts("      -p = run with lowered privileges. iptables rules will not be flushed on exit");
+    puts("      -q <queues> = process packets in <queues> parallel queues per address family (default: 1)");
+    puts("      -P <packets> = queue up to <packets> packets per peer during base exchanges. Disable if <packets> = 0 (default: 16)");
+    puts("      -M <kbytes> = limit the memory of all packets queued during base exchanges to <kbytes> (default: 1024)");
+    puts("      -W <seconds> = discard packets queued during base exchanges after <seconds> (default: 10)");
     puts("      -t <seconds> = set timeout interval to <seconds>. Disable if <seconds> = 0");
     puts("      -u = attempt to speed up esp traffic using iptables rules");
     puts("      -r = enable ESP relaying (HIP relaying for HIP daemon needs to be enabled separately)");
@@ -103,7 +108,7 @@ int main(int argc, char *argv[])
     char *end_of_number;
     int   ch;
 
-    while ((ch = getopt(argc, argv, "aAbcdef:FhHiIklmprt:uvV")) != -1) {
+    while ((ch = getopt(argc, argv, "aAbcdef:FhHiIklmM:pP:q:rt:uvVW:")) != -1) {
         switch (ch) {
         case 'A':
             accept_hip_esp_traffic_by_default = 1;
@@ -149,9 +154,35 @@ int main(int argc, char *argv[])
             filter_traffic = 1;
             use_midauth    = 1;
             break;
+        case 'M':
+            pending_queue_size = strtoul(optarg, &end_of_number, 10) * 1024;
+            if (end_of_number == optarg) {
+                fprintf(stderr, "Error: Invalid queue memory limit given\n");
+                hipfw_usage();
+                return EXIT_FAILURE;
+            }
+            break;
         case 'p':
             limit_capabilities = 1;
             break;
+        case 'P':
+            pending_queue_len = strtoul(optarg, &end_of_number, 10);
+            if (end_of_number == optarg) {
+                fprintf(stderr, "Error: Invalid queue length given\n");
+                hipfw_usage();
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'q':
+            hipfw_queue_count = strtoul(optarg, &end_of_number, 10);
+            if (end_of_number == optarg || hipfw_queue_count == 0 ||
+                hipfw_queue_count > HIPFW_MAX_QUEUE_COUNT) {
+                fprintf(stderr, "Error: Number of queues must be between 1 and %d\n",
+                        HIPFW_MAX_QUEUE_COUNT);
+                hipfw_usage();
+                return EXIT_FAILURE;
+            }
+            break;
         case 't':
             connection_timeout = strtoul(optarg, &end_of_number, 10);
             if (end_of_number == optarg) {
@@ -178,6 +209,14 @@ int main(int argc, char *argv[])
         case 'V':
             hip_print_version("hipfw");
             return EXIT_SUCCESS;
+        case 'W':
+            pending_queue_timeout = strtoul(optarg, &end_of_number, 10);
+            if (end_of_number == optarg || pending_queue_timeout == 0) {
+                fprintf(stderr, "Error: Invalid queue timeout given\n");
+                hipfw_usage();
+                return EXIT_FAILURE;
+            }
+            break;
         case ':':         /* option without operand */
             printf("Option -%c requires an operand\n", optopt);
             hipfw_usage();
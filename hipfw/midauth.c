@@ -39,6 +39,7 @@
 #define _BSD_SOURCE
 
 #include <openssl/rand.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
 
@@ -74,6 +75,8 @@ static unsigned int current_nonce;
 static time_t last_nonce_check;
 /* Interval in seconds at which the nonces are updated. */
 static time_t nonce_update_interval = 1;
+/* Protects the nonces, which are rotated while queue workers read them. */
+static pthread_mutex_t nonce_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* The structure of the challenge used for midauth verification. */
 union midauth_challenge {
@@ -128,8 +131,10 @@ static int build_midauth_opaque(uint8_t *dest, const hip_hit_t src_hit,
 
     challenge.structured.src_hit = src_hit;
     challenge.structured.dst_hit = dst_hit;
+    pthread_mutex_lock(&nonce_lock);
     memcpy(challenge.structured.nonce, nonces[nonce_index],
            sizeof(nonces[nonce_index]));
+    pthread_mutex_unlock(&nonce_lock);
 
     if (!SHA1(challenge.serialized, sizeof(challenge), dest)) {
         HIP_ERROR("Failed to generate CHALLENGE_REQUEST nonce\n");
@@ -148,6 +153,7 @@ static int build_midauth_opaque(uint8_t *dest, const hip_hit_t src_hit,
 int hipfw_midauth_update_nonces(void)
 {
     const time_t now = time(NULL);
+    unsigned int next_nonce;
 
     if (now < last_nonce_check) {
         HIP_ERROR("Clock skew detected; timestamp reset.\n");
@@ -160,11 +166,16 @@ int hipfw_midauth_update_nonces(void)
     }
 
     last_nonce_check = now;
-    current_nonce    = (current_nonce + 1) % MIDAUTH_NONCES;
-    if (!RAND_bytes(nonces[current_nonce], MIDAUTH_DEFAULT_NONCE_LENGTH)) {
+
+    pthread_mutex_lock(&nonce_lock);
+    next_nonce = (current_nonce + 1) % MIDAUTH_NONCES;
+    if (!RAND_bytes(nonces[next_nonce], MIDAUTH_DEFAULT_NONCE_LENGTH)) {
+        pthread_mutex_unlock(&nonce_lock);
         HIP_ERROR("Failed to generate CHALLENGE_REQUEST nonce\n");
         return -1;
     }
+    current_nonce = next_nonce;
+    pthread_mutex_unlock(&nonce_lock);
 
     return 0;
 }
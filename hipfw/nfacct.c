@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * In-process access to the kernel's extended packet accounting
+ * (nfnetlink_acct) objects.
+ *
+ * iptables rules that carry a "-m nfacct --nfacct-name <name>" match count
+ * the packets they see in the named accounting object. This file creates,
+ * reads and removes those objects via a NETLINK_NETFILTER socket, so that
+ * hipfw can poll rule activity without spawning iptables processes.
+ *
+ * All functions in this file share one socket. Requests are serialized by
+ * ::nfacct_lock, so that the counters can be read without holding the
+ * conntrack lock. hipfw_nfacct_init() and hipfw_nfacct_uninit() must not run
+ * concurrently with other functions.
+ */
+
+#define _BSD_SOURCE
+
+#include <endian.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_acct.h>
+
+#include "libcore/debug.h"
+#include "libcore/ife.h"
+#include "nfacct.h"
+
+/** Size of the netlink receive buffer; a dump answer fits many objects. */
+#define HIPFW_NFACCT_RECV_SIZE 8192
+
+/** Number of stale objects removed per dump in nfacct_purge(). */
+#define HIPFW_NFACCT_PURGE_BATCH 64
+
+/** A request addressing a single accounting object by name. */
+struct nfacct_request {
+    struct nlmsghdr nlh;
+    struct nfgenmsg nfg;
+    struct nlattr   attr;
+    char            name[NLA_ALIGN(NFACCT_NAME_MAX)];
+};
+
+static int      nfacct_sock = -1;
+static uint32_t nfacct_seq  = 0;
+
+/** serializes the requests on ::nfacct_sock */
+static pthread_mutex_t nfacct_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Send a request to the nfnetlink_acct subsystem.
+ *
+ * @param type  one of the NFNL_MSG_ACCT_* message types
+ * @param flags netlink flags in addition to NLM_F_REQUEST
+ * @param name  the accounting object to address or NULL for all objects
+ * @return      the sequence number of the request on success,
+ *              a negative errno value on failure
+ */
+static int64_t nfacct_send(const uint16_t type, const uint16_t flags,
+                           const char *const name)
+{
+    struct nfacct_request req = { { 0 } };
+    size_t                name_len;
+
+    req.nlh.nlmsg_len   = NLMSG_LENGTH(sizeof(req.nfg));
+    req.nlh.nlmsg_type  = (NFNL_SUBSYS_ACCT << 8) | type;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | flags;
+    req.nlh.nlmsg_seq   = ++nfacct_seq;
+    req.nfg.nfgen_family = AF_UNSPEC;
+    req.nfg.version      = NFNETLINK_V0;
+
+    if (name) {
+        name_len = strlen(name) + 1;
+        if (name_len > NFACCT_NAME_MAX) {
+            return -ENAMETOOLONG;
+        }
+        req.attr.nla_type  = NFACCT_NAME;
+        req.attr.nla_len   = NLA_HDRLEN + name_len;
+        memcpy(req.name, name, name_len);
+        req.nlh.nlmsg_len += NLA_ALIGN(req.attr.nla_len);
+    }
+
+    if (send(nfacct_sock, &req, req.nlh.nlmsg_len, 0) < 0) {
+        return -errno;
+    }
+
+    return req.nlh.nlmsg_seq;
+}
+
+/**
+ * Extract name and packet counter from an accounting object message.
+ *
+ * @param nlh     the NFNL_MSG_ACCT_NEW message sent by the kernel
+ * @param name    receives a pointer to the object name or NULL
+ * @param packets receives the packet counter (may be NULL)
+ */
+static void nfacct_parse(const struct nlmsghdr *const nlh,
+                         const char **const name, uint64_t *const packets)
+{
+    const struct nlattr *attr;
+    int                  len;
+
+    *name = NULL;
+    attr  = (const struct nlattr *)
+            ((const char *) NLMSG_DATA(nlh) + NLMSG_ALIGN(sizeof(struct nfgenmsg)));
+    len = nlh->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct nfgenmsg)));
+
+    while (len >= NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN &&
+           attr->nla_len <= len) {
+        const char *const payload = (const char *) attr + NLA_HDRLEN;
+
+        switch (attr->nla_type & NLA_TYPE_MASK) {
+        case NFACCT_NAME:
+            if (memchr(payload, '\0', attr->nla_len - NLA_HDRLEN)) {
+                *name = payload;
+            }
+            break;
+        case NFACCT_PKTS:
+            if (packets && attr->nla_len >= NLA_HDRLEN + sizeof(uint64_t)) {
+                uint64_t pkts;
+                memcpy(&pkts, payload, sizeof(pkts));
+                *packets = be64toh(pkts);
+            }
+            break;
+        }
+
+        len -= NLA_ALIGN(attr->nla_len);
+        attr = (const struct nlattr *) ((const char *) attr + NLA_ALIGN(attr->nla_len));
+    }
+}
+
+/**
+ * Receive the answer to a request sent via nfacct_send().
+ *
+ * Requests with NLM_F_ACK are answered by an error message, which carries 0
+ * on success. Single-object GET requests are answered by one object message,
+ * dumps by a sequence of them terminated by NLMSG_DONE. The kernel flags
+ * both kinds of object messages with NLM_F_MULTI.
+ *
+ * @param seq      the sequence number of the request
+ * @param dump     true if the request was a dump
+ * @param callback called for each received object message (may be NULL)
+ * @param arg      passed to @a callback
+ * @return         0 on success, a negative errno value on failure
+ */
+static int nfacct_recv(const uint32_t seq, const bool dump,
+                       void (*callback)(const struct nlmsghdr *nlh, void *arg),
+                       void *const arg)
+{
+    union {
+        struct nlmsghdr nlh;
+        char            data[HIPFW_NFACCT_RECV_SIZE];
+    } buf;
+
+    while (true) {
+        struct nlmsghdr *nlh = &buf.nlh;
+        ssize_t          len = recv(nfacct_sock, &buf, sizeof(buf), 0);
+
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+
+        for (; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_seq != seq) {
+                // late answer to an earlier, failed request
+                continue;
+            }
+
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *const nlerr = NLMSG_DATA(nlh);
+                return nlerr->error;
+            }
+
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                return 0;
+            }
+
+            if (callback) {
+                callback(nlh, arg);
+            }
+
+            if (!dump) {
+                return 0;
+            }
+        }
+    }
+}
+
+/**
+ * Send a request addressing a single object and wait for the answer.
+ *
+ * @param type     one of the NFNL_MSG_ACCT_* message types
+ * @param flags    netlink flags in addition to NLM_F_REQUEST
+ * @param name     the accounting object
+ * @param callback see nfacct_recv()
+ * @param arg      see nfacct_recv()
+ * @return         0 on success, a negative errno value on failure
+ */
+static int nfacct_query(const uint16_t type, const uint16_t flags,
+                        const char *const name,
+                        void (*callback)(const struct nlmsghdr *nlh, void *arg),
+                        void *const arg)
+{
+    const int64_t seq = nfacct_send(type, flags, name);
+
+    if (seq < 0) {
+        return seq;
+    }
+
+    return nfacct_recv(seq, false, callback, arg);
+}
+
+/** State of an nfacct_purge() dump. */
+struct nfacct_purge_state {
+    char     names[HIPFW_NFACCT_PURGE_BATCH][NFACCT_NAME_MAX];
+    unsigned count;
+    bool     truncated;
+};
+
+/**
+ * nfacct_recv() callback collecting the names of objects owned by hipfw.
+ *
+ * @param nlh an object message of the dump
+ * @param arg the struct nfacct_purge_state
+ */
+static void nfacct_collect_name(const struct nlmsghdr *const nlh, void *const arg)
+{
+    struct nfacct_purge_state *const state = arg;
+    const char                      *name;
+
+    nfacct_parse(nlh, &name, NULL);
+
+    if (!name || strncmp(name, HIPFW_NFACCT_PREFIX,
+                         sizeof(HIPFW_NFACCT_PREFIX) - 1)) {
+        return;
+    }
+
+    if (state->count == HIPFW_NFACCT_PURGE_BATCH) {
+        state->truncated = true;
+        return;
+    }
+
+    strncpy(state->names[state->count], name, NFACCT_NAME_MAX - 1);
+    state->names[state->count][NFACCT_NAME_MAX - 1] = '\0';
+    state->count++;
+}
+
+/**
+ * Remove all accounting objects owned by hipfw. Objects are left over
+ * if a previous hipfw process was killed.
+ *
+ * @return 0 on success, a negative errno value if the dump failed
+ */
+static int nfacct_purge(void)
+{
+    struct nfacct_purge_state state;
+    int64_t                   seq;
+    int                       err;
+    unsigned                  i;
+
+    do {
+        state.count     = 0;
+        state.truncated = false;
+
+        if ((seq = nfacct_send(NFNL_MSG_ACCT_GET, NLM_F_DUMP, NULL)) < 0) {
+            return seq;
+        }
+        if ((err = nfacct_recv(seq, true, nfacct_collect_name, &state))) {
+            return err;
+        }
+
+        for (i = 0; i < state.count; i++) {
+            if ((err = nfacct_query(NFNL_MSG_ACCT_DEL, NLM_F_ACK,
+                                    state.names[i], NULL, NULL))) {
+                HIP_ERROR("Failed to remove accounting object %s: %s\n",
+                          state.names[i], strerror(-err));
+                // still referenced; another dump would find it again
+                state.truncated = false;
+            }
+        }
+    } while (state.truncated);
+
+    return 0;
+}
+
+/**
+ * Open the netlink socket to the kernel's packet accounting and remove
+ * accounting objects left over by a previous hipfw process.
+ *
+ * @return 0 on success, -1 if packet accounting is not available
+ */
+int hipfw_nfacct_init(void)
+{
+    struct sockaddr_nl addr = { 0 };
+    int                err  = 0;
+
+    HIP_IFEL((nfacct_sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_NETFILTER)) < 0,
+             -1, "socket(NETLINK_NETFILTER): %s\n", strerror(errno));
+
+    addr.nl_family = AF_NETLINK;
+    HIP_IFEL(bind(nfacct_sock, (struct sockaddr *) &addr, sizeof(addr)), -1,
+             "bind(NETLINK_NETFILTER): %s\n", strerror(errno));
+
+    HIP_IFEL((err = nfacct_purge()), -1,
+             "Packet accounting (nfnetlink_acct) unavailable: %s\n",
+             strerror(-err));
+
+    return 0;
+
+out_err:
+    hipfw_nfacct_uninit();
+    return err;
+}
+
+/**
+ * Remove all accounting objects owned by hipfw and close the netlink socket.
+ * The iptables rules referencing the objects must have been removed before.
+ */
+void hipfw_nfacct_uninit(void)
+{
+    if (nfacct_sock < 0) {
+        return;
+    }
+
+    nfacct_purge();
+    close(nfacct_sock);
+    nfacct_sock = -1;
+}
+
+/**
+ * Check whether hipfw_nfacct_init() succeeded.
+ *
+ * @return true if accounting objects can be used, false otherwise
+ */
+bool hipfw_nfacct_available(void)
+{
+    return nfacct_sock >= 0;
+}
+
+/**
+ * Create an accounting object. It can then be referenced by iptables rules
+ * via "-m nfacct --nfacct-name @a name".
+ *
+ * @param name the object name, at most NFACCT_NAME_MAX - 1 characters
+ * @return     0 on success, a negative errno value on failure;
+ *             -EEXIST if the object already exists
+ */
+int hipfw_nfacct_add(const char *const name)
+{
+    int err;
+
+    if (nfacct_sock < 0) {
+        return -ENOTCONN;
+    }
+
+    pthread_mutex_lock(&nfacct_lock);
+    err = nfacct_query(NFNL_MSG_ACCT_NEW, NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK,
+                       name, NULL, NULL);
+    pthread_mutex_unlock(&nfacct_lock);
+    return err;
+}
+
+/**
+ * Remove an accounting object. The kernel refuses to remove objects that
+ * are still referenced by iptables rules.
+ *
+ * @param name the object name
+ * @return     0 on success, a negative errno value on failure
+ */
+int hipfw_nfacct_del(const char *const name)
+{
+    int err;
+
+    if (nfacct_sock < 0) {
+        return -ENOTCONN;
+    }
+
+    pthread_mutex_lock(&nfacct_lock);
+    err = nfacct_query(NFNL_MSG_ACCT_DEL, NLM_F_ACK, name, NULL, NULL);
+    pthread_mutex_unlock(&nfacct_lock);
+    return err;
+}
+
+/** State of a hipfw_nfacct_read_zero_all() dump. */
+struct nfacct_counters_state {
+    struct hipfw_nfacct_counter *counters;
+    unsigned                     count;
+    unsigned                     size;
+    int                          err;
+};
+
+/**
+ * nfacct_recv() callback collecting the counters of objects owned by hipfw.
+ *
+ * @param nlh an object message of the dump
+ * @param arg the struct nfacct_counters_state
+ */
+static void nfacct_collect_counter(const struct nlmsghdr *const nlh,
+                                   void *const arg)
+{
+    struct nfacct_counters_state *const state   = arg;
+    const char                         *name;
+    uint64_t                            packets = 0;
+
+    nfacct_parse(nlh, &name, &packets);
+
+    if (state->err || !name ||
+        strncmp(name, HIPFW_NFACCT_PREFIX, sizeof(HIPFW_NFACCT_PREFIX) - 1)) {
+        return;
+    }
+
+    if (state->count == state->size) {
+        const unsigned                     size = state->size ? 2 * state->size : 64;
+        struct hipfw_nfacct_counter *const counters =
+            realloc(state->counters, size * sizeof(*counters));
+
+        if (!counters) {
+            // keep receiving, so that the rest of the dump is consumed
+            state->err = -ENOMEM;
+            return;
+        }
+        state->counters = counters;
+        state->size     = size;
+    }
+
+    strncpy(state->counters[state->count].name, name, NFACCT_NAME_MAX - 1);
+    state->counters[state->count].name[NFACCT_NAME_MAX - 1] = '\0';
+    state->counters[state->count].packets                   = packets;
+    state->count++;
+}
+
+/**
+ * Read and reset the packet counters of all accounting objects owned by
+ * hipfw with a single dump request.
+ *
+ * @note The kernel cannot restrict the dump to objects by name, so the
+ *       counters of objects owned by other programs are reset, too.
+ *
+ * @param counters receives the counters, in no particular order. The array
+ *                 is allocated with malloc() and must be freed by the
+ *                 caller. It is NULL if there are no counters.
+ * @return         the number of counters on success,
+ *                 a negative errno value on failure
+ */
+int hipfw_nfacct_read_zero_all(struct hipfw_nfacct_counter **const counters)
+{
+    struct nfacct_counters_state state = { NULL, 0, 0, 0 };
+    int64_t                      seq;
+    int                          err;
+
+    *counters = NULL;
+    if (nfacct_sock < 0) {
+        return -ENOTCONN;
+    }
+
+    pthread_mutex_lock(&nfacct_lock);
+    if ((seq = nfacct_send(NFNL_MSG_ACCT_GET_CTRZERO, NLM_F_DUMP, NULL)) < 0) {
+        err = seq;
+    } else {
+        err = nfacct_recv(seq, true, nfacct_collect_counter, &state);
+    }
+    pthread_mutex_unlock(&nfacct_lock);
+
+    if (err || (err = state.err)) {
+        free(state.counters);
+        return err;
+    }
+
+    *counters = state.counters;
+    return state.count;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HIPL_HIPFW_NFACCT_H
+#define HIPL_HIPFW_NFACCT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/netfilter/nfnetlink_acct.h>
+
+/** Prefix of all accounting objects owned by hipfw. */
+#define HIPFW_NFACCT_PREFIX "hipfw-"
+
+/** Packet counter of an accounting object. */
+struct hipfw_nfacct_counter {
+    char     name[NFACCT_NAME_MAX];
+    uint64_t packets;
+};
+
+int hipfw_nfacct_init(void);
+void hipfw_nfacct_uninit(void);
+bool hipfw_nfacct_available(void);
+int hipfw_nfacct_add(const char *const name);
+int hipfw_nfacct_del(const char *const name);
+int hipfw_nfacct_read_zero_all(struct hipfw_nfacct_counter **const counters);
+
+#endif /* HIPL_HIPFW_NFACCT_H */
@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Holds outgoing packets while the base exchange with their destination is
+ * in flight. Without this queue, the packets that trigger a base exchange
+ * are dropped and the application only recovers after its own
+ * retransmission timeout, e.g. the TCP SYN timeout of several seconds.
+ *
+ * Packets are queued per pair of local and peer identifier (HITs or
+ * IPv4-mapped LSIs) and released in order by hipfw_pending_flush() as soon
+ * as the association is usable. The queue is bounded by the number of
+ * packets per pair (::pending_queue_len) and by the memory of all queued
+ * packets (::pending_queue_size). Packets older than
+ * ::pending_queue_timeout are discarded.
+ *
+ * @brief Per-destination packet queue for pending base exchanges
+ */
+
+#define _BSD_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <openssl/lhash.h>
+
+#include "libcore/debug.h"
+#include "libcore/hashtable.h"
+#include "libcore/list.h"
+#include "libcore/prefix.h"
+#include "hipfw_defines.h"
+#include "pending_queue.h"
+
+
+/** maximum number of packets queued per identifier pair, 0 disables
+ *  queueing */
+unsigned int pending_queue_len = 16;
+
+/** maximum memory in bytes used by all queued packets */
+size_t pending_queue_size = 1024 * 1024;
+
+/** time in seconds after which queued packets are discarded */
+time_t pending_queue_timeout = 10;
+
+struct pending_packet {
+    struct pending_packet *next;
+    time_t                 timestamp;
+    size_t                 len;
+    unsigned char          data[];
+};
+
+/** the packets queued for one identifier pair, oldest first */
+struct pending_pair {
+    struct in6_addr        local;
+    struct in6_addr        peer;
+    struct pending_packet *head;
+    struct pending_packet *tail;
+    unsigned int           count;
+    /** when the base exchange for the pair was last triggered */
+    time_t                 triggered;
+};
+
+static HIP_HASHTABLE *pending_db = NULL;
+
+/** memory used by all queued packets */
+static size_t pending_bytes = 0;
+
+/**
+ * Serializes access to ::pending_db from the netfilter queue workers and
+ * the hipd message handler. It is never held while a flushed packet is
+ * processed.
+ */
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Hash the identifiers of a queue.
+ *
+ * @param pair the queue
+ * @return     the hash value
+ */
+static unsigned long pending_pair_hash(const struct pending_pair *pair)
+{
+    const uint32_t *const local = pair->local.s6_addr32;
+    const uint32_t *const peer  = pair->peer.s6_addr32;
+
+    return local[0] ^ local[1] ^ local[2] ^ local[3] ^
+           ((peer[0] ^ peer[1] ^ peer[2] ^ peer[3]) * 0x9E3779B1UL);
+}
+
+/**
+ * Compare the identifiers of two queues.
+ *
+ * @param pair1 first queue
+ * @param pair2 second queue
+ * @return      0 if the queues have the same identifiers, non-zero otherwise
+ */
+static int pending_pair_cmp(const struct pending_pair *pair1,
+                            const struct pending_pair *pair2)
+{
+    return ipv6_addr_cmp(&pair1->local, &pair2->local) ||
+           ipv6_addr_cmp(&pair1->peer, &pair2->peer);
+}
+
+STATIC_IMPLEMENT_LHASH_HASH_FN(pending_pair, struct pending_pair)
+STATIC_IMPLEMENT_LHASH_COMP_FN(pending_pair, struct pending_pair)
+
+/**
+ * Remove the oldest packet from a queue.
+ *
+ * @param pair the queue, must not be empty
+ * @return     the packet, to be freed by the caller
+ */
+static struct pending_packet *pending_pair_pop(struct pending_pair *const pair)
+{
+    struct pending_packet *const packet = pair->head;
+
+    pair->head = packet->next;
+    if (!pair->head) {
+        pair->tail = NULL;
+    }
+    pair->count--;
+    pending_bytes -= sizeof(*packet) + packet->len;
+
+    return packet;
+}
+
+/**
+ * Discard the packets of a queue that are older than ::pending_queue_timeout.
+ *
+ * @param pair the queue
+ * @param now  the current time
+ */
+static void pending_pair_expire(struct pending_pair *const pair,
+                                const time_t now)
+{
+    while (pair->head && now - pair->head->timestamp >= pending_queue_timeout) {
+        free(pending_pair_pop(pair));
+    }
+}
+
+/**
+ * Free a queue and all its packets.
+ *
+ * @param pair the queue, already removed from ::pending_db
+ */
+static void pending_pair_free(struct pending_pair *const pair)
+{
+    while (pair->head) {
+        free(pending_pair_pop(pair));
+    }
+    free(pair);
+}
+
+/**
+ * Initialize the pending packet queues.
+ *
+ * @return 0 on success, -1 on error
+ */
+int hipfw_pending_init(void)
+{
+    pthread_mutex_lock(&pending_lock);
+    if (!pending_db) {
+        pending_db = hip_ht_init(LHASH_HASH_FN(pending_pair),
+                                 LHASH_COMP_FN(pending_pair));
+    }
+    pthread_mutex_unlock(&pending_lock);
+
+    if (!pending_db) {
+        HIP_ERROR("Failed to initialize the pending packet queues\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Discard all queued packets and free the pending packet queues.
+ */
+void hipfw_pending_uninit(void)
+{
+    struct pending_pair *pair = NULL;
+    LHASH_NODE          *item = NULL, *tmp = NULL;
+    int                  i;
+
+    pthread_mutex_lock(&pending_lock);
+    if (pending_db) {
+        list_for_each_safe(item, tmp, pending_db, i) {
+            pair = list_entry(item);
+            hip_ht_delete(pending_db, pair);
+            pending_pair_free(pair);
+        }
+        hip_ht_uninit(pending_db);
+        pending_db = NULL;
+    }
+    pthread_mutex_unlock(&pending_lock);
+}
+
+/**
+ * Queue a copy of a packet until the association between two identifiers
+ * can be used. If the queue of the pair is full, its oldest packet is
+ * discarded, as the newest packets are the most useful once the association
+ * is available (e.g. TCP retransmissions).
+ *
+ * The caller is asked to trigger the base exchange for the first packet of
+ * a pair and again once per ::pending_queue_timeout while packets keep
+ * arriving, so that a failed base exchange is retried.
+ *
+ * @param local  the local HIT or IPv4-mapped LSI
+ * @param peer   the peer HIT or IPv4-mapped LSI
+ * @param packet the packet
+ * @return       1 if the packet was queued and the caller has to trigger
+ *               the base exchange, 0 if it was queued while the base
+ *               exchange is in flight, -1 if it was not queued
+ */
+int hipfw_pending_enqueue(const struct in6_addr *local,
+                          const struct in6_addr *peer,
+                          const hip_ipq_packet_msg *packet)
+{
+    struct pending_pair    key;
+    struct pending_pair   *pair  = NULL;
+    struct pending_packet *entry = NULL;
+    const size_t           size  = sizeof(*entry) + packet->data_len;
+    const time_t           now   = time(NULL);
+    int                    err   = 0;
+    int                    trigger;
+
+    if (pending_queue_len == 0) {
+        return -1;
+    }
+
+    key.local = *local;
+    key.peer  = *peer;
+
+    pthread_mutex_lock(&pending_lock);
+
+    if (!pending_db) {
+        err = -1;
+        goto out_err;
+    }
+
+    if ((pair = hip_ht_find(pending_db, &key))) {
+        pending_pair_expire(pair, now);
+        if (pair->count >= pending_queue_len) {
+            HIP_DEBUG("pending queue full, discarding oldest packet\n");
+            free(pending_pair_pop(pair));
+        }
+    }
+    trigger = !pair || now - pair->triggered >= pending_queue_timeout;
+
+    if (pending_bytes + size > pending_queue_size) {
+        HIP_DEBUG("pending queue memory exhausted, dropping packet\n");
+        err = -1;
+        goto out_err;
+    }
+
+    if (!(entry = malloc(size))) {
+        HIP_ERROR("Allocating pending packet failed\n");
+        err = -1;
+        goto out_err;
+    }
+    entry->next      = NULL;
+    entry->timestamp = now;
+    entry->len       = packet->data_len;
+    memcpy(entry->data, packet->payload, packet->data_len);
+
+    if (!pair) {
+        if (!(pair = calloc(1, sizeof(*pair)))) {
+            HIP_ERROR("Allocating pending queue failed\n");
+            free(entry);
+            err = -1;
+            goto out_err;
+        }
+        pair->local = *local;
+        pair->peer  = *peer;
+        hip_ht_add(pending_db, pair);
+    }
+    if (trigger) {
+        pair->triggered = now;
+        err             = 1;
+    }
+
+    if (pair->tail) {
+        pair->tail->next = entry;
+    } else {
+        pair->head = entry;
+    }
+    pair->tail = entry;
+    pair->count++;
+    pending_bytes += size;
+
+out_err:
+    pthread_mutex_unlock(&pending_lock);
+    return err;
+}
+
+/**
+ * Release the packets queued for two identifiers in the order they were
+ * queued. Packets older than ::pending_queue_timeout are discarded.
+ *
+ * @param local    the local HIT or IPv4-mapped LSI
+ * @param peer     the peer HIT or IPv4-mapped LSI
+ * @param callback called for each released packet
+ * @param arg      passed on to @a callback
+ * @return         the number of released packets
+ */
+unsigned int hipfw_pending_flush(const struct in6_addr *local,
+                                 const struct in6_addr *peer,
+                                 hipfw_pending_cb callback, void *arg)
+{
+    struct pending_pair    key;
+    struct pending_pair   *pair   = NULL;
+    struct pending_packet *packet = NULL;
+    hip_ipq_packet_msg     msg    = { 0 };
+    const time_t           now    = time(NULL);
+    unsigned int           count  = 0;
+
+    key.local = *local;
+    key.peer  = *peer;
+
+    // detach the queue, so that the callback runs without the lock held
+    pthread_mutex_lock(&pending_lock);
+    if (pending_db && (pair = hip_ht_find(pending_db, &key))) {
+        hip_ht_delete(pending_db, pair);
+        pending_pair_expire(pair, now);
+        pending_bytes -= pair->count * sizeof(*packet);
+        for (packet = pair->head; packet; packet = packet->next) {
+            pending_bytes -= packet->len;
+        }
+    }
+    pthread_mutex_unlock(&pending_lock);
+
+    if (!pair) {
+        return 0;
+    }
+
+    while ((packet = pair->head)) {
+        pair->head = packet->next;
+
+        msg.data_len = packet->len;
+        msg.payload  = packet->data;
+        callback(&msg, arg);
+
+        free(packet);
+        count++;
+    }
+    free(pair);
+
+    HIP_DEBUG("released %u pending packets\n", count);
+
+    return count;
+}
+
+/**
+ * Discard all queued packets older than ::pending_queue_timeout, e.g.
+ * because their base exchange failed.
+ */
+void hipfw_pending_expire(void)
+{
+    static time_t        last_check = 0;
+    struct pending_pair *pair       = NULL;
+    LHASH_NODE          *item       = NULL, *tmp = NULL;
+    const time_t         now        = time(NULL);
+    int                  i;
+
+    // called from the main loop, sweep at most once per second
+    if (now == last_check) {
+        return;
+    }
+    last_check = now;
+
+    pthread_mutex_lock(&pending_lock);
+    if (pending_db) {
+        list_for_each_safe(item, tmp, pending_db, i) {
+            pair = list_entry(item);
+            pending_pair_expire(pair, now);
+            if (!pair->head) {
+                hip_ht_delete(pending_db, pair);
+                free(pair);
+            }
+        }
+    }
+    pthread_mutex_unlock(&pending_lock);
+}
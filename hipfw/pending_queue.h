@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HIPL_HIPFW_PENDING_QUEUE_H
+#define HIPL_HIPFW_PENDING_QUEUE_H
+
+#include <stddef.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "hipfw_defines.h"
+
+extern unsigned int pending_queue_len;
+extern size_t       pending_queue_size;
+extern time_t       pending_queue_timeout;
+
+/**
+ * Callback for a packet released by hipfw_pending_flush().
+ *
+ * @param packet the queued packet, the payload is only valid during the call
+ * @param arg    the argument passed to hipfw_pending_flush()
+ */
+typedef void (*hipfw_pending_cb)(const hip_ipq_packet_msg *packet, void *arg);
+
+int hipfw_pending_init(void);
+void hipfw_pending_uninit(void);
+int hipfw_pending_enqueue(const struct in6_addr *local,
+                          const struct in6_addr *peer,
+                          const hip_ipq_packet_msg *packet);
+unsigned int hipfw_pending_flush(const struct in6_addr *local,
+                                 const struct in6_addr *peer,
+                                 hipfw_pending_cb callback, void *arg);
+void hipfw_pending_expire(void);
+
+#endif /* HIPL_HIPFW_PENDING_QUEUE_H */
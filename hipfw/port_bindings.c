@@ -31,6 +31,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -62,6 +63,12 @@ static const unsigned int INVALIDATION_INTERVAL = 1;
  */
 static volatile sig_atomic_t cache_invalidation_flag = 1;
 
+/**
+ * Serializes lookups from concurrent netfilter queue workers, as lookups
+ * reload the /proc file buffers and fill the cache.
+ */
+static pthread_mutex_t port_bindings_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Pointer to the port bindings cache.
  *
@@ -457,6 +464,8 @@ enum hip_port_binding hip_port_bindings_get(const uint8_t protocol,
         IPPROTO_UDP == protocol) {
         const uint16_t port_hbo = ntohs(port);
 
+        pthread_mutex_lock(&port_bindings_lock);
+
         // Make sure we return (sort of) up-to-date information.
         // This is the one potentially slow operation here.
         // The others (port_bindings_get_from_proc() and the cache access
@@ -481,6 +490,8 @@ enum hip_port_binding hip_port_bindings_get(const uint8_t protocol,
             binding = port_bindings_get_from_proc(protocol, port_hbo);
             set_cache_entry(protocol, port_hbo, binding);
         }
+
+        pthread_mutex_unlock(&port_bindings_lock);
     } else {
         HIP_ERROR("Protocol %d not supported\n", protocol);
     }
@@ -137,6 +137,8 @@ static void hip_fw_context_enable_write_inplace(struct hip_fw_context *const ctx
  */
 static void hip_fw_context_enable_write(struct hip_fw_context *const ctx)
 {
+    uint8_t *scratch;
+
     HIP_ASSERT(ctx);
     HIP_ASSERT(ctx->ipq_packet);
 
@@ -145,33 +147,36 @@ static void hip_fw_context_enable_write(struct hip_fw_context *const ctx)
         return;
     }
 
-    if (ctx->ipq_packet->payload != scratch_buffer) {
+    /* queue workers bring their own buffer, others share the static one */
+    scratch = ctx->scratch_buffer ? ctx->scratch_buffer : scratch_buffer;
+
+    if (ctx->ipq_packet->payload != scratch) {
         // copy packet data
-        memcpy(scratch_buffer, ctx->ipq_packet->payload,
+        memcpy(scratch, ctx->ipq_packet->payload,
                ctx->ipq_packet->data_len);
 
         // rebase pointers in ctx to point into copy
         if (ctx->ip_version == 4) {
             ctx->ip_hdr.ipv4 = rebase(ctx->ip_hdr.ipv4,
                                       ctx->ipq_packet->payload,
-                                      scratch_buffer);
+                                      scratch);
         } else {
             HIP_ASSERT(ctx->ip_version == 6);
             ctx->ip_hdr.ipv6 = rebase(ctx->ip_hdr.ipv6,
                                       ctx->ipq_packet->payload,
-                                      scratch_buffer);
+                                      scratch);
         }
 
         switch (ctx->packet_type) {
         case ESP_PACKET:
             ctx->transport_hdr.esp = rebase(ctx->transport_hdr.esp,
                                             ctx->ipq_packet->payload,
-                                            scratch_buffer);
+                                            scratch);
             break;
         case HIP_PACKET:
             ctx->transport_hdr.hip = rebase(ctx->transport_hdr.hip,
                                             ctx->ipq_packet->payload,
-                                            scratch_buffer);
+                                            scratch);
             break;
         case OTHER_PACKET:
             break;
@@ -182,11 +187,11 @@ static void hip_fw_context_enable_write(struct hip_fw_context *const ctx)
         if (ctx->udp_encap_hdr) {
             ctx->udp_encap_hdr = rebase(ctx->udp_encap_hdr,
                                         ctx->ipq_packet->payload,
-                                        scratch_buffer);
+                                        scratch);
         }
 
         // set payload pointer to copy
-        ctx->ipq_packet->payload = scratch_buffer;
+        ctx->ipq_packet->payload = scratch;
         ctx->modified            = 1;
     } else {
         // second invocation
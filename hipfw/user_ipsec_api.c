@@ -32,7 +32,10 @@
 
 /* required for IFNAMSIZ in libipq headers */
 #define _BSD_SOURCE
+/* sendmmsg() */
+#define _GNU_SOURCE
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,6 +43,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 
@@ -50,6 +54,7 @@
 #include "esp_prot_api.h"
 #include "hipfw_defines.h"
 #include "lsi.h"
+#include "pending_queue.h"
 #include "user_ipsec_esp.h"
 #include "user_ipsec_fw_msg.h"
 #include "user_ipsec_sadb.h"
@@ -71,15 +76,35 @@
                              + EVP_MAX_MD_SIZE) \
     + MAX_HASH_LENGTH
 
+/* number of ESP packets sent with a single system call */
+#define ESP_TX_BATCH        16
+
+/**
+ * ESP packets built for one of the raw sockets, but not sent yet. The packets
+ * of a burst read from a netfilter queue are collected and then sent with a
+ * single sendmmsg() call.
+ */
+struct esp_tx_batch {
+    const int              *sock;
+    unsigned int            count;
+    /* ::ESP_TX_BATCH buffers of ::ESP_PACKET_SIZE bytes */
+    unsigned char          *buf;
+    struct mmsghdr          msgs[ESP_TX_BATCH];
+    struct iovec            iov[ESP_TX_BATCH];
+    struct sockaddr_storage addr[ESP_TX_BATCH];
+};
 
-/* this is the ESP packet we are about to build */
-static unsigned char *esp_packet = NULL;
 /* the original packet before ESP decryption */
 static unsigned char *decrypted_packet = NULL;
+/* a packet released from the pending queue, with room for the ESP padding */
+static unsigned char *pending_packet = NULL;
 
 /* sockets needed in order to reinject the ESP packet into the network stack */
 static int raw_sock_v4 = 0;
 static int raw_sock_v6 = 0;
+/* the ESP packets we are about to send, per raw socket */
+static struct esp_tx_batch tx_batch_v4 = { &raw_sock_v4, 0, NULL };
+static struct esp_tx_batch tx_batch_v6 = { &raw_sock_v6, 0, NULL };
 /* allows us to make sure that we only init ones */
 static int is_init = 0;
 /* 0 = hipd does not know that userspace ipsec on */
@@ -159,10 +184,14 @@ int userspace_ipsec_init(void)
         HIP_DEBUG("ESP_PACKET_SIZE is %i\n", ESP_PACKET_SIZE);
 
         // allocate memory for the packet buffers
-        HIP_IFEL(!(esp_packet = malloc(ESP_PACKET_SIZE)), -1,
-                 "failed to allocate memory");
+        HIP_IFEL(!(tx_batch_v4.buf = malloc(ESP_TX_BATCH * ESP_PACKET_SIZE)),
+                 -1, "failed to allocate memory");
+        HIP_IFEL(!(tx_batch_v6.buf = malloc(ESP_TX_BATCH * ESP_PACKET_SIZE)),
+                 -1, "failed to allocate memory");
         HIP_IFEL(!(decrypted_packet = malloc(ESP_PACKET_SIZE)),
                  -1, "failed to allocate memory");
+        HIP_IFEL(!(pending_packet = malloc(ESP_PACKET_SIZE)),
+                 -1, "failed to allocate memory");
 
         // create required sockets
         HIP_IFEL(init_raw_sockets(), -1, "raw sockets");
@@ -180,6 +209,39 @@ out_err:
     return err;
 }
 
+/**
+ * sends the ESP packets collected in a batch
+ *
+ * @note the caller has to hold the sadb lock
+ *
+ * @param batch the batch to be sent
+ */
+static void esp_tx_flush(struct esp_tx_batch *const batch)
+{
+    unsigned int sent = 0;
+    int          ret  = 0;
+
+    while (sent < batch->count) {
+        ret = sendmmsg(*batch->sock, &batch->msgs[sent], batch->count - sent, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // skip the packet that failed, the others may still be sent
+            HIP_PERROR("sendmmsg() failed: ");
+            sent++;
+        } else {
+            sent += ret;
+        }
+    }
+
+    if (batch->count) {
+        HIP_DEBUG("%u ESP packets re-inserted into network stack\n",
+                  batch->count);
+    }
+    batch->count = 0;
+}
+
 /**
  * uninits the sadb, frees packet buffers and notifies
  * the hipd about the deactivation of userspace ipsec
@@ -197,6 +259,12 @@ int userspace_ipsec_uninit(void)
         HIP_ERROR("failed to notify hipd about userspace ipsec deactivation\n");
     }
 
+    // send the ESP packets still waiting in the batches
+    if (is_init) {
+        esp_tx_flush(&tx_batch_v4);
+        esp_tx_flush(&tx_batch_v6);
+    }
+
     hip_sadb_uninit();
 
     // close sockets used for reinjection
@@ -208,64 +276,39 @@ int userspace_ipsec_uninit(void)
     }
 
     // free the members
-    free(esp_packet);
+    free(tx_batch_v4.buf);
+    free(tx_batch_v6.buf);
     free(decrypted_packet);
+    free(pending_packet);
 
     return err;
 }
 
 /**
- * prepares the context for performing the ESP transformation
+ * transforms a HIT-based packet to an ESP packet and adds it to the batch of
+ * packets to be sent
+ *
+ * @note the caller has to hold the sadb lock
  *
  * @param ctx   the firewall context of the packet to be processed
- * @return      0, if correct, else != 0
+ * @param entry the outbound SA entry for the packet
+ * @return      1 if the ESP packet was built, else < 0
  */
-int hip_fw_userspace_ipsec_output(const struct hip_fw_context *ctx)
+static int esp_output(const struct hip_fw_context *ctx,
+                      struct hip_sa_entry *entry)
 {
-    // entry matching the peer HIT
-    struct hip_sa_entry *entry = NULL;
     // the routable addresses as used in HIPL
-    struct in6_addr         preferred_local_addr;
-    struct in6_addr         preferred_peer_addr;
-    struct sockaddr_storage preferred_peer_sockaddr;
-    struct timeval          now;
-    uint16_t                esp_packet_len = 0;
-    int                     out_ip_version = 0;
-    int                     err            = 0;
-
-    /* we should only get HIT addresses here
-     * LSI have been handled by LSI module before and converted to HITs */
-    HIP_ASSERT(ipv6_addr_is_hit(&ctx->src) && ipv6_addr_is_hit(&ctx->dst));
-
-    HIP_DEBUG("original packet length: %u \n", ctx->ipq_packet->data_len);
-
-    HIP_DEBUG_HIT("src_hit", &ctx->src);
-    HIP_DEBUG_HIT("dst_hit", &ctx->dst);
+    struct in6_addr      preferred_local_addr;
+    struct in6_addr      preferred_peer_addr;
+    struct esp_tx_batch *batch          = NULL;
+    struct mmsghdr      *msg            = NULL;
+    unsigned char       *esp_packet     = NULL;
+    struct timeval       now;
+    uint16_t             esp_packet_len = 0;
+    int                  err            = 0;
 
     gettimeofday(&now, NULL);
 
-    // SAs directing outwards are indexed with local and peer HIT
-    entry = hip_sa_entry_find_outbound(&ctx->src, &ctx->dst);
-
-    // create new SA entry, if none exists yet
-    if (entry == NULL) {
-        HIP_DEBUG("triggering BEX...\n");
-
-        /* no SADB entry -> trigger base exchange providing src and dst hit as
-         * used by the application */
-
-        HIP_IFEL(hip_trigger_bex(&ctx->src, &ctx->dst, NULL, NULL, NULL, NULL),
-                 -1, "trigger bex\n");
-
-        // as we don't buffer the packet right now, we have to drop it
-        // due to not routable addresses
-        err = 1;
-        // don't process this message any further
-        goto out_err;
-    }
-
-    HIP_DEBUG("matching SA entry found\n");
-
     /* get preferred routable addresses */
     memcpy(&preferred_local_addr, &entry->src_addr, sizeof(struct in6_addr));
     memcpy(&preferred_peer_addr, &entry->dst_addr, sizeof(struct in6_addr));
@@ -277,11 +320,11 @@ int hip_fw_userspace_ipsec_output(const struct hip_fw_context *ctx)
     if (IN6_IS_ADDR_V4MAPPED(&preferred_local_addr)
         && IN6_IS_ADDR_V4MAPPED(&preferred_peer_addr)) {
         HIP_DEBUG("out_ip_version is IPv4\n");
-        out_ip_version = 4;
+        batch = &tx_batch_v4;
     } else if (!IN6_IS_ADDR_V4MAPPED(&preferred_local_addr)
                && !IN6_IS_ADDR_V4MAPPED(&preferred_peer_addr)) {
         HIP_DEBUG("out_ip_version is IPv6\n");
-        out_ip_version = 6;
+        batch = &tx_batch_v6;
     } else {
         HIP_ERROR("bad address combination\n");
 
@@ -289,44 +332,48 @@ int hip_fw_userspace_ipsec_output(const struct hip_fw_context *ctx)
         goto out_err;
     }
 
-    // encrypt transport layer and create new packet
+    // encrypt transport layer and create new packet in the next free buffer
+    esp_packet = batch->buf + batch->count * ESP_PACKET_SIZE;
     HIP_IFEL(hip_beet_mode_output(ctx, entry, &preferred_local_addr,
                                   &preferred_peer_addr, esp_packet,
                                   &esp_packet_len),
              1, "failed to create ESP packet");
 
-    // create sockaddr for sendto
-    hip_addr_to_sockaddr(&preferred_peer_addr, &preferred_peer_sockaddr);
+    // create sockaddr for sendmmsg
+    hip_addr_to_sockaddr(&preferred_peer_addr, &batch->addr[batch->count]);
 
-    // reinsert the esp packet into the network stack
-    if (out_ip_version == 4) {
-        err = sendto(raw_sock_v4, esp_packet, esp_packet_len, 0,
-                     (struct sockaddr *) &preferred_peer_sockaddr,
-                     hip_sockaddr_len(&preferred_peer_sockaddr));
-    } else {
-        err = sendto(raw_sock_v6, esp_packet, esp_packet_len, 0,
-                     (struct sockaddr *) &preferred_peer_sockaddr,
-                     hip_sockaddr_len(&preferred_peer_sockaddr));
-    }
+    batch->iov[batch->count].iov_base = esp_packet;
+    batch->iov[batch->count].iov_len  = esp_packet_len;
 
-    if (err < esp_packet_len) {
-        HIP_DEBUG("sendto() failed\n");
-        err = -1;
-    } else {
-        HIP_DEBUG("new packet SUCCESSFULLY re-inserted into network stack\n");
-        HIP_DEBUG("dropping original packet...\n");
+    msg = &batch->msgs[batch->count];
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_hdr.msg_name    = &batch->addr[batch->count];
+    msg->msg_hdr.msg_namelen = hip_sockaddr_len(&batch->addr[batch->count]);
+    msg->msg_hdr.msg_iov     = &batch->iov[batch->count];
+    msg->msg_hdr.msg_iovlen  = 1;
 
-        // update SA statistics for replay protection etc
-        entry->bytes             += err;
-        entry->usetime.tv_sec     = now.tv_sec;
-        entry->usetime.tv_usec    = now.tv_usec;
-        entry->usetime_ka.tv_sec  = now.tv_sec;
-        entry->usetime_ka.tv_usec = now.tv_usec;
+    batch->count++;
 
-        // the original packet has to be dropped
-        err = 1;
+    HIP_DEBUG("dropping original packet...\n");
+
+    /* update SA statistics for replay protection etc
+     *
+     * @note the packet is accounted for when it is handed to the batch, as
+     *       the SA may be gone by the time the batch is sent */
+    entry->bytes             += esp_packet_len;
+    entry->usetime.tv_sec     = now.tv_sec;
+    entry->usetime.tv_usec    = now.tv_usec;
+    entry->usetime_ka.tv_sec  = now.tv_sec;
+    entry->usetime_ka.tv_usec = now.tv_usec;
+
+    // the batch is sent at the latest when the current burst is processed
+    if (batch->count == ESP_TX_BATCH) {
+        esp_tx_flush(batch);
     }
 
+    // the original packet has to be dropped
+    err = 1;
+
     // now do some esp token maintenance operations
     HIP_IFEL(esp_prot_sadb_maintenance(entry), -1,
              "esp protection extension maintenance operations failed\n");
@@ -335,6 +382,135 @@ out_err:
     return err;
 }
 
+/**
+ * prepares the context for performing the ESP transformation
+ *
+ * @param ctx   the firewall context of the packet to be processed
+ * @return      0, if correct, else != 0
+ */
+int hip_fw_userspace_ipsec_output(const struct hip_fw_context *ctx)
+{
+    // entry matching the peer HIT
+    struct hip_sa_entry *entry = NULL;
+    int                  err   = 0;
+
+    /* we should only get HIT addresses here
+     * LSI have been handled by LSI module before and converted to HITs */
+    HIP_ASSERT(ipv6_addr_is_hit(&ctx->src) && ipv6_addr_is_hit(&ctx->dst));
+
+    HIP_DEBUG("original packet length: %u \n", ctx->ipq_packet->data_len);
+
+    HIP_DEBUG_HIT("src_hit", &ctx->src);
+    HIP_DEBUG_HIT("dst_hit", &ctx->dst);
+
+    // the SA entry and the static packet buffer are shared by all queues
+    hip_sadb_lock();
+
+    // SAs directing outwards are indexed with local and peer HIT
+    entry = hip_sa_entry_find_outbound(&ctx->src, &ctx->dst);
+
+    // create new SA entry, if none exists yet
+    if (entry == NULL) {
+        /* hold the packet until hipd installs the SA, the base exchange
+         * has already been triggered if other packets are waiting */
+        if (hipfw_pending_enqueue(&ctx->src, &ctx->dst, ctx->ipq_packet) != 0) {
+            HIP_DEBUG("triggering BEX...\n");
+
+            /* no SADB entry -> trigger base exchange providing src and dst
+             * hit as used by the application */
+            HIP_IFEL(hip_trigger_bex(&ctx->src, &ctx->dst, NULL, NULL, NULL, NULL),
+                     -1, "trigger bex\n");
+        }
+
+        // the original packet is dropped, a queued copy is sent later on
+        err = 1;
+        // don't process this message any further
+        goto out_err;
+    }
+
+    HIP_DEBUG("matching SA entry found\n");
+
+    err = esp_output(ctx, entry);
+
+out_err:
+    hip_sadb_unlock();
+    return err;
+}
+
+/**
+ * sends the ESP packets built by hip_fw_userspace_ipsec_output()
+ *
+ * This is called at the end of each burst of packets read from a netfilter
+ * queue, so that no packet waits for packets of a later burst.
+ */
+void hip_fw_userspace_ipsec_flush_output(void)
+{
+    if (!is_init) {
+        return;
+    }
+
+    hip_sadb_lock();
+    esp_tx_flush(&tx_batch_v4);
+    esp_tx_flush(&tx_batch_v6);
+    hip_sadb_unlock();
+}
+
+/**
+ * sends a packet released from the pending queue through its SA
+ *
+ * @param packet the queued HIT-based packet
+ * @param arg    the outbound SA entry
+ */
+static void pending_output(const hip_ipq_packet_msg *packet, void *arg)
+{
+    struct hip_fw_context ctx = { 0 };
+    hip_ipq_packet_msg    msg = *packet;
+
+    // the ESP transformation appends the padding to the original packet
+    memcpy(pending_packet, packet->payload, packet->data_len);
+    msg.payload = pending_packet;
+
+    ctx.ipq_packet  = &msg;
+    ctx.ip_version  = 6;
+    ctx.ip_hdr_len  = sizeof(struct ip6_hdr);
+    ctx.ip_hdr.ipv6 = (struct ip6_hdr *) pending_packet;
+    ctx.src         = ctx.ip_hdr.ipv6->ip6_src;
+    ctx.dst         = ctx.ip_hdr.ipv6->ip6_dst;
+
+    if (esp_output(&ctx, arg) < 0) {
+        HIP_ERROR("failed to send pending packet\n");
+    }
+}
+
+/**
+ * sends the packets that were queued while the SA between two HITs was
+ * being established
+ *
+ * @param src_hit   the local HIT of the outbound SA
+ * @param dst_hit   the peer HIT of the outbound SA
+ * @return          the number of sent packets
+ */
+unsigned int hip_fw_userspace_ipsec_flush_pending(const struct in6_addr *src_hit,
+                                                  const struct in6_addr *dst_hit)
+{
+    struct hip_sa_entry *entry = NULL;
+    unsigned int         count = 0;
+
+    if (!is_init) {
+        return 0;
+    }
+
+    hip_sadb_lock();
+    if ((entry = hip_sa_entry_find_outbound(src_hit, dst_hit))) {
+        count = hipfw_pending_flush(src_hit, dst_hit, pending_output, entry);
+    }
+    esp_tx_flush(&tx_batch_v4);
+    esp_tx_flush(&tx_batch_v6);
+    hip_sadb_unlock();
+
+    return count;
+}
+
 /**
  * prepares the context for performing the ESP transformation
  *
@@ -359,6 +535,9 @@ int hip_fw_userspace_ipsec_input(const struct hip_fw_context *ctx)
     esp_hdr = ctx->transport_hdr.esp;
     spi     = ntohl(esp_hdr->esp_spi);
 
+    // the SA entry and the static packet buffer are shared by all queues
+    hip_sadb_lock();
+
     // lookup corresponding SA entry by dst_addr and SPI
     HIP_IFEL(!(entry = hip_sa_entry_find_inbound(&ctx->dst, spi)), -1,
              "no SA entry found for dst_addr and SPI\n");
@@ -397,5 +576,6 @@ int hip_fw_userspace_ipsec_input(const struct hip_fw_context *ctx)
     }
 
 out_err:
+    hip_sadb_unlock();
     return err;
 }
@@ -35,6 +35,7 @@
 
 #define _BSD_SOURCE
 
+#include <netinet/in.h>
 #include <netinet/udp.h>
 #include <openssl/aes.h>
 #include <openssl/evp.h>
@@ -47,5 +48,8 @@ int userspace_ipsec_init(void);
 int userspace_ipsec_uninit(void);
 int hip_fw_userspace_ipsec_input(const struct hip_fw_context *ctx);
 int hip_fw_userspace_ipsec_output(const struct hip_fw_context *ctx);
+void hip_fw_userspace_ipsec_flush_output(void);
+unsigned int hip_fw_userspace_ipsec_flush_pending(const struct in6_addr *src_hit,
+                                                  const struct in6_addr *dst_hit);
 
 #endif /* HIPL_HIPFW_USER_IPSEC_API_H */
@@ -136,6 +136,145 @@ static void add_ipv6_header(struct ip6_hdr *ip6_hdr,
     memcpy(&ip6_hdr->ip6_dst, dst_addr, sizeof(struct in6_addr));
 }
 
+/** builds the nonce of an AEAD transform
+ *
+ * @param entry     the SA entry, its authentication key holds the salt
+ * @param iv        the explicit IV
+ * @param nonce     the nonce
+ */
+static void aead_nonce(const struct hip_sa_entry *entry,
+                       const unsigned char *iv,
+                       unsigned char nonce[AEAD_NONCE_LENGTH])
+{
+    memcpy(nonce, entry->auth_key->key, AEAD_SALT_LENGTH);
+    memcpy(&nonce[AEAD_SALT_LENGTH], iv, AEAD_IV_LENGTH);
+}
+
+/** encrypts and authenticates the payload of ESP packets in a single pass
+ *  with an AEAD transform
+ *
+ * The ESP header, including an eventual esp protection extension hash, is
+ * authenticated as additional data. It is followed by the explicit IV, the
+ * ciphertext and the ICV.
+ *
+ * @param in        the input-buffer containing the data to be encrypted
+ * @param in_type   value of the next header type
+ * @param in_len    the length of the input-buffer
+ * @param out       the output-buffer, starting with the ESP header
+ * @param out_len   the length of the output-buffer
+ * @param entry     the SA entry containing the keyed cipher context
+ * @return          0, if correct, != 0 else
+ */
+static int aead_encrypt(unsigned char *in, const uint8_t in_type,
+                        const uint16_t in_len, unsigned char *out,
+                        uint16_t *out_len, struct hip_sa_entry *entry)
+{
+    const uint16_t       esp_data_offset = esp_prot_get_data_offset(entry);
+    unsigned char *const iv              = &out[esp_data_offset];
+    unsigned char *const ciphertext      = iv + AEAD_IV_LENGTH;
+    unsigned char        nonce[AEAD_NONCE_LENGTH];
+    uint16_t             pad_len  = 0;
+    uint16_t             elen     = in_len;
+    struct hip_esp_tail *esp_tail = NULL;
+    uint32_t             iv_words[2];
+    int                  len = 0, final_len = 0;
+    int                  i, err = 0;
+
+    HIP_IFEL(!entry->aead_ctx, -1, "AEAD key missing.\n");
+
+    /* a counter makes the IV unique for this key */
+    iv_words[0] = htonl((uint32_t) (entry->aead_iv >> 32));
+    iv_words[1] = htonl((uint32_t) entry->aead_iv);
+    entry->aead_iv++;
+    memcpy(iv, iv_words, AEAD_IV_LENGTH);
+    aead_nonce(entry, iv, nonce);
+
+    /* AEAD ciphers need no block alignment, pad to 4 bytes for ESP */
+    pad_len = 4 - ((elen + sizeof(struct hip_esp_tail)) % 4);
+    for (i = 0; i < pad_len; i++) {
+        in[in_len + i] = i + 1;
+    }
+    esp_tail             = (struct hip_esp_tail *) &in[elen + pad_len];
+    esp_tail->esp_padlen = pad_len;
+    esp_tail->esp_next   = in_type;
+    elen                += pad_len + sizeof(struct hip_esp_tail);
+
+    HIP_IFEL(EVP_CipherInit_ex(entry->aead_ctx, NULL, NULL, NULL, nonce, 1) != 1 ||
+             EVP_CipherUpdate(entry->aead_ctx, NULL, &len, out,
+                              esp_data_offset) != 1 ||
+             EVP_CipherUpdate(entry->aead_ctx, ciphertext, &len, in, elen) != 1 ||
+             EVP_CipherFinal_ex(entry->aead_ctx, ciphertext + len,
+                                &final_len) != 1 ||
+             EVP_CIPHER_CTX_ctrl(entry->aead_ctx, EVP_CTRL_GCM_GET_TAG,
+                                 AEAD_ICV_LENGTH, ciphertext + elen) != 1,
+             -1, "AEAD encryption failed\n");
+
+    *out_len += AEAD_IV_LENGTH + elen + AEAD_ICV_LENGTH;
+
+out_err:
+    return err;
+}
+
+/** decrypts and verifies the payload of ESP packets in a single pass
+ *  with an AEAD transform
+ *
+ * @param in        the input-buffer, starting with the ESP header
+ * @param in_len    the length of the input-buffer
+ * @param out       the output-buffer
+ * @param out_type  type value of the ESP next header field
+ * @param out_len   the length of the output-buffer
+ * @param entry     the SA entry containing the keyed cipher context
+ * @return          0, if correct, != 0 else
+ */
+static int aead_decrypt(const unsigned char *in, const uint16_t in_len,
+                        unsigned char *out, uint8_t *out_type,
+                        uint16_t *out_len, struct hip_sa_entry *entry)
+{
+    const uint16_t       esp_data_offset = esp_prot_get_data_offset(entry);
+    const unsigned char *iv              = &in[esp_data_offset];
+    unsigned char        nonce[AEAD_NONCE_LENGTH];
+    unsigned char        icv[AEAD_ICV_LENGTH];
+    struct hip_esp_tail *esp_tail = NULL;
+    int                  elen     = 0;
+    int                  len      = 0, final_len = 0;
+    int                  err      = 0;
+
+    HIP_IFEL(!entry->aead_ctx, -1, "AEAD key missing.\n");
+
+    elen = in_len - esp_data_offset - AEAD_IV_LENGTH - AEAD_ICV_LENGTH;
+    HIP_IFEL(elen < (int) sizeof(struct hip_esp_tail), 1,
+             "ESP packet too short\n");
+
+    aead_nonce(entry, iv, nonce);
+    memcpy(icv, &in[in_len - AEAD_ICV_LENGTH], AEAD_ICV_LENGTH);
+
+    HIP_IFEL(EVP_CipherInit_ex(entry->aead_ctx, NULL, NULL, NULL, nonce, 0) != 1 ||
+             EVP_CipherUpdate(entry->aead_ctx, NULL, &len, in,
+                              esp_data_offset) != 1 ||
+             EVP_CipherUpdate(entry->aead_ctx, out, &len,
+                              iv + AEAD_IV_LENGTH, elen) != 1 ||
+             EVP_CIPHER_CTX_ctrl(entry->aead_ctx, EVP_CTRL_GCM_SET_TAG,
+                                 AEAD_ICV_LENGTH, icv) != 1,
+             -1, "AEAD decryption failed\n");
+
+    if (EVP_CipherFinal_ex(entry->aead_ctx, out + len, &final_len) != 1) {
+        HIP_DEBUG("ESP packet could not be authenticated\n");
+
+        err = 1;
+        goto out_err;
+    }
+
+    HIP_DEBUG("esp packet successfully authenticated and decrypted\n");
+
+    /* remove padding */
+    esp_tail  = (struct hip_esp_tail *) &out[elen - sizeof(struct hip_esp_tail)];
+    *out_type = esp_tail->esp_next;
+    *out_len  = elen - (esp_tail->esp_padlen + sizeof(struct hip_esp_tail));
+
+out_err:
+    return err;
+}
+
 /** encrypts the payload of ESP packets and adds authentication information
  *
  * @param in        the input-buffer containing the data to be encrypted
@@ -166,6 +305,10 @@ static int payload_encrypt(unsigned char *in, const uint8_t in_type,
     int      i               = 0;
     int      err             = 0;
 
+    if (entry->aead_ctx) {
+        return aead_encrypt(in, in_type, in_len, out, out_len, entry);
+    }
+
     esp_data_offset = esp_prot_get_data_offset(entry);
 
     /*
@@ -372,6 +515,10 @@ static int payload_decrypt(const unsigned char *in, const uint16_t in_len,
     uint16_t esp_data_offset = 0;
     int      err             = 0;
 
+    if (entry->aead_ctx) {
+        return aead_decrypt(in, in_len, out, out_type, out_len, entry);
+    }
+
     // different offset if esp extension used or not
     esp_data_offset = esp_prot_get_data_offset(entry);
 
@@ -751,8 +898,17 @@ int hip_beet_mode_input(const struct hip_fw_context *ctx,
     uint16_t esp_len            = 0;
     uint16_t decrypted_data_len = 0;
     uint8_t  next_hdr           = 0;
+    uint64_t esn                = 0;
     int      err                = 0;
 
+    // drop replayed packets before spending any work on them
+    if (hip_replay_check(&entry->replay, ntohl(ctx->transport_hdr.esp->esp_seq),
+                         &esn)) {
+        HIP_DEBUG("dropping replayed or stale ESP packet, seq %u\n",
+                  ntohl(ctx->transport_hdr.esp->esp_seq));
+        return -1;
+    }
+
     // the decrypted data will be placed behind the HIT-based IPv6 header
     next_hdr_offset = sizeof(struct ip6_hdr);
 
@@ -776,6 +932,9 @@ int hip_beet_mode_input(const struct hip_fw_context *ctx,
                              decrypted_packet + next_hdr_offset, &next_hdr,
                              &decrypted_data_len, entry), -1, "ESP decryption is not successful\n");
 
+    // only authenticated packets may move the window
+    hip_replay_update(&entry->replay, esn);
+
     *decrypted_packet_len += decrypted_data_len;
 
     // now we know the next_hdr and can set up the IPv6 header
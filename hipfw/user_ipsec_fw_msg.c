@@ -43,6 +43,7 @@
 #include "libcore/protodefs.h"
 #include "esp_prot_fw_msg.h"
 #include "hipfw.h"
+#include "user_ipsec_api.h"
 #include "user_ipsec_sadb.h"
 #include "user_ipsec_fw_msg.h"
 
@@ -86,7 +87,7 @@ int send_userspace_ipsec_to_hipd(const int activate)
     HIP_DUMP_MSG(msg);
 
     /* send msg to hipd and receive corresponding reply */
-    HIP_IFEL(hip_send_recv_daemon_info(msg, 1, hip_fw_sock), -1,
+    HIP_IFEL(hip_fw_send_recv_daemon_info(msg, 1), -1,
              "send_recv msg failed\n");
 
     /* check error value */
@@ -191,6 +192,11 @@ int handle_sa_add_request(const struct hip_common *msg)
                           retransmission, update),
              -1, "failed to add user_space IPsec security association\n");
 
+    // release the packets that have been waiting for this SA
+    if (direction == HIP_SPI_DIRECTION_OUT) {
+        hip_fw_userspace_ipsec_flush_pending(src_hit, dst_hit);
+    }
+
 out_err:
     return err;
 }
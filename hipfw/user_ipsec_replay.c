@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * The replay window is a ring of 64-bit words (RFC 6479). Advancing the
+ * window clears whole words instead of shifting the bitmap, so checking and
+ * updating a sequence number touches a single word in the common case.
+ *
+ * Sequence numbers are tracked as 64-bit extended sequence numbers. The high
+ * order bits are not transmitted and are inferred from the position of the
+ * window, which keeps the window working across a wrap of the 32-bit
+ * sequence number.
+ *
+ * @brief Anti-replay window for userspace IPsec
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "user_ipsec_replay.h"
+
+
+/* packets the window accepts behind the highest sequence number */
+#define REPLAY_WINDOW (HIP_REPLAY_WINDOW_SIZE - 64)
+
+/**
+ * Reset a replay window for a new SA.
+ *
+ * @param window the window
+ */
+void hip_replay_init(struct hip_replay_window *window)
+{
+    memset(window, 0, sizeof(*window));
+}
+
+/**
+ * Infer the extended sequence number of a received sequence number and
+ * check whether it may be accepted. This is cheap enough to run before the
+ * packet is authenticated.
+ *
+ * The high order bits are inferred with serial number arithmetic, i.e. the
+ * sequence number is taken to be less than 2^31 ahead of or behind the
+ * highest one seen. Unlike the inference of RFC 4303, Appendix A2.2,
+ * sequence numbers below the window are not moved to the next subspace:
+ * HIP does not negotiate ESN, so the ICV does not cover the high order bits
+ * and could not refute such a guess.
+ *
+ * @param window the window of the inbound SA
+ * @param seq    the sequence number of the ESP header, in host byte order
+ * @param esn    receives the extended sequence number
+ * @return       0 if the packet is new, -1 if it is a replay or too old
+ */
+int hip_replay_check(const struct hip_replay_window *window,
+                     const uint32_t seq, uint64_t *esn)
+{
+    const uint32_t ahead  = seq - (uint32_t) window->top;
+    const uint32_t behind = (uint32_t) window->top - seq;
+    uint64_t       bit;
+
+    if (ahead != 0 && ahead < UINT32_C(0x80000000)) {
+        *esn = window->top + ahead;
+        return 0;
+    }
+
+    // sequence number 0 is never sent
+    if (behind >= REPLAY_WINDOW || behind >= window->top) {
+        return -1;
+    }
+
+    *esn = window->top - behind;
+    bit  = UINT64_C(1) << (*esn & 63);
+    return window->bitmap[(*esn >> 6) % HIP_REPLAY_WINDOW_WORDS] & bit ? -1 : 0;
+}
+
+/**
+ * Record an authenticated sequence number in the replay window.
+ *
+ * @param window the window of the inbound SA
+ * @param esn    the extended sequence number determined by
+ *               hip_replay_check()
+ */
+void hip_replay_update(struct hip_replay_window *window, const uint64_t esn)
+{
+    uint64_t block, diff, i;
+
+    if (esn > window->top) {
+        // clear the words that the window moves over
+        block = window->top >> 6;
+        diff  = (esn >> 6) - block;
+        if (diff > HIP_REPLAY_WINDOW_WORDS) {
+            diff = HIP_REPLAY_WINDOW_WORDS;
+        }
+        for (i = 1; i <= diff; i++) {
+            window->bitmap[(block + i) % HIP_REPLAY_WINDOW_WORDS] = 0;
+        }
+        window->top = esn;
+    } else if (window->top - esn >= REPLAY_WINDOW) {
+        return;
+    }
+
+    window->bitmap[(esn >> 6) % HIP_REPLAY_WINDOW_WORDS] |= UINT64_C(1) << (esn & 63);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Anti-replay window for inbound userspace ESP (RFC 4303, Section 3.4.3),
+ * with inference of extended sequence numbers.
+ *
+ * @brief Anti-replay window for userspace IPsec
+ */
+
+#ifndef HIPL_HIPFW_USER_IPSEC_REPLAY_H
+#define HIPL_HIPFW_USER_IPSEC_REPLAY_H
+
+#include <stdint.h>
+
+/* size of the replay bitmap in bits, a multiple of 64. One word of the
+ * bitmap is cleared as the window advances, so the effective window is
+ * 64 packets smaller. */
+#define HIP_REPLAY_WINDOW_SIZE  1024
+#define HIP_REPLAY_WINDOW_WORDS (HIP_REPLAY_WINDOW_SIZE / 64)
+
+struct hip_replay_window {
+    uint64_t top;       /* highest authenticated extended sequence number */
+    uint64_t bitmap[HIP_REPLAY_WINDOW_WORDS];
+};
+
+void hip_replay_init(struct hip_replay_window *window);
+int hip_replay_check(const struct hip_replay_window *window,
+                     uint32_t seq, uint64_t *esn);
+void hip_replay_update(struct hip_replay_window *window, uint64_t esn);
+
+#endif /* HIPL_HIPFW_USER_IPSEC_REPLAY_H */
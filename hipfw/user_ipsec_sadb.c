@@ -31,6 +31,7 @@
  * @brief Security association database for IPsec connections
  */
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -39,7 +40,7 @@
 #include <openssl/blowfish.h>
 #include <openssl/des.h>
 #include <openssl/lhash.h>
-#include <openssl/sha.h>
+#include <openssl/rand.h>
 #include <sys/time.h>
 
 #include "libcore/builder.h"
@@ -51,15 +52,15 @@
 #include "libcore/ife.h"
 #include "libcore/keylen.h"
 #include "libcore/prefix.h"
+#include "libcore/siphash.h"
 #include "libcore/state.h"
+#include "config.h"
 #include "esp_prot_api.h"
 #include "esp_prot_defines.h"
 #include "hipfw.h"
 #include "user_ipsec_sadb.h"
 
 
-#define INDEX_HASH_FN           HIP_DIGEST_SHA1
-#define INDEX_HASH_LENGTH       SHA_DIGEST_LENGTH
 
 /* Structure for demultiplexing inbound ipsec packets, indexed by dst_addr and spi */
 struct hip_link_entry {
@@ -72,8 +73,75 @@ struct hip_link_entry {
 static HIP_HASHTABLE *sadb = NULL;
 /* database storing shortcuts to sa entries for incoming packets */
 static HIP_HASHTABLE *linkdb = NULL;
+/* protects both databases and the entries stored in them */
+static pthread_mutex_t sadb_lock = PTHREAD_MUTEX_INITIALIZER;
+/* secret key of the index hash function, chosen at random in hip_sadb_init()
+ * so that peers cannot predict which keys collide in the databases */
+static uint8_t index_hash_key[HIP_SIPHASH_KEY_LEN];
 
 
+/**
+ * get the OpenSSL cipher of an AEAD transform
+ *
+ * @param ealg  crypto transform
+ * @return      the cipher, NULL if @a ealg is no supported AEAD transform
+ */
+static const EVP_CIPHER *aead_cipher(const int ealg)
+{
+    switch (ealg) {
+#ifdef HAVE_EVP_AES_GCM
+    case HIP_ESP_AES_GCM:
+        return EVP_aes_128_gcm();
+#endif
+#ifdef HAVE_EVP_CHACHA20_POLY1305
+    case HIP_ESP_CHACHA20_POLY1305:
+        return EVP_chacha20_poly1305();
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * keys the AEAD cipher context of an SA entry
+ *
+ * The context is set up once per key, so that processing a packet only
+ * needs to pass the nonce.
+ *
+ * @param entry     SA entry with the raw encryption key set
+ * @param direction direction of the SA
+ * @return          0 on success, else -1
+ */
+static int aead_ctx_init(struct hip_sa_entry *entry, const int direction)
+{
+    const EVP_CIPHER *cipher = aead_cipher(entry->ealg);
+    const int         enc    = direction == HIP_SPI_DIRECTION_OUT;
+    int               err    = 0;
+
+    HIP_IFEL(!cipher, -1, "Unsupported AEAD transform: %i\n", entry->ealg);
+    HIP_IFEL(!entry->enc_key, -1, "enc_key required!\n");
+
+    if (!entry->aead_ctx) {
+        HIP_IFEL(!(entry->aead_ctx = EVP_CIPHER_CTX_new()), -1,
+                 "failed to allocate cipher context\n");
+    }
+
+    HIP_IFEL(EVP_CipherInit_ex(entry->aead_ctx, cipher, NULL, NULL, NULL, enc) != 1 ||
+             EVP_CIPHER_CTX_ctrl(entry->aead_ctx, EVP_CTRL_GCM_SET_IVLEN,
+                                 AEAD_NONCE_LENGTH, NULL) != 1 ||
+             EVP_CipherInit_ex(entry->aead_ctx, NULL, NULL,
+                               entry->enc_key->key, NULL, enc) != 1,
+             -1, "AEAD key problem!\n");
+
+    /* the explicit IV is a counter, so it never repeats for this key */
+    HIP_IFEL(RAND_bytes((unsigned char *) &entry->aead_iv,
+                        sizeof(entry->aead_iv)) <= 0,
+             -1, "failed to generate initial IV\n");
+
+out_err:
+    return err;
+}
+
 /**
  * hashes the inner addresses (for now) to lookup the corresponding SA entry
  *
@@ -83,7 +151,6 @@ static HIP_HASHTABLE *linkdb = NULL;
 static unsigned long sa_entry_hash(const struct hip_sa_entry *sa_entry)
 {
     struct in6_addr addr_pair[2];               /* in BEET-mode these are HITs */
-    union hip_hash  hash;
 
     if (sa_entry->mode == 3) {
         /* use hits to index in beet mode
@@ -99,13 +166,7 @@ static unsigned long sa_entry_hash(const struct hip_sa_entry *sa_entry)
         return 0;
     }
 
-    if (hip_build_digest(INDEX_HASH_FN, addr_pair,
-                         2 * sizeof(struct in6_addr), hash.serialized)) {
-        HIP_ERROR("failed to hash addresses\n");
-        return 0;
-    }
-
-    return hash.chunked[0];
+    return hip_siphash(index_hash_key, addr_pair, sizeof(addr_pair));
 }
 
 /**
@@ -146,7 +207,6 @@ static unsigned long link_entry_hash(const struct hip_link_entry *link_entry)
 {
     int            input_length = sizeof(struct in6_addr) + sizeof(uint32_t);
     unsigned char  hash_input[input_length];
-    union hip_hash hash;
 
     // values have to be present
     HIP_ASSERT(link_entry != NULL && link_entry->spi != 0);
@@ -156,13 +216,7 @@ static unsigned long link_entry_hash(const struct hip_link_entry *link_entry)
     memcpy(&hash_input[sizeof(struct in6_addr)], &link_entry->spi,
            sizeof(uint32_t));
 
-    if (hip_build_digest(INDEX_HASH_FN, hash_input, input_length,
-                         hash.serialized)) {
-        HIP_ERROR("failed to hash addresses\n");
-        return 0;
-    }
-
-    return hash.chunked[0];
+    return hip_siphash(index_hash_key, hash_input, input_length);
 }
 
 /**
@@ -355,8 +409,18 @@ static int sa_entry_set(struct hip_sa_entry *entry, int direction,
     entry->src_port   = src_port;
     entry->dst_port   = dst_port;
 
+    // keys must also be set up when switching to a different transform
+    if (entry->ealg != ealg) {
+        enc_key_changed = 1;
+    }
     entry->ealg = ealg;
 
+    // an AEAD context selects the AEAD code path, drop it for other transforms
+    if (!aead_cipher(ealg)) {
+        EVP_CIPHER_CTX_free(entry->aead_ctx);
+        entry->aead_ctx = NULL;
+    }
+
     // copy raw keys, if they changed
     if (memcmp(entry->auth_key, auth_key, hip_auth_key_length_esp(ealg))) {
         memcpy(entry->auth_key, auth_key, hip_auth_key_length_esp(ealg));
@@ -411,6 +475,12 @@ static int sa_entry_set(struct hip_sa_entry *entry, int direction,
         case HIP_ESP_BLOWFISH_SHA1:
             BF_set_key(&entry->bf_key, hip_enc_key_length(ealg), enc_key->key);
 
+            break;
+        case HIP_ESP_AES_GCM:
+        case HIP_ESP_CHACHA20_POLY1305:
+            HIP_IFEL(aead_ctx_init(entry, direction), -1,
+                     "AEAD key problem!\n");
+
             break;
         case HIP_ESP_NULL_SHA1:
         // same encryption chiper as next transform
@@ -425,9 +495,10 @@ static int sa_entry_set(struct hip_sa_entry *entry, int direction,
         }
     }
 
-    // only set the seq no in case there is NO update
+    // only set the seq no and replay window in case there is NO update
     if (!update) {
         entry->sequence = 1;
+        hip_replay_init(&entry->replay);
     }
     entry->lifetime = lifetime;
 
@@ -520,6 +591,7 @@ static void sa_entry_free(struct hip_sa_entry *entry)
     if (entry) {
         free(entry->auth_key);
         free(entry->enc_key);
+        EVP_CIPHER_CTX_free(entry->aead_ctx);
 
         // also free all hchain related members
         esp_prot_sa_entry_free(entry);
@@ -651,6 +723,8 @@ int hip_sadb_init(void)
 {
     int err = 0;
 
+    HIP_IFEL(RAND_bytes(index_hash_key, sizeof(index_hash_key)) <= 0, -1,
+             "failed to generate index hash key\n");
     HIP_IFEL(!(sadb = hip_ht_init(LHASH_HASH_FN(sa_entry),
                                   LHASH_COMP_FN(sa_entries))), -1,
              "failed to initialize sadb\n");
@@ -724,6 +798,8 @@ int hip_sadb_add(int direction, uint32_t spi, uint32_t mode,
 
     default_hit = hip_fw_get_default_hit();
 
+    hip_sadb_lock();
+
     /*
      * Switch port numbers depending on direction and make sure that we
      * are testing correct local hit.
@@ -762,6 +838,8 @@ int hip_sadb_add(int direction, uint32_t spi, uint32_t mode,
     }
 
 out_err:
+    // sends the bex-store update if the SA used anchors from the store
+    hip_sadb_unlock();
     return err;
 }
 
@@ -777,6 +855,8 @@ int hip_sadb_delete(const struct in6_addr *dst_addr, uint32_t spi)
     struct hip_sa_entry *entry = NULL;
     int                  err   = 0;
 
+    pthread_mutex_lock(&sadb_lock);
+
     HIP_IFEL(!(entry = hip_sa_entry_find_inbound(dst_addr, spi)), -1,
              "failed to retrieve sa entry\n");
 
@@ -784,6 +864,7 @@ int hip_sadb_delete(const struct in6_addr *dst_addr, uint32_t spi)
              "failed to delete entry\n");
 
 out_err:
+    pthread_mutex_unlock(&sadb_lock);
     return err;
 }
 
@@ -813,12 +894,39 @@ static void delete_sa_entry(void *const ptr)
  */
 void hip_sadb_flush(void)
 {
+    pthread_mutex_lock(&sadb_lock);
     hip_ht_doall(sadb, delete_sa_entry);
+    pthread_mutex_unlock(&sadb_lock);
+}
+
+/**
+ * Acquire exclusive access to the sadb. SA entries returned by the lookup
+ * functions may only be used while holding the lock.
+ */
+void hip_sadb_lock(void)
+{
+    pthread_mutex_lock(&sadb_lock);
+}
+
+/**
+ * Release the lock acquired with hip_sadb_lock(). Messages for hipd that
+ * were created while holding the lock are sent afterwards, so that no
+ * packet processing waits for the hipd socket.
+ */
+void hip_sadb_unlock(void)
+{
+    struct hip_ll msgs;
+
+    esp_prot_take_hipd_msgs(&msgs);
+    pthread_mutex_unlock(&sadb_lock);
+    esp_prot_send_hipd_msgs(&msgs);
 }
 
 /**
  * searches the linkdb for corresponding SA entry
  *
+ * @note the caller has to hold the sadb lock (see hip_sadb_lock())
+ *
  * @param dst_addr  outer destination address of the ip packet
  * @param spi       SPI number of the searched entry
  * @return          SA entry on success or NULL if no matching entry was found
@@ -846,6 +954,8 @@ out_err:
 /**
  * searches the sadb for a SA entry
  *
+ * @note the caller has to hold the sadb lock (see hip_sadb_lock())
+ *
  * @param src_hit   inner source address
  * @param dst_hit   inner destination address
  * @return          SA entry on success or NULL if no matching entry found
@@ -39,15 +39,24 @@
 #include <openssl/aes.h>
 #include <openssl/blowfish.h>
 #include <openssl/des.h>
+#include <openssl/evp.h>
 #include <sys/time.h>
 
 #include "libcore/esp_prot_common.h"
 #include "libcore/hashchain.h"
 #include "esp_prot_defines.h"
+#include "user_ipsec_replay.h"
 
 
 #define BEET_MODE 3 /* mode: 1-transport, 2-tunnel, 3-beet -> right now we only support mode 3 */
 
+/* nonce of AEAD transforms: salt from the keying material followed by the
+ * explicit IV carried in each packet (RFC 4106) */
+#define AEAD_SALT_LENGTH  4
+#define AEAD_IV_LENGTH    8
+#define AEAD_NONCE_LENGTH (AEAD_SALT_LENGTH + AEAD_IV_LENGTH)
+#define AEAD_ICV_LENGTH   16
+
 /* IPsec Security Association entry */
 struct hip_sa_entry {
     int             direction;             /* direction of the SA: inbound/outbound */
@@ -67,12 +76,15 @@ struct hip_sa_entry {
     des_key_schedule       ks[3];          /* 3-DES keys */
     AES_KEY                aes_key;        /* AES key */
     BF_KEY                 bf_key;         /* BLOWFISH key */
+    EVP_CIPHER_CTX        *aead_ctx;       /* keyed context of AEAD transforms */
+    uint64_t               aead_iv;        /* next explicit IV of AEAD transforms */
     /******************** statistics *************************/
     uint64_t       lifetime;               /* seconds until expiration */
     uint64_t       bytes;                  /* bytes transmitted */
     struct timeval usetime;                /* last used timestamp */
     struct timeval usetime_ka;             /* last used timestamp, including keep-alives */
     uint32_t       sequence;               /* ESP sequence number counter */
+    struct hip_replay_window replay;       /* anti-replay window of inbound SAs */
     /*********** esp protection extension params *************/
     /* for both directions */
     uint8_t esp_prot_transform;                /* mode used for securing ipsec traffic */
@@ -111,6 +123,8 @@ int hip_sadb_add(int direction,
 int hip_sadb_delete(const struct in6_addr *dst_addr,
                     uint32_t spi);
 void hip_sadb_flush(void);
+void hip_sadb_lock(void);
+void hip_sadb_unlock(void);
 struct hip_sa_entry *hip_sa_entry_find_inbound(const struct in6_addr *dst_addr,
                                                uint32_t spi);
 struct hip_sa_entry *hip_sa_entry_find_outbound(const struct in6_addr *src_hit,
@@ -1166,6 +1166,8 @@ const char *hip_get_msg_type_name(const uint8_t msg_type)
     case HIP_MSG_SET_NAT_PLAIN_UDP:  return "HIP_MSG_SET_NAT_PLAIN_UDP";
     case HIP_MSG_SET_NAT_NONE:       return "HIP_MSG_SET_NAT_NONE";
     case HIP_MSG_FW_BEX_DONE:        return "HIP_MSG_FW_BEX_DONE";
+    case HIP_MSG_FW_HA_UPDATE:       return "HIP_MSG_FW_HA_UPDATE";
+    case HIP_MSG_FW_HA_DELETE:       return "HIP_MSG_FW_HA_DELETE";
     case HIP_MSG_IPSEC_ADD_SA:       return "HIP_MSG_IPSEC_ADD_SA";
     case HIP_MSG_USERSPACE_IPSEC:    return "HIP_MSG_USERSPACE_IPSEC";
     case HIP_MSG_ESP_PROT_TFM:       return "HIP_MSG_ESP_PROT_TFM";
@@ -2684,6 +2686,12 @@ hip_transform_suite hip_get_param_transform_suite_id(const void *transform_tlv)
                                            HIP_HIP_AES_SHA1 };
     uint16_t        supported_esp_tf[] = { HIP_ESP_NULL_SHA1,
                                            HIP_ESP_3DES_SHA1,
+#ifdef HAVE_EVP_AES_GCM
+                                           HIP_ESP_AES_GCM,
+#endif
+#ifdef HAVE_EVP_CHACHA20_POLY1305
+                                           HIP_ESP_CHACHA20_POLY1305,
+#endif
                                            HIP_ESP_AES_SHA1 };
     const uint16_t *table = NULL;
     const uint16_t *tfm;
@@ -265,23 +265,57 @@ uint16_t inchksum(const void *data, uint32_t length)
  *             sockaddr_in6 structure in network byte order.
  *             IPv6 mapped addresses are not supported.
  * @return     the checksum
- * @note       Checksumming is from Boeing's HIPD.
- * @note       the header file declaration disables optimizations for
- *             this function due to issues with IPv6 (lp:1184142)
  */
-uint16_t __attribute__((optimize("O0"))) hip_checksum_packet(char *data,
-                                            const struct sockaddr *src,
-                                            const struct sockaddr *dst)
+uint16_t hip_checksum_packet(char *data,
+                             const struct sockaddr *src,
+                             const struct sockaddr *dst)
+{
+    const struct hip_common *const hiph = (const struct hip_common *) data;
+    const struct iovec             iov  = {
+        .iov_base = data,
+        .iov_len  = (hiph->payload_len + 1) * 8
+    };
+
+    return hip_checksum_packet_iov(&iov, 1, src, dst);
+}
+
+/**
+ * Calculates the checksum of a HIP packet with pseudo-header, where the
+ * packet is split across several buffers.
+ *
+ * @param iov    the buffers that make up the packet, the first one starts
+ *               with the hip_common header. All buffers but the last must
+ *               have an even length.
+ * @param iovcnt the number of buffers
+ * @param src    The source address of the packet as a sockaddr_in or
+ *               sockaddr_in6 structure in network byte order.
+ *               IPv6 mapped addresses are not supported.
+ * @param dst    The destination address of the packet as a sockaddr_in or
+ *               sockaddr_in6 structure in network byte order.
+ *               IPv6 mapped addresses are not supported.
+ * @return       the checksum
+ * @note         Checksumming is from Boeing's HIPD.
+ * @note         the header file declaration disables optimizations for
+ *               this function due to issues with IPv6 (lp:1184142)
+ */
+uint16_t __attribute__((optimize("O0"))) hip_checksum_packet_iov(const struct iovec *const iov,
+                                                const unsigned int iovcnt,
+                                                const struct sockaddr *src,
+                                                const struct sockaddr *dst)
 {
     uint16_t               checksum = 0;
     uint32_t               sum      = 0;
     uint16_t               count    = 0, length = 0;
-    uint16_t               *p       = NULL; /* 16-bit */
+    const uint16_t        *p        = NULL; /* 16-bit */
     struct pseudo_header   pseudoh  = { { 0 } };
     struct pseudo_header6  pseudoh6 = { { 0 } };
     uint32_t               src_network, dst_network;
     const struct in6_addr *src6, *dst6;
-    struct hip_common     *hiph = (struct hip_common *) data;
+    unsigned int           i;
+
+    for (i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
 
     if (src->sa_family == AF_INET) {
         /* IPv4 checksum based on UDP-- Section 6.1.2 */
@@ -291,7 +325,6 @@ uint16_t __attribute__((optimize("O0"))) hip_checksum_packet(char *data,
         memcpy(&pseudoh.src_addr, &src_network, 4);
         memcpy(&pseudoh.dst_addr, &dst_network, 4);
         pseudoh.protocol      = IPPROTO_HIP;
-        length                = (hiph->payload_len + 1) * 8;
         pseudoh.packet_length = htons(length);
 
         count = sizeof(struct pseudo_header);                 /* count always even number */
@@ -303,7 +336,6 @@ uint16_t __attribute__((optimize("O0"))) hip_checksum_packet(char *data,
 
         memcpy(&pseudoh6.src_addr[0], src6, 16);
         memcpy(&pseudoh6.dst_addr[0], dst6, 16);
-        length                 = (hiph->payload_len + 1) * 8;
         pseudoh6.packet_length = htonl(length);
         pseudoh6.next_hdr      = IPPROTO_HIP;
 
@@ -324,15 +356,17 @@ uint16_t __attribute__((optimize("O0"))) hip_checksum_packet(char *data,
 
     /* one's complement sum 16-bit words of data */
     HIP_DEBUG("Checksumming %d bytes of data.\n", length);
-    count = length;
-    p     = (uint16_t *) data;
-    while (count > 1) {
-        sum   += *p++;
-        count -= 2;
-    }
-    /* add left-over byte, if any */
-    if (count > 0) {
-        sum += (unsigned char) *p;
+    for (i = 0; i < iovcnt; i++) {
+        count = iov[i].iov_len;
+        p     = iov[i].iov_base;
+        while (count > 1) {
+            sum   += *p++;
+            count -= 2;
+        }
+        /* add left-over byte, if any */
+        if (count > 0) {
+            sum += *(const unsigned char *) p;
+        }
     }
 
     /*  Fold 32-bit sum to 16 bits */
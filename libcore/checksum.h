@@ -7,6 +7,7 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 uint16_t ipv4_checksum(const uint8_t protocol, const void *const s,
                        const void *const d, const void *const c,
@@ -20,5 +21,9 @@ uint16_t inchksum(const void *data, uint32_t length);
 uint16_t hip_checksum_packet(char *data,
                              const struct sockaddr *src,
                              const struct sockaddr *dst);
+uint16_t hip_checksum_packet_iov(const struct iovec *const iov,
+                                 const unsigned int iovcnt,
+                                 const struct sockaddr *src,
+                                 const struct sockaddr *dst);
 
 #endif /* HIPL_LIBCORE_GPL_CHECKSUM_H */
@@ -1782,12 +1782,13 @@ static int conf_handle_locator(struct hip_common *msg, UNUSED int action,
 static int conf_handle_puzzle(struct hip_common *msg, int action,
                               const char *opt[], int optc, int send_only)
 {
-    int                          err  = 0, ret = 0, msg_type = 0, all, new_val = 0;
-    const int                   *diff = NULL;
-    hip_hit_t                    hit  = { { { 0 } } }, all_zero_hit = { { { 0 } } };
-    char                         hit_s[INET6_ADDRSTRLEN];
-    const struct hip_tlv_common *current_param = NULL;
-    hip_tlv                      param_type    = 0;
+    int                           err  = 0, ret = 0, msg_type = 0, all, new_val = 0;
+    const int                    *diff = NULL;
+    const struct hip_puzzle_load *load = NULL;
+    hip_hit_t                     hit  = { { { 0 } } }, all_zero_hit = { { { 0 } } };
+    char                          hit_s[INET6_ADDRSTRLEN];
+    const struct hip_tlv_common  *current_param = NULL;
+    hip_tlv                       param_type    = 0;
 
     if (action == ACTION_SET) {
         if (optc != 2) {
@@ -1869,12 +1870,20 @@ static int conf_handle_puzzle(struct hip_common *msg, int action,
                 //no need to get the hit from msg
             } else if (param_type == HIP_PARAM_INT) {
                 diff = hip_get_param_contents_direct(current_param);
+            } else if (param_type == HIP_PARAM_PUZZLE_LOAD) {
+                load = (const struct hip_puzzle_load *) current_param;
             } else {
                 HIP_ERROR("Unrelated parameter in user message.\n");
             }
         }
 
         HIP_INFO("Puzzle difficulty is: %d\n", *diff);
+        if (load) {
+            HIP_INFO("Difficulty of new R1s is %u (raised by %u for load: "
+                     "I1/s %u, I2/s %u, crypto backlog %u)\n",
+                     load->k, load->boost, load->i1_rate, load->i2_rate,
+                     load->backlog);
+        }
 
         if (ipv6_addr_cmp(&all_zero_hit, &hit) != 0) {
             inet_ntop(AF_INET6, &hit, hit_s, INET6_ADDRSTRLEN);
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief Multi-buffer SHA-1 for hash chain and hash tree generation
+ *
+ * A single SHA-1 computation is sequential, but hash chain stores and hash
+ * trees need many independent digests of short, equally long messages. The
+ * vector engines run the SHA-1 compression function for HASH_MB_LANES such
+ * messages in lockstep, one message per 32 bit vector lane.
+ *
+ * The engine is chosen at runtime from the CPU features. On CPUs with the
+ * SHA extensions, the scalar OpenSSL implementation already uses dedicated
+ * instructions and is preferred. Everywhere else, AVX2 or SSE2 lanes are used
+ * if the compiler supports them, with OpenSSL as the fallback.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <openssl/sha.h>
+
+#include "debug.h"
+#include "hash_mb.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define HASH_MB_X86
+#endif
+
+/** not yet initialized engine selection */
+#define HASH_MB_UNSET -1
+
+static int engine = HASH_MB_UNSET;
+
+#ifdef HASH_MB_X86
+
+/* CPUID leaf 7 flag for the SHA extensions */
+#define HASH_MB_CPUID_SHA (1 << 29)
+
+typedef uint32_t mb_vec __attribute__((vector_size(4 * HASH_MB_LANES)));
+
+#define ROTL32(x, b) (((x) << (b)) | ((x) >> (32 - (b))))
+
+#define SHA1_F1(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA1_F2(b, c, d) ((b) ^ (c) ^ (d))
+#define SHA1_F3(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+
+/* one SHA-1 round, the callers rotate the variables instead of moving them */
+#define SHA1_ROUND(a, b, c, d, e, f, k, t)                              \
+    do {                                                                \
+        if ((t) >= 16) {                                                \
+            w[(t) & 15] = ROTL32(w[((t) - 3) & 15] ^ w[((t) - 8) & 15] ^ \
+                                 w[((t) - 14) & 15] ^ w[(t) & 15], 1);  \
+        }                                                               \
+        e += ROTL32(a, 5) + f(b, c, d) + (k) + w[(t) & 15];             \
+        b  = ROTL32(b, 30);                                             \
+    } while (0)
+
+#define SHA1_5ROUNDS(f, k, t)                                           \
+    do {                                                                \
+        SHA1_ROUND(a, b, c, d, e, f, k, t);                             \
+        SHA1_ROUND(e, a, b, c, d, f, k, t + 1);                         \
+        SHA1_ROUND(d, e, a, b, c, f, k, t + 2);                         \
+        SHA1_ROUND(c, d, e, a, b, f, k, t + 3);                         \
+        SHA1_ROUND(b, c, d, e, a, f, k, t + 4);                         \
+    } while (0)
+
+/**
+ * Defines a function that runs the SHA-1 compression function for all lanes.
+ * The lanes are processed with GCC vector extensions, which are compiled to
+ * the instruction set given as target.
+ *
+ * @param name   name of the function
+ * @param isa    the instruction set for the target attribute
+ */
+#define SHA1_MB_COMPRESS(name, isa)                                          \
+    __attribute__((target(isa)))                                             \
+    static void name(uint32_t state[5][HASH_MB_LANES],                       \
+                     const uint32_t block[16][HASH_MB_LANES])                \
+    {                                                                        \
+        mb_vec w[16], a, b, c, d, e;                                         \
+        mb_vec h[5];                                                         \
+        int    t;                                                            \
+                                                                             \
+        memcpy(h, state, sizeof(h));                                         \
+        memcpy(w, block, sizeof(w));                                         \
+        a = h[0];                                                            \
+        b = h[1];                                                            \
+        c = h[2];                                                            \
+        d = h[3];                                                            \
+        e = h[4];                                                            \
+                                                                             \
+        for (t = 0; t < 20; t += 5) {                                        \
+            SHA1_5ROUNDS(SHA1_F1, 0x5a827999, t);                            \
+        }                                                                    \
+        for (; t < 40; t += 5) {                                             \
+            SHA1_5ROUNDS(SHA1_F2, 0x6ed9eba1, t);                            \
+        }                                                                    \
+        for (; t < 60; t += 5) {                                             \
+            SHA1_5ROUNDS(SHA1_F3, 0x8f1bbcdc, t);                            \
+        }                                                                    \
+        for (; t < 80; t += 5) {                                             \
+            SHA1_5ROUNDS(SHA1_F2, 0xca62c1d6, t);                            \
+        }                                                                    \
+                                                                             \
+        h[0] += a;                                                           \
+        h[1] += b;                                                           \
+        h[2] += c;                                                           \
+        h[3] += d;                                                           \
+        h[4] += e;                                                           \
+        memcpy(state, h, sizeof(h));                                         \
+    }
+
+SHA1_MB_COMPRESS(sha1_mb_compress_sse2, "sse2")
+SHA1_MB_COMPRESS(sha1_mb_compress_avx2, "avx2")
+
+/**
+ * Checks whether the CPU implements the SHA extensions.
+ *
+ * @return 1 if the SHA instructions are available, 0 otherwise
+ */
+static int cpu_has_sha_ni(void)
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, NULL) < 7) {
+        return 0;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+    return (ebx & HASH_MB_CPUID_SHA) != 0;
+}
+
+/**
+ * Hashes up to HASH_MB_LANES messages of equal length with a vector engine.
+ * Unused lanes hash the first message again and are discarded.
+ *
+ * @param data    the messages
+ * @param length  the length of each message in bytes
+ * @param digests buffers of SHA_DIGEST_LENGTH bytes for the digests
+ * @param num     the number of messages, at most HASH_MB_LANES
+ * @param mb_engine the vector engine to be used
+ */
+static void sha1_mb(const unsigned char *const data[], const size_t length,
+                    unsigned char *const digests[], const unsigned num,
+                    const enum hash_mb_engine mb_engine)
+{
+    static const uint32_t iv[5] = { 0x67452301, 0xefcdab89, 0x98badcfe,
+                                    0x10325476, 0xc3d2e1f0 };
+    const uint64_t        bits       = (uint64_t) length * 8;
+    const size_t          num_blocks = (length + 8) / 64 + 1;
+    uint32_t              state[5][HASH_MB_LANES];
+    uint32_t              block[16][HASH_MB_LANES];
+    unsigned char         buffer[64];
+    uint32_t              word;
+    const unsigned char  *msg;
+    size_t                i, offset, msg_bytes, msg_words;
+    unsigned              lane, j;
+
+    for (j = 0; j < 5; j++) {
+        for (lane = 0; lane < HASH_MB_LANES; lane++) {
+            state[j][lane] = iv[j];
+        }
+    }
+
+    for (i = 0; i < num_blocks; i++) {
+        offset    = i * 64;
+        msg_bytes = offset < length ? length - offset : 0;
+        msg_bytes = msg_bytes < 64 ? msg_bytes : 64;
+        msg_words = (msg_bytes + 3) / 4;
+
+        // the padding is the same in all lanes
+        memset(buffer, 0, sizeof(buffer));
+        if (offset <= length && length - offset < 64) {
+            buffer[length - offset] = 0x80;
+        }
+        if (i == num_blocks - 1) {
+            for (j = 0; j < 8; j++) {
+                buffer[56 + j] = bits >> (56 - 8 * j);
+            }
+        }
+        for (j = msg_words; j < 16; j++) {
+            memcpy(&word, &buffer[4 * j], sizeof(word));
+            for (lane = 0; lane < HASH_MB_LANES; lane++) {
+                block[j][lane] = ntohl(word);
+            }
+        }
+
+        // store the big-endian message words lane by lane
+        for (lane = 0; lane < HASH_MB_LANES; lane++) {
+            msg = &data[lane < num ? lane : 0][offset];
+
+            for (j = 0; j < msg_bytes / 4; j++) {
+                memcpy(&word, &msg[4 * j], sizeof(word));
+                block[j][lane] = ntohl(word);
+            }
+            // a trailing partial word is completed by the padding
+            if (j < msg_words) {
+                memcpy(&buffer[4 * j], &msg[4 * j], msg_bytes % 4);
+                memcpy(&word, &buffer[4 * j], sizeof(word));
+                block[j][lane] = ntohl(word);
+            }
+        }
+
+        if (mb_engine == HASH_MB_AVX2) {
+            sha1_mb_compress_avx2(state, block);
+        } else {
+            sha1_mb_compress_sse2(state, block);
+        }
+    }
+
+    for (lane = 0; lane < num; lane++) {
+        for (j = 0; j < SHA_DIGEST_LENGTH; j++) {
+            digests[lane][j] = state[j / 4][lane] >> (24 - 8 * (j % 4));
+        }
+    }
+}
+
+#endif /* HASH_MB_X86 */
+
+/**
+ * Checks whether an engine can be used on this CPU.
+ *
+ * @param mb_engine the engine
+ * @return 1 if the engine is supported, 0 otherwise
+ */
+static int engine_supported(const enum hash_mb_engine mb_engine)
+{
+    switch (mb_engine) {
+    case HASH_MB_SCALAR:
+        return 1;
+#ifdef HASH_MB_X86
+    case HASH_MB_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case HASH_MB_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Gets the engine used for multi-buffer hashing. The engine is selected
+ * from the CPU features on first use.
+ *
+ * @return the engine
+ */
+enum hash_mb_engine hash_mb_get_engine(void)
+{
+    int mb_engine = __atomic_load_n(&engine, __ATOMIC_RELAXED);
+
+    if (mb_engine == HASH_MB_UNSET) {
+        mb_engine = HASH_MB_SCALAR;
+#ifdef HASH_MB_X86
+        if (!cpu_has_sha_ni()) {
+            if (engine_supported(HASH_MB_AVX2)) {
+                mb_engine = HASH_MB_AVX2;
+            } else if (engine_supported(HASH_MB_SSE2)) {
+                mb_engine = HASH_MB_SSE2;
+            }
+        }
+#endif
+        HIP_DEBUG("multi-buffer hashing engine: %i\n", mb_engine);
+        __atomic_store_n(&engine, mb_engine, __ATOMIC_RELAXED);
+    }
+
+    return mb_engine;
+}
+
+/**
+ * Overrides the engine selected from the CPU features.
+ *
+ * @param mb_engine the engine to be used
+ * @return 0 on success, -1 if the CPU does not support the engine
+ */
+int hash_mb_set_engine(const enum hash_mb_engine mb_engine)
+{
+    if (!engine_supported(mb_engine)) {
+        return -1;
+    }
+    __atomic_store_n(&engine, mb_engine, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+/**
+ * Computes the SHA-1 digests of several messages of equal length.
+ *
+ * @param data    the messages
+ * @param length  the length of each message in bytes
+ * @param digests buffers of SHA_DIGEST_LENGTH bytes for the digests, which
+ *                may overlap with the corresponding message
+ * @param num     the number of messages
+ * @return 0 on success, -1 on error
+ */
+int hash_mb_sha1(const unsigned char *const data[], const size_t length,
+                 unsigned char *const digests[], const unsigned num)
+{
+    SHA_CTX  ctx;
+    unsigned i = 0;
+
+#ifdef HASH_MB_X86
+    const enum hash_mb_engine mb_engine = hash_mb_get_engine();
+    unsigned                  lanes;
+
+    if (mb_engine != HASH_MB_SCALAR) {
+        // a single remaining message is faster in the scalar implementation
+        for (; i + 1 < num; i += lanes) {
+            lanes = num - i < HASH_MB_LANES ? num - i : HASH_MB_LANES;
+            sha1_mb(&data[i], length, &digests[i], lanes, mb_engine);
+        }
+    }
+#endif
+
+    /* the low-level interface avoids the per-call algorithm lookup that
+     * the one-shot SHA1() has in recent OpenSSL versions */
+    for (; i < num; i++) {
+        if (!SHA1_Init(&ctx) || !SHA1_Update(&ctx, data[i], length) ||
+            !SHA1_Final(digests[i], &ctx)) {
+            HIP_ERROR("failed to calculate hash\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
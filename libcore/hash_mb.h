@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HIPL_LIBCORE_HASH_MB_H
+#define HIPL_LIBCORE_HASH_MB_H
+
+#include <stddef.h>
+
+/** number of messages the vector engines hash in lockstep */
+#define HASH_MB_LANES 8
+
+/** implementations of the multi-buffer engine */
+enum hash_mb_engine {
+    HASH_MB_SCALAR = 0,
+    HASH_MB_SSE2,
+    HASH_MB_AVX2
+};
+
+int hash_mb_sha1(const unsigned char *const data[], const size_t length,
+                 unsigned char *const digests[], const unsigned num);
+
+enum hash_mb_engine hash_mb_get_engine(void);
+int hash_mb_set_engine(const enum hash_mb_engine engine);
+
+#endif /* HIPL_LIBCORE_HASH_MB_H */
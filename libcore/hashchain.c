@@ -37,6 +37,7 @@
 #include <openssl/md5.h>
 
 #include "debug.h"
+#include "hash_mb.h"
 #include "hashtree.h"
 #include "ife.h"
 #include "hashchain.h"
@@ -99,29 +100,125 @@ out_err:
     return err;
 }
 
-/** creates a new hash chain
+/* slots of the elements array of a pebbled hash chain */
+#define PEBBLED_SEED    0
+#define PEBBLED_ANCHOR  1
+#define PEBBLED_CURRENT 2
+
+/** computes the next element of a hash chain in place
  *
- * @param       hash_func hash function to be used to generate the hash values
- * @param       hash_length length of the hash values
- * @param       hchain_length number of hash elements
- * @param       hchain_hierarchy the hierarchy level this hash chain will belong to
- * @param       link_tree the link tree, if HHL is used
- * @return  pointer to the newly created hash chain, NULL on error
+ * @param       hchain the hash chain the element belongs to
+ * @param       element the element, replaced by its successor
+ * @return      0 on success, -1 on error
  */
-struct hash_chain *hchain_create(const hash_function hash_func,
-                                 const int hash_length,
-                                 const int hchain_length,
-                                 const int hchain_hierarchy,
-                                 struct hash_tree *link_tree)
+static int hchain_step(const struct hash_chain *hchain, unsigned char *element)
 {
-    struct hash_chain *hchain = NULL;
     /* the hash function output might be longer than needed
      * allocate enough memory for the hash function output
      *
      * @note we also allow a concatenation with the link tree root and the jump chain element here */
     unsigned char hash_value[3 * MAX_HASH_LENGTH];
-    int           hash_data_length = 0;
-    int           i, err = 0;
+    int           hash_data_length = hchain->hash_length;
+
+    memcpy(hash_value, element, hchain->hash_length);
+
+    /* concatenate used part of the calculated hash with the link tree root */
+    if (hchain->link_tree) {
+        memcpy(&hash_value[hchain->hash_length], hchain->link_tree->root,
+               hchain->link_tree->node_length);
+        hash_data_length = 2 * hchain->hash_length;
+    }
+
+    // (input, input_length, output) -> output_length == 20
+    if (!hchain->hash_function(hash_value, hash_data_length, hash_value)) {
+        HIP_ERROR("failed to calculate hash\n");
+        return -1;
+    }
+
+    // only consider highest bytes of digest with length of actual element
+    memcpy(element, hash_value, hchain->hash_length);
+
+    return 0;
+}
+
+/** computes the next elements of several hash chains in lockstep
+ *
+ * SHA-1 based chains are advanced with the multi-buffer engine, other hash
+ * functions one chain at a time.
+ *
+ * @param       hchains the hash chains, which share hash function, hash length
+ *                      and hierarchy level
+ * @param       elements the current element of each chain, replaced by its
+ *                       successor
+ * @param       num_hchains number of hash chains, at most HASH_MB_LANES
+ * @return      0 on success, -1 on error
+ */
+static int hchain_step_multi(struct hash_chain *const hchains[],
+                             unsigned char elements[][MAX_HASH_LENGTH],
+                             const int num_hchains)
+{
+    unsigned char        hash_values[HASH_MB_LANES][2 * MAX_HASH_LENGTH];
+    const unsigned char *data[HASH_MB_LANES];
+    unsigned char       *digests[HASH_MB_LANES];
+    const int            hash_length      = hchains[0]->hash_length;
+    int                  hash_data_length = hash_length;
+    int                  i;
+
+    if (num_hchains == 1 || hchains[0]->hash_function != (hash_function) SHA1) {
+        for (i = 0; i < num_hchains; i++) {
+            if (hchain_step(hchains[i], elements[i])) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    for (i = 0; i < num_hchains; i++) {
+        memcpy(hash_values[i], elements[i], hash_length);
+
+        // same link tree concatenation as in hchain_step()
+        if (hchains[i]->link_tree) {
+            memcpy(&hash_values[i][hash_length], hchains[i]->link_tree->root,
+                   hchains[i]->link_tree->node_length);
+            hash_data_length = 2 * hash_length;
+        }
+
+        data[i]    = hash_values[i];
+        digests[i] = hash_values[i];
+    }
+
+    if (hash_mb_sha1(data, hash_data_length, digests, num_hchains)) {
+        return -1;
+    }
+
+    for (i = 0; i < num_hchains; i++) {
+        memcpy(elements[i], hash_values[i], hash_length);
+    }
+
+    return 0;
+}
+
+/** allocates a new hash chain without computing its elements
+ *
+ * @param       hash_func hash function to be used to generate the hash values
+ * @param       hash_length length of the hash values
+ * @param       hchain_length number of hash elements
+ * @param       hchain_hierarchy the hierarchy level this hash chain will belong to
+ * @param       link_tree the link tree, if HHL is used
+ * @param       pebbled store pebbles instead of all elements
+ * @return  pointer to the newly allocated hash chain, NULL on error
+ */
+static struct hash_chain *hchain_alloc(const hash_function hash_func,
+                                       const int hash_length,
+                                       const int hchain_length,
+                                       const int hchain_hierarchy,
+                                       struct hash_tree *link_tree,
+                                       const int pebbled)
+{
+    struct hash_chain    *hchain = NULL;
+    struct hchain_pebble *pebble = NULL;
+    int                   max_pebbles, len;
+    int                   err = 0;
 
     HIP_ASSERT(hash_func != NULL);
     // make sure that the hash we want to use is smaller than the max output
@@ -133,60 +230,255 @@ struct hash_chain *hchain_create(const hash_function hash_func,
     HIP_IFEL(!(hchain = calloc(1, sizeof(struct hash_chain))), -1,
              "failed to allocate memory\n");
 
-    // allocate memory for the hash chain elements
-    HIP_IFEL(!(hchain->elements = calloc(1, hash_length * hchain_length)),
-             -1, "failed to allocate memory\n");
-
+    hchain->hash_function    = hash_func;
+    hchain->hash_length      = hash_length;
+    hchain->hchain_length    = hchain_length;
+    hchain->current_index    = hchain_length;
+    hchain->hchain_hierarchy = hchain_hierarchy;
     // set the link tree if we are using different hierarchies
-    if (link_tree) {
-        hchain->link_tree = link_tree;
-        hash_data_length  = 2 * hash_length;
+    hchain->link_tree = link_tree;
+
+    if (pebbled) {
+        // halving the remaining range needs at most ceil(log2(n)) + 1 pebbles
+        for (max_pebbles = 1, len = 1; len < hchain_length; len *= 2) {
+            max_pebbles++;
+        }
+
+        HIP_IFEL(!(hchain->elements = calloc(3, hash_length)),
+                 -1, "failed to allocate memory\n");
+        HIP_IFEL(!(hchain->pebbles = calloc(max_pebbles, sizeof(*hchain->pebbles))),
+                 -1, "failed to allocate memory\n");
+
+        /* place the pebbles the first pops would need anyway, each
+         * pebble covers the upper half of the range of the previous one */
+        pebble           = hchain->pebbles;
+        pebble->position = 0;
+        pebble->end      = hchain_length;
+        while (pebble->end - pebble->position > 1) {
+            pebble[1].position = pebble->position +
+                                 (pebble->end - pebble->position) / 2;
+            pebble[1].end      = pebble->end;
+            pebble->end        = pebble[1].position;
+            pebble++;
+        }
+        hchain->num_pebbles = pebble - hchain->pebbles + 1;
     } else {
+        // allocate memory for the hash chain elements
+        HIP_IFEL(!(hchain->elements = calloc(1, hash_length * hchain_length)),
+                 -1, "failed to allocate memory\n");
+    }
+
+out_err:
+    if (err && hchain) {
+        // the link tree stays with the caller
         hchain->link_tree = NULL;
-        hash_data_length  = hash_length;
+        hchain_free(hchain);
+        hchain = NULL;
+    }
+
+    return hchain;
+}
+
+/** creates up to HASH_MB_LANES new hash chains, whose elements are computed
+ *  in lockstep
+ *
+ * A pebbled hash chain only stores O(log n) of its elements. The others are
+ * recomputed when they are popped, which costs O(log n) hash operations per
+ * element on average (Coppersmith and Jakobsson, "Almost Optimal Hash
+ * Sequence Traversal").
+ *
+ * @param       hash_func hash function to be used to generate the hash values
+ * @param       hash_length length of the hash values
+ * @param       hchain_length number of hash elements
+ * @param       hchain_hierarchy the hierarchy level the hash chains will belong to
+ * @param       link_trees the link tree of each hash chain if HHL is used,
+ *                         NULL otherwise
+ * @param       pebbled store pebbles instead of all elements
+ * @param       hchains buffer for the newly created hash chains
+ * @param       num_hchains number of hash chains to be created
+ * @return      0 on success, -1 on error
+ *
+ * @note The hash chains take over the link trees. On error, all link trees are
+ *       freed and no hash chain is returned.
+ */
+static int hchain_build(const hash_function hash_func,
+                        const int hash_length,
+                        const int hchain_length,
+                        const int hchain_hierarchy,
+                        struct hash_tree *const link_trees[],
+                        const int pebbled,
+                        struct hash_chain *hchains[],
+                        const int num_hchains)
+{
+    unsigned char         elements[HASH_MB_LANES][MAX_HASH_LENGTH];
+    struct hchain_pebble *pebbles[HASH_MB_LANES];
+    struct hash_chain    *hchain = NULL;
+    int                   i, j, err = 0;
+
+    HIP_ASSERT(num_hchains > 0 && num_hchains <= HASH_MB_LANES);
+
+    memset(hchains, 0, num_hchains * sizeof(*hchains));
+
+    for (j = 0; j < num_hchains; j++) {
+        HIP_IFEL(!(hchains[j] = hchain_alloc(hash_func, hash_length,
+                                             hchain_length, hchain_hierarchy,
+                                             link_trees ? link_trees[j] : NULL,
+                                             pebbled)),
+                 -1, "failed to allocate hash chain\n");
+        pebbles[j] = hchains[j]->pebbles;
+
+        // random bytes as seed
+        HIP_IFEL(RAND_bytes(elements[j], hash_length) <= 0, -1,
+                 "failed to get random bytes for source element\n");
     }
 
     for (i = 0; i < hchain_length; i++) {
         if (i > 0) {
-            // (input, input_length, output) -> output_length == 20
-            HIP_IFEL(!(hash_func(hash_value, hash_data_length, hash_value)), -1,
+            HIP_IFEL(hchain_step_multi(hchains, elements, num_hchains), -1,
                      "failed to calculate hash\n");
-            // only consider highest bytes of digest with length of actual element
-            memcpy(&hchain->elements[i * hash_length], hash_value, hash_length);
-        } else {
-            // random bytes as seed -> need a copy in hash_value for further computations
-            HIP_IFEL(RAND_bytes(hash_value, hash_length) <= 0, -1,
-                     "failed to get random bytes for source element\n");
-
-            memcpy(&hchain->elements[i * hash_length], hash_value, hash_length);
         }
 
-        /* concatenate used part of the calculated hash with the link tree root */
-        if (link_tree) {
-            memcpy(&hash_value[hash_length], link_tree->root, link_tree->node_length);
+        for (j = 0; j < num_hchains; j++) {
+            hchain = hchains[j];
+
+            if (!pebbled) {
+                memcpy(&hchain->elements[i * hash_length], elements[j],
+                       hash_length);
+            } else if (pebbles[j] < hchain->pebbles + hchain->num_pebbles &&
+                       pebbles[j]->position == i) {
+                memcpy(pebbles[j]->element, elements[j], hash_length);
+                pebbles[j]++;
+            }
         }
     }
 
-    hchain->hash_function    = hash_func;
-    hchain->hash_length      = hash_length;
-    hchain->hchain_length    = hchain_length;
-    hchain->current_index    = hchain_length;
-    hchain->hchain_hierarchy = hchain_hierarchy;
+    for (j = 0; j < num_hchains && pebbled; j++) {
+        hchain = hchains[j];
+        memcpy(&hchain->elements[PEBBLED_SEED * hash_length],
+               hchain->pebbles[0].element, hash_length);
+        memcpy(&hchain->elements[PEBBLED_ANCHOR * hash_length], elements[j],
+               hash_length);
+    }
 
-    HIP_DEBUG("Hash-chain with %i elements of length %i created!\n",
-              hchain_length,
-              hash_length);
+    HIP_DEBUG("%i hash-chains with %i elements of length %i created!\n",
+              num_hchains, hchain_length, hash_length);
 
 out_err:
     if (err) {
-        // hchain was fully created
-        hchain_free(hchain);
-        hchain = NULL;
+        for (j = 0; j < num_hchains; j++) {
+            if (hchains[j]) {
+                // frees the link tree as well
+                hchain_free(hchains[j]);
+                hchains[j] = NULL;
+            } else if (link_trees) {
+                htree_free(link_trees[j]);
+            }
+        }
     }
 
+    return err;
+}
+
+/** creates a new hash chain that stores all of its elements
+ *
+ * @param       hash_func hash function to be used to generate the hash values
+ * @param       hash_length length of the hash values
+ * @param       hchain_length number of hash elements
+ * @param       hchain_hierarchy the hierarchy level this hash chain will belong to
+ * @param       link_tree the link tree, if HHL is used
+ * @return  pointer to the newly created hash chain, NULL on error
+ */
+struct hash_chain *hchain_create(const hash_function hash_func,
+                                 const int hash_length,
+                                 const int hchain_length,
+                                 const int hchain_hierarchy,
+                                 struct hash_tree *link_tree)
+{
+    struct hash_chain *hchain = NULL;
+
+    hchain_build(hash_func, hash_length, hchain_length, hchain_hierarchy,
+                 &link_tree, 0, &hchain, 1);
+
+    return hchain;
+}
+
+/** creates a new hash chain that only stores O(log n) of its elements
+ *
+ * @param       hash_func hash function to be used to generate the hash values
+ * @param       hash_length length of the hash values
+ * @param       hchain_length number of hash elements
+ * @param       hchain_hierarchy the hierarchy level this hash chain will belong to
+ * @param       link_tree the link tree, if HHL is used
+ * @return  pointer to the newly created hash chain, NULL on error
+ */
+struct hash_chain *hchain_create_pebbled(const hash_function hash_func,
+                                         const int hash_length,
+                                         const int hchain_length,
+                                         const int hchain_hierarchy,
+                                         struct hash_tree *link_tree)
+{
+    struct hash_chain *hchain = NULL;
+
+    hchain_build(hash_func, hash_length, hchain_length, hchain_hierarchy,
+                 &link_tree, 1, &hchain, 1);
+
     return hchain;
 }
 
+/** creates several hash chains with the same parameters at once
+ *
+ * The elements of up to HASH_MB_LANES chains are computed in lockstep, which
+ * allows SHA-1 based chains to use the multi-buffer hashing engine.
+ *
+ * @param       hash_func hash function to be used to generate the hash values
+ * @param       hash_length length of the hash values
+ * @param       hchain_length number of hash elements
+ * @param       hchain_hierarchy the hierarchy level the hash chains will belong to
+ * @param       link_trees the link tree of each hash chain if HHL is used,
+ *                         NULL otherwise
+ * @param       pebbled store pebbles instead of all elements
+ * @param       hchains buffer for the newly created hash chains
+ * @param       num_hchains number of hash chains to be created
+ * @return      0 on success, -1 on error
+ *
+ * @note The hash chains take over the link trees. On error, all link trees are
+ *       freed and no hash chain is returned.
+ */
+int hchain_create_multi(const hash_function hash_func,
+                        const int hash_length,
+                        const int hchain_length,
+                        const int hchain_hierarchy,
+                        struct hash_tree *const link_trees[],
+                        const int pebbled,
+                        struct hash_chain *hchains[],
+                        const int num_hchains)
+{
+    int i, j, num, err = 0;
+
+    for (i = 0; i < num_hchains; i += HASH_MB_LANES) {
+        num = num_hchains - i < HASH_MB_LANES ? num_hchains - i : HASH_MB_LANES;
+
+        if (hchain_build(hash_func, hash_length, hchain_length,
+                         hchain_hierarchy, link_trees ? &link_trees[i] : NULL,
+                         pebbled, &hchains[i], num)) {
+            HIP_ERROR("failed to create hash chains\n");
+
+            // release the chains of the previous and the trees of the next rounds
+            for (j = 0; j < i; j++) {
+                hchain_free(hchains[j]);
+                hchains[j] = NULL;
+            }
+            for (j = i + num; j < num_hchains && link_trees; j++) {
+                htree_free(link_trees[j]);
+            }
+            err = -1;
+            break;
+        }
+    }
+
+    return err;
+}
+
 /* getter function for a specific element of the given hash chain
  *
  * @param       hash_chain hash chain from which the element should be returned
@@ -201,7 +493,16 @@ static unsigned char *hchain_element_by_index(const struct hash_chain *hash_chai
 
     HIP_ASSERT(hash_chain);
 
-    if (idx >= 0 && idx < hash_chain->hchain_length) {
+    if (hash_chain->pebbles && idx == 0) {
+        element = &hash_chain->elements[PEBBLED_SEED * hash_chain->hash_length];
+    } else if (hash_chain->pebbles && idx == hash_chain->hchain_length - 1) {
+        element = &hash_chain->elements[PEBBLED_ANCHOR * hash_chain->hash_length];
+    } else if (hash_chain->pebbles) {
+        HIP_ERROR("Only seed and anchor of a pebbled hash chain can be accessed by index!");
+
+        err = -1;
+        goto out_err;
+    } else if (idx >= 0 && idx < hash_chain->hchain_length) {
         element = &hash_chain->elements[idx * hash_chain->hash_length];
     } else {
         HIP_ERROR("Element from uninited hash chain or out-of-bound element requested!");
@@ -260,6 +561,52 @@ static unsigned char *hchain_next(const struct hash_chain *hash_chain)
     return element;
 }
 
+/** recomputes the next element of a pebbled hash chain and removes it from the
+ * traversal stack
+ *
+ * @param       hash_chain the pebbled hash chain
+ * @return      next element of the hash chain or NULL if the hash chain is depleted
+ */
+static unsigned char *hchain_pebbled_next(struct hash_chain *hash_chain)
+{
+    struct hchain_pebble *top     = NULL;
+    unsigned char        *element = NULL;
+    int                   i;
+
+    if (hash_chain->num_pebbles == 0) {
+        HIP_ERROR("Element from depleted hash chain requested!");
+        return NULL;
+    }
+
+    top = &hash_chain->pebbles[hash_chain->num_pebbles - 1];
+
+    /* split the range of the top pebble until it covers a single element,
+     * each split leaves a new pebble at the middle of the range */
+    while (top->end - top->position > 1) {
+        top[1].position = top->position + (top->end - top->position) / 2;
+        top[1].end      = top->end;
+        top->end        = top[1].position;
+
+        memcpy(top[1].element, top->element, hash_chain->hash_length);
+        for (i = top->position; i < top[1].position; i++) {
+            if (hchain_step(hash_chain, top[1].element)) {
+                return NULL;
+            }
+        }
+
+        top++;
+        hash_chain->num_pebbles++;
+    }
+
+    element = &hash_chain->elements[PEBBLED_CURRENT * hash_chain->hash_length];
+    memcpy(element, top->element, hash_chain->hash_length);
+    hash_chain->num_pebbles--;
+
+    HIP_HEXDUMP("Hash chain element: ", element, hash_chain->hash_length);
+
+    return element;
+}
+
 /** removes and returns the next element from the hash chain advances current element pointer
  *
  * @param       hash_chain hash chain which has to be popped
@@ -271,7 +618,11 @@ unsigned char *hchain_pop(struct hash_chain *hash_chain)
 
     HIP_ASSERT(hash_chain);
 
-    element = hchain_next(hash_chain);
+    if (hash_chain->pebbles) {
+        element = hchain_pebbled_next(hash_chain);
+    } else {
+        element = hchain_next(hash_chain);
+    }
     hash_chain->current_index--;
 
     return element;
@@ -291,6 +642,7 @@ int hchain_free(struct hash_chain *hash_chain)
         hash_chain->link_tree = NULL;
 
         free(hash_chain->elements);
+        free(hash_chain->pebbles);
         free(hash_chain);
     }
 
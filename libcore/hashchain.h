@@ -49,14 +49,25 @@ typedef unsigned char * (*hash_function)(const unsigned char *,
                                          unsigned long,
                                          unsigned char *);
 
+/* element stored by a pebbled hash chain, from which the elements with
+ * indices [position, end) are recomputed when they are revealed */
+struct hchain_pebble {
+    int           position;
+    int           end;
+    unsigned char element[MAX_HASH_LENGTH];
+};
+
 struct hash_chain {
-    hash_function     hash_function;
-    int               hash_length; /* length of the hashes, of which the hchain consist */
-    int               hchain_length; /* number of initial elements in the hash-chain */
-    int               hchain_hierarchy; /* hierarchy this hchain belongs to */
-    int               current_index; /* index to currently revealed element for hchain traversal*/
-    unsigned char    *elements;    /* array containing the elements of the hash chain*/
-    struct hash_tree *link_tree;   /* pointer to a hash tree for linking hchains */
+    hash_function         hash_function;
+    int                   hash_length; /* length of the hashes, of which the hchain consist */
+    int                   hchain_length; /* number of initial elements in the hash-chain */
+    int                   hchain_hierarchy; /* hierarchy this hchain belongs to */
+    int                   current_index; /* index to currently revealed element for hchain traversal*/
+    unsigned char        *elements;    /* array containing the elements of the hash chain,
+                                        * only seed, anchor and last revealed element if pebbled */
+    struct hash_tree     *link_tree;   /* pointer to a hash tree for linking hchains */
+    struct hchain_pebble *pebbles;     /* traversal stack of a pebbled hchain, NULL otherwise */
+    int                   num_pebbles; /* number of pebbles on the traversal stack */
 };
 
 int hchain_verify(const unsigned char *current_hash,
@@ -71,6 +82,19 @@ struct hash_chain *hchain_create(const hash_function hash_function,
                                  const int hchain_length,
                                  const int hchain_hierarchy,
                                  struct hash_tree *link_tree);
+struct hash_chain *hchain_create_pebbled(const hash_function hash_function,
+                                         const int hash_length,
+                                         const int hchain_length,
+                                         const int hchain_hierarchy,
+                                         struct hash_tree *link_tree);
+int hchain_create_multi(const hash_function hash_function,
+                        const int hash_length,
+                        const int hchain_length,
+                        const int hchain_hierarchy,
+                        struct hash_tree *const link_trees[],
+                        const int pebbled,
+                        struct hash_chain *hchains[],
+                        const int num_hchains);
 unsigned char *hchain_get_anchor(const struct hash_chain *hash_chain);
 unsigned char *hchain_get_seed(const struct hash_chain *hash_chain);
 unsigned char *hchain_pop(struct hash_chain *hash_chain);
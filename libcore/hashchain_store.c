@@ -34,6 +34,7 @@
 #include <string.h>
 
 #include "debug.h"
+#include "hash_mb.h"
 #include "hashtree.h"
 #include "ife.h"
 #include "linkedlist.h"
@@ -77,6 +78,7 @@ int hcstore_init(struct hchain_store *hcstore,
     // set global values
     hcstore->num_hchains_per_item = num_hchains_per_item;
     hcstore->refill_threshold     = refill_threshold;
+    hcstore->pebbled_hchains      = 0;
 
     hcstore->num_functions = 0;
 
@@ -104,6 +106,50 @@ int hcstore_init(struct hchain_store *hcstore,
     return err;
 }
 
+/** initializes an empty hash item store that uses the same hash functions,
+ *  hash lengths, hash structure lengths and hierarchies as another store
+ *
+ * @param       hcstore the store to be initialized
+ * @param       model the store whose registrations should be copied
+ * @param       refill_threshold the threshold below which a hierarchy level will be refilled
+ * @return      always returns 0
+ */
+int hcstore_init_like(struct hchain_store *hcstore,
+                      const struct hchain_store *model,
+                      const double refill_threshold)
+{
+    int i, j;
+
+    HIP_ASSERT(hcstore != NULL);
+    HIP_ASSERT(model != NULL);
+
+    hcstore_init(hcstore, model->num_hchains_per_item, refill_threshold);
+    hcstore->pebbled_hchains = model->pebbled_hchains;
+
+    hcstore->num_functions = model->num_functions;
+    memcpy(hcstore->hash_functions, model->hash_functions,
+           sizeof(hcstore->hash_functions));
+    memcpy(hcstore->num_hash_lengths, model->num_hash_lengths,
+           sizeof(hcstore->num_hash_lengths));
+    memcpy(hcstore->hash_lengths, model->hash_lengths,
+           sizeof(hcstore->hash_lengths));
+
+    for (i = 0; i < MAX_FUNCTIONS; i++) {
+        for (j = 0; j < MAX_NUM_HASH_LENGTH; j++) {
+            hcstore->hchain_shelves[i][j].num_hchain_lengths =
+                model->hchain_shelves[i][j].num_hchain_lengths;
+            memcpy(hcstore->hchain_shelves[i][j].hchain_lengths,
+                   model->hchain_shelves[i][j].hchain_lengths,
+                   sizeof(hcstore->hchain_shelves[i][j].hchain_lengths));
+            memcpy(hcstore->hchain_shelves[i][j].num_hierarchies,
+                   model->hchain_shelves[i][j].num_hierarchies,
+                   sizeof(hcstore->hchain_shelves[i][j].num_hierarchies));
+        }
+    }
+
+    return 0;
+}
+
 /** un-initializes a hash structure store
  *
  * @param       hcstore the store to be un-initialized
@@ -340,6 +386,72 @@ out_err:
     return err;
 }
 
+/** creates the link tree for a hash structure on a higher hierarchy level
+ *
+ * The leaves of the link tree are the anchors or roots of the hash structures
+ * on the next lower level, which has to be full.
+ *
+ * @param       hcstore the store
+ * @param       hash_func_id index to the hash function
+ * @param       hash_length_id index to the hash length
+ * @param       hchain_length_id index to the hash structure length
+ * @param       hierarchy_level hierarchy level of the linked hash structure
+ * @param       use_hash_trees indicates whether hash chains or hash trees are stored
+ * @return      the link tree, NULL on error
+ */
+static struct hash_tree *hcstore_create_link_tree(struct hchain_store *hcstore,
+                                                  const int hash_func_id,
+                                                  const int hash_length_id,
+                                                  const int hchain_length_id,
+                                                  const int hierarchy_level,
+                                                  const int use_hash_trees)
+{
+    struct hip_ll     *lower_item  = NULL;
+    struct hash_tree  *link_tree   = NULL;
+    struct hash_chain *tmp_hchain  = NULL;
+    struct hash_tree  *tmp_htree   = NULL;
+    int                hash_length = 0;
+    unsigned           j;
+
+    hash_length = hcstore->hash_lengths[hash_func_id][hash_length_id];
+    lower_item  = &hcstore->hchain_shelves[hash_func_id][hash_length_id].
+                  hchains[hchain_length_id][hierarchy_level - 1];
+
+    // right now the trees only support hashes of 20 bytes
+    HIP_ASSERT(hash_length == 20);
+
+    // create a link tree for each hchain on level > 0
+    if (!(link_tree = htree_init(hcstore->num_hchains_per_item, hash_length,
+                                 hash_length, hash_length, NULL, 0))) {
+        HIP_ERROR("failed to init link tree\n");
+        return NULL;
+    }
+    htree_add_random_secrets(link_tree);
+
+    // lower items should be full by now
+    HIP_ASSERT(hip_ll_get_size(lower_item) == hcstore->num_hchains_per_item);
+
+    // add the anchors of the next lower level as data
+    for (j = 0; j < hcstore->num_hchains_per_item; j++) {
+        if (use_hash_trees) {
+            tmp_htree = hip_ll_get(lower_item, j);
+
+            htree_add_data(link_tree, tmp_htree->root, hash_length);
+        } else {
+            tmp_hchain = hip_ll_get(lower_item, j);
+
+            htree_add_data(link_tree, hchain_get_anchor(tmp_hchain),
+                           hash_length);
+        }
+    }
+
+    // calculate the tree
+    htree_calc_nodes(link_tree, htree_leaf_generator,
+                     htree_node_generator, NULL);
+
+    return link_tree;
+}
+
 /** helper function to refill the store
  *
  * @param       hcstore store to be refilled
@@ -359,17 +471,16 @@ static int hcstore_fill_item(struct hchain_store *hcstore,
                              const int update_higher_level,
                              const int use_hash_trees)
 {
-    struct hash_chain *hchain         = NULL;
+    struct hash_chain *hchains[HASH_MB_LANES];
+    struct hash_tree  *link_trees[HASH_MB_LANES];
     struct hash_tree  *htree          = NULL;
     struct hash_tree  *link_tree      = NULL;
     hash_function      hash_func      = NULL;
     int                hash_length    = 0;
     int                hchain_length  = 0;
     unsigned           create_hchains = 0;
-    struct hash_chain *tmp_hchain     = NULL;
-    struct hash_tree  *tmp_htree      = NULL;
     int                err            = 0;
-    unsigned           i, j;
+    unsigned           i, j, num;
 
     // set necessary parameters
     hash_func     = hcstore->hash_functions[hash_func_id];
@@ -399,46 +510,22 @@ static int hcstore_fill_item(struct hchain_store *hcstore,
                      "failed to fill item\n");
         }
 
-        // create one hchain at a time
-        for (i = 0; i < create_hchains; i++) {
-            // hierarchy level 0 does not use any link trees
-            link_tree = NULL;
-
-            if (hierarchy_level > 0) {
-                // right now the trees only support hashes of 20 bytes
-                HIP_ASSERT(hash_length == 20);
-
-                // create a link tree for each hchain on level > 0
-                link_tree = htree_init(hcstore->num_hchains_per_item, hash_length,
-                                       hash_length, hash_length, NULL, 0);
-                htree_add_random_secrets(link_tree);
-
-                // lower items should be full by now
-                HIP_ASSERT(hip_ll_get_size(&hcstore->hchain_shelves[hash_func_id][hash_length_id].hchains[hchain_length_id][hierarchy_level - 1])
-                           == hcstore->num_hchains_per_item);
-
-                // add the anchors of the next lower level as data
-                for (j = 0; j < hcstore->num_hchains_per_item; j++) {
-                    if (use_hash_trees) {
-                        tmp_htree = hip_ll_get(&hcstore->hchain_shelves[hash_func_id][hash_length_id].hchains[hchain_length_id][hierarchy_level - 1],
-                                               j);
-
-                        htree_add_data(link_tree, tmp_htree->root, hash_length);
-                    } else {
-                        tmp_hchain = hip_ll_get(&hcstore->hchain_shelves[hash_func_id][hash_length_id].hchains[hchain_length_id][hierarchy_level - 1],
-                                                j);
-
-                        htree_add_data(link_tree, hchain_get_anchor(tmp_hchain),
-                                       hash_length);
-                    }
+        if (use_hash_trees) {
+            // create one htree at a time
+            for (i = 0; i < create_hchains; i++) {
+                // hierarchy level 0 does not use any link trees
+                link_tree = NULL;
+
+                if (hierarchy_level > 0) {
+                    HIP_IFEL(!(link_tree = hcstore_create_link_tree(hcstore,
+                                                                    hash_func_id,
+                                                                    hash_length_id,
+                                                                    hchain_length_id,
+                                                                    hierarchy_level,
+                                                                    use_hash_trees)),
+                             -1, "failed to create link tree\n");
                 }
 
-                // calculate the tree
-                htree_calc_nodes(link_tree, htree_leaf_generator,
-                                 htree_node_generator, NULL);
-            }
-
-            if (use_hash_trees) {
                 // create a new htree
                 HIP_IFEL(!(htree = htree_init(hchain_length,
                                               hash_length,
@@ -463,15 +550,50 @@ static int hcstore_fill_item(struct hchain_store *hcstore,
                 // add it as last element to have some circulation
                 HIP_IFEL(hip_ll_add_last(&hcstore->hchain_shelves[hash_func_id][hash_length_id].hchains[hchain_length_id][hierarchy_level], htree),
                          -1, "failed to store new htree\n");
-            } else {
-                // create a new hchain
-                HIP_IFEL(!(hchain = hchain_create(hash_func, hash_length,
-                                                  hchain_length, hierarchy_level, link_tree)), -1,
-                         "failed to create new hchain\n");
+            }
+        } else {
+            // create the hchains in groups, whose elements are computed in lockstep
+            for (i = 0; i < create_hchains; i += num) {
+                num = create_hchains - i < HASH_MB_LANES ?
+                      create_hchains - i : HASH_MB_LANES;
+
+                for (j = 0; j < num; j++) {
+                    // hierarchy level 0 does not use any link trees
+                    link_trees[j] = NULL;
+
+                    if (hierarchy_level > 0 &&
+                        !(link_trees[j] = hcstore_create_link_tree(hcstore,
+                                                                   hash_func_id,
+                                                                   hash_length_id,
+                                                                   hchain_length_id,
+                                                                   hierarchy_level,
+                                                                   use_hash_trees))) {
+                        while (j-- > 0) {
+                            htree_free(link_trees[j]);
+                        }
+                        HIP_ERROR("failed to create link tree\n");
+                        err = -1;
+                        goto out_err;
+                    }
+                }
 
-                // add it as last element to have some circulation
-                HIP_IFEL(hip_ll_add_last(&hcstore->hchain_shelves[hash_func_id][hash_length_id].hchains[hchain_length_id][hierarchy_level], hchain),
-                         -1, "failed to store new hchain\n");
+                // takes over the link trees
+                HIP_IFEL(hchain_create_multi(hash_func, hash_length, hchain_length,
+                                             hierarchy_level, link_trees,
+                                             hcstore->pebbled_hchains, hchains, num),
+                         -1, "failed to create new hchains\n");
+
+                // add them as last elements to have some circulation
+                for (j = 0; j < num; j++) {
+                    if (hip_ll_add_last(&hcstore->hchain_shelves[hash_func_id][hash_length_id].hchains[hchain_length_id][hierarchy_level], hchains[j])) {
+                        for (; j < num; j++) {
+                            hchain_free(hchains[j]);
+                        }
+                        HIP_ERROR("failed to store new hchain\n");
+                        err = -1;
+                        goto out_err;
+                    }
+                }
             }
         }
 
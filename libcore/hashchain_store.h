@@ -65,6 +65,8 @@ struct hchain_store {
     double refill_threshold;
     /* number of hash structures stored per item, when it is full */
     unsigned num_hchains_per_item;
+    /* create hash chains that only store O(log n) of their elements */
+    int pebbled_hchains;
     /* amount of currently used hash-functions */
     unsigned num_functions;
     /* pointer to the hash-function used to create and verify the hchain
@@ -83,6 +85,9 @@ struct hchain_store {
 int hcstore_init(struct hchain_store *hcstore,
                  const int num_hchains_per_item,
                  const double refill_threshold);
+int hcstore_init_like(struct hchain_store *hcstore,
+                      const struct hchain_store *model,
+                      const double refill_threshold);
 void hcstore_uninit(struct hchain_store *hcstore, const int use_hash_trees);
 int hcstore_register_function(struct hchain_store *hcstore,
                               const hash_function hash_function);
@@ -39,6 +39,7 @@
 
 #include "common.h"
 #include "debug.h"
+#include "hash_mb.h"
 #include "ife.h"
 #include "hashtree.h"
 
@@ -300,9 +301,89 @@ int htree_add_random_secrets(struct hash_tree *tree)
     return err;
 }
 
+/** computes the leaf nodes like htree_leaf_generator() does, but hashes
+ *  several leaves at once with the multi-buffer engine
+ *
+ * @param       tree pointer to the tree
+ * @return      0 on success, -1 otherwise
+ */
+static int htree_calc_leaves_mb(struct hash_tree *tree)
+{
+    const int            leaf_length = tree->max_data_length + tree->secret_length;
+    unsigned char        buffers[HASH_MB_LANES][leaf_length];
+    const unsigned char *data[HASH_MB_LANES];
+    unsigned char       *digests[HASH_MB_LANES];
+    int                  i, j, num;
+
+    for (i = 0; i < tree->leaf_set_size; i += HASH_MB_LANES) {
+        num = tree->leaf_set_size - i < HASH_MB_LANES ?
+              tree->leaf_set_size - i : HASH_MB_LANES;
+
+        for (j = 0; j < num; j++) {
+            // concatenate the data block with its secret, if there is one
+            if (tree->secret_length > 0) {
+                memcpy(buffers[j], &tree->data[(i + j) * tree->max_data_length],
+                       tree->max_data_length);
+                memcpy(&buffers[j][tree->max_data_length],
+                       &tree->secrets[(i + j) * tree->secret_length],
+                       tree->secret_length);
+                data[j] = buffers[j];
+            } else {
+                data[j] = &tree->data[(i + j) * tree->max_data_length];
+            }
+            digests[j] = &tree->nodes[(i + j) * tree->node_length];
+        }
+
+        if (hash_mb_sha1(data, leaf_length, digests, num)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/** computes the nodes of a tree level like htree_node_generator() does, but
+ *  hashes several nodes at once with the multi-buffer engine
+ *
+ * @param       tree pointer to the tree
+ * @param       source_index offset of the level below in bytes
+ * @param       target_index offset of the level to be computed in bytes
+ * @param       level_width number of nodes on the level below
+ * @return      0 on success, -1 otherwise
+ */
+static int htree_calc_level_mb(struct hash_tree *tree,
+                               const int source_index,
+                               const int target_index,
+                               const int level_width)
+{
+    const unsigned char *data[HASH_MB_LANES];
+    unsigned char       *digests[HASH_MB_LANES];
+    int                  i, j, num;
+
+    for (i = 0; i < level_width / 2; i += HASH_MB_LANES) {
+        num = level_width / 2 - i < HASH_MB_LANES ?
+              level_width / 2 - i : HASH_MB_LANES;
+
+        // left and right node are in subsequent memory blocks
+        for (j = 0; j < num; j++) {
+            data[j]    = &tree->nodes[source_index + 2 * (i + j) * tree->node_length];
+            digests[j] = &tree->nodes[target_index + (i + j) * tree->node_length];
+        }
+
+        if (hash_mb_sha1(data, 2 * tree->node_length, digests, num)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 /** generates the nodes for a tree with completely filled leaf set,
  * otherwise it fills up the remaining data items with random data
  *
+ * The default generators htree_leaf_generator() and htree_node_generator()
+ * are evaluated for several nodes of a level at once.
+ *
  * @param       tree pointer to the tree
  * @param       leaf_gen leaf generator function pointer
  * @param       node_gen node generator function pointer
@@ -327,17 +408,22 @@ int htree_calc_nodes(struct hash_tree *tree,
     /* traverse all data blocks and create the leafs */
     HIP_DEBUG("computing leaf nodes: %i\n", tree->leaf_set_size);
 
-    for (i = 0; i < tree->leaf_set_size; i++) {
-        // only use secrets if they are defined
-        if (tree->secret_length > 0) {
-            secret = &tree->secrets[i * tree->secret_length];
-        }
+    if (leaf_gen == htree_leaf_generator) {
+        HIP_IFEL(htree_calc_leaves_mb(tree), -1,
+                 "failed to calculate leaf hashes\n");
+    } else {
+        for (i = 0; i < tree->leaf_set_size; i++) {
+            // only use secrets if they are defined
+            if (tree->secret_length > 0) {
+                secret = &tree->secrets[i * tree->secret_length];
+            }
 
-        // input: i-th data block -> output as i-th node-array element
-        HIP_IFEL(leaf_gen(&tree->data[i * tree->max_data_length], tree->max_data_length,
-                          secret, tree->secret_length,
-                          &tree->nodes[i * tree->node_length], gen_args),
-                 -1, "failed to calculate leaf hashes\n");
+            // input: i-th data block -> output as i-th node-array element
+            HIP_IFEL(leaf_gen(&tree->data[i * tree->max_data_length], tree->max_data_length,
+                              secret, tree->secret_length,
+                              &tree->nodes[i * tree->node_length], gen_args),
+                     -1, "failed to calculate leaf hashes\n");
+        }
     }
 
     /* compute hashes on all other levels */
@@ -354,21 +440,27 @@ int htree_calc_nodes(struct hash_tree *tree,
          * already calculated nodes of the previous level */
         target_index = source_index + (level_width * tree->node_length);
 
-        /* we always handle two elements at once */
-        for (i = 0; i < level_width; i += 2) {
-            HIP_IFEL(node_gen(&tree->nodes[source_index + (i * tree->node_length)],
-                              &tree->nodes[source_index + ((i + 1) * tree->node_length)],
-                              tree->node_length,
-                              &tree->nodes[target_index + ((i / 2) * tree->node_length)],
-                              gen_args), -1,
+        if (node_gen == htree_node_generator) {
+            HIP_IFEL(htree_calc_level_mb(tree, source_index, target_index,
+                                         level_width), -1,
                      "failed to calculate hashes of intermediate nodes\n");
-
-            // this means we're calculating the root node
-            if (level_width == 2) {
-                tree->root = &tree->nodes[target_index + ((i / 2) * tree->node_length)];
+        } else {
+            /* we always handle two elements at once */
+            for (i = 0; i < level_width; i += 2) {
+                HIP_IFEL(node_gen(&tree->nodes[source_index + (i * tree->node_length)],
+                                  &tree->nodes[source_index + ((i + 1) * tree->node_length)],
+                                  tree->node_length,
+                                  &tree->nodes[target_index + ((i / 2) * tree->node_length)],
+                                  gen_args), -1,
+                         "failed to calculate hashes of intermediate nodes\n");
             }
         }
 
+        // this means we're calculating the root node
+        if (level_width == 2) {
+            tree->root = &tree->nodes[target_index];
+        }
+
         // next level has got half the elements
         level_width = level_width / 2;
 
@@ -140,6 +140,10 @@
 /* Free slot */
 #define HIP_MSG_FW_BEX_DONE                      157
 #define HIP_MSG_RESTART_DUMMY_INTERFACE          158
+/** hipd -> hipfw: host associations (HA_INFO) were added or changed */
+#define HIP_MSG_FW_HA_UPDATE                     159
+/** hipd -> hipfw: host associations (HA_INFO) were deleted */
+#define HIP_MSG_FW_HA_DELETE                     160
 /* free slots */
 #define HIP_MSG_NSUPDATE_OFF                     179
 #define HIP_MSG_NSUPDATE_ON                      180
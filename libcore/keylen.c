@@ -50,6 +50,12 @@ int hip_enc_key_length(int tid)
     case HIP_ESP_3DES_SHA1:
         ret = 24;
         break;
+    case HIP_ESP_AES_GCM:
+        ret = 16;
+        break;
+    case HIP_ESP_CHACHA20_POLY1305:
+        ret = 32;
+        break;
     case HIP_ESP_NULL_SHA1:
     case HIP_ESP_NULL_NULL:
         ret = 0;
@@ -77,6 +83,8 @@ int hip_hmac_key_length(int tid)
     case HIP_ESP_AES_SHA1:
     case HIP_ESP_3DES_SHA1:
     case HIP_ESP_NULL_SHA1:
+    case HIP_ESP_AES_GCM:
+    case HIP_ESP_CHACHA20_POLY1305:
         ret = 20;
         break;
     case HIP_ESP_NULL_NULL:
@@ -108,6 +116,12 @@ int hip_auth_key_length_esp(int tid)
     case HIP_ESP_3DES_SHA1:
         ret = 20;
         break;
+    case HIP_ESP_AES_GCM:
+    case HIP_ESP_CHACHA20_POLY1305:
+        /* AEAD transforms need no authentication key, but a 4 byte salt
+         * for the nonce (RFC 4106) */
+        ret = 4;
+        break;
     case HIP_ESP_NULL_NULL:
         ret = 0;
         break;
@@ -73,6 +73,8 @@
  */
 
 #define _BSD_SOURCE
+/* recvmmsg() */
+#define _GNU_SOURCE
 
 #include <errno.h>
 #include <stdint.h>
@@ -555,67 +557,84 @@ out_err:
     return err;
 }
 
+/** size of the ancillary data buffer of a received control message */
+#define HIP_CONTROL_MSG_CBUFF_LEN CMSG_SPACE(256)
+
 /**
- * Prepare a @c hip_common struct, allocate memory for buffers and nested
- * structs. Receive a message from socket and fill the @c hip_common struct
- * with the values from this message. Do not call this function directly,
- * use hip_read_control_msg_v4() and hip_read_control_msg_v6() wrappers
- * instead!
+ * Set up a message header for receiving a control message.
  *
- * @param sockfd         a socket to read from.
- * @param ctx            a pointer to the packet context
+ * @param msg       the message header
+ * @param iov       the I/O vector to use for the message data
+ * @param addr_from buffer for the source address
+ * @param cbuff     buffer for the ancillary data, of size
+ *                  ::HIP_CONTROL_MSG_CBUFF_LEN
+ * @param hip_msg   buffer for the message data
+ */
+static void init_control_msghdr(struct msghdr *const msg,
+                                struct iovec *const iov,
+                                struct sockaddr_storage *const addr_from,
+                                char *const cbuff,
+                                struct hip_common *const hip_msg)
+{
+    hip_msg_init(hip_msg);
+
+    memset(msg, 0, sizeof(*msg));
+    memset(cbuff, 0, HIP_CONTROL_MSG_CBUFF_LEN);
+
+    /* setup message header with control and receive buffers */
+    msg->msg_name    = addr_from;
+    msg->msg_namelen = sizeof(struct sockaddr_storage);
+    msg->msg_iov     = iov;
+    msg->msg_iovlen  = 1;
+
+    msg->msg_control    = cbuff;
+    msg->msg_controllen = HIP_CONTROL_MSG_CBUFF_LEN;
+    msg->msg_flags      = 0;
+
+    iov->iov_len  = HIP_MAX_NETWORK_PACKET;
+    iov->iov_base = hip_msg;
+}
+
+/**
+ * Fill the packet context from a received control message: the addresses
+ * and ports are taken from the message header and its ancillary data, the
+ * encapsulation header is stripped and the HIP header is verified.
+ *
+ * @param ctx            a pointer to the packet context, holding the
+ *                       received message data
+ * @param msg            the message header filled by recvmsg()
+ * @param len            the number of received bytes
  * @param encap_hdr_size size of encapsulated header in bytes.
  * @param is_ipv4        a boolean value to indicate whether message is received
  *                       on IPv4.
  * @return               -1 in case of an error, 0 otherwise.
  */
-static int read_control_msg_all(int sockfd, struct hip_packet_context *ctx,
-                                int encap_hdr_size, int is_ipv4)
+static int parse_control_msg(struct hip_packet_context *ctx,
+                             struct msghdr *msg,
+                             const int len,
+                             const int encap_hdr_size,
+                             const int is_ipv4)
 {
-    struct sockaddr_storage addr_from, addr_to = { 0 };
-    struct sockaddr_in     *addr_from4 = (struct sockaddr_in *) &addr_from;
-    struct sockaddr_in6    *addr_from6 = (struct sockaddr_in6 *) &addr_from;
-    struct cmsghdr         *cmsg       = NULL;
-    struct msghdr           msg        = { 0 };
+    struct sockaddr_storage *addr_from  = msg->msg_name;
+    struct sockaddr_in      *addr_from4 = (struct sockaddr_in *) addr_from;
+    struct sockaddr_in6     *addr_from6 = (struct sockaddr_in6 *) addr_from;
+    struct sockaddr_storage  addr_to    = { 0 };
+    struct cmsghdr          *cmsg       = NULL;
     union {
         struct in_pktinfo    *pktinfo_in4;
         struct inet6_pktinfo *pktinfo_in6;
     } pktinfo;
-    struct iovec iov;
-    char         cbuff[CMSG_SPACE(256)] = { 0 };
-    int          len, err               = 0;
-    int          cmsg_level, cmsg_type;
-
-    hip_msg_init(ctx->input_msg);
-
-    HIP_DEBUG("read_control_msg_all() invoked.\n");
-
-    /* setup message header with control and receive buffers */
-    msg.msg_name    = &addr_from;
-    msg.msg_namelen = sizeof(struct sockaddr_storage);
-    msg.msg_iov     = &iov;
-    msg.msg_iovlen  = 1;
-
-    msg.msg_control    = cbuff;
-    msg.msg_controllen = sizeof(cbuff);
-    msg.msg_flags      = 0;
-
-    iov.iov_len  = HIP_MAX_NETWORK_PACKET;
-    iov.iov_base = ctx->input_msg;
+    int err = 0;
+    int cmsg_level, cmsg_type;
 
     pktinfo.pktinfo_in4 = NULL;
 
-    len = recvmsg(sockfd, &msg, 0);
-
-    HIP_IFEL(len < 0, -1, "ICMP%s error: errno=%d, %s\n",
-             is_ipv4 ? "v4" : "v6", errno, strerror(errno));
-
     cmsg_level = is_ipv4 ? IPPROTO_IP : IPPROTO_IPV6;
     cmsg_type  = is_ipv4 ? IP_PKTINFO : IPV6_2292PKTINFO;
 
     /* destination address comes from ancillary data passed
      * with msg due to IPV6_PKTINFO socket option */
-    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
         if (cmsg->cmsg_level == cmsg_level &&
             cmsg->cmsg_type  == cmsg_type) {
             /* The structure is a union, so this fills also the
@@ -671,13 +690,11 @@ static int read_control_msg_all(int sockfd, struct hip_packet_context *ctx,
     }
 
     HIP_IFEL(hip_verify_network_header(ctx->input_msg,
-                                       (struct sockaddr *) &addr_from,
+                                       (struct sockaddr *) addr_from,
                                        (struct sockaddr *) &addr_to,
                                        len - encap_hdr_size), -1,
              "verifying network header failed\n");
 
-
-
     HIP_DEBUG_IN6ADDR("src", &ctx->src_addr);
     HIP_DEBUG_IN6ADDR("dst", &ctx->dst_addr);
 
@@ -685,6 +702,105 @@ out_err:
     return err;
 }
 
+/**
+ * Prepare a @c hip_common struct, allocate memory for buffers and nested
+ * structs. Receive a message from socket and fill the @c hip_common struct
+ * with the values from this message. Do not call this function directly,
+ * use hip_read_control_msg_v4() and hip_read_control_msg_v6() wrappers
+ * instead!
+ *
+ * @param sockfd         a socket to read from.
+ * @param ctx            a pointer to the packet context
+ * @param encap_hdr_size size of encapsulated header in bytes.
+ * @param is_ipv4        a boolean value to indicate whether message is received
+ *                       on IPv4.
+ * @return               -1 in case of an error, 0 otherwise.
+ */
+static int read_control_msg_all(int sockfd, struct hip_packet_context *ctx,
+                                int encap_hdr_size, int is_ipv4)
+{
+    struct sockaddr_storage addr_from;
+    struct msghdr           msg;
+    struct iovec            iov;
+    char                    cbuff[HIP_CONTROL_MSG_CBUFF_LEN];
+    int                     len, err = 0;
+
+    HIP_DEBUG("read_control_msg_all() invoked.\n");
+
+    init_control_msghdr(&msg, &iov, &addr_from, cbuff, ctx->input_msg);
+
+    len = recvmsg(sockfd, &msg, 0);
+
+    HIP_IFEL(len < 0, -1, "ICMP%s error: errno=%d, %s\n",
+             is_ipv4 ? "v4" : "v6", errno, strerror(errno));
+
+    err = parse_control_msg(ctx, &msg, len, encap_hdr_size, is_ipv4);
+
+out_err:
+    return err;
+}
+
+/**
+ * Receive all queued control messages from a socket, up to a limit, with a
+ * single system call. Does not block.
+ *
+ * Each message is received into the input buffer of its own packet context.
+ * The error field of a context is set if its message is malformed, and
+ * cleared otherwise.
+ *
+ * @param sockfd         a socket to read from.
+ * @param ctxs           packet contexts with allocated input buffers.
+ * @param num            number of packet contexts, at most
+ *                       HIP_CONTROL_MSG_BATCH.
+ * @param encap_hdr_size size of encapsulated header in bytes.
+ * @param is_ipv4        a boolean value to indicate whether messages are
+ *                       received on IPv4.
+ * @return               the number of received messages, or -1 on error.
+ */
+int hip_read_control_msgs(int sockfd,
+                          struct hip_packet_context *ctxs,
+                          unsigned int num,
+                          int encap_hdr_size,
+                          int is_ipv4)
+{
+    struct mmsghdr          msgs[HIP_CONTROL_MSG_BATCH];
+    struct iovec            iov[HIP_CONTROL_MSG_BATCH];
+    struct sockaddr_storage addr_from[HIP_CONTROL_MSG_BATCH];
+    char                    cbuff[HIP_CONTROL_MSG_BATCH][HIP_CONTROL_MSG_CBUFF_LEN];
+    unsigned int            i;
+    int                     count;
+
+    if (num > HIP_CONTROL_MSG_BATCH) {
+        num = HIP_CONTROL_MSG_BATCH;
+    }
+
+    for (i = 0; i < num; i++) {
+        init_control_msghdr(&msgs[i].msg_hdr, &iov[i], &addr_from[i],
+                            cbuff[i], ctxs[i].input_msg);
+        msgs[i].msg_len = 0;
+    }
+
+    count = recvmmsg(sockfd, msgs, num, MSG_DONTWAIT, NULL);
+    if (count < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        HIP_ERROR("ICMP%s error: errno=%d, %s\n",
+                  is_ipv4 ? "v4" : "v6", errno, strerror(errno));
+        return -1;
+    }
+
+    HIP_DEBUG("received %d control messages on socket %d\n", count, sockfd);
+
+    for (i = 0; i < (unsigned int) count; i++) {
+        ctxs[i].error = parse_control_msg(&ctxs[i], &msgs[i].msg_hdr,
+                                          msgs[i].msg_len, encap_hdr_size,
+                                          is_ipv4) ? 1 : 0;
+    }
+
+    return count;
+}
+
 /**
  * Read an IPv6 control message.
  *
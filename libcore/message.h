@@ -33,6 +33,9 @@
 #include "protodefs.h"
 #include "state.h"
 
+/** maximum number of control messages received with one system call */
+#define HIP_CONTROL_MSG_BATCH 16
+
 int hip_daemon_connect(int hip_user_sock);
 int hip_read_user_control_msg(int socket,
                               struct hip_common *hip_msg,
@@ -43,6 +46,11 @@ int hip_read_control_msg_v6(int socket,
 int hip_read_control_msg_v4(int socket,
                             struct hip_packet_context *ctx,
                             int encap_hdr_size);
+int hip_read_control_msgs(int socket,
+                          struct hip_packet_context *ctxs,
+                          unsigned int num,
+                          int encap_hdr_size,
+                          int is_ipv4);
 int hip_send_recv_daemon_info(struct hip_common *msg,
                               int send_only,
                               int opt_socket);
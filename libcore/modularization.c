@@ -102,6 +102,20 @@ static struct hip_ll parameter_types;
  */
 static uint16_t num_disabled_modules = 0;
 
+/**
+ * Names of the registered state slots, indexed by slot id.
+ *
+ * Modules resolve the slot id of their state item once with
+ * lmod_register_state_slot() and then use lmod_get_state_item_by_slot() to
+ * access the item of a host association.
+ */
+static char **state_slot_names;
+
+/**
+ * Number of registered state slots.
+ */
+static unsigned int num_state_slots;
+
 /**
  * Initializes a new data structure for storage of references to state items.
  * This data structure consists of a pointer set and can be mentioned as global
@@ -118,13 +132,16 @@ struct modular_state *lmod_init_state(void)
         return NULL;
     }
 
-    if (!(state->item_list = malloc(sizeof(struct hip_ll)))) {
-        return NULL;
-    }
+    state->items     = NULL;
+    state->num_items = 0;
 
-    hip_ll_init(state->item_list);
-    state->item_names = NULL;
-    state->num_items  = 0;
+    if (num_state_slots > 0) {
+        if (!(state->items = calloc(num_state_slots, sizeof(void *)))) {
+            free(state);
+            return NULL;
+        }
+        state->num_items = num_state_slots;
+    }
 
     return state;
 }
@@ -225,21 +242,18 @@ void lmod_uninit_state_items(struct modular_state *const state)
 }
 
 /**
- * Retrieve a void pointer to a state variable from the global state set using
- * the state item name.
+ * Look up the slot id of a state item by its name.
  *
- *  @param      state       Pointer to the global state.
  *  @param      item_name   String identifying a state.
- *  @return Success = id (index number) of the state item as unsigned int
+ *  @return Success = slot id of the state item
  *          Error   = -1
  */
-static int lmod_get_state_item_id(struct modular_state *state,
-                                  const char *item_name)
+static int lmod_get_state_slot(const char *const item_name)
 {
     unsigned int i;
 
-    for (i = 0; i < state->num_items; i++) {
-        if (strcmp(item_name, state->item_names[i]) == 0) {
+    for (i = 0; i < num_state_slots; i++) {
+        if (strcmp(item_name, state_slot_names[i]) == 0) {
             return i;
         }
     }
@@ -247,25 +261,87 @@ static int lmod_get_state_item_id(struct modular_state *state,
     return -1;
 }
 
+/**
+ * Register a state slot for the state item with the given name. Modules call
+ * this once during initialization and keep the returned slot id for
+ * constant-time access to their state with lmod_get_state_item_by_slot().
+ * Registering the same name again returns the same slot id.
+ *
+ * @note Call lmod_uninit_state_slots() to free all memory allocated for the
+ *       slot names.
+ *
+ *  @param      item_name   String identifying the state item.
+ *  @return Success = slot id of the state item
+ *          Error   = -1
+ */
+int lmod_register_state_slot(const char *const item_name)
+{
+    char **new_names;
+    int    slot;
+
+    if (!item_name) {
+        HIP_ERROR("Missing item name.\n");
+        return -1;
+    }
+
+    if ((slot = lmod_get_state_slot(item_name)) != -1) {
+        return slot;
+    }
+
+    if (!(new_names = realloc(state_slot_names,
+                              (num_state_slots + 1) * sizeof(char *)))) {
+        return -1;
+    }
+    state_slot_names = new_names;
+
+    if (!(state_slot_names[num_state_slots] = strdup(item_name))) {
+        return -1;
+    }
+
+    return num_state_slots++;
+}
+
+/**
+ * Free all memory allocated for the names of the state slots.
+ */
+void lmod_uninit_state_slots(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < num_state_slots; i++) {
+        free(state_slot_names[i]);
+    }
+    free(state_slot_names);
+    state_slot_names = NULL;
+    num_state_slots  = 0;
+}
+
 /**
  * Returns a void pointer to a state item from the global state set using
- * the id (index number).
+ * the slot id returned by lmod_register_state_slot().
  *
  *  @param      state       Pointer to the global state.
- *  @param      id          Index number of the requested state.
+ *  @param      slot        Slot id of the requested state.
  *  @return Success = Pointer to the requested state item (if exists)
  *          Error   = NULL
  */
-static void *lmod_get_state_item_by_id(struct modular_state *state,
-                                       const unsigned int id)
+void *lmod_get_state_item_by_slot(const struct modular_state *const state,
+                                  const int slot)
 {
-    return hip_ll_get(state->item_list, id);
+    if (!state || slot < 0 || (unsigned int) slot >= state->num_items) {
+        return NULL;
+    }
+
+    return state->items[slot];
 }
 
 /**
  * Returns a void pointer to a state item from the global state set using
  * the string identifier.
  *
+ * @note Prefer lmod_get_state_item_by_slot() on hot paths, this function
+ *       looks up the slot by comparing names.
+ *
  *  @param      state       Pointer to the global state.
  *  @param      item_name   String identifying the state.
  *  @return Success = Pointer to the requested state item (if exists)
@@ -273,20 +349,19 @@ static void *lmod_get_state_item_by_id(struct modular_state *state,
  */
 void *lmod_get_state_item(struct modular_state *state, const char *item_name)
 {
-    int state_id;
+    void *item;
 
     if (!state || !item_name) {
         HIP_ERROR("Missing state or item name.\n");
         return NULL;
     }
 
-    state_id = lmod_get_state_item_id(state, item_name);
-    if (state_id == -1) {
+    if (!(item = lmod_get_state_item_by_slot(state,
+                                             lmod_get_state_slot(item_name)))) {
         HIP_ERROR("State %s not found.\n", item_name);
-        return NULL;
-    } else {
-        return lmod_get_state_item_by_id(state, state_id);
     }
+
+    return item;
 }
 
 /**
@@ -294,31 +369,45 @@ void *lmod_get_state_item(struct modular_state *state, const char *item_name)
  * type. This function stores a reference to the new state item.
  *
  * Afterwards the state item is retrievable by the provided @c item_name or the
- * returned id (unsigned int).
+ * returned slot id. Names that were not registered with
+ * lmod_register_state_slot() before get a new slot.
  *
  *  @param      state       Pointer to the global state.
  *  @param      state_item  Pointer to the new state information.
  *  @param      item_name   String for retrieving the state item by name.
- *  @return Success = id (unsigned int) for retrieving the state by number
+ *  @return Success = slot id for retrieving the state by number
  *          Error   = -1
  */
 int lmod_add_state_item(struct modular_state *state,
                         void *state_item,
                         const char *item_name)
 {
-    /* Check if identifier already exists */
-    if (lmod_get_state_item_id(state, item_name) != -1) {
+    void **new_items;
+    int    slot;
+
+    if ((slot = lmod_register_state_slot(item_name)) == -1) {
         return -1;
     }
 
-    hip_ll_add_last(state->item_list, state_item);
+    /* Check if the slot is already taken */
+    if (lmod_get_state_item_by_slot(state, slot)) {
+        return -1;
+    }
 
-    state->item_names = realloc(state->item_names,
-                                (state->num_items + 1) * sizeof(char *));
+    if ((unsigned int) slot >= state->num_items) {
+        if (!(new_items = realloc(state->items,
+                                  num_state_slots * sizeof(void *)))) {
+            return -1;
+        }
+        memset(new_items + state->num_items, 0,
+               (num_state_slots - state->num_items) * sizeof(void *));
+        state->items     = new_items;
+        state->num_items = num_state_slots;
+    }
 
-    state->item_names[state->num_items++] = strdup(item_name);
+    state->items[slot] = state_item;
 
-    return state->num_items - 1;
+    return slot;
 }
 
 /**
@@ -331,14 +420,12 @@ void lmod_uninit_state(struct modular_state *state)
     unsigned int i;
 
     lmod_uninit_state_items(state);
-    hip_ll_uninit(state->item_list, free);
-    free(state->item_list);
 
     for (i = 0; i < state->num_items; i++) {
-        free(state->item_names[i]);
+        free(state->items[i]);
     }
 
-    free(state->item_names);
+    free(state->items);
     free(state);
 }
 
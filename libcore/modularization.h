@@ -31,12 +31,12 @@
 #include "linkedlist.h"
 
 /**
- * @todo add description
+ * Per host association storage of module state items. Items are indexed by
+ * the slot id a module obtains from lmod_register_state_slot().
  */
 struct modular_state {
-    struct hip_ll *item_list;
-    char         **item_names;
-    unsigned int   num_items;
+    void       **items;
+    unsigned int num_items;
 };
 
 struct hip_ll *lmod_register_function(struct hip_ll *list, void *entry,
@@ -55,6 +55,10 @@ void lmod_init_state_items(struct modular_state *state);
 
 void lmod_uninit_state_items(struct modular_state *const state);
 
+int lmod_register_state_slot(const char *const item_name);
+
+void lmod_uninit_state_slots(void);
+
 struct modular_state *lmod_init_state(void);
 
 int lmod_add_state_item(struct modular_state *state,
@@ -64,6 +68,9 @@ int lmod_add_state_item(struct modular_state *state,
 void *lmod_get_state_item(struct modular_state *state,
                           const char *item_name);
 
+void *lmod_get_state_item_by_slot(const struct modular_state *const state,
+                                  const int slot);
+
 void lmod_uninit_state(struct modular_state *state);
 
 int lmod_disable_module(const char *module_id);
@@ -189,7 +189,7 @@
 #define HIP_PARAM_PORTPAIR              32788
 #define HIP_PARAM_SRC_ADDR              32789
 #define HIP_PARAM_DST_ADDR              32790
-/* free slot */
+#define HIP_PARAM_PUZZLE_LOAD           32791
 #define HIP_PARAM_HA_INFO               32792
 /* free slot */
 #define HIP_PARAM_CERT_SPKI_INFO        32794
@@ -329,6 +329,10 @@
 #define HIP_ESP_BLOWFISH_SHA1           4
 #define HIP_ESP_NULL_SHA1               5
 #define HIP_ESP_NULL_MD5                6
+/* AES-128-GCM with a 16-octet ICV (RFC 7402) */
+#define HIP_ESP_AES_GCM                 13
+/* not assigned for HIP, this is the ESP transform ID from RFC 7634 */
+#define HIP_ESP_CHACHA20_POLY1305       28
 
 /* Only for testing!!! */
 #define HIP_ESP_NULL_NULL            0x0
@@ -994,6 +998,18 @@ struct hip_heartbeat {
     int         heartbeat;
 } __attribute__((packed));
 
+/** state of the automatic puzzle difficulty, reported to hipconf */
+struct hip_puzzle_load {
+    hip_tlv     type;
+    hip_tlv_len length;
+    uint8_t     k;           /**< difficulty of newly created R1s */
+    uint8_t     boost;       /**< part of @c k added because of load */
+    uint16_t    reserved;
+    uint32_t    i1_rate;     /**< smoothed I1s per second */
+    uint32_t    i2_rate;     /**< smoothed I2s per second */
+    uint32_t    backlog;     /**< crypto jobs in flight */
+} __attribute__((packed));
+
 /** draft-ietf-hip-nat-traversal-02 */
 struct hip_reg_from {
     hip_tlv         type;     /**< type code for the parameter */
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief SipHash-2-4 keyed hash function
+ *
+ * SipHash is a fast pseudorandom function for short inputs. Hash tables
+ * indexed by data that an attacker can choose (addresses, SPIs, HITs) use it
+ * with a secret random key, so that the attacker cannot force collisions.
+ *
+ * @see J.-P. Aumasson and D. J. Bernstein: "SipHash: a fast short-input PRF",
+ *      INDOCRYPT 2012
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "siphash.h"
+
+#define ROTL64(x, b) (uint64_t) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3)                                    \
+    do {                                                            \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                    \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                    \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+    } while (0)
+
+/**
+ * Read a little-endian 64 bit word from an unaligned buffer.
+ *
+ * @param p the buffer
+ * @return  the word in host byte order
+ */
+static uint64_t load_le64(const uint8_t *const p)
+{
+    return (uint64_t) p[0]         | ((uint64_t) p[1] << 8)  |
+           ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24) |
+           ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) |
+           ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+/**
+ * Compute the SipHash-2-4 of a buffer.
+ *
+ * @param key  the secret key
+ * @param data the buffer to hash
+ * @param len  the length of @a data in bytes
+ * @return     the 64 bit hash value
+ */
+uint64_t hip_siphash(const uint8_t key[HIP_SIPHASH_KEY_LEN],
+                     const void *const data, const size_t len)
+{
+    const uint8_t *in   = data;
+    const uint8_t *end  = in + len - (len % 8);
+    const uint64_t k0   = load_le64(key);
+    const uint64_t k1   = load_le64(key + 8);
+    uint64_t       v0   = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t       v1   = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t       v2   = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t       v3   = k1 ^ 0x7465646279746573ULL;
+    uint64_t       m    = 0;
+    uint64_t       last = (uint64_t) len << 56;
+    size_t         i;
+
+    for (; in != end; in += 8) {
+        m   = load_le64(in);
+        v3 ^= m;
+        SIPROUND(v0, v1, v2, v3);
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    for (i = 0; i < len % 8; i++) {
+        last |= (uint64_t) in[i] << (8 * i);
+    }
+
+    v3 ^= last;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
@@ -109,12 +109,16 @@ enum hip_ha_state {
  * database entries.
  */
 struct hip_msg_retrans {
-    int                count;
-    uint64_t           current_backoff;
-    struct timeval     last_transmit;
-    struct in6_addr    saddr;
-    struct in6_addr    daddr;
-    struct hip_common *buf;
+    int                    count;
+    uint64_t               current_backoff;
+    struct timeval         last_transmit;
+    struct in6_addr        saddr;
+    struct in6_addr        daddr;
+    struct hip_common     *buf;
+    /** the host association the retransmission belongs to */
+    struct hip_hadb_state *entry;
+    /** position in the retransmission timer heap, -1 if not scheduled */
+    int                    timer_index;
 };
 
 struct hip_peer_addr_list_item {
@@ -319,6 +323,8 @@ struct hip_hadb_state {
     uint8_t hip_version;
     /* modular state */
     struct modular_state *hip_modular_state;
+    /** packet handling suspended on a crypto worker, NULL if none */
+    struct hip_crypto_job *crypto_job;
 } __attribute__((packed));
 
 /** A data structure defining host association information that is sent
@@ -30,6 +30,7 @@
 
 #include <arpa/inet.h>
 
+#include "config.h"
 #include "debug.h"
 #include "builder.h"
 #include "transform.h"
@@ -81,14 +82,40 @@ out:
     return tid;
 }
 
+/**
+ * check whether an ESP transform is an AEAD transform supported by this build
+ *
+ * AEAD transforms are only implemented by userspace IPsec.
+ *
+ * @param tid transform
+ * @return    1 if @a tid is a supported AEAD transform, 0 otherwise
+ */
+int hip_esp_transform_is_aead(const hip_transform_suite tid)
+{
+    switch (tid) {
+#ifdef HAVE_EVP_AES_GCM
+    case HIP_ESP_AES_GCM:
+        return 1;
+#endif
+#ifdef HAVE_EVP_CHACHA20_POLY1305
+    case HIP_ESP_CHACHA20_POLY1305:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
 /**
  * select an ESP transform to use
- * @param param ESP_TRANSFORM payload where the transform is selected from
+ * @param param      ESP_TRANSFORM payload where the transform is selected from
+ * @param allow_aead whether AEAD transforms may be selected
  *
  * @return      the first acceptable Suite-ID or zero if no acceptable
  *              Suite-ID was found.
  */
-hip_transform_suite hip_select_esp_transform(const struct hip_tlv_common *param)
+hip_transform_suite hip_select_esp_transform(const struct hip_tlv_common *param,
+                                             const int allow_aead)
 {
     int                        item_number = HIP_TRANSFORM_ESP_MAX;
     hip_transform_suite        tid         = 0;
@@ -113,6 +140,14 @@ hip_transform_suite hip_select_esp_transform(const struct hip_tlv_common *param)
         case HIP_ESP_NULL_SHA1:
             tid = *suggestion;
             goto out;
+        case HIP_ESP_AES_GCM:
+        case HIP_ESP_CHACHA20_POLY1305:
+            if (allow_aead && hip_esp_transform_is_aead(*suggestion)) {
+                tid = *suggestion;
+                goto out;
+            }
+            HIP_DEBUG("Skipping AEAD ESP suite id (%u)\n", *suggestion);
+            break;
         default:
             /* Specs don't say what to do when unknowns are found.
              * We ignore.
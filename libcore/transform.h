@@ -28,7 +28,9 @@
 
 #include "protodefs.h"
 
-hip_transform_suite hip_select_esp_transform(const struct hip_tlv_common *param);
+int hip_esp_transform_is_aead(const hip_transform_suite tid);
+hip_transform_suite hip_select_esp_transform(const struct hip_tlv_common *param,
+                                             const int allow_aead);
 hip_transform_suite hip_select_hip_transform(const struct hip_tlv_common *param);
 int hip_transform_key_length(int tid);
 
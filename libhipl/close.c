@@ -140,7 +140,7 @@ int xmit_close(struct hip_hadb_state *entry, void *opaque)
                           entry->peer_udp_port, msg_close, entry, 0),
              -ECOMM, "Sending CLOSE message failed.\n");
 
-    entry->state = HIP_STATE_CLOSING;
+    hip_hadb_set_state(entry, HIP_STATE_CLOSING);
 #ifdef CONFIG_HIP_PERFORMANCE
     HIP_DEBUG("Stop and write PERF_CLOSE_SEND\n");
     hip_perf_stop_benchmark(perf_set, PERF_CLOSE_SEND);
@@ -353,7 +353,7 @@ int hip_close_send_response(UNUSED const uint8_t packet_type,
                           0),
              -ECOMM, "Sending CLOSE ACK message failed.\n");
 
-    ctx->hadb_entry->state = HIP_STATE_CLOSED;
+    hip_hadb_set_state(ctx->hadb_entry, HIP_STATE_CLOSED);
 
     HIP_DEBUG("CLOSED.\n");
 
@@ -475,7 +475,7 @@ int hip_close_ack_handle_packet(UNUSED const uint8_t packet_type,
     HIP_IFEL(!ctx->hadb_entry, -1,
              "No entry in host association database when receiving R2. Dropping.\n");
 
-    ctx->hadb_entry->state = HIP_STATE_CLOSED;
+    hip_hadb_set_state(ctx->hadb_entry, HIP_STATE_CLOSED);
 
     HIP_DEBUG("CLOSED\n");
 
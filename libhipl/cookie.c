@@ -31,6 +31,7 @@
 #define _BSD_SOURCE
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -40,17 +41,22 @@
 #include "libcore/debug.h"
 #include "libcore/icomm.h"
 #include "libcore/ife.h"
+#include "libcore/prefix.h"
 #include "libcore/protodefs.h"
 #include "libcore/solve.h"
 #include "libcore/gpl/pk.h"
 #include "config.h"
 #include "hidb.h"
 #include "output.h"
+#include "puzzle_control.h"
 #include "cookie.h"
 
 
 static uint8_t hip_cookie_difficulty = 0; /* a difficulty of i leads to approx. 2^(i-1) hash computations during BEX */
 
+/** number of local host identities whose R1s are being recreated */
+static unsigned int r1_recreations_pending = 0;
+
 /**
  * query for current puzzle difficulty
  *
@@ -58,10 +64,21 @@ static uint8_t hip_cookie_difficulty = 0; /* a difficulty of i leads to approx.
  */
 static int get_cookie_difficulty(void)
 {
-    /* Note: we could return a higher value if we detect DoS */
     return hip_cookie_difficulty;
 }
 
+/**
+ * query for the puzzle difficulty of new R1s, the configured difficulty
+ * raised by the load-dependent boost of the puzzle controller
+ *
+ * @return the puzzle difficulty
+ */
+static uint8_t get_effective_cookie_difficulty(void)
+{
+    return MIN(get_cookie_difficulty() + hip_puzzle_control_boost(),
+               MAX_PUZZLE_DIFFICULTY);
+}
+
 /**
  * set puzzle difficulty
  *
@@ -84,18 +101,31 @@ static int set_cookie_difficulty(const uint8_t k)
  * get the puzzle difficulty and return result (for hipconf)
  *
  * @param msg A message containing a HIT for which to query for
- *            the difficulty. The difficulty will be written
- *            into the message as a HIP_PARAM_INT parameter.
+ *            the difficulty. The configured difficulty will be written
+ *            into the message as a HIP_PARAM_INT parameter, the state
+ *            of the automatic difficulty as a HIP_PARAM_PUZZLE_LOAD
+ *            parameter.
  * @return zero on success and negative on error
  */
 int hip_get_puzzle_difficulty_msg(struct hip_common *msg)
 {
-    int err = 0, diff = 0;
+    int                    err  = 0, diff = 0;
+    struct hip_puzzle_load load = { 0 };
 
     diff = get_cookie_difficulty();
 
-    hip_build_param_contents(msg, &diff, HIP_PARAM_INT, sizeof(diff));
+    HIP_IFEL(hip_build_param_contents(msg, &diff, HIP_PARAM_INT, sizeof(diff)),
+             -1, "Building the difficulty failed\n");
 
+    hip_set_param_type((struct hip_tlv_common *) &load, HIP_PARAM_PUZZLE_LOAD);
+    hip_calc_param_len((struct hip_tlv_common *) &load,
+                       sizeof(load) - sizeof(struct hip_tlv_common));
+    hip_puzzle_control_get_load(&load);
+    load.k = get_effective_cookie_difficulty();
+    HIP_IFEL(hip_build_param(msg, &load), -1,
+             "Building the puzzle load failed\n");
+
+out_err:
     return err;
 }
 
@@ -119,7 +149,7 @@ int hip_set_puzzle_difficulty_msg(struct hip_common *msg)
         HIP_ERROR("No difficulty set\n");
         return -1;
     }
-    if (set_cookie_difficulty(*new_val), -1) {
+    if (set_cookie_difficulty(*new_val) < 0) {
         HIP_ERROR("Setting difficulty failed\n");
         return -1;
     }
@@ -177,24 +207,25 @@ static int calc_cookie_idx(struct in6_addr *ip_i, struct in6_addr *ip_r)
 }
 
 /**
- * Get a copy of R1entry structure.
+ * Get the precreated R1 packet for an I1. The packet stays in the R1 table,
+ * callers must not modify it and must copy it if they keep it beyond the
+ * handling of the I1.
  *
  * @param ip_i        Initiator's IPv6
  * @param ip_r        Responder's IPv6
  * @param our_hit     Our HIT
  * @param dh_group_id Diffie Hellman group ID. -1 for HIPv1, otherwise return
                       R1 for HIPv2
- * @return            A R1 packet copy on success, NULL on error
+ * @return            The precreated R1 packet on success, NULL on error
  */
-struct hip_common *hip_get_r1(struct in6_addr *ip_i, struct in6_addr *ip_r,
-                              struct in6_addr *our_hit, const int dh_group_id)
+const struct hip_common *hip_get_r1(struct in6_addr *ip_i, struct in6_addr *ip_r,
+                                    struct in6_addr *our_hit, const int dh_group_id)
 {
-    struct hip_common    *r1         = NULL;
-    struct hip_common    *r1_matched = NULL;
-    struct local_host_id *hid        = NULL;
-    int                   idx, len;
+    const struct hip_common *r1_matched = NULL;
+    struct local_host_id    *hid        = NULL;
+    int                      idx;
 
-    /* Find the proper R1 table and copy the R1 message from the table */
+    /* Find the proper R1 table */
     hid = hip_get_hostid_entry_by_lhi_and_algo(our_hit, HIP_ANY_ALGO, -1);
     if (hid == NULL) {
         HIP_ERROR("Unknown HIT\n");
@@ -205,24 +236,112 @@ struct hip_common *hip_get_r1(struct in6_addr *ip_i, struct in6_addr *ip_r,
     HIP_DEBUG("Calculated index: %d\n", idx);
 
     if (dh_group_id == -1) {
-        r1_matched = &hid->r1[idx].buf.msg;
+        r1_matched = &hid->r1_table->r1[idx].buf.msg;
     } else {
-        r1_matched = &hid->r1_v2[dh_group_id][idx].buf.msg;
+        r1_matched = &hid->r1_table->r1_v2[dh_group_id][idx].buf.msg;
     }
-    /* Create a copy of the found entry */
-    len = hip_get_msg_total_len(r1_matched);
-    if (len <= 0) {
+
+    if (hip_get_msg_total_len(r1_matched) <= sizeof(struct hip_common)) {
         HIP_ERROR("Invalid r1 entry\n");
         return NULL;
     }
 
-    if ((r1 = hip_msg_alloc()) == NULL) {
-        return NULL;
+    return r1_matched;
+}
+
+/**
+ * HIPv1 & HIPv2: create one R1 entry of an R1 table
+ *
+ * @param table       the R1 table
+ * @param entry       the entry to create, entries below HIP_R1TABLESIZE are
+ *                    HIPv1 R1s, the following ones HIPv2 R1s for the groups of
+ *                    HIP_DH_GROUP_LIST
+ * @param hit         the local HIT
+ * @param sign        a signing callback function
+ * @param privkey     the private key to use for signing
+ * @param pubkey      the host id (public key)
+ * @return            zero on success and non-zero on error
+ */
+static int create_r1_entry(struct hip_r1table *const table,
+                           const unsigned int entry,
+                           const hip_hit_t *const hit,
+                           int (*sign)(void *const key, struct hip_common *const m),
+                           void *const privkey,
+                           const struct hip_host_id *const pubkey)
+{
+    const uint8_t      cookie_k = get_effective_cookie_difficulty();
+    const unsigned int i        = entry % HIP_R1TABLESIZE;
+    int                group_id;
+
+    if (entry < HIP_R1TABLESIZE) {
+        hip_msg_init(&table->r1[i].buf.msg);
+
+        if (hip_create_r1(&table->r1[i].buf.msg, hit, sign, privkey,
+                          pubkey, cookie_k)) {
+            HIP_ERROR("Unable to precreate R1s\n");
+            return -1;
+        }
+        HIP_DEBUG("R1 Packet %d created\n", i);
+    } else {
+        group_id = HIP_DH_GROUP_LIST[entry / HIP_R1TABLESIZE - 1];
+        hip_msg_init(&table->r1_v2[group_id][i].buf.msg);
+
+        if (hip_create_r1_v2(&table->r1_v2[group_id][i].buf.msg, hit, sign,
+                             privkey, pubkey, cookie_k, group_id)) {
+            HIP_ERROR("Unable to precreate R1_v2\n");
+            return -1;
+        }
+        HIP_DEBUG("R1_v2 Packets %d created for group: %d\n", i, group_id);
+    }
+
+    return 0;
+}
+
+/**
+ * Remember the puzzle of an R1 entry in the entry replacing it, so that
+ * initiators that are still solving it are not rejected.
+ *
+ * @param new_entry the new R1 entry
+ * @param old_entry the R1 entry being replaced
+ */
+static void keep_previous_puzzle(struct hip_r1entry *const new_entry,
+                                 const struct hip_r1entry *const old_entry)
+{
+    const struct hip_puzzle *puzzle;
+
+    if (!(puzzle = hip_get_param(&old_entry->buf.msg, HIP_PARAM_PUZZLE))) {
+        new_entry->Cvalid = false;
+        return;
     }
 
-    memcpy(r1, r1_matched, len);
+    memcpy(new_entry->Ci, puzzle->I, PUZZLE_LENGTH);
+    new_entry->Ck = puzzle->K;
+    memcpy(new_entry->Copaque, puzzle->opaque, HIP_PUZZLE_OPAQUE_LEN);
+    new_entry->Cvalid = true;
+}
+
+/**
+ * Remember the puzzles of an R1 table in the table replacing it.
+ *
+ * @param new_table the new R1 table
+ * @param old_table the R1 table being replaced, may be NULL
+ */
+static void keep_previous_puzzles(struct hip_r1table *const new_table,
+                                  const struct hip_r1table *const old_table)
+{
+    int group_id, i;
+
+    if (!old_table) {
+        return;
+    }
 
-    return r1;
+    for (i = 0; i < HIP_R1TABLESIZE; i++) {
+        keep_previous_puzzle(&new_table->r1[i], &old_table->r1[i]);
+        for (group_id = 0; group_id < HIP_MAX_DH_GROUP_ID; group_id++) {
+            keep_previous_puzzle(&new_table->r1_v2[group_id][i],
+                                 &old_table->r1_v2[group_id][i]);
+        }
+    }
 }
 
 /**
@@ -241,37 +360,45 @@ int hip_precreate_r1(struct local_host_id *id_entry,
                      void *const privkey,
                      const struct hip_host_id *const pubkey)
 {
-    const uint8_t cookie_k = get_cookie_difficulty();
-    int           i, j, group_id;
+    struct hip_r1table *table;
+    unsigned int        entry;
 
-    for (i = 0; i < HIP_R1TABLESIZE; i++) {
-        hip_msg_init(&id_entry->r1[i].buf.msg);
+    if (!(table = calloc(1, sizeof(*table)))) {
+        HIP_ERROR("Failed to allocate R1 table\n");
+        return -ENOMEM;
+    }
 
-        if (hip_create_r1(&id_entry->r1[i].buf.msg, hit, sign, privkey,
-                          pubkey, cookie_k)) {
-            HIP_ERROR("Unable to precreate R1s\n");
+    for (entry = 0; entry < HIP_R1_ENTRIES; entry++) {
+        if (create_r1_entry(table, entry, hit, sign, privkey, pubkey)) {
+            free(table);
             return -1;
         }
-        HIP_DEBUG("R1 Packet %d created\n", i);
     }
 
-    for (j = 0; j < HIP_DH_GROUP_LIST_SIZE; j++) {
-        group_id = HIP_DH_GROUP_LIST[j];
-        for (i = 0; i < HIP_R1TABLESIZE; i++) {
-            hip_msg_init(&id_entry->r1_v2[group_id][i].buf.msg);
-
-            if (hip_create_r1_v2(&id_entry->r1_v2[group_id][i].buf.msg, hit, sign,
-                                 privkey, pubkey, cookie_k, group_id)) {
-                HIP_ERROR("Unable to precreate R1_v2\n");
-                return -1;
-            }
-            HIP_DEBUG("R1_v2 Packets %d created for group: %d\n", i, group_id);
-        }
-    }
+    keep_previous_puzzles(table, id_entry->r1_table);
+    free(id_entry->r1_table);
+    id_entry->r1_table = table;
 
     return 0;
 }
 
+/**
+ * Free the R1 tables of a local host identity.
+ *
+ * @param id_entry the host id entry
+ */
+void hip_uninit_r1(struct local_host_id *const id_entry)
+{
+    if (id_entry->r1_shadow) {
+        free(id_entry->r1_shadow);
+        id_entry->r1_shadow = NULL;
+        r1_recreations_pending--;
+    }
+
+    free(id_entry->r1_table);
+    id_entry->r1_table = NULL;
+}
+
 /**
  * Verifies the solution of a puzzle. First we check that K and I are the same
  * as in the puzzle we sent. If not, then we check the previous ones (since the
@@ -311,24 +438,27 @@ int hip_verify_cookie(struct in6_addr *ip_i, struct in6_addr *ip_r,
              -1, "Requested source HIT not (any more) available.\n");
 
     if (hip_version == HIP_V1) {
-        result = &hid->r1[calc_cookie_idx(ip_i, ip_r)];
+        result = &hid->r1_table->r1[calc_cookie_idx(ip_i, ip_r)];
     } else {
-        result = &hid->r1_v2[dh_group_id][calc_cookie_idx(ip_i, ip_r)];
+        result = &hid->r1_table->r1_v2[dh_group_id][calc_cookie_idx(ip_i, ip_r)];
     }
 
     puzzle = hip_get_param(&result->buf.msg, HIP_PARAM_PUZZLE);
     HIP_IFEL(!puzzle, -1, "Internal error: could not find the cookie\n");
-    HIP_IFEL(memcmp(solution->opaque, puzzle->opaque,
-                    HIP_PUZZLE_OPAQUE_LEN), -1,
-             "Received cookie opaque does not match the sent opaque\n");
 
-    HIP_DEBUG("Solution's I (0x%llx), sent I (0x%llx)\n",
-              solution->I, puzzle->I);
+    HIP_HEXDUMP("solution", solution, sizeof(*solution));
+    HIP_HEXDUMP("puzzle", puzzle, sizeof(*puzzle));
 
-    if (solution->K != puzzle->K) {
-        HIP_INFO("Solution's K (%d) does not match sent K (%d)\n",
+    if (solution->K != puzzle->K ||
+        memcmp(solution->I, puzzle->I, PUZZLE_LENGTH) ||
+        memcmp(solution->opaque, puzzle->opaque, HIP_PUZZLE_OPAQUE_LEN)) {
+        HIP_INFO("Solution does not match the current puzzle (K %d, sent K %d)\n",
                  solution->K, puzzle->K);
 
+        /* The R1s may have been recreated since this R1 was sent, e.g.
+         * because the puzzle difficulty changed. */
+        HIP_IFEL(!result->Cvalid, -1,
+                 "Solution does not match the sent puzzle\n");
         HIP_IFEL(solution->K != result->Ck, -1,
                  "Solution's K did not match any sent Ks.\n");
         HIP_IFEL(memcmp(solution->I, result->Ci, PUZZLE_LENGTH), -1,
@@ -337,14 +467,6 @@ int hip_verify_cookie(struct in6_addr *ip_i, struct in6_addr *ip_r,
                         HIP_PUZZLE_OPAQUE_LEN), -1,
                  "Solution's opaque data does not match sent opaque data.\n");
         HIP_DEBUG("Received solution to an old puzzle\n");
-    } else {
-        HIP_HEXDUMP("solution", solution, sizeof(*solution));
-        HIP_HEXDUMP("puzzle", puzzle, sizeof(*puzzle));
-        HIP_IFEL(memcmp(solution->I, puzzle->I, PUZZLE_LENGTH), -1,
-                 "Solution's I did not match the sent I\n");
-        HIP_IFEL(memcmp(solution->opaque, puzzle->opaque,
-                        HIP_PUZZLE_OPAQUE_LEN), -1,
-                 "Solution's opaque data does not match the opaque data sent\n");
     }
 
     memcpy(puzzle_input.puzzle, solution->I, PUZZLE_LENGTH);
@@ -360,27 +482,26 @@ out_err:
 }
 
 /**
- * recreate R1 packets corresponding to one HI
+ * Look up the function to sign packets with the key of a host identity.
  *
  * @param entry the host id entry
- * @param opaque unused, required for compatibility with hip_for_each_hi()
- * @return zero on success or negative on error
+ * @param sign  the signing function is returned here
+ * @return zero on success or negative if the algorithm is unknown
  */
-static int recreate_r1s_for_entry_move(struct local_host_id *entry,
-                                       UNUSED void *opaque)
+static int get_signature_func(const struct local_host_id *const entry,
+                              int (**sign)(void *const key,
+                                           struct hip_common *const m))
 {
-    int (*signature_func)(void *const key, struct hip_common *const m);
-
     switch (hip_get_host_id_algo(&entry->host_id)) {
     case HIP_HI_RSA:
-        signature_func = hip_rsa_sign;
+        *sign = hip_rsa_sign;
         break;
     case HIP_HI_DSA:
-        signature_func = hip_dsa_sign;
+        *sign = hip_dsa_sign;
         break;
 #ifdef HAVE_EC_CRYPTO
     case HIP_HI_ECDSA:
-        signature_func = hip_ecdsa_sign;
+        *sign = hip_ecdsa_sign;
         break;
 #endif /* HAVE_EC_CRYPTO */
     default:
@@ -388,21 +509,112 @@ static int recreate_r1s_for_entry_move(struct local_host_id *entry,
         return -1;
     }
 
-    if (hip_precreate_r1(entry, &entry->hit, signature_func,
-                         entry->private_key, &entry->host_id) < 0) {
+    return 0;
+}
+
+/**
+ * Start recreating the R1 packets of one HI in its shadow table. A recreation
+ * that is already in progress starts over, as the R1s created so far may be
+ * outdated.
+ *
+ * @param entry the host id entry
+ * @param opaque unused, required for compatibility with hip_for_each_hi()
+ * @return zero on success or negative on error
+ */
+static int start_r1_recreation(struct local_host_id *entry,
+                               UNUSED void *opaque)
+{
+    if (!entry->r1_shadow) {
+        if (!(entry->r1_shadow = calloc(1, sizeof(*entry->r1_shadow)))) {
+            HIP_ERROR("Failed to allocate R1 table\n");
+            return -ENOMEM;
+        }
+        r1_recreations_pending++;
+    }
+    entry->r1_shadow_next = 0;
+
+    return 0;
+}
+
+/**
+ * Create the next R1 packet of an HI whose R1s are being recreated. The
+ * shadow table replaces the R1s in use once all of its entries exist.
+ *
+ * @param entry the host id entry
+ * @param opaque set to true once an R1 was created, so that only one R1 is
+ *               created per call of hip_for_each_hi()
+ * @return zero on success or negative on error
+ */
+static int recreate_next_r1(struct local_host_id *entry, void *opaque)
+{
+    bool *const         created = opaque;
+    struct hip_r1table *old_table;
+    int                 (*sign)(void *const key, struct hip_common *const m);
+
+    if (*created || !entry->r1_shadow) {
+        return 0;
+    }
+    *created = true;
+
+    if (get_signature_func(entry, &sign) ||
+        create_r1_entry(entry->r1_shadow, entry->r1_shadow_next, &entry->hit,
+                        sign, entry->private_key, &entry->host_id)) {
         HIP_ERROR("Precreate r1 failed\n");
+        free(entry->r1_shadow);
+        entry->r1_shadow = NULL;
+        r1_recreations_pending--;
         return -1;
     }
 
+    if (++entry->r1_shadow_next == HIP_R1_ENTRIES) {
+        keep_previous_puzzles(entry->r1_shadow, entry->r1_table);
+        old_table        = entry->r1_table;
+        entry->r1_table  = entry->r1_shadow;
+        entry->r1_shadow = NULL;
+        r1_recreations_pending--;
+        free(old_table);
+        HIP_DEBUG("R1 packets recreated\n");
+    }
+
     return 0;
 }
 
 /**
- * precreate all R1 packets
+ * Start recreating all R1 packets. The new R1s are created one at a time by
+ * hip_continue_r1_recreation() and replace the R1s of an HI only when all of
+ * them are ready, so the responder keeps answering I1s in the meantime.
  *
  * @return zero on success or negative on error
  */
 int hip_recreate_all_precreated_r1_packets(void)
 {
-    return hip_for_each_hi(recreate_r1s_for_entry_move, NULL);
+    return hip_for_each_hi(start_r1_recreation, NULL);
+}
+
+/**
+ * Check whether R1 packets are being recreated.
+ *
+ * @return true if hip_continue_r1_recreation() has work to do
+ */
+bool hip_r1_recreation_pending(void)
+{
+    return r1_recreations_pending > 0;
+}
+
+/**
+ * Create the next of the R1 packets that are being recreated. The main loop
+ * calls this once per pass, which bounds the time it is blocked by signing
+ * to a single R1.
+ *
+ * @return zero on success or negative on error
+ */
+int hip_continue_r1_recreation(void)
+{
+    bool created = false;
+
+    if (!r1_recreations_pending) {
+        return 0;
+    }
+
+    return hip_for_each_hi(recreate_next_r1, &created);
 }
@@ -26,22 +26,30 @@
 #ifndef HIPL_LIBHIPL_COOKIE_H
 #define HIPL_LIBHIPL_COOKIE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <netinet/in.h>
 
+#include "libcore/crypto.h"
 #include "libcore/protodefs.h"
 #include "libhipl/hidb.h"
 
-struct hip_common *hip_get_r1(struct in6_addr *ip_i,
-                              struct in6_addr *ip_r,
-                              struct in6_addr *our_hit,
-                              const int dh_group_id);
+/** number of R1 entries of a struct hip_r1table that are precreated */
+#define HIP_R1_ENTRIES (HIP_R1TABLESIZE * (1 + HIP_DH_GROUP_LIST_SIZE))
+
+const struct hip_common *hip_get_r1(struct in6_addr *ip_i,
+                                    struct in6_addr *ip_r,
+                                    struct in6_addr *our_hit,
+                                    const int dh_group_id);
 int hip_recreate_all_precreated_r1_packets(void);
+bool hip_r1_recreation_pending(void);
+int hip_continue_r1_recreation(void);
 int hip_precreate_r1(struct local_host_id *id_entry,
                      const hip_hit_t *const hit,
                      int (*sign)(void *const key, struct hip_common *const m),
                      void *const privkey,
                      const struct hip_host_id *const pubkey);
+void hip_uninit_r1(struct local_host_id *const id_entry);
 int hip_verify_cookie(struct in6_addr *ip_i, struct in6_addr *ip_r,
                       struct hip_common *hdr,
                       const struct hip_solution *cookie,
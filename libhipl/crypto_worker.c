@@ -0,0 +1,428 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Signature verification and Diffie-Hellman computations of a base exchange
+ * take milliseconds. Run inline, a single I2 blocks the packets of all other
+ * peers. Instead, a packet handle function can hand such work to a pool of
+ * worker threads and suspend the handling of its packet with
+ * hip_crypto_offload().
+ *
+ * The suspended packet context is copied into a job. A worker runs the
+ * job's work function on the private copy of the received message. It must
+ * not touch any other daemon state. Finished jobs are signaled to the main
+ * loop through an eventfd that is registered like any other socket. There,
+ * the job's done function applies the results to the host association, and
+ * the remaining handle functions of the packet run.
+ *
+ * A host association has at most one suspended packet. Further packets for
+ * it are dropped until the job is complete (see hip_receive_control_packet()).
+ * If the association is deleted in the meantime, the job is canceled and
+ * its results are discarded.
+ *
+ * @brief Worker threads for the expensive stages of packet handling
+ */
+
+#define _BSD_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "libcore/builder.h"
+#include "libcore/common.h"
+#include "libcore/debug.h"
+#include "libcore/ife.h"
+#include "hip_socket.h"
+#include "pkt_handling.h"
+#include "crypto_worker.h"
+
+/** A packet whose handling is suspended until its work is done. */
+struct hip_crypto_job {
+    struct hip_crypto_job    *next;
+    /** private copy of the packet context, only used by the main thread */
+    struct hip_packet_context ctx;
+    uint8_t                   packet_type;
+    enum hip_state            ha_state;
+    /** the suspended handle function */
+    int                       (*handle_function)(const uint8_t packet_type,
+                                                 const enum hip_state ha_state,
+                                                 struct hip_packet_context *ctx);
+    int                       (*work)(struct hip_common *const msg,
+                                      void *const arg);
+    int                       (*done)(struct hip_packet_context *const ctx,
+                                      void *const arg,
+                                      const int result);
+    void                     *arg;
+    /** return value of the work function */
+    int                       result;
+};
+
+/** singly linked list of jobs with O(1) append */
+struct job_queue {
+    struct hip_crypto_job *head;
+    struct hip_crypto_job *tail;
+};
+
+static pthread_t    workers[HIP_CRYPTO_MAX_WORKERS];
+static unsigned int num_workers = 0;
+static int          workers_stop;
+
+/** signals finished jobs to the main loop, -1 if there are no workers */
+static int completion_fd = -1;
+
+/** jobs handed off and not yet completed, only used by the main thread */
+static unsigned int jobs_in_flight = 0;
+
+/** jobs waiting for a worker */
+static struct job_queue pending;
+/** jobs waiting for the main loop */
+static struct job_queue finished;
+
+/**
+ * Protects ::pending, ::finished and ::workers_stop. Idle workers wait on
+ * ::jobs_cond for new jobs.
+ */
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  jobs_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Append a job to a queue.
+ *
+ * @param queue the queue
+ * @param job   the job
+ */
+static void job_queue_append(struct job_queue *const queue,
+                             struct hip_crypto_job *const job)
+{
+    job->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = job;
+    } else {
+        queue->head = job;
+    }
+    queue->tail = job;
+}
+
+/**
+ * Remove all jobs from a queue.
+ *
+ * @param queue the queue
+ * @return      the first of the removed jobs, linked by their next pointers
+ */
+static struct hip_crypto_job *job_queue_take(struct job_queue *const queue)
+{
+    struct hip_crypto_job *const head = queue->head;
+
+    queue->head = NULL;
+    queue->tail = NULL;
+    return head;
+}
+
+/**
+ * Main function of a worker thread.
+ *
+ * @param arg unused
+ * @return    NULL
+ */
+static void *crypto_worker(UNUSED void *arg)
+{
+    const uint64_t         one = 1;
+    struct hip_crypto_job *job;
+    sigset_t               signals;
+
+    /* signals are handled by the main thread */
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    pthread_mutex_lock(&jobs_lock);
+    while (!workers_stop) {
+        if (!(job = pending.head)) {
+            pthread_cond_wait(&jobs_cond, &jobs_lock);
+            continue;
+        }
+        if (!(pending.head = job->next)) {
+            pending.tail = NULL;
+        }
+        pthread_mutex_unlock(&jobs_lock);
+
+        job->result = job->work(job->ctx.input_msg, job->arg);
+
+        pthread_mutex_lock(&jobs_lock);
+        job_queue_append(&finished, job);
+        if (write(completion_fd, &one, sizeof(one)) != sizeof(one)) {
+            HIP_ERROR("Failed to signal a finished job: %s\n", strerror(errno));
+        }
+    }
+    pthread_mutex_unlock(&jobs_lock);
+
+    return NULL;
+}
+
+/**
+ * Complete a job on the main thread and free it.
+ *
+ * @param job the job
+ */
+static void finish_job(struct hip_crypto_job *const job)
+{
+    jobs_in_flight--;
+
+    if (job->ctx.hadb_entry) {
+        job->ctx.hadb_entry->crypto_job = NULL;
+    } else {
+        HIP_DEBUG("Host association deleted, discarding job.\n");
+        job->result = -ECANCELED;
+    }
+
+    if (!job->done(&job->ctx, job->arg, job->result) &&
+        job->ctx.hadb_entry && !job->ctx.error) {
+        hip_resume_handle_functions(job->packet_type, job->ha_state,
+                                    &job->ctx, job->handle_function);
+    }
+
+    free(job->arg);
+    free(job->ctx.input_msg);
+    free(job->ctx.output_msg);
+    free(job);
+}
+
+/**
+ * Complete all finished jobs. Called by the main loop when ::completion_fd
+ * becomes readable.
+ *
+ * @param ctx the packet context of the main loop, unused
+ * @return    0 on success, -1 on error
+ */
+static int handle_finished_jobs(UNUSED struct hip_packet_context *ctx)
+{
+    struct hip_crypto_job *job, *next;
+    uint64_t               count;
+
+    if (read(completion_fd, &count, sizeof(count)) != sizeof(count)) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+
+    pthread_mutex_lock(&jobs_lock);
+    job = job_queue_take(&finished);
+    pthread_mutex_unlock(&jobs_lock);
+
+    for (; job; job = next) {
+        next = job->next;
+        finish_job(job);
+    }
+
+    return 0;
+}
+
+/**
+ * Start the crypto worker threads.
+ *
+ * @param num number of worker threads, at most HIP_CRYPTO_MAX_WORKERS. With
+ *            zero workers, offloaded work runs inline.
+ * @return    0 on success, -1 on error
+ */
+int hip_init_crypto_workers(const unsigned int num)
+{
+    int err = 0;
+
+    if (num == 0) {
+        HIP_DEBUG("No crypto workers, running crypto inline.\n");
+        return 0;
+    }
+
+    HIP_IFEL((completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0, -1,
+             "Failed to create completion eventfd: %s\n", strerror(errno));
+    HIP_IFEL(hip_register_socket(completion_fd, handle_finished_jobs, 20000),
+             -1, "Failed to register completion eventfd\n");
+
+    workers_stop = 0;
+    while (num_workers < num && num_workers < HIP_CRYPTO_MAX_WORKERS) {
+        HIP_IFEL(pthread_create(&workers[num_workers], NULL, crypto_worker, NULL),
+                 -1, "Failed to start crypto worker\n");
+        num_workers++;
+    }
+
+    HIP_DEBUG("Started %u crypto workers.\n", num_workers);
+    return 0;
+
+out_err:
+    hip_uninit_crypto_workers();
+    return err;
+}
+
+/**
+ * Stop the crypto worker threads and discard all jobs.
+ */
+void hip_uninit_crypto_workers(void)
+{
+    struct hip_crypto_job *job, *next;
+
+    pthread_mutex_lock(&jobs_lock);
+    workers_stop = 1;
+    pthread_cond_broadcast(&jobs_cond);
+    pthread_mutex_unlock(&jobs_lock);
+
+    for (; num_workers > 0; num_workers--) {
+        pthread_join(workers[num_workers - 1], NULL);
+    }
+
+    job = job_queue_take(&pending);
+    for (; job; job = next) {
+        next = job->next;
+        hip_crypto_cancel(job->ctx.hadb_entry);
+        finish_job(job);
+    }
+    job = job_queue_take(&finished);
+    for (; job; job = next) {
+        next = job->next;
+        hip_crypto_cancel(job->ctx.hadb_entry);
+        finish_job(job);
+    }
+
+    if (completion_fd >= 0) {
+        close(completion_fd);
+        completion_fd = -1;
+    }
+}
+
+/**
+ * Hand the expensive stage of a packet handle function to a worker thread.
+ *
+ * On success, the handle function returns HIP_HANDLE_SUSPENDED. The packet
+ * context is copied and the packet handling continues on the main thread with
+ * the copy, once @a work is complete: @a done is called with the result of
+ * @a work and the remaining handle functions run if it returns zero.
+ *
+ * Without worker threads, @a work and @a done are called right away.
+ *
+ * @param packet_type     the packet type passed to the handle function
+ * @param ha_state        the host association state passed to the handle
+ *                        function
+ * @param ctx             the packet context
+ * @param handle_function the calling handle function
+ * @param work            function run by the worker. It receives a private
+ *                        copy of the received message and must only access
+ *                        that and @a arg.
+ * @param done            function that applies the result on the main
+ *                        thread. If the host association was deleted in the
+ *                        meantime, it is called with -ECANCELED and a NULL
+ *                        host association and must only release the
+ *                        resources held by @a arg. Returns zero to continue
+ *                        the packet handling. On error, it sets ctx->error.
+ * @param arg             argument of @a work and @a done, allocated with
+ *                        malloc(). It is freed after @a done returned.
+ * @return                HIP_HANDLE_SUSPENDED if the work was handed off,
+ *                        otherwise the return value of @a done
+ */
+int hip_crypto_offload(const uint8_t packet_type,
+                       const enum hip_state ha_state,
+                       struct hip_packet_context *const ctx,
+                       int (*handle_function)(const uint8_t packet_type,
+                                              const enum hip_state ha_state,
+                                              struct hip_packet_context *ctx),
+                       int (*work)(struct hip_common *const msg,
+                                   void *const arg),
+                       int (*done)(struct hip_packet_context *const ctx,
+                                   void *const arg,
+                                   const int result),
+                       void *const arg)
+{
+    struct hip_crypto_job *job = NULL;
+    int                    err;
+
+    if (num_workers == 0 || !ctx->hadb_entry) {
+        goto inline_work;
+    }
+
+    if (!(job = calloc(1, sizeof(*job))) ||
+        !(job->ctx.input_msg = hip_msg_alloc()) ||
+        !(job->ctx.output_msg = hip_msg_alloc())) {
+        HIP_ERROR("Out of memory, running crypto inline.\n");
+        if (job) {
+            free(job->ctx.input_msg);
+            free(job);
+        }
+        goto inline_work;
+    }
+
+    memcpy(job->ctx.input_msg, ctx->input_msg, HIP_MAX_PACKET);
+    memcpy(job->ctx.output_msg, ctx->output_msg, HIP_MAX_PACKET);
+    job->ctx.src_addr    = ctx->src_addr;
+    job->ctx.dst_addr    = ctx->dst_addr;
+    job->ctx.msg_ports   = ctx->msg_ports;
+    job->ctx.hadb_entry  = ctx->hadb_entry;
+    job->packet_type     = packet_type;
+    job->ha_state        = ha_state;
+    job->handle_function = handle_function;
+    job->work            = work;
+    job->done            = done;
+    job->arg             = arg;
+
+    ctx->hadb_entry->crypto_job = job;
+    jobs_in_flight++;
+
+    pthread_mutex_lock(&jobs_lock);
+    job_queue_append(&pending, job);
+    pthread_cond_signal(&jobs_cond);
+    pthread_mutex_unlock(&jobs_lock);
+
+    return HIP_HANDLE_SUSPENDED;
+
+inline_work:
+    err = done(ctx, arg, work(ctx->input_msg, arg));
+    free(arg);
+    return err;
+}
+
+/**
+ * Cancel the suspended packet handling of a host association. Its job still
+ * runs, but the result is discarded.
+ *
+ * @param entry the host association, may be NULL
+ */
+void hip_crypto_cancel(struct hip_hadb_state *const entry)
+{
+    if (entry && entry->crypto_job) {
+        entry->crypto_job->ctx.hadb_entry = NULL;
+        entry->crypto_job                 = NULL;
+    }
+}
+
+/**
+ * Get the number of jobs that were handed off and whose packet handling has
+ * not yet resumed.
+ *
+ * @return the number of jobs in flight
+ */
+unsigned int hip_crypto_backlog(void)
+{
+    return jobs_in_flight;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HIPL_LIBHIPL_CRYPTO_WORKER_H
+#define HIPL_LIBHIPL_CRYPTO_WORKER_H
+
+#include <stdint.h>
+
+#include "libcore/protodefs.h"
+#include "libcore/state.h"
+
+/** upper bound for the number of crypto worker threads */
+#define HIP_CRYPTO_MAX_WORKERS 32
+
+int hip_init_crypto_workers(const unsigned int num_workers);
+void hip_uninit_crypto_workers(void);
+
+int hip_crypto_offload(const uint8_t packet_type,
+                       const enum hip_state ha_state,
+                       struct hip_packet_context *const ctx,
+                       int (*handle_function)(const uint8_t packet_type,
+                                              const enum hip_state ha_state,
+                                              struct hip_packet_context *ctx),
+                       int (*work)(struct hip_common *const msg,
+                                   void *const arg),
+                       int (*done)(struct hip_packet_context *const ctx,
+                                   void *const arg,
+                                   const int result),
+                       void *const arg);
+
+void hip_crypto_cancel(struct hip_hadb_state *const entry);
+unsigned int hip_crypto_backlog(void);
+
+#endif /* HIPL_LIBHIPL_CRYPTO_WORKER_H */
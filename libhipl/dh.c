@@ -196,6 +196,43 @@ int hip_match_dh_group_list(const struct hip_tlv_common *const dh_group_list,
     return -1;
 }
 
+/**
+ * Get the local key of a DH group, generating it if it does not exist yet.
+ *
+ * @param group_id the DH group ID
+ * @return         the key or NULL on error
+ */
+static DH *get_dh_key(const uint16_t group_id)
+{
+    if (dh_table[group_id] == NULL) {
+        if (NULL == (dh_table[group_id] = hip_generate_dh_key(group_id))) {
+            HIP_ERROR("Failed to generate a DH key for group: %d\n", group_id);
+        }
+    }
+
+    return dh_table[group_id];
+}
+
+#ifdef HAVE_EC_CRYPTO
+/**
+ * Get the local key of an ECDH group, generating it if it does not exist yet.
+ *
+ * @param group_id the ECDH group ID
+ * @return         the key or NULL on error
+ */
+static EC_KEY *get_ecdh_key(const uint16_t group_id)
+{
+    if (ecdh_table[group_id] == NULL) {
+        if (NULL == (ecdh_table[group_id] = hip_generate_ecdh_key(group_id))) {
+            HIP_ERROR("Failed to generate an ECDH key for group: %d\n",
+                      group_id);
+        }
+    }
+
+    return ecdh_table[group_id];
+}
+#endif /* HAVE_EC_CRYPTO */
+
 /**
  * Calculate a Diffie-Hellman shared secret based on the public key of the peer
  * (passed as an argument) and own DH private key (created beforehand).
@@ -223,16 +260,11 @@ static int hip_calculate_dh_shared_secret(const uint16_t group_id,
         return -1;
     }
 
-    if (dh_table[group_id] == NULL) {
-        if (NULL == (key = hip_generate_dh_key(group_id))) {
-            HIP_ERROR("Failed to generate a DH key for group: %d\n", group_id);
-            return -1;
-        }
-        dh_table[group_id] = key;
+    if (!(key = get_dh_key(group_id))) {
+        return -1;
     }
-    key = dh_table[group_id];
 
-    secret_len = hip_gen_dh_shared_key(dh_table[group_id], public_value, len,
+    secret_len = hip_gen_dh_shared_key(key, public_value, len,
                                        buffer, bufsize);
     if (secret_len < 0) {
         HIP_ERROR("failed to create a DH shared secret\n");
@@ -268,15 +300,9 @@ static int hip_calculate_ecdh_shared_secret(const uint16_t group_id,
     EC_KEY *key;
     int     key_len;
 
-    if (ecdh_table[group_id] == NULL) {
-        if (NULL == (key = hip_generate_ecdh_key(group_id))) {
-            HIP_ERROR("Failed to generate an ECDH key for group: %d\n",
-                      group_id);
-            return -1;
-        }
-        ecdh_table[group_id] = key;
+    if (!(key = get_ecdh_key(group_id))) {
+        return -1;
     }
-    key = ecdh_table[group_id];
 
     key_len = hip_get_dh_size(group_id);
     if (key_len != pubkey_len || key_len / 2 > bufsize) {
@@ -338,6 +364,31 @@ int hip_calculate_shared_secret(const uint16_t group_id,
 #endif /* HAVE_EC_CRYPTO */
 }
 
+/**
+ * Make sure that the local key of a Diffie-Hellman group exists.
+ *
+ * hip_calculate_shared_secret() creates missing keys on demand. Once the key
+ * exists, it only reads it. The keys are not replaced while the daemon runs,
+ * so that worker threads may then calculate shared secrets concurrently.
+ *
+ * @param group_id the Diffie-Hellman group ID
+ * @return         0 on success, -1 otherwise
+ */
+int hip_init_dh_key(const uint16_t group_id)
+{
+    if (group_id <= 0 || group_id >= HIP_MAX_DH_GROUP_ID) {
+        HIP_ERROR("Invalid Diffie-Hellman group ID: %d\n", group_id);
+        return -1;
+    }
+
+#ifdef HAVE_EC_CRYPTO
+    if (hip_is_ecdh_group(group_id)) {
+        return get_ecdh_key(group_id) ? 0 : -1;
+    }
+#endif /* HAVE_EC_CRYPTO */
+    return get_dh_key(group_id) ? 0 : -1;
+}
+
 /**
  * Re-generate a DH key for a given group ID.
  *
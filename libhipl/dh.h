@@ -38,6 +38,7 @@ int hip_calculate_shared_secret(const uint16_t group_id,
                                 const int len,
                                 unsigned char *const buffer,
                                 const int bufsize);
+int hip_init_dh_key(const uint16_t group_id);
 int hip_init_cipher(void);
 
 int hip_insert_dh_v2(uint8_t *buffer, int bufsize, int group_id);
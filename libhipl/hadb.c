@@ -88,10 +88,13 @@
 #include "libcore/gpl/xfrmapi.h"
 #include "config.h"
 #include "accessor.h"
+#include "crypto_worker.h"
 #include "hidb.h"
 #include "hipd.h"
 #include "input.h"
 #include "keymat.h"
+#include "maintenance.h"
+#include "msg_pool.h"
 #include "netdev.h"
 #include "output.h"
 #include "hadb.h"
@@ -379,6 +382,8 @@ int hip_hadb_insert_state(struct hip_hadb_state *ha)
             hip_ht_add(hadb_hit, ha);
             st = HIP_HA_STATE_VALID;
             HIP_DEBUG("HIP association was inserted successfully.\n");
+            ha->ha_state = st;
+            hipfw_update_ha_info(HIP_MSG_FW_HA_UPDATE, ha);
         } else {
             HIP_DEBUG("HIP association was NOT inserted because "
                       "a HIP association with matching HITs was "
@@ -701,22 +706,17 @@ static int hadb_init_entry(struct hip_hadb_state *entry)
 
     entry->next_retrans_slot = 0;
     for (unsigned int i = 0; i < HIP_RETRANSMIT_QUEUE_SIZE; i++) {
-        if (!(entry->hip_msg_retrans[i].buf = calloc(1, HIP_MAX_NETWORK_PACKET))) {
-            for (unsigned int j = 0; j < i; j++) {
-                free(entry->hip_msg_retrans[j].buf);
-            }
-            return -ENOMEM;
-        }
-        entry->hip_msg_retrans[i].count = 0;
+        /* buffers are taken from the message pool when a packet is queued */
+        entry->hip_msg_retrans[i].buf         = NULL;
+        entry->hip_msg_retrans[i].count       = 0;
+        entry->hip_msg_retrans[i].entry       = entry;
+        entry->hip_msg_retrans[i].timer_index = -1;
     }
 
     /* Initialize module states */
     entry->hip_modular_state = lmod_init_state();
     if (entry->hip_modular_state == NULL) {
         HIP_ERROR("Failed to initialize modular state.\n");
-        for (unsigned int i = 0; i < HIP_RETRANSMIT_QUEUE_SIZE; i++) {
-            free(entry->hip_msg_retrans[i].buf);
-        }
         return -1;
     }
     lmod_init_state_items(entry->hip_modular_state);
@@ -798,6 +798,7 @@ int hip_hadb_add_peer_addr(struct hip_hadb_state *entry,
     }
     ipv6_addr_copy(&entry->peer_addr, new_addr);
     HIP_DEBUG_IN6ADDR("entry->peer_address \n", &entry->peer_addr);
+    hipfw_update_ha_info(HIP_MSG_FW_HA_UPDATE, entry);
 
     if (entry->peer_addr_list_to_be_added) {
         /* Adding the peer address to the entry->peer_addr_list_to_be_added
@@ -833,13 +834,16 @@ static void hadb_delete_state(struct hip_hadb_state *ha)
 
     HIP_DEBUG("ha=0x%p\n", ha);
 
+    /* A pending crypto job must not resume on the freed state */
+    hip_crypto_cancel(ha);
+
     /* Delete SAs */
 
     free(ha->dh_shared_key);
     for (i = 0; i < HIP_RETRANSMIT_QUEUE_SIZE; i++) {
-        free(ha->hip_msg_retrans[i].buf);
+        hip_unschedule_retransmission(&ha->hip_msg_retrans[i]);
+        hip_msg_pool_put(ha->hip_msg_retrans[i].buf);
     }
-    hip_update_select_timeout();
     if (ha->peer_pub) {
         switch (hip_get_host_id_algo(ha->peer_pub)) {
         case HIP_HI_RSA:
@@ -894,6 +898,7 @@ int hip_del_peer_info_entry(struct hip_hadb_state *ha)
     HIP_DEBUG_HIT("peer HIT", &ha->hit_peer);
     hip_delete_security_associations_and_sp(ha);
 
+    hipfw_update_ha_info(HIP_MSG_FW_HA_DELETE, ha);
     hadb_delete_state(ha);
 
     return 0;
@@ -1036,6 +1041,20 @@ void hip_init_hadb(void)
     hadb_hit = hip_ht_init(LHASH_HASH_FN(ha), LHASH_COMP_FN(ha));
 }
 
+/**
+ * Change the state of a host association and inform the firewall.
+ *
+ * @param entry a pointer to a host association
+ * @param state the new state
+ */
+void hip_hadb_set_state(struct hip_hadb_state *entry, const enum hip_state state)
+{
+    if (entry->state != state) {
+        entry->state = state;
+        hipfw_update_ha_info(HIP_MSG_FW_HA_UPDATE, entry);
+    }
+}
+
 /**
  * Switches on a local control bit for a host association entry.
  *
@@ -1221,6 +1240,34 @@ int hip_count_open_connections(void)
     return n;
 }
 
+/**
+ * Describe a host association to user space.
+ *
+ * @param entry the host association
+ * @param hid   receives the description
+ */
+void hip_hadb_get_user_info(const struct hip_hadb_state *entry,
+                            struct hip_hadb_user_info_state *hid)
+{
+    memset(hid, 0, sizeof(*hid));
+
+    hid->state = entry->state;
+    ipv6_addr_copy(&hid->hit_our, &entry->hit_our);
+    ipv6_addr_copy(&hid->hit_peer, &entry->hit_peer);
+    ipv6_addr_copy(&hid->ip_our, &entry->our_addr);
+    ipv6_addr_copy(&hid->ip_peer, &entry->peer_addr);
+    ipv4_addr_copy(&hid->lsi_our, &entry->lsi_our);
+    ipv4_addr_copy(&hid->lsi_peer, &entry->lsi_peer);
+    memcpy(&hid->peer_hostname, &entry->peer_hostname, HIP_HOST_ID_HOSTNAME_LEN_MAX);
+
+    hid->nat_udp_port_peer  = entry->peer_udp_port;
+    hid->nat_udp_port_local = entry->local_udp_port;
+
+    hid->broadcast_status = hip_broadcast_status;
+
+    hid->peer_controls = entry->peer_controls;
+}
+
 /**
  * an enumerator to find information on host associations
  *
@@ -1232,17 +1279,10 @@ int hip_count_open_connections(void)
 int hip_handle_get_ha_info(struct hip_hadb_state *entry, void *opaq)
 {
     int                             err = 0;
-    struct hip_hadb_user_info_state hid = { { { { 0 } } } };
+    struct hip_hadb_user_info_state hid;
     struct hip_common              *msg = opaq;
 
-    hid.state = entry->state;
-    ipv6_addr_copy(&hid.hit_our, &entry->hit_our);
-    ipv6_addr_copy(&hid.hit_peer, &entry->hit_peer);
-    ipv6_addr_copy(&hid.ip_our, &entry->our_addr);
-    ipv6_addr_copy(&hid.ip_peer, &entry->peer_addr);
-    ipv4_addr_copy(&hid.lsi_our, &entry->lsi_our);
-    ipv4_addr_copy(&hid.lsi_peer, &entry->lsi_peer);
-    memcpy(&hid.peer_hostname, &entry->peer_hostname, HIP_HOST_ID_HOSTNAME_LEN_MAX);
+    hip_hadb_get_user_info(entry, &hid);
 
     /** @todo Modularize heartbeat */
 #if 0
@@ -1255,13 +1295,6 @@ int hip_handle_get_ha_info(struct hip_hadb_state *entry, void *opaq)
     hid.heartbeats_sent     = entry->heartbeats_sent;
 #endif
 
-    hid.nat_udp_port_peer  = entry->peer_udp_port;
-    hid.nat_udp_port_local = entry->local_udp_port;
-
-    hid.broadcast_status = hip_broadcast_status;
-
-    hid.peer_controls = entry->peer_controls;
-
     /* does not print heartbeat info, but I do not think it even should -Samu*/
     print_debug_info(&hid.ip_our, &hid.ip_peer, &hid.hit_our, &hid.hit_peer,
                      &hid.lsi_peer, (char *) &hid.peer_hostname,
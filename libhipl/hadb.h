@@ -97,6 +97,8 @@ struct hip_hadb_state *hip_hadb_create_state(void);
 int hip_for_each_ha(int(func) (struct hip_hadb_state *entry, void *opaq),
                     void *opaque);
 
+void hip_hadb_set_state(struct hip_hadb_state *entry, const enum hip_state state);
+
 /* next 2 functions are not called from outside but make sense and are
  * 'proposed' in libcore/state.h
  */
@@ -113,6 +115,8 @@ int hip_count_open_connections(void);
 struct hip_hadb_state *hip_hadb_find_rvs_candidate_entry(const hip_hit_t *,
                                                          const hip_hit_t *);
 
+void hip_hadb_get_user_info(const struct hip_hadb_state *entry,
+                            struct hip_hadb_user_info_state *hid);
 int hip_handle_get_ha_info(struct hip_hadb_state *entry, void *);
 
 /*lsi support functions*/
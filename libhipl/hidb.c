@@ -295,6 +295,7 @@ static int del_host_id(hip_hit_t hit)
     }
 
     list_del(id, hip_local_hostid_db);
+    hip_uninit_r1(id);
     free(id);
     id = NULL;
 
@@ -516,6 +517,7 @@ out_err:
         default:
             HIP_DEBUG("Could not free key, because key type is unknown\n");
         }
+        hip_uninit_r1(id_entry);
         free(id_entry);
     }
 
@@ -44,9 +44,23 @@
 struct hip_r1entry {
     union hip_msg_bfr buf;
     uint32_t          generation;
+    /** the puzzle of the R1 this entry replaced, see @c Cvalid */
     uint8_t           Ci[PUZZLE_LENGTH];
     uint8_t           Ck;
     uint8_t           Copaque[HIP_PUZZLE_OPAQUE_LEN];
+    /** whether @c Ci, @c Ck and @c Copaque hold a previous puzzle */
+    bool              Cvalid;
+};
+
+/**
+ * Precreated R1 entries of a local host identity.
+ * Due to the introduction of DH_GROUP_LIST in HIPv2, R1's DIFFIE_HELLMAN
+ * parameter must match one of the group ID of initiator's I1. Therefore we
+ * precreate R1 for all DH groups we support.
+ */
+struct hip_r1table {
+    struct hip_r1entry r1[HIP_R1TABLESIZE];
+    struct hip_r1entry r1_v2[HIP_MAX_DH_GROUP_ID][HIP_R1TABLESIZE];
 };
 
 struct local_host_id {
@@ -56,12 +70,12 @@ struct local_host_id {
     struct hip_host_id host_id;
     void              *private_key;       /* RSA or DSA */
 
-    /* precreated R1 entries.
-     * Due to the introduction of DH_GROUP_LIST in HIPv2,  R1's DIFFIE_HELLMAN
-     * parameter must match one of the group ID of initiator's I1. Therefore we
-     * precreate R1 for all DH groups we support. */
-    struct hip_r1entry r1[HIP_R1TABLESIZE];
-    struct hip_r1entry r1_v2[HIP_MAX_DH_GROUP_ID][HIP_R1TABLESIZE];
+    /** the R1 entries handed out to initiators */
+    struct hip_r1table *r1_table;
+    /** R1 entries being recreated, swapped in for @c r1_table when done */
+    struct hip_r1table *r1_shadow;
+    /** index of the next R1 entry to create in @c r1_shadow */
+    unsigned int        r1_shadow_next;
 };
 
 struct local_host_id *hip_get_hostid_entry_by_lhi_and_algo(const struct in6_addr *const hit,
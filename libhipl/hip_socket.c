@@ -29,10 +29,16 @@
  * Identity Protocol (HIP).
  */
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 
 #include "libcore/builder.h"
 #include "libcore/common.h"
@@ -84,62 +90,86 @@ int hip_user_sock = 0;
  */
 static struct hip_ll *hip_sockets;
 
-static int handle_raw_input_v6(struct hip_packet_context *ctx)
-{
-    int err = 0;
+/** maximum number of ready sockets handled per wakeup */
+#define HIP_SOCKET_MAX_EVENTS 16
 
-    HIP_DEBUG("received on: hip_raw_sock_input_v6\n");
+/** maximum number of messages read from one socket per wakeup, so that a
+ *  flooded socket cannot starve the others */
+#define HIP_SOCKET_BATCH 32
+
+/** epoll instance watching all registered sockets, -1 if not initialized */
+static int hip_epoll_fd = -1;
+
+/**
+ * Packet contexts that control messages are received into. A burst of
+ * messages is read with one system call and then handled back to back.
+ */
+static struct hip_packet_context rx_ctx[HIP_CONTROL_MSG_BATCH];
 
-    if (hip_read_control_msg_v6(hip_raw_sock_input_v6,
-                                ctx,
-                                0)) {
+/**
+ * Read a batch of control messages from a socket and handle them.
+ *
+ * @param sockfd         the socket to read from
+ * @param encap_hdr_size size of the encapsulation header in bytes
+ * @param is_ipv4        whether the socket receives IPv4 messages
+ * @param receive        the function handling a received message
+ * @param ctx            the packet context of the main loop, which provides
+ *                       the output buffer
+ * @return               the number of messages read, -1 on error
+ */
+static int handle_control_msgs(const int sockfd,
+                               const int encap_hdr_size,
+                               const int is_ipv4,
+                               int (*receive)(struct hip_packet_context *ctx),
+                               const struct hip_packet_context *const ctx)
+{
+    int i, count;
+
+    count = hip_read_control_msgs(sockfd, rx_ctx, HIP_CONTROL_MSG_BATCH,
+                                  encap_hdr_size, is_ipv4);
+    if (count < 0) {
         HIP_ERROR("Reading network msg failed\n");
-    } else {
-        err = hip_receive_control_packet(ctx);
-        if (err) {
-            HIP_ERROR("hip_receive_control_packet()!\n");
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (rx_ctx[i].error) {
+            HIP_ERROR("Reading network msg failed\n");
+            continue;
+        }
+
+        rx_ctx[i].output_msg = ctx->output_msg;
+        rx_ctx[i].hadb_entry = NULL;
+        if (receive(&rx_ctx[i])) {
+            HIP_ERROR("Handling of control msg failed\n");
         }
     }
 
-    return err;
+    return count;
 }
 
-static int handle_raw_input_v4(struct hip_packet_context *ctx)
+static int handle_raw_input_v6(struct hip_packet_context *ctx)
 {
-    int err = 0;
+    HIP_DEBUG("received on: hip_raw_sock_input_v6\n");
 
-    HIP_DEBUG("received on: hip_raw_sock_input_v4\n");
+    return handle_control_msgs(hip_raw_sock_input_v6, 0, 0,
+                               hip_receive_control_packet, ctx);
+}
 
-    if (hip_read_control_msg_v4(hip_raw_sock_input_v4,
-                                ctx,
-                                IPV4_HDR_SIZE)) {
-        HIP_ERROR("Reading network msg failed\n");
-    } else {
-        err = hip_receive_control_packet(ctx);
-        if (err) {
-            HIP_ERROR("hip_receive_control_packet()!\n");
-        }
-    }
+static int handle_raw_input_v4(struct hip_packet_context *ctx)
+{
+    HIP_DEBUG("received on: hip_raw_sock_input_v4\n");
 
-    return err;
+    return handle_control_msgs(hip_raw_sock_input_v4, IPV4_HDR_SIZE, 1,
+                               hip_receive_control_packet, ctx);
 }
 
 static int handle_nat_input(struct hip_packet_context *ctx)
 {
-    int err = 0;
-
     HIP_DEBUG("received on: hip_nat_sock_input_udp\n");
 
-    err = hip_read_control_msg_v4(hip_nat_sock_input_udp,
-                                  ctx,
-                                  HIP_UDP_ZERO_BYTES_LEN);
-    if (err) {
-        HIP_ERROR("Reading network msg failed\n");
-    } else {
-        err = hip_receive_udp_control_packet(ctx);
-    }
-
-    return err;
+    return handle_control_msgs(hip_nat_sock_input_udp, HIP_UDP_ZERO_BYTES_LEN, 1,
+                               hip_receive_udp_control_packet, ctx);
 }
 
 static int handle_user_sock(struct hip_packet_context *ctx)
@@ -229,8 +259,43 @@ void hip_register_sockets(void)
  */
 void hip_unregister_sockets(void)
 {
+    unsigned int i;
+
+    if (hip_epoll_fd >= 0) {
+        close(hip_epoll_fd);
+        hip_epoll_fd = -1;
+    }
+
+    for (i = 0; i < HIP_CONTROL_MSG_BATCH; i++) {
+        free(rx_ctx[i].input_msg);
+        rx_ctx[i].input_msg = NULL;
+    }
+
     hip_ll_uninit(hip_sockets, free);
     free(hip_sockets);
+    hip_sockets = NULL;
+}
+
+/**
+ * Add a registered socket to the epoll instance.
+ *
+ * @param sock the socket entry, which is returned with its events
+ * @return       0 on success, -1 on error
+ */
+static int watch_socket(struct socketfd *const sock)
+{
+    struct epoll_event event = { 0 };
+
+    event.events   = EPOLLIN;
+    event.data.ptr = sock;
+
+    if (epoll_ctl(hip_epoll_fd, EPOLL_CTL_ADD, sock->fd, &event)) {
+        HIP_ERROR("Failed to watch socket %d: %s\n", sock->fd,
+                  strerror(errno));
+        return -1;
+    }
+
+    return 0;
 }
 
 /**
@@ -240,7 +305,8 @@ void hip_unregister_sockets(void)
  *       hip_unregister_sockets().
  *
  * @param socketfd The socket descriptor.
- * @param func_ptr The associated handler function.
+ * @param func_ptr The associated handler function. If it reads more than one
+ *                 message per call, it returns the number of messages.
  * @param priority Execution priority for the handler function.
  * @return Success =  0
  *         Error   = -1
@@ -260,9 +326,17 @@ int hip_register_socket(int socketfd,
     new_socket->fd       = socketfd;
     new_socket->func_ptr = func_ptr;
 
-    HIP_IFEL(!(hip_sockets = lmod_register_function(hip_sockets, new_socket, priority)),
+    /* sockets registered while the main loop runs are watched right away */
+    HIP_IFEL(hip_epoll_fd >= 0 && watch_socket(new_socket),
              -1,
-             "Error on registering a maintenance function.\n");
+             "Error on watching the socket.\n");
+
+    if (!(hip_sockets = lmod_register_function(hip_sockets, new_socket, priority))) {
+        if (hip_epoll_fd >= 0) {
+            epoll_ctl(hip_epoll_fd, EPOLL_CTL_DEL, socketfd, NULL);
+        }
+        HIP_IFEL(1, -1, "Error on registering a maintenance function.\n");
+    }
 
     return 0;
 
@@ -271,71 +345,126 @@ out_err:
     return err;
 }
 
-int hip_get_highest_descriptor(void)
+/**
+ * Set up the epoll instance for the main loop and watch all sockets
+ * registered so far.
+ *
+ * @return 0 on success, -1 on error
+ */
+int hip_init_socket_events(void)
 {
-    int                       highest_descriptor = 0;
-    const struct hip_ll_node *iter               = NULL;
+    const struct hip_ll_node *iter = NULL;
+    unsigned int              i;
+
+    for (i = 0; i < HIP_CONTROL_MSG_BATCH; i++) {
+        if (!rx_ctx[i].input_msg && !(rx_ctx[i].input_msg = hip_msg_alloc())) {
+            HIP_ERROR("Failed to allocate receive buffers.\n");
+            return -1;
+        }
+    }
+
+    if ((hip_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        HIP_ERROR("Failed to create epoll instance: %s\n", strerror(errno));
+        return -1;
+    }
 
     if (hip_sockets) {
         while ((iter = hip_ll_iterate(hip_sockets, iter))) {
-            if (((struct socketfd *) iter->ptr)->fd >= highest_descriptor) {
-                highest_descriptor = ((struct socketfd *) iter->ptr)->fd;
+            if (watch_socket(iter->ptr)) {
+                return -1;
             }
         }
     } else {
         HIP_DEBUG("No sockets registered.\n");
     }
 
-    return highest_descriptor;
+    return 0;
 }
 
-void hip_prepare_fd_set(fd_set *read_fdset)
+/**
+ * Check without blocking whether another message is queued on a socket.
+ *
+ * @param fd the socket descriptor
+ * @return   true if a message can be read, false otherwise or if fd is no
+ *           socket
+ */
+static bool socket_has_data(const int fd)
 {
-    const struct hip_ll_node *iter = NULL;
+    char byte;
 
-    FD_ZERO(read_fdset);
+    return recv(fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT) >= 0;
+}
 
-    if (hip_sockets) {
-        while ((iter = hip_ll_iterate(hip_sockets, iter))) {
-            FD_SET(((struct socketfd *) iter->ptr)->fd, read_fdset);
+/**
+ * Sort the ready sockets by the priority of their handlers, so that they run
+ * in the same order as the sockets were registered.
+ *
+ * @param events     the events returned by epoll_wait()
+ * @param num_events the number of events
+ */
+static void sort_events(struct epoll_event *const events, const int num_events)
+{
+    struct epoll_event event;
+    int                i, j;
+
+    for (i = 1; i < num_events; i++) {
+        event = events[i];
+        for (j = i; j > 0 && ((struct socketfd *) events[j - 1].data.ptr)->priority >
+             ((struct socketfd *) event.data.ptr)->priority; j--) {
+            events[j] = events[j - 1];
         }
-    } else {
-        HIP_DEBUG("No sockets registered.\n");
+        events[j] = event;
     }
 }
 
 /**
- * Run callbacks for any global socket that's flagged in the fd_set.
- * Invoked from hipd_main's main loop.
+ * Wait for readable sockets and run their handlers. Each ready socket is
+ * drained of up to HIP_SOCKET_BATCH messages, so that a burst of packets
+ * costs a single wakeup. A handler that reads several messages at once
+ * returns their number.
  *
- * @param read_fdset fd_set loaded with global socket handles, after
- *                   select() call.
- * @param ctx        Initialized packet context. Will be prepared for next
- *                   iteration upon return.
- * @todo             select() should probably be called here rather than in
- *                   hipd_main (passing read_fdset is superfluous)
- * @see              hipd_main
+ * @param timeout the maximum time to wait
+ * @param ctx     Initialized packet context. Will be prepared for next
+ *                iteration upon return.
+ * @return        the number of ready sockets, -1 on error
+ * @see           hipd_main
  */
-void hip_run_socket_handles(fd_set *read_fdset, struct hip_packet_context *ctx)
+int hip_run_socket_events(const struct timeval *const timeout,
+                          struct hip_packet_context *ctx)
 {
-    const struct hip_ll_node *iter = NULL;
-    int                       socketfd;
+    struct epoll_event events[HIP_SOCKET_MAX_EVENTS];
+    struct socketfd   *sock;
+    int                num_events, i, batch, handled;
+
+    num_events = epoll_wait(hip_epoll_fd, events, HIP_SOCKET_MAX_EVENTS,
+                            timeout->tv_sec * 1000 +
+                            (timeout->tv_usec + 999) / 1000);
+    if (num_events < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        HIP_ERROR("epoll_wait() error: %s.\n", strerror(errno));
+        return -1;
+    }
 
-    if (hip_sockets) {
-        while ((iter = hip_ll_iterate(hip_sockets, iter))) {
-            socketfd = ((struct socketfd *) iter->ptr)->fd;
+    sort_events(events, num_events);
 
-            if (FD_ISSET(socketfd, read_fdset)) {
-                ((struct socketfd *) iter->ptr)->func_ptr(ctx);
-                HIP_DEBUG("result: %d\n", ctx->error);
+    for (i = 0; i < num_events; i++) {
+        sock = events[i].data.ptr;
 
-                /* Reset for next iteration.
-                 * msg_ports has no reset-state. */
-                ctx->hadb_entry = NULL;
-                ctx->error      = 0;
-            }
-        }
-    } else {
-        HIP_DEBUG("No sockets registered.\n");
+        batch = 0;
+        do {
+            handled = sock->func_ptr(ctx);
+            HIP_DEBUG("result: %d\n", ctx->error);
+
+            /* Reset for next iteration.
+             * msg_ports has no reset-state. */
+            ctx->hadb_entry = NULL;
+            ctx->error      = 0;
+
+            batch += handled > 1 ? handled : 1;
+        } while (batch < HIP_SOCKET_BATCH && socket_has_data(sock->fd));
     }
+
+    return num_events;
 }
@@ -27,7 +27,7 @@
 #define HIPL_LIBHIPL_HIP_SOCKET_H
 
 #include <stdint.h>
-#include <sys/select.h>
+#include <sys/time.h>
 #include "libcore/protodefs.h"
 
 extern int hip_raw_sock_input_v6;
@@ -44,10 +44,9 @@ int hip_register_socket(int socketfd,
                         int (*func_ptr)(struct hip_packet_context *ctx),
                         const uint16_t priority);
 
-int hip_get_highest_descriptor(void);
+int hip_init_socket_events(void);
 
-void hip_prepare_fd_set(fd_set *read_fdset);
-
-void hip_run_socket_handles(fd_set *read_fdset, struct hip_packet_context *ctx);
+int hip_run_socket_events(const struct timeval *const timeout,
+                          struct hip_packet_context *ctx);
 
 #endif /* HIPL_LIBHIPL_HIP_SOCKET_H */
@@ -34,7 +34,6 @@
 #define _BSD_SOURCE
 
 #include <errno.h>
-#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,7 +41,6 @@
 #include <strings.h>
 #include <unistd.h>
 #include <arpa/inet.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/time.h>
@@ -62,6 +60,8 @@
 #include "libcore/util.h"
 #include "config.h"
 #include "accessor.h"
+#include "cookie.h"
+#include "crypto_worker.h"
 #include "hadb.h"
 #include "hip_socket.h"
 #include "init.h"
@@ -78,12 +78,6 @@ struct rtnl_handle hip_nl_route;
 
 int lsi_status = HIP_MSG_LSI_OFF;
 
-/* The timeout for the select call in the main loop. */
-static struct timeval select_timeout;
-/* Shortest backoff (in microseconds) of all retransmissions of all HAs.
- * Used to determine the required select timeout. */
-static uint64_t shortest_backoff;
-
 /**
  * print hipd usage instructions on stderr
  */
@@ -106,6 +100,27 @@ static void usage(void)
     fprintf(stderr, "\n");
 }
 
+/**
+ * Get the number of crypto worker threads to start. One processor is left to
+ * the main loop.
+ *
+ * @return the number of crypto workers, zero to run the crypto inline
+ */
+static unsigned int crypto_worker_count(void)
+{
+#ifdef CONFIG_HIP_PERFORMANCE
+    /* the benchmark bookkeeping is not thread-safe */
+    return 0;
+#else
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus <= 1) {
+        return 1;
+    }
+    return cpus - 1 > HIP_CRYPTO_MAX_WORKERS ? HIP_CRYPTO_MAX_WORKERS : cpus - 1;
+#endif
+}
+
 /**
  * Parse the command line options
  * @param argc  number of command line parameters
@@ -179,65 +194,6 @@ int hipd_parse_cmdline_opts(int argc, char *argv[], uint64_t *flags)
     return 0;
 }
 
-/**
- * Determine the lowest retransmission backoff of all retransmissions in the
- * given host association.
- *
- * Note: The lowest retransmission backoff will be written to the static
- *       variable shortest_backoff. The caller is responsible for initializing
- *       this variable as the actual retransmission backoffs are compared
- *       against it.
- *
- * @param hadb The hadb state from which the lowest retransmission backoff will
- *             be determined.
- * @param opaq UNUSED.
- *
- * @return Always 0. Not void because hip_for_each_ha() requires a return value.
- */
-static int get_shortest_retrans_backoff(struct hip_hadb_state *hadb, UNUSED void *opaq)
-{
-    for (unsigned int i = 0; i < HIP_RETRANSMIT_QUEUE_SIZE; i++) {
-        struct hip_msg_retrans *retrans = &hadb->hip_msg_retrans[i];
-
-        if (shortest_backoff == HIP_RETRANSMIT_BACKOFF_MIN) {
-            break;
-        } else if (retrans->count > 0 && retrans->current_backoff < shortest_backoff) {
-            shortest_backoff = retrans->current_backoff;
-        }
-    }
-
-    return 0;
-}
-
-/**
- * Update the select timeout with respect to the currently outstanding
- * retransmissions. If there are no retransmissions the timeout will be
- * set to the HIP_SELECT_TIMEOUT default value. Else it will be set to the
- * minimum backoff of all retransmissions.
- *
- * @return  0 on success
- *         -1 on error
- */
-int hip_update_select_timeout(void)
-{
-    uint64_t last_backoff = shortest_backoff;
-
-    shortest_backoff = HIP_SELECT_TIMEOUT_USEC;
-    if (hip_for_each_ha(get_shortest_retrans_backoff, NULL) < 0) {
-        HIP_ERROR("Failed to determine shortest retransmission backoff.\n");
-        return -1;
-    }
-
-    if (shortest_backoff != last_backoff) {
-        select_timeout.tv_sec  = shortest_backoff / 1000000;
-        select_timeout.tv_usec = shortest_backoff % 1000000;
-        HIP_DEBUG("select() timeout set to %" PRIu64 "ms.\n",
-                  shortest_backoff / 1000);
-    }
-
-    return 0;
-}
-
 /**
  * Daemon "main" function.
  * @param flags startup flags
@@ -245,8 +201,7 @@ int hip_update_select_timeout(void)
  */
 int hipd_main(uint64_t flags)
 {
-    int                       highest_descriptor = 0, err = 0;
-    fd_set                    read_fdset;
+    int                       err = 0;
     struct hip_packet_context ctx = { 0 };
 
 #ifdef CONFIG_HIP_PERFORMANCE
@@ -315,12 +270,17 @@ int hipd_main(uint64_t flags)
         return 0;
     }
 
-    highest_descriptor = hip_get_highest_descriptor();
+    HIP_IFEL(hip_init_maintenance_timer(), 1,
+             "Failed to set up the maintenance timer.\n");
+    HIP_IFEL(hip_init_crypto_workers(crypto_worker_count()), 1,
+             "Failed to start the crypto workers.\n");
+    HIP_IFEL(hip_init_socket_events(), 1,
+             "Failed to set up the socket event loop.\n");
 
-    /* Enter to the select-loop */
+    /* Enter to the event loop */
     HIP_DEBUG_GL(HIP_DEBUG_GROUP_INIT,
                  HIP_DEBUG_LEVEL_INFORMATIVE,
-                 "Hipd daemon running. Starting select loop.\n");
+                 "Hipd daemon running. Starting event loop.\n");
     hipd_set_state(HIPD_STATE_EXEC);
 #ifdef CONFIG_HIP_PERFORMANCE
     HIP_DEBUG("Stop and write PERF_STARTUP\n");
@@ -328,36 +288,30 @@ int hipd_main(uint64_t flags)
     hip_perf_write_benchmark(perf_set, PERF_STARTUP);
 #endif
 
-    select_timeout.tv_sec  = HIP_SELECT_TIMEOUT;
-    select_timeout.tv_usec = 0;
-
     while (hipd_get_state() != HIPD_STATE_CLOSED) {
-        /* The select() call modifies the provided timeout struct timeval.
-         * This variable indirection makes sure that the correct timeout value
-         * is used in every loop iteration. */
-        struct timeval timeout = select_timeout;
+        /* Wake up when the next retransmission is due. Periodic maintenance
+         * is driven by its timer socket and runs as one of the handlers. */
+        struct timeval timeout;
 
-        hip_prepare_fd_set(&read_fdset);
+        hip_retransmission_timeout(&timeout);
 
-        err = select(highest_descriptor + 1, &read_fdset, NULL, NULL, &timeout);
+        /* do not wait while R1s are being recreated, one R1 per pass */
+        if (hip_r1_recreation_pending()) {
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = 0;
+        }
 
-        /* Only run socket handles, if at least one file descriptor is ready.
-         * Output error, in case of a select error.*/
-        if (err > 0) {
-            hip_run_socket_handles(&read_fdset, &ctx);
-        } else if (err < 0) {
-            HIP_ERROR("select() error: %s.\n", strerror(errno));
+        if (hip_run_socket_events(&timeout, &ctx) < 0) {
+            HIP_ERROR("Socket event handling failed.\n");
         }
 
-        /* always check if we got packets to be retransmitted */
+        /* send the retransmissions that are due */
         if (hip_scan_retransmissions()) {
             HIP_ERROR("Retransmission scan failed.\n");
         }
 
-        /* This call takes care on its own that is does not execute
-         * maintenance tasks below a defined time interval threshold. */
-        if (hip_periodic_maintenance()) {
-            HIP_ERROR("Periodic maintenance task failed\n");
+        if (hip_continue_r1_recreation()) {
+            HIP_ERROR("Failed to recreate puzzles.\n");
         }
     }
 
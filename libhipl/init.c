@@ -76,6 +76,7 @@
 #include "config.h"
 #include "accessor.h"
 #include "close.h"
+#include "crypto_worker.h"
 #include "dh.h"
 #include "esp_prot_hipd_msg.h"
 #include "esp_prot_light_update.h"
@@ -86,6 +87,7 @@
 #include "hiprelay.h"
 #include "input.h"
 #include "maintenance.h"
+#include "msg_pool.h"
 #include "nat.h"
 #include "netdev.h"
 #include "nsupdate.h"
@@ -596,6 +598,7 @@ static void init_handle_functions(void)
     hip_register_handle_function(HIP_ALL, HIP_I1, HIP_STATE_NONE, &hip_send_r1,   40000);
 
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_setup_ipsec_sa, 30500);
@@ -605,6 +608,7 @@ static void init_handle_functions(void)
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I1_SENT, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I1_SENT, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I1_SENT, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I1_SENT, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I1_SENT, &hip_setup_ipsec_sa, 30500);
@@ -614,6 +618,7 @@ static void init_handle_functions(void)
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I1_SENT, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I1_SENT, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I2_SENT, &hip_check_i2,             20000);
+    hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I2_SENT, &hip_check_i2_identity,    20500);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I2_SENT, &hip_handle_i2_in_i2_sent, 21000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I2_SENT, &hip_handle_i2,            30000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I2_SENT, &hip_update_retransmissions, 30250);
@@ -624,6 +629,7 @@ static void init_handle_functions(void)
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I2_SENT, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_I2_SENT, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_R2_SENT, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_R2_SENT, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_R2_SENT, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_R2_SENT, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_R2_SENT, &hip_setup_ipsec_sa, 30500);
@@ -633,6 +639,7 @@ static void init_handle_functions(void)
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_R2_SENT, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_R2_SENT, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_ESTABLISHED, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_ESTABLISHED, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_ESTABLISHED, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_ESTABLISHED, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_ESTABLISHED, &hip_setup_ipsec_sa, 30500);
@@ -642,6 +649,7 @@ static void init_handle_functions(void)
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_ESTABLISHED, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_ESTABLISHED, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSING, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSING, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSING, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSING, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSING, &hip_setup_ipsec_sa, 30500);
@@ -651,6 +659,7 @@ static void init_handle_functions(void)
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSING, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSING, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSED, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSED, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSED, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSED, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSED, &hip_setup_ipsec_sa, 30500);
@@ -660,6 +669,7 @@ static void init_handle_functions(void)
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSED, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_CLOSED, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_NONE, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_NONE, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_NONE, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_NONE, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_ALL, HIP_I2, HIP_STATE_NONE, &hip_setup_ipsec_sa, 30500);
@@ -796,6 +806,7 @@ static int libhip_init_handle_functions(void)
     hip_register_handle_function(HIP_V1, HIP_I1, HIP_STATE_NONE, &hip_send_r1,   40000);
 
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_create_r2, 40000);
@@ -804,6 +815,7 @@ static int libhip_init_handle_functions(void)
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_UNASSOCIATED, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I1_SENT, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I1_SENT, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I1_SENT, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I1_SENT, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I1_SENT, &hip_create_r2, 40000);
@@ -812,6 +824,7 @@ static int libhip_init_handle_functions(void)
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I1_SENT, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I1_SENT, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I2_SENT, &hip_check_i2,             20000);
+    hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I2_SENT, &hip_check_i2_identity,    20500);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I2_SENT, &hip_handle_i2_in_i2_sent, 21000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I2_SENT, &hip_handle_i2,            30000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I2_SENT, &hip_update_retransmissions, 30250);
@@ -821,6 +834,7 @@ static int libhip_init_handle_functions(void)
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I2_SENT, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_I2_SENT, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_R2_SENT, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_R2_SENT, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_R2_SENT, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_R2_SENT, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_R2_SENT, &hip_create_r2, 40000);
@@ -829,6 +843,7 @@ static int libhip_init_handle_functions(void)
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_R2_SENT, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_R2_SENT, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_ESTABLISHED, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_ESTABLISHED, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_ESTABLISHED, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_ESTABLISHED, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_ESTABLISHED, &hip_create_r2, 40000);
@@ -837,6 +852,7 @@ static int libhip_init_handle_functions(void)
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_ESTABLISHED, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_ESTABLISHED, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSING, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSING, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSING, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSING, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSING, &hip_create_r2, 40000);
@@ -845,6 +861,7 @@ static int libhip_init_handle_functions(void)
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSING, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSING, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSED, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSED, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSED, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSED, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSED, &hip_create_r2, 40000);
@@ -853,6 +870,7 @@ static int libhip_init_handle_functions(void)
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSED, &hip_add_rvs_relay_to, 43000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_CLOSED, &hip_send_r2, 50000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_NONE, &hip_check_i2,  20000);
+    hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_NONE, &hip_check_i2_identity, 20500);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_NONE, &hip_handle_i2, 30000);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_NONE, &hip_update_retransmissions, 30250);
     hip_register_handle_function(HIP_V1, HIP_I2, HIP_STATE_NONE, &hip_create_r2, 40000);
@@ -996,12 +1014,16 @@ void hip_exit(void)
     /* Next line is needed only if RVS or hiprelay is in use. */
     hip_uninit_services();
 
+    hip_uninit_crypto_workers();
+
     hip_uninit_handle_functions();
 
     hip_user_uninit_handles();
 
     hip_uninit_maint_functions();
 
+    hip_uninit_retransmission_timers();
+
     lmod_uninit_packet_types();
 
     lmod_uninit_parameter_types();
@@ -1056,6 +1078,8 @@ void hip_exit(void)
     }
 
     hip_uninit_hadb();
+    hip_uninit_msg_pool();
+    lmod_uninit_state_slots();
     hip_uninit_host_id_dbs();
 
     if (hip_user_sock) {
@@ -51,16 +51,19 @@
 #include "libcore/icomm.h"
 #include "libcore/ife.h"
 #include "libcore/keylen.h"
+#include "libcore/modularization.h"
 #include "libcore/performance.h"
 #include "libcore/prefix.h"
 #include "libcore/protodefs.h"
 #include "libcore/solve.h"
 #include "libcore/state.h"
 #include "libcore/transform.h"
+#include "libcore/gpl/pk.h"
 #include "libcore/gpl/xfrmapi.h"
 #include "modules/update/hipd/update.h"
 #include "config.h"
 #include "cookie.h"
+#include "crypto_worker.h"
 #include "dh.h"
 #include "esp_prot_hipd_msg.h"
 #include "esp_prot_light_update.h"
@@ -70,10 +73,12 @@
 #include "hiprelay.h"
 #include "keymat.h"
 #include "maintenance.h"
+#include "msg_pool.h"
 #include "netdev.h"
 #include "opp_mode.h"
 #include "output.h"
 #include "pkt_handling.h"
+#include "puzzle_control.h"
 #include "registration.h"
 #include "input.h"
 
@@ -252,32 +257,224 @@ out_err:
     return err;
 }
 
+/**
+ * Diffie-Hellman shared secret and keying material of a base exchange. The
+ * expensive part is computed by a crypto worker.
+ */
+struct keymat_job {
+    uint8_t                  I[PUZZLE_LENGTH];
+    uint8_t                  J[PUZZLE_LENGTH];
+    int                      hip_transf_length;
+    int                      hmac_transf_length;
+    int                      esp_transf_length;
+    int                      auth_transf_length;
+    size_t                   keymat_len_min; /* how many bytes we need at least for the KEYMAT */
+    size_t                   keymat_len;     /* note SHA boundary */
+    uint16_t                 esp_keymat_index;
+    char                    *dh_shared_key;
+    int                      dh_shared_len;
+    char                    *keymat;
+    struct hip_keymat_keymat km;
+};
+
+/**
+ * Create the shared secret and the keying material. Runs on a crypto worker.
+ *
+ * @param msg private copy of the received message
+ * @param arg the keymat_job
+ * @return    zero on success, or negative on error
+ */
+static int calculate_keying_material(struct hip_common *const msg,
+                                     void *const arg)
+{
+    struct keymat_job                *job = arg;
+    const struct hip_diffie_hellman  *dhf;
+    const struct hip_dh_public_value *dhpv;
+    uint8_t                           calc_index;
+
+    if (!(dhf = hip_get_param(msg, HIP_PARAM_DIFFIE_HELLMAN))) {
+        HIP_ERROR("No Diffie-Hellman parameter found.\n");
+        return -ENOENT;
+    }
+
+    /* If the message has two DH keys, select (the stronger, usually) one. */
+    dhpv = hip_dh_select_key(dhf);
+
+#ifdef CONFIG_HIP_PERFORMANCE
+    HIP_DEBUG("Start PERF_DH_CREATE\n");
+    hip_perf_start_benchmark(perf_set, PERF_DH_CREATE);
+#endif
+
+    job->dh_shared_len = hip_calculate_shared_secret(dhpv->group_id,
+                                                     dhpv->public_value,
+                                                     ntohs(dhpv->pub_len),
+                                                     (unsigned char *) job->dh_shared_key,
+                                                     job->dh_shared_len);
+    if (job->dh_shared_len <= 0) {
+        HIP_ERROR("Calculation of shared secret failed.\n");
+        return -EINVAL;
+    }
+    HIP_DEBUG("DH group %d, shared secret length is %d\n",
+              dhpv->group_id, job->dh_shared_len);
+
+    hip_make_keymat(job->dh_shared_key,
+                    job->dh_shared_len,
+                    &job->km,
+                    job->keymat,
+                    job->keymat_len,
+                    &msg->hit_sender,
+                    &msg->hit_receiver,
+                    &calc_index,
+                    job->I,
+                    job->J);
+
+#ifdef CONFIG_HIP_PERFORMANCE
+    HIP_DEBUG("Stop PERF_DH_CREATE\n");
+    hip_perf_stop_benchmark(perf_set, PERF_DH_CREATE);
+#endif
+
+    return 0;
+}
+
+/**
+ * Draw the initial HIP and ESP keys from the keying material into the host
+ * association and store the shared secret there.
+ *
+ * @param ctx    the packet context
+ * @param arg    the keymat_job
+ * @param result the return value of calculate_keying_material()
+ * @return       zero on success, or negative on error
+ */
+static int apply_keying_material(struct hip_packet_context *const ctx,
+                                 void *const arg,
+                                 const int result)
+{
+    struct keymat_job *job = arg;
+    int                we_are_HITg;
+
+    if (result) {
+        if (ctx->hadb_entry) {
+            HIP_ERROR("Unable to produce keying material. Dropping the packet.\n");
+            ctx->error = -EPROTO;
+        }
+        free(job->dh_shared_key);
+        free(job->keymat);
+        return -EPROTO;
+    }
+
+    /* draw from km to keymat, copy keymat to dst, length of
+     * keymat is len */
+
+    we_are_HITg = hip_hit_is_bigger(&ctx->input_msg->hit_receiver,
+                                    &ctx->input_msg->hit_sender);
+
+    HIP_DEBUG("We are %s HIT.\n", we_are_HITg ? "greater" : "lesser");
+
+    if (we_are_HITg) {
+        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_enc_out.key, &job->km,
+                                 job->hip_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_hmac_out.key, &job->km,
+                                 job->hmac_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_enc_in.key, &job->km,
+                                 job->hip_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_hmac_in.key, &job->km,
+                                 job->hmac_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->esp_out.key, &job->km,
+                                 job->esp_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->auth_out.key, &job->km,
+                                 job->auth_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->esp_in.key, &job->km,
+                                 job->esp_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->auth_in.key, &job->km,
+                                 job->auth_transf_length);
+    } else {
+        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_enc_in.key, &job->km,
+                                 job->hip_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_hmac_in.key, &job->km,
+                                 job->hmac_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_enc_out.key, &job->km,
+                                 job->hip_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_hmac_out.key, &job->km,
+                                 job->hmac_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->esp_in.key, &job->km,
+                                 job->esp_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->auth_in.key, &job->km,
+                                 job->auth_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->esp_out.key, &job->km,
+                                 job->esp_transf_length);
+        hip_keymat_draw_and_copy(ctx->hadb_entry->auth_out.key, &job->km,
+                                 job->auth_transf_length);
+    }
+    HIP_HEXDUMP("HIP-gl encryption:", &ctx->hadb_entry->hip_enc_out.key,
+                job->hip_transf_length);
+    HIP_HEXDUMP("HIP-gl integrity (HMAC) key:", &ctx->hadb_entry->hip_hmac_out.key,
+                job->hmac_transf_length);
+    HIP_HEXDUMP("HIP-lg encryption:", &ctx->hadb_entry->hip_enc_in.key,
+                job->hip_transf_length);
+    HIP_HEXDUMP("HIP-lg integrity (HMAC) key:", &ctx->hadb_entry->hip_hmac_in.key,
+                job->hmac_transf_length);
+    HIP_HEXDUMP("SA-gl ESP encryption key:", &ctx->hadb_entry->esp_out.key,
+                job->esp_transf_length);
+    HIP_HEXDUMP("SA-gl ESP authentication key:", &ctx->hadb_entry->auth_out.key,
+                job->auth_transf_length);
+    HIP_HEXDUMP("SA-lg ESP encryption key:", &ctx->hadb_entry->esp_in.key,
+                job->esp_transf_length);
+    HIP_HEXDUMP("SA-lg ESP authentication key:", &ctx->hadb_entry->auth_in.key,
+                job->auth_transf_length);
+
+    /* the next byte when creating new keymat */
+    ctx->hadb_entry->current_keymat_index = job->keymat_len_min;     /* offset value, so no +1 ? */
+    ctx->hadb_entry->keymat_calc_index    = (ctx->hadb_entry->current_keymat_index / HIP_AH_SHA_LEN) + 1;
+    ctx->hadb_entry->esp_keymat_index     = job->esp_keymat_index;
+
+    memcpy(ctx->hadb_entry->current_keymat_K,
+           job->keymat + (ctx->hadb_entry->keymat_calc_index - 1) * HIP_AH_SHA_LEN, HIP_AH_SHA_LEN);
+
+    /* store DH shared key */
+    free(ctx->hadb_entry->dh_shared_key);
+    ctx->hadb_entry->dh_shared_key     = job->dh_shared_key;
+    ctx->hadb_entry->dh_shared_key_len = job->dh_shared_len;
+
+    /* on success free for dh_shared_key is called during close procedure with
+     * hip_del_peer_info_entry() */
+    free(job->keymat);
+    return 0;
+}
+
 /**
  * Creates shared secret and produce keying material
  * The initial ESP keys are drawn out of the keying material.
  *
- * @param ctx      context
- * @param I        I value from puzzle
- * @param J        J value from puzzle
- * @return zero on success, or negative on error.
+ * The Diffie-Hellman computation runs on a crypto worker, so that the calling
+ * handle function is suspended.
+ *
+ * @param packet_type     the packet type passed to the handle function
+ * @param ha_state        the host association state passed to the handle
+ *                        function
+ * @param ctx             context
+ * @param handle_function the calling handle function
+ * @param I               I value from puzzle
+ * @param J               J value from puzzle
+ * @return HIP_HANDLE_SUSPENDED, zero on success, or negative on error.
  */
-static int produce_keying_material(struct hip_packet_context *ctx,
+static int produce_keying_material(const uint8_t packet_type,
+                                   const enum hip_state ha_state,
+                                   struct hip_packet_context *ctx,
+                                   int (*handle_function)(const uint8_t packet_type,
+                                                          const enum hip_state ha_state,
+                                                          struct hip_packet_context *ctx),
                                    const uint8_t I[PUZZLE_LENGTH],
                                    const uint8_t J[PUZZLE_LENGTH])
 {
-    char                        *dh_shared_key = NULL;
-    int                          hip_transf_length, hmac_transf_length;
-    int                          auth_transf_length, esp_transf_length, we_are_HITg = 0;
-    int                          hip_tfm, esp_tfm, err = 0, dh_shared_len = 1024;
-    struct hip_keymat_keymat     km;
-    const struct hip_esp_info   *esp_info;
-    char                        *keymat = NULL;
-    size_t                       keymat_len_min; /* how many bytes we need at least for the KEYMAT */
-    size_t                       keymat_len; /* note SHA boundary */
-    const struct hip_tlv_common *param = NULL;
-    uint16_t                     esp_keymat_index, esp_default_keymat_index;
-    struct hip_diffie_hellman   *dhf;
-    struct in6_addr             *plain_local_hit = NULL;
+    int                              hip_tfm, esp_tfm, err = 0;
+    const struct hip_esp_info       *esp_info;
+    uint16_t                         esp_default_keymat_index;
+    const struct hip_tlv_common     *param = NULL;
+    const struct hip_diffie_hellman *dhf;
+    struct keymat_job               *job = NULL;
+
+    HIP_IFEL(!(job = calloc(1, sizeof(*job))), -ENOMEM,
+             "Error on allocating memory for keying material.\n");
 
     /* Perform light operations first before allocating memory or
      * using lots of CPU time */
@@ -289,184 +486,242 @@ static int produce_keying_material(struct hip_packet_context *ctx,
     HIP_IFEL(!(param = hip_get_param(ctx->input_msg, HIP_PARAM_ESP_TRANSFORM)),
              -EINVAL,
              "Could not find ESP transform\n");
-    HIP_IFEL((esp_tfm = hip_select_esp_transform(param)) == 0,
+    HIP_IFEL((esp_tfm = hip_select_esp_transform(param,
+                                                 hip_use_userspace_ipsec)) == 0,
              -EINVAL, "Could not select proper ESP transform\n");
 
-    hip_transf_length  = hip_transform_key_length(hip_tfm);
-    hmac_transf_length = hip_hmac_key_length(esp_tfm);
-    esp_transf_length  = hip_enc_key_length(esp_tfm);
-    auth_transf_length = hip_auth_key_length_esp(esp_tfm);
+    job->hip_transf_length  = hip_transform_key_length(hip_tfm);
+    job->hmac_transf_length = hip_hmac_key_length(esp_tfm);
+    job->esp_transf_length  = hip_enc_key_length(esp_tfm);
+    job->auth_transf_length = hip_auth_key_length_esp(esp_tfm);
 
     HIP_DEBUG("Transform lengths are:\n"
               "\tHIP = %d, HMAC = %d, ESP = %d, auth = %d\n",
-              hip_transf_length, hmac_transf_length, esp_transf_length,
-              auth_transf_length);
+              job->hip_transf_length, job->hmac_transf_length,
+              job->esp_transf_length, job->auth_transf_length);
 
     HIP_DEBUG("I and J values from the puzzle and its solution are:\n"
               "\tI = 0x%llx\n\tJ = 0x%llx\n", I, J);
 
+    memcpy(job->I, I, PUZZLE_LENGTH);
+    memcpy(job->J, J, PUZZLE_LENGTH);
+
     /* Create only minimum amount of KEYMAT for now. From draft chapter
      * HIP KEYMAT we know how many bytes we need for all keys used in the
      * base exchange. */
-    keymat_len_min = hip_transf_length + hmac_transf_length +
-                     hip_transf_length + hmac_transf_length + esp_transf_length +
-                     auth_transf_length + esp_transf_length + auth_transf_length;
+    job->keymat_len_min = job->hip_transf_length + job->hmac_transf_length +
+                          job->hip_transf_length + job->hmac_transf_length +
+                          job->esp_transf_length + job->auth_transf_length +
+                          job->esp_transf_length + job->auth_transf_length;
 
     /* Assume ESP keys are after authentication keys */
-    esp_default_keymat_index = hip_transf_length + hmac_transf_length +
-                               hip_transf_length + hmac_transf_length;
+    esp_default_keymat_index = job->hip_transf_length + job->hmac_transf_length +
+                               job->hip_transf_length + job->hmac_transf_length;
 
     /* R1 contains no ESP_INFO */
     esp_info = hip_get_param(ctx->input_msg, HIP_PARAM_ESP_INFO);
 
     if (esp_info) {
-        esp_keymat_index = ntohs(esp_info->keymat_index);
+        job->esp_keymat_index = ntohs(esp_info->keymat_index);
     } else {
-        esp_keymat_index = esp_default_keymat_index;
+        job->esp_keymat_index = esp_default_keymat_index;
     }
 
-    if (esp_keymat_index != esp_default_keymat_index) {
+    if (job->esp_keymat_index != esp_default_keymat_index) {
         /** @todo Add support for keying material. */
         HIP_ERROR("Varying keying material slices are not supported yet.\n");
         err = -1;
         goto out_err;
     }
 
-    keymat_len = keymat_len_min;
+    job->keymat_len = job->keymat_len_min;
 
-    if (keymat_len % HIP_AH_SHA_LEN) {
-        keymat_len += HIP_AH_SHA_LEN - (keymat_len % HIP_AH_SHA_LEN);
+    if (job->keymat_len % HIP_AH_SHA_LEN) {
+        job->keymat_len += HIP_AH_SHA_LEN - (job->keymat_len % HIP_AH_SHA_LEN);
     }
 
     HIP_DEBUG("Keying material:\n\tminimum length = %u\n\t"
-              "keying material length = %u.\n", keymat_len_min, keymat_len);
+              "keying material length = %u.\n", job->keymat_len_min,
+              job->keymat_len);
 
-    HIP_IFEL(!(keymat = malloc(keymat_len)), -ENOMEM,
+    HIP_IFEL(!(job->keymat = malloc(job->keymat_len)), -ENOMEM,
              "Error on allocating memory for keying material.\n");
 
     /* 1024 should be enough for shared secret. The length of the shared
      * secret actually depends on the DH Group. */
     /** @todo 1024 -> hip_get_dh_size ? */
-    HIP_IFEL(!(dh_shared_key = calloc(1, dh_shared_len)),
+    job->dh_shared_len = 1024;
+    HIP_IFEL(!(job->dh_shared_key = calloc(1, job->dh_shared_len)),
              -ENOMEM,
              "Error on allocating memory for Diffie-Hellman shared key.\n");
 
-    HIP_IFEL(!(dhf = hip_get_param_readwrite(ctx->input_msg,
-                                             HIP_PARAM_DIFFIE_HELLMAN)),
+    HIP_IFEL(!(dhf = hip_get_param(ctx->input_msg, HIP_PARAM_DIFFIE_HELLMAN)),
              -ENOENT, "No Diffie-Hellman parameter found.\n");
 
-    /* If the message has two DH keys, select (the stronger, usually) one. */
-    const struct hip_dh_public_value *dhpv = hip_dh_select_key(dhf);
+    /* the worker must not create our DH key */
+    HIP_IFEL(hip_init_dh_key(hip_dh_select_key(dhf)->group_id),
+             -EINVAL, "No Diffie-Hellman key for the selected group.\n");
+
+    return hip_crypto_offload(packet_type, ha_state, ctx, handle_function,
+                              calculate_keying_material, apply_keying_material,
+                              job);
+
+out_err:
+    if (job) {
+        free(job->dh_shared_key);
+        free(job->keymat);
+        free(job);
+    }
+    return err;
+}
+
+/**
+ * Verify the signature of a received message. Runs on a crypto worker, so
+ * that it creates its own public key from a copy of the peer's HOST_ID
+ * instead of using the key of the host association.
+ *
+ * @param msg private copy of the received message
+ * @param arg copy of the peer's HOST_ID
+ * @return    zero on success, or non-zero on failure
+ */
+static int verify_signature(struct hip_common *const msg, void *const arg)
+{
+    const struct hip_host_id_priv *const peer_pub = arg;
+    void                                *key      = NULL;
+    int                                  err      = -1;
 
 #ifdef CONFIG_HIP_PERFORMANCE
-    HIP_DEBUG("Start PERF_DH_CREATE\n");
-    hip_perf_start_benchmark(perf_set, PERF_DH_CREATE);
+    HIP_DEBUG("Start PERF_VERIFY\n");
+    hip_perf_start_benchmark(perf_set, PERF_VERIFY);
 #endif
 
-    dh_shared_len = hip_calculate_shared_secret(dhpv->group_id, dhpv->public_value,
-                                                ntohs(dhpv->pub_len),
-                                                (unsigned char *) dh_shared_key,
-                                                dh_shared_len);
-    HIP_IFEL(dh_shared_len <= 0, -EINVAL, "Calculation of shared secret failed.\n");
-    HIP_DEBUG("DH group %d, shared secret length is %d\n",
-              dhpv->group_id, dh_shared_len);
-
-    hip_make_keymat(dh_shared_key,
-                    dh_shared_len,
-                    &km,
-                    keymat,
-                    keymat_len,
-                    &ctx->input_msg->hit_sender,
-                    &ctx->input_msg->hit_receiver,
-                    &ctx->hadb_entry->keymat_calc_index,
-                    I,
-                    J);
+    switch (hip_get_host_id_algo(arg)) {
+    case HIP_HI_RSA:
+        if ((key = hip_key_rr_to_rsa(peer_pub, 0))) {
+            err = hip_rsa_verify(key, msg);
+            RSA_free(key);
+        }
+        break;
+    case HIP_HI_DSA:
+        if ((key = hip_key_rr_to_dsa(peer_pub, 0))) {
+            err = hip_dsa_verify(key, msg);
+            DSA_free(key);
+        }
+        break;
+#ifdef HAVE_EC_CRYPTO
+    case HIP_HI_ECDSA:
+        if ((key = hip_key_rr_to_ecdsa(peer_pub, 0))) {
+            err = hip_ecdsa_verify(key, msg);
+            EC_KEY_free(key);
+        }
+        break;
+#endif /* HAVE_EC_CRYPTO */
+    default:
+        HIP_ERROR("Unknown algorithm\n");
+    }
 
-    /* draw from km to keymat, copy keymat to dst, length of
-     * keymat is len */
+#ifdef CONFIG_HIP_PERFORMANCE
+    HIP_DEBUG("Stop PERF_VERIFY\n");
+    hip_perf_stop_benchmark(perf_set, PERF_VERIFY);
+#endif
 
-    we_are_HITg = hip_hit_is_bigger(&ctx->input_msg->hit_receiver,
-                                    &ctx->input_msg->hit_sender);
+    return err;
+}
 
-    HIP_DEBUG("We are %s HIT.\n", we_are_HITg ? "greater" : "lesser");
+/**
+ * Drop a packet whose signature could not be verified.
+ *
+ * @param ctx    the packet context
+ * @param arg    copy of the peer's HOST_ID
+ * @param result the return value of verify_signature()
+ * @return       zero if the signature is valid, or negative otherwise
+ */
+static int check_signature(struct hip_packet_context *const ctx,
+                           UNUSED void *const arg,
+                           const int result)
+{
+    if (result) {
+        if (ctx->hadb_entry) {
+            HIP_ERROR("Verification of %s signature failed\n",
+                      lmod_get_packet_identifier(hip_get_msg_type(ctx->input_msg)));
+            ctx->error = -EINVAL;
+        }
+        return -EINVAL;
+    }
 
-    if (we_are_HITg) {
-        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_enc_out.key, &km,
-                                 hip_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_hmac_out.key, &km,
-                                 hmac_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_enc_in.key, &km,
-                                 hip_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_hmac_in.key, &km,
-                                 hmac_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->esp_out.key, &km,
-                                 esp_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->auth_out.key, &km,
-                                 auth_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->esp_in.key, &km,
-                                 esp_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->auth_in.key, &km,
-                                 auth_transf_length);
-    } else {
-        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_enc_in.key, &km,
-                                 hip_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_hmac_in.key, &km,
-                                 hmac_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_enc_out.key, &km,
-                                 hip_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->hip_hmac_out.key, &km,
-                                 hmac_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->esp_in.key, &km,
-                                 esp_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->auth_in.key, &km,
-                                 auth_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->esp_out.key, &km,
-                                 esp_transf_length);
-        hip_keymat_draw_and_copy(ctx->hadb_entry->auth_out.key, &km,
-                                 auth_transf_length);
+    HIP_DEBUG("Signature verified\n");
+    return 0;
+}
+
+/**
+ * Drop an I2 packet whose signature could not be verified. Otherwise, store
+ * the R1 generation counter of the peer, now that the packet is
+ * authenticated.
+ *
+ * @param ctx    the packet context
+ * @param arg    copy of the peer's HOST_ID
+ * @param result the return value of verify_signature()
+ * @return       zero if the signature is valid, or negative otherwise
+ */
+static int check_i2_signature(struct hip_packet_context *const ctx,
+                              void *const arg,
+                              const int result)
+{
+    const struct hip_r1_counter *r1cntr;
+    int                          err;
+
+    if ((err = check_signature(ctx, arg, result))) {
+        return err;
     }
-#ifdef CONFIG_HIP_PERFORMANCE
-    HIP_DEBUG("Stop PERF_DH_CREATE\n");
-    hip_perf_stop_benchmark(perf_set, PERF_DH_CREATE);
-#endif
-    HIP_HEXDUMP("HIP-gl encryption:", &ctx->hadb_entry->hip_enc_out.key,
-                hip_transf_length);
-    HIP_HEXDUMP("HIP-gl integrity (HMAC) key:", &ctx->hadb_entry->hip_hmac_out.key,
-                hmac_transf_length);
-    HIP_HEXDUMP("HIP-lg encryption:", &ctx->hadb_entry->hip_enc_in.key,
-                hip_transf_length);
-    HIP_HEXDUMP("HIP-lg integrity (HMAC) key:", &ctx->hadb_entry->hip_hmac_in.key,
-                hmac_transf_length);
-    HIP_HEXDUMP("SA-gl ESP encryption key:", &ctx->hadb_entry->esp_out.key,
-                esp_transf_length);
-    HIP_HEXDUMP("SA-gl ESP authentication key:", &ctx->hadb_entry->auth_out.key,
-                auth_transf_length);
-    HIP_HEXDUMP("SA-lg ESP encryption key:", &ctx->hadb_entry->esp_in.key,
-                esp_transf_length);
-    HIP_HEXDUMP("SA-lg ESP authentication key:", &ctx->hadb_entry->auth_in.key,
-                auth_transf_length);
 
-    /* the next byte when creating new keymat */
-    ctx->hadb_entry->current_keymat_index = keymat_len_min;     /* offset value, so no +1 ? */
-    ctx->hadb_entry->keymat_calc_index    = (ctx->hadb_entry->current_keymat_index / HIP_AH_SHA_LEN) + 1;
-    ctx->hadb_entry->esp_keymat_index     = esp_keymat_index;
+    if ((r1cntr = hip_get_param(ctx->input_msg, HIP_PARAM_R1_COUNTER))) {
+        ctx->hadb_entry->birthday = r1cntr->generation;
+    }
 
-    memcpy(ctx->hadb_entry->current_keymat_K,
-           keymat + (ctx->hadb_entry->keymat_calc_index - 1) * HIP_AH_SHA_LEN, HIP_AH_SHA_LEN);
+    return 0;
+}
 
-    /* store DH shared key */
-    ctx->hadb_entry->dh_shared_key     = dh_shared_key;
-    ctx->hadb_entry->dh_shared_key_len = dh_shared_len;
+/**
+ * Verify the signature of a received message with the public key of the
+ * peer. The verification runs on a crypto worker, so that the calling handle
+ * function is suspended.
+ *
+ * @param packet_type     the packet type passed to the handle function
+ * @param ha_state        the host association state passed to the handle
+ *                        function
+ * @param ctx             the packet context, the host association holds the
+ *                        public key of the peer
+ * @param handle_function the calling handle function
+ * @param done            applies the verification result, see
+ *                        hip_crypto_offload()
+ * @return HIP_HANDLE_SUSPENDED, zero on success, or negative on error.
+ */
+static int verify_packet_signature(const uint8_t packet_type,
+                                   const enum hip_state ha_state,
+                                   struct hip_packet_context *ctx,
+                                   int (*handle_function)(const uint8_t packet_type,
+                                                          const enum hip_state ha_state,
+                                                          struct hip_packet_context *ctx),
+                                   int (*done)(struct hip_packet_context *const ctx,
+                                               void *const arg,
+                                               const int result))
+{
+    struct hip_host_id *peer_pub;
 
-    /* on success free for dh_shared_key is called during close procedure with
-     * hip_del_peer_info_entry() */
-out_err:
-    if (err) {
-        free(dh_shared_key);
+    if (!ctx->hadb_entry->peer_pub) {
+        HIP_ERROR("No public key of the peer\n");
+        return -EINVAL;
     }
-    free(keymat);
-    free(plain_local_hit);
-    return err;
+
+    if (!(peer_pub = malloc(sizeof(*peer_pub)))) {
+        HIP_ERROR("Out of memory\n");
+        return -ENOMEM;
+    }
+    memcpy(peer_pub, ctx->hadb_entry->peer_pub,
+           hip_get_param_total_len(ctx->hadb_entry->peer_pub));
+
+    return hip_crypto_offload(packet_type, ha_state, ctx, handle_function,
+                              verify_signature, done, peer_pub);
 }
 
 /**
@@ -579,6 +834,7 @@ int hip_receive_control_packet(struct hip_packet_context *ctx)
     HIP_DUMP_MSG(ctx->input_msg);
 
     type = hip_get_msg_type(ctx->input_msg);
+    hip_puzzle_control_count(type);
 
     ctx->hadb_entry = hip_hadb_find_byhits(&ctx->input_msg->hit_sender,
                                            &ctx->input_msg->hit_receiver);
@@ -590,6 +846,12 @@ int hip_receive_control_packet(struct hip_packet_context *ctx)
         return -1;
     }
 
+    /* Packets are not processed concurrently for the same association. */
+    if (ctx->hadb_entry && ctx->hadb_entry->crypto_job) {
+        HIP_DEBUG("Host association is busy. Dropping.\n");
+        return -1;
+    }
+
     /* Check if state can be found for opportunistic BEX */
     if (!ctx->hadb_entry &&
         (type == HIP_I1 || type == HIP_R1)) {
@@ -712,10 +974,11 @@ int hip_receive_udp_control_packet(struct hip_packet_context *ctx)
  *            address, the ports and the corresponding entry from the host
  *            association database).
  *
- * @return zero on success, or negative error value on error.
+ * @return zero on success, HIP_HANDLE_SUSPENDED while the signature is verified, or
+ *         negative error value on error.
  */
-int hip_check_r1(RVS const uint8_t packet_type,
-                 RVS const enum hip_state ha_state,
+int hip_check_r1(const uint8_t packet_type,
+                 const enum hip_state ha_state,
                  struct hip_packet_context *ctx)
 {
     int                          err = 0, mask = HIP_PACKET_CTRL_ANON, len;
@@ -821,24 +1084,12 @@ int hip_check_r1(RVS const uint8_t packet_type,
                  -EINVAL, "DH group downgrade check failed.\n");
     }
 
-#ifdef CONFIG_HIP_PERFORMANCE
-    HIP_DEBUG("Start PERF_VERIFY\n");
-    hip_perf_start_benchmark(perf_set, PERF_VERIFY);
-#endif
-    HIP_IFEL(ctx->hadb_entry->verify(ctx->hadb_entry->peer_pub_key,
-                                     ctx->input_msg),
-             -EINVAL,
-             "Verification of R1 signature failed\n");
-#ifdef CONFIG_HIP_PERFORMANCE
-    HIP_DEBUG("Stop PERF_VERIFY\n");
-    hip_perf_stop_benchmark(perf_set, PERF_VERIFY);
-#endif
+    err = verify_packet_signature(packet_type, ha_state, ctx, hip_check_r1,
+                                  check_signature);
 
 out_err:
-    if (err) {
+    if (err < 0) {
         ctx->error = err;
-    } else {
-        HIP_DEBUG("successfully verified R1\n");
     }
     return err;
 }
@@ -853,7 +1104,8 @@ out_err:
  *            address, the ports and the corresponding entry from the host
  *            association database).
  *
- * @return zero on success, or negative error value on error.
+ * @return zero on success, HIP_HANDLE_SUSPENDED while the keying material is
+ *         produced, or negative error value on error.
  *
  * @todo           When rendezvous service is used, the I1 packet is relayed
  *                 to the responder via the rendezvous server. Responder then
@@ -863,7 +1115,7 @@ out_err:
  *                 initiator should store these addresses to cope with the
  *                 double jump problem.
  */
-int hip_handle_r1(UNUSED const uint8_t packet_type,
+int hip_handle_r1(const uint8_t packet_type,
                   const enum hip_state ha_state,
                   struct hip_packet_context *ctx)
 {
@@ -939,13 +1191,9 @@ int hip_handle_r1(UNUSED const uint8_t packet_type,
 
     /* note: we could skip keying material generation in the case
      * of a retransmission but then we'd had to fill ctx->hmac etc */
-    if (produce_keying_material(ctx, ctx->hadb_entry->puzzle_i,
-                                ctx->hadb_entry->puzzle_solution)) {
-        HIP_ERROR("Could not produce keying material\n");
-        return -EINVAL;
-    }
-
-    return 0;
+    return produce_keying_material(packet_type, ha_state, ctx, hip_handle_r1,
+                                   ctx->hadb_entry->puzzle_i,
+                                   ctx->hadb_entry->puzzle_solution);
 }
 
 int hip_build_esp_info(UNUSED const uint8_t packet_type,
@@ -1058,10 +1306,11 @@ int hip_handle_i2_in_i2_sent(UNUSED const uint8_t packet_type,
  *            address, the ports and the corresponding entry from the host
  *            association database).
  *
- * @return zero on success, or negative error value on error.
+ * @return zero on success, HIP_HANDLE_SUSPENDED while the signature is verified, or
+ *         negative error value on error.
  */
-int hip_check_r2(UNUSED const uint8_t packet_type,
-                 UNUSED const enum hip_state ha_state,
+int hip_check_r2(const uint8_t packet_type,
+                 const enum hip_state ha_state,
                  struct hip_packet_context *ctx)
 {
     int      err  = 0;
@@ -1103,21 +1352,11 @@ int hip_check_r2(UNUSED const uint8_t packet_type,
     }
 
     /* Signature validation */
-#ifdef CONFIG_HIP_PERFORMANCE
-    HIP_DEBUG("Start PERF_VERIFY(3)\n");
-    hip_perf_start_benchmark(perf_set, PERF_VERIFY);
-#endif
-    HIP_IFEL(ctx->hadb_entry->verify(ctx->hadb_entry->peer_pub_key,
-                                     ctx->input_msg),
-             -EINVAL,
-             "R2 signature verification failed.\n");
-#ifdef CONFIG_HIP_PERFORMANCE
-    HIP_DEBUG("Stop PERF_VERIFY(3)\n");
-    hip_perf_stop_benchmark(perf_set, PERF_VERIFY);
-#endif
+    err = verify_packet_signature(packet_type, ha_state, ctx, hip_check_r2,
+                                  check_signature);
 
 out_err:
-    if (err) {
+    if (err < 0) {
         ctx->error = err;
     }
     return err;
@@ -1185,7 +1424,7 @@ int hip_handle_r2(RVS const uint8_t packet_type,
 
     hip_handle_reg_from(ctx->hadb_entry, ctx->input_msg);
 
-    ctx->hadb_entry->state = HIP_STATE_ESTABLISHED;
+    hip_hadb_set_state(ctx->hadb_entry, HIP_STATE_ESTABLISHED);
     hip_hadb_insert_state(ctx->hadb_entry);
 
     HIP_INFO("Reached ESTABLISHED state\n");
@@ -1416,26 +1655,19 @@ static bool i2_is_retransmission(const struct hip_packet_context *const ctx)
  *            address, the ports and the corresponding entry from the host
  *            association database).
  *
- * @return zero on success, or negative error value on error.
+ * @return zero on success, HIP_HANDLE_SUSPENDED while the keying material is produced, or
+ *         negative error value on error.
  */
-int hip_check_i2(UNUSED const uint8_t packet_type,
-                 UNUSED const enum hip_state ha_state,
+int hip_check_i2(const uint8_t packet_type,
+                 const enum hip_state ha_state,
                  struct hip_packet_context *ctx)
 {
     int                              hip_version       = 0;
-    int                              err               = 0, is_loopback = 0;
+    int                              err               = 0;
     bool                             skip_key_creation = false;
     uint16_t                         mask              = HIP_PACKET_CTRL_ANON;
-    uint16_t                         crypto_len        = 0;
-    char                            *tmp_enc           = NULL;
-    const char                      *enc               = NULL;
-    unsigned char                   *iv                = NULL;
     const struct hip_solution       *solution          = NULL;
     const struct hip_diffie_hellman *dh_param          = NULL;
-    const struct hip_r1_counter     *r1cntr            = NULL;
-    const struct hip_hip_transform  *hip_transform     = NULL;
-    struct hip_host_id              *host_id_in_enc    = NULL;
-    struct hip_host_id               host_id;
     int                              dh_group_id, i;
 
 #ifdef CONFIG_HIP_PERFORMANCE
@@ -1567,13 +1799,44 @@ int hip_check_i2(UNUSED const uint8_t packet_type,
     if (skip_key_creation) {
         HIP_DEBUG("Skipping keying material production.\n");
     } else {
-        HIP_IFEL(produce_keying_material(ctx,
-                                         solution->I,
-                                         solution->J),
-                 -EPROTO,
-                 "Unable to produce keying material. Dropping the I2 packet.\n");
+        err = produce_keying_material(packet_type, ha_state, ctx, hip_check_i2,
+                                      solution->I, solution->J);
     }
 
+out_err:
+    if (err < 0) {
+        ctx->error = err;
+    }
+    return err;
+}
+
+/**
+ * Check the authenticity of a received I2 control packet, once the keying
+ * material for it is available.
+ *
+ * @param packet_type The packet type of the control message (RFC 5201, 5.3.)
+ * @param ha_state The host association state (RFC 5201, 4.4.1.)
+ * @param ctx Pointer to the packet context, containing all information for
+ *            the packet handling (received message, source and destination
+ *            address, the ports and the corresponding entry from the host
+ *            association database).
+ *
+ * @return zero on success, HIP_HANDLE_SUSPENDED while the signature is
+ *         verified, or negative error value on error.
+ */
+int hip_check_i2_identity(const uint8_t packet_type,
+                          const enum hip_state ha_state,
+                          struct hip_packet_context *ctx)
+{
+    int                             err            = 0, is_loopback = 0;
+    uint16_t                        crypto_len     = 0;
+    char                           *tmp_enc        = NULL;
+    const char                     *enc            = NULL;
+    unsigned char                  *iv             = NULL;
+    const struct hip_hip_transform *hip_transform  = NULL;
+    struct hip_host_id             *host_id_in_enc = NULL;
+    struct hip_host_id              host_id;
+
     /* Verify HMAC. */
     if (hip_hidb_hit_is_our(&ctx->input_msg->hit_sender) &&
         hip_hidb_hit_is_our(&ctx->input_msg->hit_receiver)) {
@@ -1726,26 +1989,13 @@ int hip_check_i2(UNUSED const uint8_t packet_type,
 
     /* Store peer's public key and HIT to HA */
     HIP_IFE(hip_init_peer(ctx->hadb_entry, &host_id), -EINVAL);
-    /* Validate signature */
-#ifdef CONFIG_HIP_PERFORMANCE
-    HIP_DEBUG("Start PERF_VERIFY(2)\n");
-    hip_perf_start_benchmark(perf_set, PERF_VERIFY);
-#endif
-    HIP_IFEL(ctx->hadb_entry->verify(ctx->hadb_entry->peer_pub_key,
-                                     ctx->input_msg),
-             -EINVAL,
-             "Verification of I2 signature failed\n");
-#ifdef CONFIG_HIP_PERFORMANCE
-    HIP_DEBUG("Stop PERF_VERIFY(2)\n");
-    hip_perf_stop_benchmark(perf_set, PERF_VERIFY);
-#endif
 
-    if ((r1cntr = hip_get_param(ctx->input_msg, HIP_PARAM_R1_COUNTER))) {
-        ctx->hadb_entry->birthday = r1cntr->generation;
-    }
+    /* Validate signature, the R1 generation counter is stored on success */
+    err = verify_packet_signature(packet_type, ha_state, ctx,
+                                  hip_check_i2_identity, check_i2_signature);
 
 out_err:
-    if (err) {
+    if (err < 0) {
         ctx->error = err;
     }
     free(tmp_enc);
@@ -1841,7 +2091,8 @@ int hip_handle_i2(UNUSED const uint8_t packet_type,
                                        HIP_PARAM_ESP_TRANSFORM)),
              -ENOENT, "Did not find ESP transform on i2\n");
 
-    HIP_IFEL(!(ctx->hadb_entry->esp_transform = hip_select_esp_transform(esp_tfm)),
+    HIP_IFEL(!(ctx->hadb_entry->esp_transform = hip_select_esp_transform(esp_tfm,
+                                                                         hip_use_userspace_ipsec)),
              -1, "Could not select proper ESP transform\n");
 
     /********** ESP-PROT anchor [OPTIONAL] **********/
@@ -1862,7 +2113,7 @@ int hip_handle_i2(UNUSED const uint8_t packet_type,
     hip_perf_write_benchmark(perf_set, PERF_BASE);
 #endif
 
-    ctx->hadb_entry->state = HIP_STATE_ESTABLISHED;
+    hip_hadb_set_state(ctx->hadb_entry, HIP_STATE_ESTABLISHED);
     HIP_INFO("Reached %s state\n", hip_state_str(ctx->hadb_entry->state));
 
 out_err:
@@ -2047,10 +2298,9 @@ int hip_handle_notify(UNUSED const uint8_t packet_type,
 }
 
 /**
- * Clear the given retransmission and update the select() timeout.
- * i.e. set the remaining retransmissions to zero, zero the buffer and
- * update the select() timeout as there is one retransmission less to be
- * considered.
+ * Clear the given retransmission, i.e. set the remaining retransmissions to
+ * zero, return the buffer to the message pool and remove its retransmission
+ * timer.
  *
  * @param retrans The retransmission to be cleared.
  */
@@ -2061,10 +2311,9 @@ void hip_clear_retransmission(struct hip_msg_retrans *const retrans)
     }
 
     retrans->count = 0;
-    if (retrans->buf) {
-        memset(retrans->buf, 0, hip_get_msg_total_len(retrans->buf));
-    }
-    hip_update_select_timeout();
+    hip_msg_pool_put(retrans->buf);
+    retrans->buf = NULL;
+    hip_unschedule_retransmission(retrans);
 }
 
 /**
@@ -74,6 +74,10 @@ int hip_check_i2(const uint8_t packet_type,
                  const enum hip_state ha_state,
                  struct hip_packet_context *ctx);
 
+int hip_check_i2_identity(const uint8_t packet_type,
+                          const enum hip_state ha_state,
+                          struct hip_packet_context *ctx);
+
 int hip_handle_i1(const uint8_t packet_type,
                   const enum hip_state ha_state,
                   struct hip_packet_context *ctx);
@@ -45,8 +45,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
 
 #include "libcore/builder.h"
+#include "libcore/common.h"
 #include "libcore/debug.h"
 #include "libcore/hip_udp.h"
 #include "libcore/ife.h"
@@ -57,6 +60,7 @@
 #include "accessor.h"
 #include "close.h"
 #include "cookie.h"
+#include "crypto_worker.h"
 #include "hadb.h"
 #include "hidb.h"
 #include "hipd.h"
@@ -64,6 +68,7 @@
 #include "init.h"
 #include "input.h"
 #include "output.h"
+#include "puzzle_control.h"
 #include "maintenance.h"
 
 #define FORCE_EXIT_COUNTER_START                5
@@ -86,6 +91,192 @@ static const time_t maintenance_interval = 1; // in seconds
  */
 static struct hip_ll *maintenance_functions;
 
+/**
+ * Timer descriptor that wakes up the main loop for periodic maintenance.
+ */
+static int maintenance_timer = -1;
+
+/**
+ * Pending retransmission, ordered by the time it is due.
+ */
+struct retrans_timer {
+    uint64_t                due;  /* in microseconds since the epoch */
+    struct hip_msg_retrans *retrans;
+};
+
+/**
+ * Binary min-heap of all scheduled retransmissions. The earliest one is at
+ * index 0, so due retransmissions are found without walking all host
+ * associations.
+ */
+static struct retrans_timer *retrans_timers;
+static unsigned int          num_retrans_timers;
+static unsigned int          max_retrans_timers;
+
+/** initial number of slots in the retransmission timer heap */
+#define RETRANS_TIMERS_MIN 64
+
+/**
+ * Convert a timeval to microseconds.
+ *
+ * @param tv the time value
+ * @return   the time in microseconds
+ */
+static uint64_t timeval_to_usec(const struct timeval *const tv)
+{
+    return (uint64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/**
+ * Place a timer at the given heap position and update its back reference.
+ *
+ * @param index the heap position
+ * @param timer the timer
+ */
+static void retrans_timer_set(const unsigned int index,
+                              const struct retrans_timer timer)
+{
+    retrans_timers[index]      = timer;
+    timer.retrans->timer_index = index;
+}
+
+/**
+ * Restore the heap order for the timer at the given position.
+ *
+ * @param index heap position of a timer whose deadline changed
+ */
+static void retrans_timer_sift(unsigned int index)
+{
+    const struct retrans_timer timer = retrans_timers[index];
+    unsigned int               child;
+
+    // move towards the root while the parent is due later
+    while (index > 0 && retrans_timers[(index - 1) / 2].due > timer.due) {
+        retrans_timer_set(index, retrans_timers[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+
+    // move towards the leaves while a child is due earlier
+    while ((child = 2 * index + 1) < num_retrans_timers) {
+        if (child + 1 < num_retrans_timers &&
+            retrans_timers[child + 1].due < retrans_timers[child].due) {
+            child++;
+        }
+        if (retrans_timers[child].due >= timer.due) {
+            break;
+        }
+        retrans_timer_set(index, retrans_timers[child]);
+        index = child;
+    }
+
+    retrans_timer_set(index, timer);
+}
+
+/**
+ * Schedule a queued retransmission for the time when its current backoff
+ * has expired. A retransmission that is already scheduled is moved to its
+ * new deadline.
+ *
+ * @param retrans the retransmission, which must belong to a host association
+ * @return        0 on success, -1 if out of memory
+ */
+int hip_schedule_retransmission(struct hip_msg_retrans *const retrans)
+{
+    struct retrans_timer *timers;
+    unsigned int          index;
+
+    HIP_ASSERT(retrans && retrans->entry);
+
+    if (retrans->timer_index < 0) {
+        if (num_retrans_timers == max_retrans_timers) {
+            const unsigned int max = max_retrans_timers ?
+                                     2 * max_retrans_timers : RETRANS_TIMERS_MIN;
+
+            if (!(timers = realloc(retrans_timers, max * sizeof(*timers)))) {
+                HIP_ERROR("Failed to allocate retransmission timer.\n");
+                return -1;
+            }
+            retrans_timers     = timers;
+            max_retrans_timers = max;
+        }
+        index                         = num_retrans_timers++;
+        retrans_timers[index].retrans = retrans;
+    } else {
+        index = retrans->timer_index;
+    }
+
+    retrans_timers[index].due = timeval_to_usec(&retrans->last_transmit) +
+                                retrans->current_backoff;
+    retrans_timer_sift(index);
+
+    return 0;
+}
+
+/**
+ * Remove the timer of a retransmission, if it is scheduled.
+ *
+ * @param retrans the retransmission
+ */
+void hip_unschedule_retransmission(struct hip_msg_retrans *const retrans)
+{
+    const int index = retrans ? retrans->timer_index : -1;
+
+    if (index < 0) {
+        return;
+    }
+
+    retrans->timer_index = -1;
+    num_retrans_timers--;
+
+    // fill the gap with the last timer
+    if ((unsigned int) index < num_retrans_timers) {
+        retrans_timer_set(index, retrans_timers[num_retrans_timers]);
+        retrans_timer_sift(index);
+    }
+}
+
+/**
+ * Determine how long the main loop may wait for input before the next
+ * retransmission is due.
+ *
+ * @param timeout set to the time until the earliest retransmission, but at
+ *                most HIP_SELECT_TIMEOUT so that the main loop regularly
+ *                checks the daemon state
+ */
+void hip_retransmission_timeout(struct timeval *const timeout)
+{
+    struct timeval now;
+    uint64_t       wait = HIP_SELECT_TIMEOUT_USEC;
+    uint64_t       current;
+
+    if (num_retrans_timers > 0) {
+        gettimeofday(&now, NULL);
+        current = timeval_to_usec(&now);
+
+        if (retrans_timers[0].due <= current) {
+            wait = 0;
+        } else if (retrans_timers[0].due - current < wait) {
+            wait = retrans_timers[0].due - current;
+        }
+    }
+
+    timeout->tv_sec  = wait / 1000000;
+    timeout->tv_usec = wait % 1000000;
+}
+
+/**
+ * Free the retransmission timer heap.
+ */
+void hip_uninit_retransmission_timers(void)
+{
+    while (num_retrans_timers > 0) {
+        hip_unschedule_retransmission(retrans_timers[0].retrans);
+    }
+    free(retrans_timers);
+    retrans_timers     = NULL;
+    max_retrans_timers = 0;
+}
+
 /**
  * Update the retransmission backoff of the given retransmission.
  * The backoff will simply be doubled and in case the maximum is exceeded
@@ -112,73 +303,78 @@ static void update_retrans_backoff(struct hip_msg_retrans *const retrans)
 }
 
 /**
- * an iterator to handle packet retransmission for a given host association
+ * Send a due retransmission and schedule the next one.
  *
- * @param entry the host association which to handle
- * @param current_time current time
+ * @param retrans the retransmission, whose timer has already been removed
  * @return zero on success or negative on failure
  */
-static int handle_retransmissions(struct hip_hadb_state *entry,
-                                  void *current_time)
+static int handle_retransmission(struct hip_msg_retrans *const retrans)
 {
-    int                     err = 0, i = 0;
-    struct hip_msg_retrans *retrans;
-    struct timeval         *now = current_time;
-
-    for (i = 0; i < HIP_RETRANSMIT_QUEUE_SIZE; i++) {
-        retrans = &entry->hip_msg_retrans[(entry->next_retrans_slot + i) %
-                                          HIP_RETRANSMIT_QUEUE_SIZE];
-
-        if (retrans->count > 0) {
-            if (calc_timeval_diff(&retrans->last_transmit, now) >
-                retrans->current_backoff) {
-                /* @todo: verify that this works over slow ADSL line */
-                if (hip_send_pkt(&retrans->saddr,
-                                 &retrans->daddr,
-                                 entry->nat_mode ? hip_get_local_nat_udp_port() : 0,
-                                 entry->peer_udp_port,
-                                 retrans->buf,
-                                 entry, 0) == 0) {
-                    /* Set entry state, if previous state was unassociated
-                     * and type is I1. */
-                    if (hip_get_msg_type(retrans->buf) == HIP_I1 &&
-                        entry->state == HIP_STATE_UNASSOCIATED) {
-                        HIP_DEBUG("Resent I1 succcesfully\n");
-                        entry->state = HIP_STATE_I1_SENT;
-                    }
-                } else {
-                    HIP_ERROR("Failed to retransmit packet of type %d.\n",
-                              hip_get_msg_type(retrans->buf));
-                    err = -1;
-                }
-
-                retrans->count--;
-                gettimeofday(&retrans->last_transmit, NULL);
-                update_retrans_backoff(retrans);
-                hip_update_select_timeout();
-            }
-        } else if (hip_get_msg_type(retrans->buf)) {
+    struct hip_hadb_state *entry = retrans->entry;
+    int                    err   = 0;
+
+    /* @todo: verify that this works over slow ADSL line */
+    if (hip_send_pkt(&retrans->saddr,
+                     &retrans->daddr,
+                     entry->nat_mode ? hip_get_local_nat_udp_port() : 0,
+                     entry->peer_udp_port,
+                     retrans->buf,
+                     entry, 0) == 0) {
+        /* Set entry state, if previous state was unassociated
+         * and type is I1. */
+        if (hip_get_msg_type(retrans->buf) == HIP_I1 &&
+            entry->state == HIP_STATE_UNASSOCIATED) {
+            HIP_DEBUG("Resent I1 succcesfully\n");
+            hip_hadb_set_state(entry, HIP_STATE_I1_SENT);
+        }
+    } else {
+        HIP_ERROR("Failed to retransmit packet of type %d.\n",
+                  hip_get_msg_type(retrans->buf));
+        err = -1;
+    }
+
+    retrans->count--;
+    gettimeofday(&retrans->last_transmit, NULL);
+    update_retrans_backoff(retrans);
+
+    if (retrans->count > 0) {
+        if (hip_schedule_retransmission(retrans)) {
             hip_clear_retransmission(retrans);
+            err = -1;
         }
+    } else if (retrans->buf) {
+        /* not yet released by update_retrans_backoff() */
+        hip_clear_retransmission(retrans);
     }
 
     return err;
 }
 
 /**
- * deliver pending retransmissions for all host associations
+ * deliver the pending retransmissions that are due
  *
  * @return zero on success or negative on failure
  */
 int hip_scan_retransmissions(void)
 {
-    struct timeval current_time;
+    struct hip_msg_retrans *retrans;
+    struct timeval          current_time;
+    uint64_t                now;
+    int                     err = 0;
+
     gettimeofday(&current_time, NULL);
+    now = timeval_to_usec(&current_time);
 
-    if (hip_for_each_ha(handle_retransmissions, &current_time)) {
-        return -1;
+    while (num_retrans_timers > 0 && retrans_timers[0].due <= now) {
+        retrans = retrans_timers[0].retrans;
+        hip_unschedule_retransmission(retrans);
+
+        if (handle_retransmission(retrans)) {
+            err = -1;
+        }
     }
-    return 0;
+
+    return err;
 }
 
 /**
@@ -261,28 +457,22 @@ void hip_uninit_maint_functions(void)
         hip_ll_uninit(maintenance_functions, free);
         free(maintenance_functions);
     }
+
+    if (maintenance_timer >= 0) {
+        close(maintenance_timer);
+        maintenance_timer = -1;
+    }
 }
 
 /**
- * Periodic maintenance.
+ * Periodic maintenance. Runs once per maintenance_interval, paced by the
+ * monotonic maintenance timer.
  *
  * @return zero on success or negative on failure
  */
 int hip_periodic_maintenance(void)
 {
-    static time_t last_maintenance = 0;      // timestamp of last call
-    const time_t  now              = time(NULL);
-    int           err              = 0;
-
-    if (now < last_maintenance) {
-        last_maintenance = now;
-        HIP_ERROR("System clock skew detected; internal timestamp reset\n");
-        return -1;
-    }
-
-    if (now - last_maintenance < maintenance_interval) {
-        return 0;
-    }
+    int err = 0;
 
     if (hipd_get_state() == HIPD_STATE_CLOSING) {
         if (force_exit_counter > 0) {
@@ -300,6 +490,12 @@ int hip_periodic_maintenance(void)
      * in closing or closed state, delete them */
     hip_for_each_ha(hip_purge_closing_ha, NULL);
 
+    /* Recreate the R1s right away if the puzzle difficulty was adapted to
+     * the load. */
+    if (hip_puzzle_control_update(hip_crypto_backlog())) {
+        precreate_counter = -1;
+    }
+
     if (precreate_counter < 0) {
         if (hip_recreate_all_precreated_r1_packets()) {
             HIP_ERROR("Failed to recreate puzzles.\n");
@@ -314,7 +510,63 @@ int hip_periodic_maintenance(void)
 
     run_maint_functions();
 
-    last_maintenance = now;
+    return err;
+}
+
+/**
+ * Handle an expiration of the maintenance timer.
+ *
+ * @param ctx the packet context, unused
+ * @return    zero on success or negative on failure
+ */
+static int handle_maintenance_timer(UNUSED struct hip_packet_context *ctx)
+{
+    uint64_t expirations;
+
+    if (read(maintenance_timer, &expirations, sizeof(expirations)) !=
+        sizeof(expirations)) {
+        HIP_ERROR("Failed to read maintenance timer: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (hip_periodic_maintenance()) {
+        HIP_ERROR("Periodic maintenance task failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Create the timer that runs hip_periodic_maintenance() every
+ * maintenance_interval and register it with the main loop.
+ *
+ * @return zero on success or negative on failure
+ */
+int hip_init_maintenance_timer(void)
+{
+    const struct itimerspec interval = {
+        .it_interval = { .tv_sec = maintenance_interval },
+        .it_value    = { .tv_sec = maintenance_interval }
+    };
+    int err = 0;
+
+    HIP_IFEL((maintenance_timer = timerfd_create(CLOCK_MONOTONIC,
+                                                 TFD_NONBLOCK | TFD_CLOEXEC)) < 0,
+             -1, "Failed to create maintenance timer: %s\n", strerror(errno));
+    HIP_IFEL(timerfd_settime(maintenance_timer, 0, &interval, NULL),
+             -1, "Failed to arm maintenance timer: %s\n", strerror(errno));
+    HIP_IFEL(hip_register_socket(maintenance_timer, handle_maintenance_timer,
+                                 50000),
+             -1, "Failed to register maintenance timer\n");
+
+    return 0;
+
+out_err:
+    if (maintenance_timer >= 0) {
+        close(maintenance_timer);
+        maintenance_timer = -1;
+    }
     return err;
 }
 
@@ -367,6 +619,102 @@ out_err:
     return err;
 }
 
+/**
+ * Push a new, changed or deleted host association to the firewall. The
+ * firewall keeps its HA cache up to date from these messages and thus never
+ * needs to query hipd for HA information on the packet path.
+ *
+ * @param action HIP_MSG_FW_HA_UPDATE or HIP_MSG_FW_HA_DELETE
+ * @param entry  the host association
+ *
+ * @return zero on success or negative on failure
+ */
+int hipfw_update_ha_info(const int action, const struct hip_hadb_state *entry)
+{
+    struct hip_hadb_user_info_state hid;
+    struct hip_common              *msg = NULL;
+    int                             err = 0;
+
+    /* the firewall only caches HAs with LSI support enabled, and only
+     * HAs in the database are known to it */
+    if (lsi_status == HIP_MSG_LSI_OFF || entry->ha_state != HIP_HA_STATE_VALID) {
+        return 0;
+    }
+
+    hip_hadb_get_user_info(entry, &hid);
+
+    HIP_IFEL(!(msg = hip_msg_alloc()), -ENOMEM, "alloc\n");
+    HIP_IFEL(hip_build_user_hdr(msg, action, 0), -1, "Build hdr failed\n");
+    HIP_IFEL(hip_build_param_contents(msg, &hid, HIP_PARAM_HA_INFO, sizeof(hid)),
+             -1, "build param contents failed\n");
+
+    if (hip_sendto_firewall(msg) < 0) {
+        HIP_PERROR("Send to firewall failed: ");
+        err = -1;
+    }
+
+out_err:
+    free(msg);
+    return err;
+}
+
+/**
+ * Append a host association to a HIP_MSG_FW_HA_UPDATE message for the
+ * firewall. Full messages are sent and reused.
+ *
+ * @param entry the host association
+ * @param opaq  the message
+ * @return zero on success or negative on failure
+ */
+static int build_ha_info_update(struct hip_hadb_state *entry, void *opaq)
+{
+    struct hip_common              *msg = opaq;
+    struct hip_hadb_user_info_state hid;
+
+    if (hip_get_msg_total_len(msg) + sizeof(struct hip_tlv_common) +
+        sizeof(hid) + 8 > HIP_MAX_PACKET) {
+        if (hip_sendto_firewall(msg) < 0) {
+            HIP_PERROR("Send to firewall failed: ");
+            return -1;
+        }
+        hip_msg_init(msg);
+        if (hip_build_user_hdr(msg, HIP_MSG_FW_HA_UPDATE, 0)) {
+            return -1;
+        }
+    }
+
+    hip_hadb_get_user_info(entry, &hid);
+    return hip_build_param_contents(msg, &hid, HIP_PARAM_HA_INFO, sizeof(hid));
+}
+
+/**
+ * Send all host associations to the firewall. This fills the HA cache of a
+ * firewall that just enabled LSI support; later changes are sent by
+ * hipfw_update_ha_info().
+ *
+ * @return zero on success or negative on failure
+ */
+int hipfw_sync_ha_info(void)
+{
+    struct hip_common *msg = NULL;
+    int                err = 0;
+
+    HIP_IFEL(!(msg = hip_msg_alloc()), -ENOMEM, "alloc\n");
+    HIP_IFEL(hip_build_user_hdr(msg, HIP_MSG_FW_HA_UPDATE, 0), -1,
+             "Build hdr failed\n");
+    HIP_IFEL(hip_for_each_ha(build_ha_info_update, msg), -1,
+             "Failed to send host associations to firewall\n");
+
+    if (hip_get_next_param(msg, NULL) && hip_sendto_firewall(msg) < 0) {
+        HIP_PERROR("Send to firewall failed: ");
+        err = -1;
+    }
+
+out_err:
+    free(msg);
+    return err;
+}
+
 /**
  * tell firewall to turn on or off the ESP relay mode
  *
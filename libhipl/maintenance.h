@@ -30,17 +30,26 @@
 #include <netinet/in.h>
 #include <sys/time.h>
 
+#include "libcore/state.h"
+
 int hip_register_maint_function(int (*maint_function)(void),
                                 const uint16_t priority);
 int hip_unregister_maint_function(int (*maint_function)(void));
 void hip_uninit_maint_functions(void);
+int hip_schedule_retransmission(struct hip_msg_retrans *const retrans);
+void hip_unschedule_retransmission(struct hip_msg_retrans *const retrans);
+void hip_retransmission_timeout(struct timeval *const timeout);
+void hip_uninit_retransmission_timers(void);
 int hip_scan_retransmissions(void);
 int hip_periodic_maintenance(void);
+int hip_init_maintenance_timer(void);
 
 /*Communication with firewall daemon*/
 int hipfw_set_bex_data(int action,
                        struct in6_addr *hit_s,
                        struct in6_addr *hit_r);
 int hipfw_set_esp_relay(int action);
+int hipfw_update_ha_info(const int action, const struct hip_hadb_state *entry);
+int hipfw_sync_ha_info(void);
 
 #endif /* HIPL_LIBHIPL_MAINTENANCE_H */
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Buffers for HIP messages that are kept around for a while, like the copies
+ * of sent packets held for retransmission. Most host associations never
+ * retransmit after the base exchange, so these buffers are taken from a pool
+ * on demand instead of being allocated with every host association.
+ *
+ * Buffers come in a few size classes. Each class carves its buffers from
+ * slabs of ::MSG_POOL_SLAB_SIZE bytes and keeps released buffers on a free
+ * list for reuse. Slabs are only returned to the system by
+ * hip_uninit_msg_pool(), so the memory of the pool follows the peak number
+ * of buffers in use, not the number of host associations.
+ *
+ * The pool is not thread-safe; it is only used by the main loop.
+ *
+ * @brief Pool of size-classed HIP message buffers
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "libcore/common.h"
+#include "libcore/debug.h"
+#include "libcore/protodefs.h"
+#include "msg_pool.h"
+
+/** bytes allocated at once for the buffers of one size class */
+#define MSG_POOL_SLAB_SIZE 16384
+
+/** buffer sizes; the largest class holds any network packet */
+static const uint16_t size_classes[] = { 128, 256, 512, 1024,
+                                         HIP_MAX_NETWORK_PACKET };
+
+/** header of a pooled buffer, the message follows it */
+struct pooled_msg {
+    union {
+        /** next free buffer of the class, while the buffer is free */
+        struct pooled_msg *next;
+        /** index into ::size_classes, while the buffer is in use */
+        unsigned int       size_class;
+        /** keeps the message aligned */
+        uint64_t           align;
+    } u;
+};
+
+/** header of a slab, the buffers follow it */
+struct msg_slab {
+    struct msg_slab *next;
+};
+
+struct msg_pool_class {
+    struct pooled_msg *free;
+    struct msg_slab   *slabs;
+};
+
+static struct msg_pool_class pool[ARRAY_SIZE(size_classes)];
+
+/** number of buffers handed out and not yet released */
+static unsigned int msgs_in_use;
+
+/**
+ * Add a slab of free buffers to a size class.
+ *
+ * @param size_class index into ::size_classes
+ * @return           0 on success, -1 if out of memory
+ */
+static int add_slab(const unsigned int size_class)
+{
+    const size_t       msg_size = sizeof(struct pooled_msg) + size_classes[size_class];
+    const unsigned int num_msgs = (MSG_POOL_SLAB_SIZE - sizeof(struct msg_slab)) / msg_size;
+    struct msg_slab   *slab;
+    struct pooled_msg *msg;
+
+    if (!(slab = malloc(MSG_POOL_SLAB_SIZE))) {
+        HIP_ERROR("Failed to allocate message buffers.\n");
+        return -1;
+    }
+    slab->next             = pool[size_class].slabs;
+    pool[size_class].slabs = slab;
+
+    for (unsigned int i = 0; i < num_msgs; i++) {
+        msg = (struct pooled_msg *)
+              ((char *) (slab + 1) + i * msg_size);
+        msg->u.next           = pool[size_class].free;
+        pool[size_class].free = msg;
+    }
+
+    return 0;
+}
+
+/**
+ * Get a buffer for a HIP message from the pool. The buffer is not zeroed.
+ *
+ * @param len the length of the message in bytes, at most
+ *            HIP_MAX_NETWORK_PACKET
+ * @return    the buffer, or NULL if @a len is too large or out of memory
+ */
+struct hip_common *hip_msg_pool_get(const uint16_t len)
+{
+    struct pooled_msg *msg;
+    unsigned int       size_class;
+
+    for (size_class = 0; size_class < ARRAY_SIZE(size_classes); size_class++) {
+        if (len <= size_classes[size_class]) {
+            break;
+        }
+    }
+    if (size_class == ARRAY_SIZE(size_classes)) {
+        HIP_ERROR("Message of %u bytes is too large for the pool.\n", len);
+        return NULL;
+    }
+
+    if (!pool[size_class].free && add_slab(size_class)) {
+        return NULL;
+    }
+
+    msg                   = pool[size_class].free;
+    pool[size_class].free = msg->u.next;
+    msg->u.size_class     = size_class;
+    msgs_in_use++;
+
+    return (struct hip_common *) (msg + 1);
+}
+
+/**
+ * Return a buffer to the pool.
+ *
+ * @param buf a buffer from hip_msg_pool_get(), or NULL
+ */
+void hip_msg_pool_put(struct hip_common *const buf)
+{
+    struct pooled_msg *msg;
+    unsigned int       size_class;
+
+    if (!buf) {
+        return;
+    }
+
+    msg        = (struct pooled_msg *) buf - 1;
+    size_class = msg->u.size_class;
+    HIP_ASSERT(size_class < ARRAY_SIZE(size_classes));
+
+    msg->u.next           = pool[size_class].free;
+    pool[size_class].free = msg;
+    msgs_in_use--;
+}
+
+/**
+ * Get the number of buffers that were taken from the pool and not yet
+ * returned.
+ *
+ * @return the number of buffers in use
+ */
+unsigned int hip_msg_pool_in_use(void)
+{
+    return msgs_in_use;
+}
+
+/**
+ * Release the memory of the pool. All buffers must have been returned.
+ */
+void hip_uninit_msg_pool(void)
+{
+    struct msg_slab *slab;
+
+    if (msgs_in_use) {
+        HIP_ERROR("%u message buffers still in use.\n", msgs_in_use);
+    }
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(size_classes); i++) {
+        while ((slab = pool[i].slabs)) {
+            pool[i].slabs = slab->next;
+            free(slab);
+        }
+        pool[i].free = NULL;
+    }
+    msgs_in_use = 0;
+}
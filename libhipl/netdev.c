@@ -975,6 +975,7 @@ send_i1:
 
     if (!reuse_hadb_local_address && src_addr) {
         ipv6_addr_copy(&entry->our_addr, src_addr);
+        hipfw_update_ha_info(HIP_MSG_FW_HA_UPDATE, entry);
     }
 
     memcpy(hip_cast_sa_addr(addr), &entry->our_addr,
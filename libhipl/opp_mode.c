@@ -126,7 +126,7 @@ int hip_handle_opp_r1(struct hip_packet_context *ctx)
     HIP_IFEL(hip_init_us(ctx->hadb_entry, &ctx->input_msg->hit_receiver),
              -1, "hip_init_us failed\n");
     /* old HA has state 2, new HA has state 1, so copy it */
-    ctx->hadb_entry->state = opp_entry->state;
+    hip_hadb_set_state(ctx->hadb_entry, opp_entry->state);
     /* For service registration routines */
     ctx->hadb_entry->local_controls = opp_entry->local_controls;
     ctx->hadb_entry->peer_controls  = opp_entry->peer_controls;
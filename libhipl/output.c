@@ -32,6 +32,7 @@
 #define _BSD_SOURCE
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -54,6 +55,7 @@
 #include "libcore/prefix.h"
 #include "libcore/protodefs.h"
 #include "libcore/solve.h"
+#include "libcore/transform.h"
 #include "libcore/gpl/xfrmapi.h"
 #include "config.h"
 #include "cookie.h"
@@ -64,6 +66,9 @@
 #include "hipd.h"
 #include "hiprelay.h"
 #include "init.h"
+#include "input.h"
+#include "maintenance.h"
+#include "msg_pool.h"
 #include "nat.h"
 #include "netdev.h"
 #include "registration.h"
@@ -152,7 +157,7 @@ static int send_i1_pkt(struct hip_common *i1, struct in6_addr *local_addr,
     HIP_DEBUG("err after sending: %d.\n", err);
 
     if (!err) {
-        entry->state = HIP_STATE_I1_SENT;
+        hip_hadb_set_state(entry, HIP_STATE_I1_SENT);
     } else if (err == 1) {
         err = 0;
     }
@@ -562,7 +567,8 @@ int hip_create_i2(UNUSED const uint8_t packet_type,
             -ENOENT);
 
     /* Select only one transform */
-    HIP_IFEL((transform_esp_suite = hip_select_esp_transform(param)) == 0,
+    HIP_IFEL((transform_esp_suite = hip_select_esp_transform(param,
+                                                             hip_use_userspace_ipsec)) == 0,
              -1, "Could not find acceptable hip transform suite\n");
     HIP_IFEL(hip_build_param_esp_transform(ctx->output_msg,
                                            &transform_esp_suite, 1), -1,
@@ -659,7 +665,7 @@ int hip_send_i2(UNUSED const uint8_t packet_type,
     HIP_IFEL(err < 0, -ECOMM, "Sending I2 packet failed.\n");
 
     if (ctx->hadb_entry->state == HIP_STATE_I1_SENT) {
-        ctx->hadb_entry->state = HIP_STATE_I2_SENT;
+        hip_hadb_set_state(ctx->hadb_entry, HIP_STATE_I2_SENT);
     }
 
 out_err:
@@ -703,6 +709,13 @@ static int build_r1_after_dh_param(struct hip_common *const msg,
         HIP_ESP_3DES_SHA1,
         HIP_ESP_NULL_SHA1
     };
+    /* AEAD transforms, offered in front of the others if available */
+    const hip_transform_suite transform_esp_aead[] = {
+        HIP_ESP_AES_GCM,
+        HIP_ESP_CHACHA20_POLY1305
+    };
+    hip_transform_suite esp_suites[HIP_TRANSFORM_ESP_MAX - 1];
+    unsigned int        esp_suite_count = 0;
 
     /* change order if necessary */
     sprintf(order, "%d", hip_transform_order);
@@ -747,10 +760,20 @@ static int build_r1_after_dh_param(struct hip_common *const msg,
     HIP_DEBUG("Found %d active service(s) \n", service_count);
     hip_build_param_reg_info(msg, service_list, service_count);
 
-    /* Parameter ESP-ENC transform. */
-    err = hip_build_param_esp_transform(msg, transform_esp_suite,
-                                        sizeof(transform_esp_suite) /
-                                        sizeof(hip_transform_suite));
+    /* Parameter ESP-ENC transform. Only userspace IPsec implements the
+     * AEAD transforms. */
+    if (hip_use_userspace_ipsec) {
+        for (i = 0; i < (int) (sizeof(transform_esp_aead) / sizeof(*transform_esp_aead)); i++) {
+            if (hip_esp_transform_is_aead(transform_esp_aead[i])) {
+                esp_suites[esp_suite_count++] = transform_esp_aead[i];
+            }
+        }
+    }
+    memcpy(&esp_suites[esp_suite_count], transform_esp_suite,
+           sizeof(transform_esp_suite));
+    esp_suite_count += sizeof(transform_esp_suite) / sizeof(hip_transform_suite);
+
+    err = hip_build_param_esp_transform(msg, esp_suites, esp_suite_count);
     if (err) {
         HIP_ERROR("Building of ESP transform failed\n");
         return err;
@@ -989,9 +1012,11 @@ int hip_send_r1(UNUSED const uint8_t packet_type,
                 UNUSED const enum hip_state ha_state,
                 struct hip_packet_context *ctx)
 {
-    int                err    = 0;
-    struct hip_common *r1pkt  = NULL;
-    struct in6_addr    dst_ip = IN6ADDR_ANY_INIT,
+    int                      err           = 0;
+    const struct hip_common *r1_precreated = NULL;
+    struct hip_common       *r1pkt         = NULL;
+    struct hip_common        r1hdr;
+    struct in6_addr          dst_ip = IN6ADDR_ANY_INIT,
     *r1_dst_addr              = NULL,
     *local_plain_hit          = NULL,
     *r1_src_addr              = &ctx->dst_addr;
@@ -1058,8 +1083,9 @@ int hip_send_r1(UNUSED const uint8_t packet_type,
     }
 
     if (hip_get_msg_version(ctx->input_msg) == HIP_V1) {
-        HIP_IFEL(!(r1pkt = hip_get_r1(r1_dst_addr, &ctx->dst_addr,
-                                      &ctx->input_msg->hit_receiver, -1)),
+        HIP_IFEL(!(r1_precreated = hip_get_r1(r1_dst_addr, &ctx->dst_addr,
+                                              &ctx->input_msg->hit_receiver,
+                                              -1)),
                  -ENOENT, "No precreated R1\n");
     } else {
         const struct hip_tlv_common *dh_group_list;
@@ -1075,19 +1101,15 @@ int hip_send_r1(UNUSED const uint8_t packet_type,
                  "Cannot find a matchness for DH_GROUP_LIST\n");
         HIP_DEBUG("Selected DH group: %d\n", selected_group);
 
-        r1pkt = hip_get_r1(r1_dst_addr, &ctx->dst_addr,
-                           &ctx->input_msg->hit_receiver, selected_group);
-        HIP_IFEL(r1pkt == NULL, -ENOENT, "No precreated R1_v2 for group: %d\n",
-                 selected_group);
+        r1_precreated = hip_get_r1(r1_dst_addr, &ctx->dst_addr,
+                                   &ctx->input_msg->hit_receiver,
+                                   selected_group);
+        HIP_IFEL(r1_precreated == NULL, -ENOENT,
+                 "No precreated R1_v2 for group: %d\n", selected_group);
     }
 
-    if (&ctx->input_msg->hit_sender) {
-        ipv6_addr_copy(&r1pkt->hit_receiver, &ctx->input_msg->hit_sender);
-    } else {
-        memset(&r1pkt->hit_receiver, 0, sizeof(struct in6_addr));
-    }
-
-    HIP_DEBUG_HIT("hip_xmit_r1(): r1pkt->hit_receiver", &r1pkt->hit_receiver);
+    HIP_DEBUG_HIT("hip_xmit_r1(): r1pkt->hit_receiver",
+                  &ctx->input_msg->hit_sender);
 
 #ifdef CONFIG_HIP_RVS
     /** @todo Parameters must be in ascending order, should this
@@ -1096,6 +1118,12 @@ int hip_send_r1(UNUSED const uint8_t packet_type,
     /* If I1 had a RELAY_FROM/FROM, then we must build a RELAY_TO/VIA_RVS
      * parameter. */
     if (!ipv6_addr_any(&dst_ip) && relay_para_type) {
+        /* the relay parameter is appended, so this R1 needs its own copy */
+        HIP_IFEL(!(r1pkt = hip_msg_alloc()), -ENOMEM,
+                 "Out of memory while copying R1\n");
+        memcpy(r1pkt, r1_precreated, hip_get_msg_total_len(r1_precreated));
+        ipv6_addr_copy(&r1pkt->hit_receiver, &ctx->input_msg->hit_sender);
+
         if (relay_para_type == HIP_PARAM_RELAY_FROM) {
             HIP_DEBUG("Build param relay_to\n");
             hip_build_param_relay_to(r1pkt, &dst_ip, r1_dst_port);
@@ -1109,14 +1137,28 @@ int hip_send_r1(UNUSED const uint8_t packet_type,
      * This is if:
      * a) the I1 was received on UDP.
      * b) the received I1 packet had a RELAY_FROM parameter. */
-    if (r1_dst_port) {
+    if (r1pkt) {
         HIP_IFEL(hip_send_pkt(r1_src_addr, r1_dst_addr,
-                              hip_get_local_nat_udp_port(),
+                              r1_dst_port ? hip_get_local_nat_udp_port() : 0,
                               r1_dst_port, r1pkt, NULL, 0),
-                 -ECOMM, "Sending R1 packet on UDP failed.\n");
-    } else { /* Else R1 is sent on raw HIP. */
-        HIP_IFEL(hip_send_pkt(r1_src_addr, r1_dst_addr, 0, 0, r1pkt, NULL, 0),
-                 -ECOMM, "Sending R1 packet on raw HIP failed.\n");
+                 -ECOMM, "Sending relayed R1 packet failed.\n");
+    } else {
+        /* Only the header differs between the R1s sent from one table
+         * entry. Send the parameters straight from the table. */
+        memcpy(&r1hdr, r1_precreated, sizeof(r1hdr));
+        ipv6_addr_copy(&r1hdr.hit_receiver, &ctx->input_msg->hit_sender);
+
+        if (r1_dst_port) {
+            HIP_IFEL(hip_send_pkt_split(r1_src_addr, r1_dst_addr,
+                                        hip_get_local_nat_udp_port(),
+                                        r1_dst_port, &r1hdr,
+                                        r1_precreated + 1),
+                     -ECOMM, "Sending R1 packet on UDP failed.\n");
+        } else { /* Else R1 is sent on raw HIP. */
+            HIP_IFEL(hip_send_pkt_split(r1_src_addr, r1_dst_addr, 0, 0,
+                                        &r1hdr, r1_precreated + 1),
+                     -ECOMM, "Sending R1 packet on raw HIP failed.\n");
+        }
     }
 
 out_err:
@@ -1338,7 +1380,8 @@ int are_addresses_compatible(const struct in6_addr *src_addr,
  * @param msg       a pointer to a HIP packet common header with source and
  *                  destination HITs.
  * @param entry     a pointer to the current host association database state.
- * @return          zero
+ * @return          zero on success, -ENOMEM if no buffer or retransmission
+ *                  timer was available
  */
 static int queue_packet(const struct in6_addr *src_addr,
                         const struct in6_addr *peer_addr,
@@ -1346,6 +1389,8 @@ static int queue_packet(const struct in6_addr *src_addr,
                         struct hip_hadb_state *entry)
 {
     struct hip_msg_retrans *retrans;
+    struct hip_common      *buf;
+    const uint16_t          len = hip_get_msg_total_len(msg);
 
     if (!entry) {
         return 0;
@@ -1353,10 +1398,14 @@ static int queue_packet(const struct in6_addr *src_addr,
 
     retrans = &entry->hip_msg_retrans[entry->next_retrans_slot];
 
-    /* Not reusing the old entry as the new packet may have different length */
-    memset(retrans->buf, 0, HIP_MAX_NETWORK_PACKET);
+    /* The new packet may belong to a different size class than the old one */
+    if (!(buf = hip_msg_pool_get(len))) {
+        return -ENOMEM;
+    }
+    hip_msg_pool_put(retrans->buf);
+    retrans->buf = buf;
 
-    memcpy(retrans->buf, msg, hip_get_msg_total_len(msg));
+    memcpy(retrans->buf, msg, len);
     ipv6_addr_copy(&retrans->saddr, src_addr);
     ipv6_addr_copy(&retrans->daddr, peer_addr);
     retrans->count = HIP_RETRANSMIT_MAX;
@@ -1364,7 +1413,10 @@ static int queue_packet(const struct in6_addr *src_addr,
     retrans->current_backoff = HIP_RETRANSMIT_BACKOFF_MIN;
 
     entry->next_retrans_slot = (entry->next_retrans_slot + 1) % HIP_RETRANSMIT_QUEUE_SIZE;
-    hip_update_select_timeout();
+    if (hip_schedule_retransmission(retrans)) {
+        hip_clear_retransmission(retrans);
+        return -ENOMEM;
+    }
 
     return 0;
 }
@@ -1385,6 +1437,9 @@ static int queue_packet(const struct in6_addr *src_addr,
  * @param dst_port   not used.
  * @param msg        a pointer to a HIP packet common header with source and
  *                   destination HITs.
+ * @param params     the parameters of the packet if they do not follow
+ *                   @a msg in memory, NULL otherwise. @a msg then only holds
+ *                   the struct hip_common header.
  * @param entry      a pointer to the current host association database state.
  * @param retransmit a boolean value indicating if this is a retransmission
  *                   (@b zero if this is @b not a retransmission).
@@ -1394,7 +1449,7 @@ static int queue_packet(const struct in6_addr *src_addr,
  *                   function pointed by the function pointer
  *                   hadb_xmit_func->send_pkt instead.
  * @note             If retransmit is set other than zero, make sure that the
- *                   entry is not NULL.
+ *                   entry is not NULL and @a params is NULL.
  * @todo             remove the sleep code (queuing is enough?)
  *
  * @see              send_udp_from_one_src
@@ -1404,28 +1459,36 @@ static int send_raw_from_one_src(const struct in6_addr *local_addr,
                                  const in_port_t src_port,
                                  const in_port_t dst_port,
                                  struct hip_common *msg,
+                                 const void *const params,
                                  struct hip_hadb_state *entry,
                                  const int retransmit)
 {
-    int                     err         = 0, len         = 0, udp      = 0;
-    int                     src_is_ipv4 = 0, dst_is_ipv4 = 0, memmoved = 0;
+    int                     err         = 0, len         = 0, udp = 0;
+    int                     src_is_ipv4 = 0, dst_is_ipv4 = 0;
     int                     sa_size, sent;
     struct sockaddr_storage src  = { 0 }, dst  = { 0 };
     struct sockaddr_in6    *src6 = NULL, *dst6 = NULL;
     struct sockaddr_in     *src4 = NULL, *dst4 = NULL;
     struct in6_addr         my_addr;
+    /* UDP header and zero bytes sent in front of the HIP packet */
+    uint8_t       udp_prefix[sizeof(struct udphdr) + HIP_UDP_ZERO_BYTES_LEN] = { 0 };
+    struct iovec  iov[3];
+    struct msghdr mhdr = { 0 };
     /* Points either to v4 or v6 raw sock */
     int hip_raw_sock_output = 0;
 
     /* Verify the existence of obligatory parameters. */
     HIP_ASSERT(peer_addr != NULL && msg != NULL);
+    HIP_ASSERT(!params || !retransmit);
 
     HIP_DEBUG("Sending %s packet\n",
               hip_get_msg_type_name(hip_get_msg_type(msg)));
     HIP_DEBUG_IN6ADDR("hip_send_raw(): local_addr", local_addr);
     HIP_DEBUG_IN6ADDR("hip_send_raw(): peer_addr", peer_addr);
     HIP_DEBUG("Source port=%d, destination port=%d\n", src_port, dst_port);
-    HIP_DUMP_MSG(msg);
+    if (!params) {
+        HIP_DUMP_MSG(msg);
+    }
 
     //check msg length
     if (!hip_check_network_msg_len(msg)) {
@@ -1510,11 +1573,25 @@ static int send_raw_from_one_src(const struct in6_addr *local_addr,
         goto out_err;
     }
 
+    /* iov[0] is reserved for the UDP encapsulation */
+    if (params) {
+        iov[1].iov_base = msg;
+        iov[1].iov_len  = sizeof(struct hip_common);
+        /* sendmsg() does not write to the iovecs, drop the const */
+        iov[2].iov_base = (void *) (uintptr_t) params;
+        iov[2].iov_len  = len - sizeof(struct hip_common);
+    } else {
+        iov[1].iov_base = msg;
+        iov[1].iov_len  = len;
+        iov[2].iov_base = NULL;
+        iov[2].iov_len  = 0;
+    }
+
     hip_zero_msg_checksum(msg);
     if (!udp) {
-        msg->checksum = hip_checksum_packet((char *) msg,
-                                            (struct sockaddr *) &src,
-                                            (struct sockaddr *) &dst);
+        msg->checksum = hip_checksum_packet_iov(&iov[1], 2,
+                                                (struct sockaddr *) &src,
+                                                (struct sockaddr *) &dst);
     }
 
     /* Note that we need the original (possibly mapped addresses here.
@@ -1542,35 +1619,33 @@ static int send_raw_from_one_src(const struct in6_addr *local_addr,
     }
 #endif
 
-    /* For some reason, neither sendmsg or send (with bind+connect)
-     * do not seem to work properly. Thus, we use just sendto() */
-
-    len = hip_get_msg_total_len(msg);
-
+    /* The UDP header and the 32 bits of zero bytes between UDP and HIP
+     * are sent from a separate buffer, so that the packet is not moved. */
+    iov[0].iov_base = udp_prefix;
+    iov[0].iov_len  = 0;
     if (udp) {
         if (!hipl_is_libhip_mode()) {
-            /* Insert 32 bits of zero bytes between UDP and HIP */
-            memmove((char *) msg + HIP_UDP_ZERO_BYTES_LEN + sizeof(struct udphdr), msg, len);
-            memset(msg, 0, HIP_UDP_ZERO_BYTES_LEN + sizeof(struct udphdr));
-            len += HIP_UDP_ZERO_BYTES_LEN + sizeof(struct udphdr);
-
-            struct udphdr *uh = (struct udphdr *) msg;
-            uh->source = htons(src_port);
-            uh->dest   = htons(dst_port);
-            uh->len    = htons(len);
-            uh->check  = 0;
+            struct udphdr *uh = (struct udphdr *) udp_prefix;
+
+            iov[0].iov_len = sizeof(udp_prefix);
+            uh->source     = htons(src_port);
+            uh->dest       = htons(dst_port);
+            uh->len        = htons(len + sizeof(udp_prefix));
+            uh->check      = 0;
         } else {
-            memmove((char *) msg + HIP_UDP_ZERO_BYTES_LEN, msg, len);
-            memset(msg, 0, HIP_UDP_ZERO_BYTES_LEN);
-            len += HIP_UDP_ZERO_BYTES_LEN;
+            iov[0].iov_len = HIP_UDP_ZERO_BYTES_LEN;
 
             dst4->sin_port = htons(dst_port);
         }
-        memmoved = 1;
     }
+    len += iov[0].iov_len;
+
+    mhdr.msg_name    = &dst;
+    mhdr.msg_namelen = sa_size;
+    mhdr.msg_iov     = iov;
+    mhdr.msg_iovlen  = ARRAY_SIZE(iov);
 
-    sent = sendto(hip_raw_sock_output, msg, len, 0,
-                  (struct sockaddr *) &dst, sa_size);
+    sent = sendmsg(hip_raw_sock_output, &mhdr, 0);
     if (sent != len) {
         HIP_ERROR("Could not send all the requested data (%d/%d)\n",
                   sent, len);
@@ -1598,13 +1673,6 @@ out_err:
     }
     bind(hip_raw_sock_output, (struct sockaddr *) &src, sa_size);
 
-    if (udp && memmoved) {
-        /* Remove 32 bits of zero bytes between UDP and HIP */
-        len -= HIP_UDP_ZERO_BYTES_LEN + sizeof(struct udphdr);
-        memmove(msg, (char *) msg + HIP_UDP_ZERO_BYTES_LEN + sizeof(struct udphdr), len);
-        memset((char *) msg + len, 0, HIP_UDP_ZERO_BYTES_LEN + sizeof(struct udphdr));
-    }
-
     if (err) {
         HIP_ERROR("strerror: %s\n", strerror(errno));
     }
@@ -1634,6 +1702,8 @@ out_err:
  *                   (host byte order).
  * @param msg        a pointer to a HIP packet common header with source and
  *                   destination HITs.
+ * @param params     the parameters of the packet if they do not follow
+ *                   @a msg in memory, NULL otherwise.
  * @param entry      a pointer to the current host association database state.
  * @param retransmit a boolean value indicating if this is a retransmission
  *                   (@b zero if this is @b not a retransmission).
@@ -1655,20 +1725,16 @@ static int send_udp_from_one_src(const struct in6_addr *local_addr,
                                  const in_port_t src_port,
                                  const in_port_t dst_port,
                                  struct hip_common *msg,
+                                 const void *const params,
                                  struct hip_hadb_state *entry,
                                  const int retransmit)
 {
     return send_raw_from_one_src(local_addr, peer_addr, src_port,
-                                 dst_port, msg, entry, retransmit);
+                                 dst_port, msg, params, entry, retransmit);
 }
 
 /**
- * Send a HIP message.
- *
- * Sends a HIP message to the peer on HIP/IP. This function also calculates the
- * HIP packet checksum.
- *
- * Used protocol suite is <code>IPv4(HIP)</code> or <code>IPv6(HIP)</code>.
+ * Send a HIP message, see hip_send_pkt().
  *
  * @param local_addr a pointer to our IPv6 or IPv4-in-IPv6 format IPv4 address.
  *                   If local_addr is NULL, the packet is sent from all addresses.
@@ -1677,26 +1743,21 @@ static int send_udp_from_one_src(const struct in6_addr *local_addr,
  * @param dst_port   not used.
  * @param msg        a pointer to a HIP packet common header with source and
  *                   destination HITs.
+ * @param params     the parameters of the packet if they do not follow
+ *                   @a msg in memory, NULL otherwise.
  * @param entry      a pointer to the current host association database state.
  * @param retransmit a boolean value indicating if this is a retransmission
  *                   (@b zero if this is @b not a retransmission).
  * @return           zero on success, or negative error value on error.
- * @note             This function should never be used directly. Use
- *                   hip_send_pkt_stateless() or the host association send
- *                   function pointed by the function pointer
- *                   hadb_xmit_func->send_pkt instead.
- * @note             If retransmit is set other than zero, make sure that the
- *                   entry is not NULL.
- * @todo             remove the sleep code (queuing is enough?)
- * @see              hip_send_udp
  */
-int hip_send_pkt(const struct in6_addr *local_addr,
-                 const struct in6_addr *peer_addr,
-                 const in_port_t src_port,
-                 const in_port_t dst_port,
-                 struct hip_common *msg,
-                 struct hip_hadb_state *entry,
-                 const int retransmit)
+static int send_pkt(const struct in6_addr *local_addr,
+                    const struct in6_addr *peer_addr,
+                    const in_port_t src_port,
+                    const in_port_t dst_port,
+                    struct hip_common *msg,
+                    const void *const params,
+                    struct hip_hadb_state *entry,
+                    const int retransmit)
 {
     int                    err             = 0;
     struct netdev_address *netdev_src_addr = NULL;
@@ -1727,11 +1788,11 @@ int hip_send_pkt(const struct in6_addr *local_addr,
             ((hip_get_nat_mode(entry) != HIP_NAT_MODE_NONE) || dst_port != 0)) {
             return send_udp_from_one_src(local_addr, peer_addr,
                                          src_port, dst_port,
-                                         msg, entry, retransmit);
+                                         msg, params, entry, retransmit);
         } else {
             return send_raw_from_one_src(local_addr, peer_addr,
                                          src_port, dst_port,
-                                         msg, entry, retransmit);
+                                         msg, params, entry, retransmit);
         }
     }
 
@@ -1750,12 +1811,82 @@ int hip_send_pkt(const struct in6_addr *local_addr,
         /* Notice: errors from sending are suppressed intentiously because they occur often */
         if (IN6_IS_ADDR_V4MAPPED(peer_addr) && (hip_get_nat_mode(entry) != HIP_NAT_MODE_NONE || dst_port != 0)) {
             send_udp_from_one_src(src_addr, peer_addr, src_port, dst_port,
-                                  msg, entry, retransmit);
+                                  msg, params, entry, retransmit);
         } else {
             send_raw_from_one_src(src_addr, peer_addr, src_port, dst_port,
-                                  msg, entry, retransmit);
+                                  msg, params, entry, retransmit);
         }
     }
 
     return err;
 }
+
+/**
+ * Send a HIP message.
+ *
+ * Sends a HIP message to the peer on HIP/IP. This function also calculates the
+ * HIP packet checksum.
+ *
+ * Used protocol suite is <code>IPv4(HIP)</code> or <code>IPv6(HIP)</code>.
+ *
+ * @param local_addr a pointer to our IPv6 or IPv4-in-IPv6 format IPv4 address.
+ *                   If local_addr is NULL, the packet is sent from all addresses.
+ * @param peer_addr  a pointer to peer IPv6 or IPv4-in-IPv6 format IPv4 address.
+ * @param src_port   not used.
+ * @param dst_port   not used.
+ * @param msg        a pointer to a HIP packet common header with source and
+ *                   destination HITs.
+ * @param entry      a pointer to the current host association database state.
+ * @param retransmit a boolean value indicating if this is a retransmission
+ *                   (@b zero if this is @b not a retransmission).
+ * @return           zero on success, or negative error value on error.
+ * @note             This function should never be used directly. Use
+ *                   hip_send_pkt_stateless() or the host association send
+ *                   function pointed by the function pointer
+ *                   hadb_xmit_func->send_pkt instead.
+ * @note             If retransmit is set other than zero, make sure that the
+ *                   entry is not NULL.
+ * @todo             remove the sleep code (queuing is enough?)
+ * @see              hip_send_udp
+ */
+int hip_send_pkt(const struct in6_addr *local_addr,
+                 const struct in6_addr *peer_addr,
+                 const in_port_t src_port,
+                 const in_port_t dst_port,
+                 struct hip_common *msg,
+                 struct hip_hadb_state *entry,
+                 const int retransmit)
+{
+    return send_pkt(local_addr, peer_addr, src_port, dst_port, msg, NULL,
+                    entry, retransmit);
+}
+
+/**
+ * Send a HIP message whose parameters are in a separate buffer from its
+ * header. This sends precreated packets without copying them: only the
+ * header is modified for the packet at hand, the parameters are read in
+ * place. The packet is not queued for retransmission.
+ *
+ * @param local_addr a pointer to our IPv6 or IPv4-in-IPv6 format IPv4 address.
+ *                   If local_addr is NULL, the packet is sent from all addresses.
+ * @param peer_addr  a pointer to peer IPv6 or IPv4-in-IPv6 format IPv4 address.
+ * @param src_port   source port number for UDP encapsulation (host byte order)
+ * @param dst_port   destination port number for UDP encapsulation
+ *                   (host byte order)
+ * @param hdr        the header of the packet. Its length field covers the
+ *                   whole packet, its checksum is overwritten.
+ * @param params     the parameters of the packet, the remaining
+ *                   hip_get_msg_total_len(@a hdr) - sizeof(struct hip_common)
+ *                   bytes of the packet
+ * @return           zero on success, or negative error value on error.
+ */
+int hip_send_pkt_split(const struct in6_addr *local_addr,
+                       const struct in6_addr *peer_addr,
+                       const in_port_t src_port,
+                       const in_port_t dst_port,
+                       struct hip_common *hdr,
+                       const void *const params)
+{
+    return send_pkt(local_addr, peer_addr, src_port, dst_port, hdr, params,
+                    NULL, 0);
+}
@@ -123,6 +123,12 @@ int hip_send_pkt(const struct in6_addr *local_addr,
                  struct hip_common *msg,
                  struct hip_hadb_state *entry,
                  const int retransmit);
+int hip_send_pkt_split(const struct in6_addr *local_addr,
+                       const struct in6_addr *peer_addr,
+                       const in_port_t src_port,
+                       const in_port_t dst_port,
+                       struct hip_common *hdr,
+                       const void *const params);
 int hip_send_udp_stun(struct in6_addr *local_addr, struct in6_addr *peer_addr,
                       in_port_t src_port, in_port_t dst_port,
                       const void *msg, int length);
@@ -31,6 +31,7 @@
 #include <stdint.h>
 
 #include "libcore/builder.h"
+#include "libcore/debug.h"
 #include "libcore/ife.h"
 #include "libcore/linkedlist.h"
 #include "libcore/protodefs.h"
@@ -125,21 +126,25 @@ out_err:
 }
 
 /**
- * Run all handle functions for specified combination from packet type and host
- * association state.
+ * Run the handle functions for specified combination from packet type and
+ * host association state, starting after a given handle function.
  *
  * @param packet_type The packet type of the control message (RFC 5201, 5.3.)
  * @param ha_state The host association state (RFC 5201, 4.4.1.)
- * @param ctx The packet context containing the received message, source and
- *            destination address, the ports and the corresponding entry from
- *            the host association database.
+ * @param ctx The packet context.
+ * @param after The handle function after which to start, or NULL to run
+ *              all handle functions.
  *
- * @return Success =  0
- *         Error   = -1
+ * @return Success   =  0
+ *         Suspended =  HIP_HANDLE_SUSPENDED
+ *         Error     = -1
  */
-int hip_run_handle_functions(const uint8_t packet_type,
-                             const enum hip_state ha_state,
-                             struct hip_packet_context *ctx)
+static int run_handle_functions(const uint8_t packet_type,
+                                const enum hip_state ha_state,
+                                struct hip_packet_context *ctx,
+                                int (*after)(const uint8_t packet_type,
+                                             const enum hip_state ha_state,
+                                             struct hip_packet_context *ctx))
 {
     int                       err = 0;
     int                       hip_version;
@@ -160,13 +165,25 @@ int hip_run_handle_functions(const uint8_t packet_type,
              packet_type,
              ha_state);
 
+    /* skip the handle functions that already ran */
+    if (after) {
+        do {
+            iter = hip_ll_iterate(hip_handle_functions[hip_version][packet_type][ha_state],
+                                  iter);
+        } while (iter && ((struct handle_function *) iter->ptr)->func_ptr != after);
+        HIP_IFEL(!iter, -1, "Suspended handle function not registered.\n");
+    }
+
     while ((iter = hip_ll_iterate(hip_handle_functions[hip_version][packet_type][ha_state],
                                   iter))
            && !ctx->error) {
         err = ((struct handle_function *) iter->ptr)->func_ptr(packet_type,
                                                                ha_state,
                                                                ctx);
-        if (err) {
+        if (err == HIP_HANDLE_SUSPENDED) {
+            HIP_DEBUG("Handle function suspended, waiting for completion.\n");
+            return err;
+        } else if (err) {
             HIP_ERROR("Error after running registered handle function, dropping packet...\n");
             return err;
         }
@@ -176,6 +193,56 @@ out_err:
     return err;
 }
 
+/**
+ * Run all handle functions for specified combination from packet type and host
+ * association state.
+ *
+ * A handle function may hand expensive work off to another thread and return
+ * HIP_HANDLE_SUSPENDED. The remaining handle functions are then skipped until
+ * the work is complete and hip_resume_handle_functions() is called.
+ *
+ * @param packet_type The packet type of the control message (RFC 5201, 5.3.)
+ * @param ha_state The host association state (RFC 5201, 4.4.1.)
+ * @param ctx The packet context containing the received message, source and
+ *            destination address, the ports and the corresponding entry from
+ *            the host association database.
+ *
+ * @return Success   =  0
+ *         Suspended =  HIP_HANDLE_SUSPENDED
+ *         Error     = -1
+ */
+int hip_run_handle_functions(const uint8_t packet_type,
+                             const enum hip_state ha_state,
+                             struct hip_packet_context *ctx)
+{
+    return run_handle_functions(packet_type, ha_state, ctx, NULL);
+}
+
+/**
+ * Continue a suspended run of handle functions with the handle function
+ * registered after the one that suspended it.
+ *
+ * @param packet_type The packet type passed to the suspended handle function.
+ * @param ha_state The host association state passed to the suspended handle
+ *                 function.
+ * @param ctx The packet context of the suspended run.
+ * @param handle_function The handle function that returned
+ *                        HIP_HANDLE_SUSPENDED.
+ *
+ * @return Success   =  0
+ *         Suspended =  HIP_HANDLE_SUSPENDED
+ *         Error     = -1
+ */
+int hip_resume_handle_functions(const uint8_t packet_type,
+                                const enum hip_state ha_state,
+                                struct hip_packet_context *ctx,
+                                int (*handle_function)(const uint8_t packet_type,
+                                                       const enum hip_state ha_state,
+                                                       struct hip_packet_context *ctx))
+{
+    return run_handle_functions(packet_type, ha_state, ctx, handle_function);
+}
+
 /**
  * Free the memory used for storage of handle functions.
  *
@@ -190,6 +257,7 @@ void hip_uninit_handle_functions(void)
                 if (hip_handle_functions[i][j][k]) {
                     hip_ll_uninit(hip_handle_functions[i][j][k], free);
                     free(hip_handle_functions[i][j][k]);
+                    hip_handle_functions[i][j][k] = NULL;
                 }
             }
         }
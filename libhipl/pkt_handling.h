@@ -26,11 +26,20 @@
 #ifndef HIPL_LIBHIPL_PKT_HANDLING_H
 #define HIPL_LIBHIPL_PKT_HANDLING_H
 
+#include <limits.h>
 #include <stdint.h>
 
 #include "libcore/protodefs.h"
 #include "libcore/state.h"
 
+/**
+ * Returned by a handle function that handed its work off to another thread.
+ * The remaining handle functions run once the work is complete. Handle
+ * functions return other positive values to stop the packet handling (e.g.
+ * hip_handle_i2_in_i2_sent()), so this must not be a small number.
+ */
+#define HIP_HANDLE_SUSPENDED INT_MAX
+
 int hip_register_handle_function(const uint8_t hip_version,
                                  const uint8_t packet_type,
                                  const enum hip_state ha_state,
@@ -43,6 +52,13 @@ int hip_run_handle_functions(const uint8_t packet_type,
                              const enum hip_state ha_state,
                              struct hip_packet_context *ctx);
 
+int hip_resume_handle_functions(const uint8_t packet_type,
+                                const enum hip_state ha_state,
+                                struct hip_packet_context *ctx,
+                                int (*handle_function)(const uint8_t packet_type,
+                                                       const enum hip_state ha_state,
+                                                       struct hip_packet_context *ctx));
+
 void hip_uninit_handle_functions(void);
 
 #endif /* HIPL_LIBHIPL_PKT_HANDLING_H */
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Automatic puzzle difficulty. The responder can choose the difficulty K of
+ * the puzzle in its R1s freely, but a fixed K is either too low to slow down
+ * a flood of I2s or needlessly high for legitimate initiators while there is
+ * no load. This controller measures the load of the responder and adds a
+ * boost to the configured difficulty while it is overloaded.
+ *
+ * The load is measured as the arrival rates of I1 and I2 packets, averaged
+ * over a few seconds, and the number of crypto jobs of I2s that are waiting
+ * for or running on a crypto worker. hip_puzzle_control_update() is called
+ * once per second by the maintenance loop. It raises the boost by one as
+ * long as any of the measures exceeds its high watermark, but waits
+ * ::RAISE_HOLD_TICKS seconds after each raise so that the R1s with the new
+ * difficulty get a chance to be sent out. The boost is lowered by one after
+ * all measures stayed below their low watermarks for ::CALM_TICKS seconds.
+ *
+ * The controller is not thread-safe; it is only used by the main loop.
+ *
+ * @brief Adapt the puzzle difficulty to the measured load
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libcore/debug.h"
+#include "libcore/prefix.h"
+#include "libcore/protodefs.h"
+#include "puzzle_control.h"
+
+/** I1s per second above which the responder is overloaded */
+#define I1_RATE_HIGH      512
+/** I1s per second below which the boost may be lowered */
+#define I1_RATE_LOW       128
+/** I2s per second above which the responder is overloaded */
+#define I2_RATE_HIGH      32
+/** I2s per second below which the boost may be lowered */
+#define I2_RATE_LOW       8
+/** crypto jobs in flight above which the responder is overloaded */
+#define BACKLOG_HIGH      16
+/** crypto jobs in flight up to which the boost may be lowered */
+#define BACKLOG_LOW       1
+
+/** upper bound of the boost */
+#define MAX_BOOST         16
+/** seconds to wait after a raise of the boost before raising it again */
+#define RAISE_HOLD_TICKS  2
+/** seconds without load after which the boost is lowered */
+#define CALM_TICKS        10
+
+/** the weight of a new sample in the averaged rates is 1 / 2^RATE_SHIFT */
+#define RATE_SHIFT        2
+/** the averaged rates are fixed point numbers with RATE_FRAC fraction bits */
+#define RATE_FRAC         4
+/** convert a rate in packets per second to the fixed point format */
+#define RATE(r)           ((uint32_t) (r) << RATE_FRAC)
+
+/** packets received since the last update */
+static unsigned int i1_count, i2_count;
+/** averaged packet rates, see ::RATE_FRAC */
+static uint32_t i1_avg, i2_avg;
+/** crypto backlog at the last update */
+static unsigned int last_backlog;
+
+static uint8_t      boost;
+/** updates left until the boost may be raised again */
+static unsigned int hold_ticks;
+/** updates without load since the boost was last changed */
+static unsigned int calm_ticks;
+
+/**
+ * Add the number of packets received during the last second to an
+ * exponentially weighted moving average.
+ *
+ * @param avg   the average
+ * @param count the number of packets
+ * @return      the new average
+ */
+static uint32_t update_average(const uint32_t avg, const unsigned int count)
+{
+    const uint32_t sample = RATE(MIN(count, UINT32_MAX >> RATE_FRAC));
+
+    return avg - (avg >> RATE_SHIFT) + (sample >> RATE_SHIFT);
+}
+
+/**
+ * Account for a received control packet.
+ *
+ * @param packet_type the type of the packet, only I1 and I2 are counted
+ */
+void hip_puzzle_control_count(const uint8_t packet_type)
+{
+    if (packet_type == HIP_I1) {
+        i1_count++;
+    } else if (packet_type == HIP_I2) {
+        i2_count++;
+    }
+}
+
+/**
+ * Update the load measures and adapt the boost of the puzzle difficulty.
+ * To be called once per second.
+ *
+ * @param backlog the number of crypto jobs in flight
+ * @return        true if the boost changed and the R1s need to be recreated
+ */
+bool hip_puzzle_control_update(const unsigned int backlog)
+{
+    bool overload, calm;
+
+    i1_avg       = update_average(i1_avg, i1_count);
+    i2_avg       = update_average(i2_avg, i2_count);
+    i1_count     = 0;
+    i2_count     = 0;
+    last_backlog = backlog;
+
+    overload = i1_avg >= RATE(I1_RATE_HIGH) ||
+               i2_avg >= RATE(I2_RATE_HIGH) ||
+               backlog >= BACKLOG_HIGH;
+    calm = i1_avg < RATE(I1_RATE_LOW) &&
+           i2_avg < RATE(I2_RATE_LOW) &&
+           backlog <= BACKLOG_LOW;
+
+    if (hold_ticks > 0) {
+        hold_ticks--;
+    }
+
+    if (overload) {
+        calm_ticks = 0;
+        if (hold_ticks > 0 || boost >= MAX_BOOST) {
+            return false;
+        }
+        boost++;
+        hold_ticks = RAISE_HOLD_TICKS;
+        HIP_INFO("Load is high (I1/s %u, I2/s %u, backlog %u), raising puzzle boost to %u\n",
+                 i1_avg >> RATE_FRAC, i2_avg >> RATE_FRAC, backlog, boost);
+        return true;
+    }
+
+    if (!calm || boost == 0) {
+        calm_ticks = 0;
+        return false;
+    }
+
+    if (++calm_ticks < CALM_TICKS) {
+        return false;
+    }
+    boost--;
+    calm_ticks = 0;
+    HIP_INFO("Load is low, lowering puzzle boost to %u\n", boost);
+    return true;
+}
+
+/**
+ * Get the difficulty to add to the configured puzzle difficulty.
+ *
+ * @return the boost
+ */
+uint8_t hip_puzzle_control_boost(void)
+{
+    return boost;
+}
+
+/**
+ * Report the state of the controller.
+ *
+ * @param load filled with the boost and the load measures; the difficulty
+ *             and the TLV header are left to the caller
+ */
+void hip_puzzle_control_get_load(struct hip_puzzle_load *const load)
+{
+    load->boost   = boost;
+    load->i1_rate = i1_avg >> RATE_FRAC;
+    load->i2_rate = i2_avg >> RATE_FRAC;
+    load->backlog = last_backlog;
+}
@@ -709,6 +709,7 @@ int hip_handle_user_msg(struct hip_common *msg,
 
     case HIP_MSG_LSI_ON:
         lsi_status = HIP_MSG_LSI_ON;
+        err        = hipfw_sync_ha_info();
         break;
     case HIP_MSG_LSI_OFF:
         lsi_status = HIP_MSG_LSI_OFF;
@@ -40,6 +40,7 @@
 #include "libcore/protodefs.h"
 #include "libcore/state.h"
 #include "libcore/gpl/xfrmapi.h"
+#include "cookie.h"
 #include "esp_prot_hipd_msg.h"
 #include "hipd.h"
 #include "init.h"
@@ -62,13 +63,14 @@ int hip_use_userspace_ipsec = 0;
 int hip_userspace_ipsec_activate(const struct hip_common *msg)
 {
     const struct hip_tlv_common *param = NULL;
-    int                          err   = 0, activate = 0;
+    int                          err   = 0, activate = 0, changed = 0;
 
     // process message and store anchor elements in the db
     param    = hip_get_param(msg, HIP_PARAM_INT);
     activate = *((const int *) hip_get_param_contents_direct(param));
 
     // set global variable
+    changed                 = hip_use_userspace_ipsec != activate;
     hip_use_userspace_ipsec = activate;
     HIP_DEBUG("userspace ipsec set to %i\n", activate);
 
@@ -85,6 +87,13 @@ int hip_userspace_ipsec_activate(const struct hip_common *msg)
         hip_flush_all_sa();
     }
 
+    /* the ESP transforms offered in R1 depend on the IPsec mode */
+    if (changed) {
+        HIP_IFEL(hip_recreate_all_precreated_r1_packets(), -1,
+                 "failed to recreate all R1s\n");
+    }
+
+out_err:
     return err;
 }
 
@@ -98,6 +98,9 @@ static int heartbeat_interval = HIP_HEARTBEAT_INTERVAL;
 /** Remove state for stale connections after this many heartbeat failures. */
 static const int heartbeat_state_remove_threshold = 12;
 
+/** slot of the heartbeat failure counter in the modular state of an HA */
+static int heartbeat_state_slot = -1;
+
 /**
  * This function sends ICMPv6 echo with timestamp
  *
@@ -222,8 +225,8 @@ static int icmp_statistics(struct in6_addr *src, struct in6_addr *dst,
     calc_statistics(&entry->heartbeats_statistics, &rcvd_heartbeats, NULL,
                     NULL, &avg, &std_dev, STATS_IN_MSECS);
 
-    heartbeat_failures = lmod_get_state_item(entry->hip_modular_state,
-                                             "heartbeat_update");
+    heartbeat_failures = lmod_get_state_item_by_slot(entry->hip_modular_state,
+                                                     heartbeat_state_slot);
 
     *heartbeat_failures = 0;
     HIP_DEBUG("heartbeat_failures: %d\n", *heartbeat_failures);
@@ -370,8 +373,8 @@ static int heartbeat_send(struct hip_hadb_state *hadb_entry, void *opaq)
     uint8_t *heartbeat_failures = NULL;
 
     if (hadb_entry->state == HIP_STATE_ESTABLISHED) {
-        if (!(heartbeat_failures = lmod_get_state_item(hadb_entry->hip_modular_state,
-                                                       "heartbeat_update"))) {
+        if (!(heartbeat_failures = lmod_get_state_item_by_slot(hadb_entry->hip_modular_state,
+                                                               heartbeat_state_slot))) {
             HIP_ERROR("Missing 'heartbeat_update' state item.\n");
             return -1;
         }
@@ -483,6 +486,11 @@ int hip_heartbeat_init(void)
         return -1;
     }
 
+    if ((heartbeat_state_slot = lmod_register_state_slot("heartbeat_update")) == -1) {
+        HIP_ERROR("Error on registration of the heartbeat state slot.\n");
+        return -1;
+    }
+
     if (lmod_register_state_init_function(&heartbeat_init_state)) {
         HIP_ERROR("Error on registration of heartbeat_init_state().\n");
         return -1;
@@ -43,6 +43,7 @@
 #include "libcore/builder.h"
 #include "libcore/common.h"
 #include "libcore/debug.h"
+#include "libcore/modularization.h"
 #include "libcore/protodefs.h"
 #include "libhipl/hadb.h"
 #include "libhipl/maintenance.h"
@@ -52,14 +53,19 @@
 
 static const int hip_heartbeat_trigger_update_threshold = 5;
 
+/** slot of the heartbeat failure counter kept by the heartbeat module */
+static int heartbeat_state_slot = -1;
+
 static int hb_update_trigger(struct hip_hadb_state *const hadb_entry,
                              UNUSED void *opaque)
 {
     uint8_t *heartbeat_failures = NULL;
 
     if (hadb_entry->state == HIP_STATE_ESTABLISHED) {
-        heartbeat_failures = lmod_get_state_item(hadb_entry->hip_modular_state,
-                                                "heartbeat_update");
+        if (!(heartbeat_failures = lmod_get_state_item_by_slot(hadb_entry->hip_modular_state,
+                                                               heartbeat_state_slot))) {
+            return 0;
+        }
 
         if (*heartbeat_failures > 0 &&
             *heartbeat_failures % hip_heartbeat_trigger_update_threshold == 0) {
@@ -86,6 +92,11 @@ int hip_hb_update_init(void)
 {
     HIP_INFO("Initializing tunnel updates for heartbeat extension\n");
 
+    if ((heartbeat_state_slot = lmod_register_state_slot("heartbeat_update")) == -1) {
+        HIP_ERROR("Error on registration of the heartbeat state slot.\n");
+        return -1;
+    }
+
     if (hip_register_maint_function(&hb_update_maintenance, 50000)) {
         HIP_DEBUG("Error on registration of hip_hb_update_maintenance()\n");
         return -1;
@@ -62,6 +62,9 @@
 #include "update_param_handling.h"
 #include "update.h"
 
+/** slot of the update state in the modular state of a host association */
+static int update_state_slot = -1;
+
 /**
  * Prepare the creation of a new UPDATE packet.
  *
@@ -220,8 +223,7 @@ static int check_update_freshness(UNUSED const uint8_t packet_type,
              -1,
              "No host association database entry found.\n");
 
-    HIP_IFEL(!(localstate = lmod_get_state_item(ctx->hadb_entry->hip_modular_state,
-                                                "update")),
+    HIP_IFEL(!(localstate = hip_update_get_state(ctx->hadb_entry)),
              -1,
              "failed to look up UPDATE-specific state\n");
 
@@ -334,7 +336,7 @@ static int send_update_packet(UNUSED const uint8_t packet_type,
     switch (hip_classify_update_type(ctx->input_msg)) {
     case FIRST_UPDATE_PACKET:
         // send challenge to all advertised locators
-        localstate = lmod_get_state_item(ctx->hadb_entry->hip_modular_state, "update");
+        localstate = hip_update_get_state(ctx->hadb_entry);
 
         for (unsigned i = 0; i < localstate->valid_locators; i++) {
             dst_addr = &localstate->addresses_to_send_echo_request[i];
@@ -441,6 +443,8 @@ static int set_active_addresses(UNUSED const uint8_t packet_type,
         ctx->hadb_entry->peer_addr = ctx->src_addr;
     }
 
+    hipfw_update_ha_info(HIP_MSG_FW_HA_UPDATE, ctx->hadb_entry);
+
     return 0;
 }
 
@@ -569,9 +573,8 @@ static int update_init_state(struct modular_state *state)
 /**
  * Free memory that was allocated in the update_state instance.
  *
- * @note The item_name parameter for the lmod_get_state_item() call has to be
- *       the same as the one it was registered with in update_init_state().
- *       In this case it is "update".
+ * @note The state is looked up in the slot registered for "update" by
+ *       hip_update_init(), the name update_init_state() adds it with.
  *
  * @param state Pointer to the modular state data structure.
  *
@@ -582,7 +585,7 @@ static void update_uninit_state(struct modular_state *const state)
 {
     struct update_state *update_state = NULL;
 
-    update_state = lmod_get_state_item(state, "update");
+    update_state = lmod_get_state_item_by_slot(state, update_state_slot);
     if (update_state != NULL) {
         update_state->valid_locators = 0;
     }
@@ -610,7 +613,7 @@ static int update_change_state(UNUSED const uint8_t packet_type,
     if (ctx->hadb_entry->state == HIP_STATE_R2_SENT) {
         HIP_DEBUG("Received UPDATE in state %s, moving to ESTABLISHED.\n",
                   hip_state_str(ctx->hadb_entry->state));
-        ctx->hadb_entry->state = HIP_STATE_ESTABLISHED;
+        hip_hadb_set_state(ctx->hadb_entry, HIP_STATE_ESTABLISHED);
     }
 
 #ifdef CONFIG_HIP_PERFORMANCE
@@ -638,6 +641,17 @@ static int update_manual_update(UNUSED struct hip_common *msg,
     return trigger_update_for_all_peers();
 }
 
+/**
+ * Get the update state of a host association.
+ *
+ * @param ha the host association
+ * @return   the update state of @a ha or NULL if it has none
+ */
+struct update_state *hip_update_get_state(const struct hip_hadb_state *const ha)
+{
+    return lmod_get_state_item_by_slot(ha->hip_modular_state, update_state_slot);
+}
+
 /**
  * Getter for the sequence number value.
  *
@@ -714,7 +728,7 @@ int hip_trigger_update(struct hip_hadb_state *const hadb_entry)
     int                  err        = 0;
     const int            retransmit = 1;
 
-    localstate = lmod_get_state_item(hadb_entry->hip_modular_state, "update");
+    localstate = hip_update_get_state(hadb_entry);
 
     HIP_IFEL(!(locator_update_packet = hip_msg_alloc()), -ENOMEM,
              "Out of memory while allocation memory for the update packet\n");
@@ -774,6 +788,10 @@ int hip_update_init(void)
 {
     int err = 0;
 
+    HIP_IFEL((update_state_slot = lmod_register_state_slot("update")) == -1,
+             -1,
+             "Error on registering update state slot.\n");
+
     HIP_IFEL(lmod_register_state_init_function(&update_init_state),
              -1,
              "Error on registering update state init function.\n");
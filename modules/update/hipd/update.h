@@ -125,6 +125,8 @@ union hip_locator_info_addr {
     struct hip_locator_type_1 type1;
 } __attribute__((packed));
 
+struct update_state *hip_update_get_state(const struct hip_hadb_state *const ha);
+
 uint32_t hip_update_get_out_id(const struct update_state *const state);
 
 int hip_trigger_update(struct hip_hadb_state *const hadb_entry);
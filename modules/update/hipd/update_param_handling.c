@@ -78,7 +78,7 @@ static void remove_addresses_to_send_echo_request(struct update_state *const sta
  */
 static void print_addresses_to_send_update_request(const struct hip_hadb_state *const ha)
 {
-    const struct update_state *const localstate = lmod_get_state_item(ha->hip_modular_state, "update");
+    const struct update_state *const localstate = hip_update_get_state(ha);
 
     HIP_DEBUG("Addresses to send update:\n");
     for (unsigned i = 0; i < localstate->valid_locators; i++) {
@@ -170,8 +170,7 @@ int hip_add_seq_param(UNUSED const uint8_t packet_type,
     int                  err        = 0;
 
     if (hip_classify_update_type(ctx->input_msg) == FIRST_UPDATE_PACKET) {
-        HIP_IFEL(!(localstate = lmod_get_state_item(ctx->hadb_entry->hip_modular_state,
-                                                    "update")),
+        HIP_IFEL(!(localstate = hip_update_get_state(ctx->hadb_entry)),
                  -1, "failed to look up update state\n");
         localstate->update_id_out++;
         HIP_DEBUG("outgoing UPDATE ID=%u\n", hip_update_get_out_id(localstate));
@@ -211,8 +210,7 @@ int hip_handle_seq_param(UNUSED const uint8_t packet_type,
         HIP_IFEL(!(seq = hip_get_param(ctx->input_msg, HIP_PARAM_SEQ)),
                  -1, "SEQ parameter not found\n");
 
-        HIP_IFEL(!(localstate = lmod_get_state_item(ctx->hadb_entry->hip_modular_state,
-                                                    "update")),
+        HIP_IFEL(!(localstate = hip_update_get_state(ctx->hadb_entry)),
                  -1, "failed to look up update state\n");
 
         // progress update sequence to currently processed update
@@ -388,8 +386,7 @@ int hip_handle_locator_parameter(UNUSED const uint8_t packet_type,
 
         // Empty the addresses_to_send_echo_request list before adding the
         // new addresses
-        localstate = lmod_get_state_item(ctx->hadb_entry->hip_modular_state,
-                                         "update");
+        localstate = hip_update_get_state(ctx->hadb_entry);
 
         HIP_DEBUG("hip_get_state_item returned localstate: %p\n", localstate);
         remove_addresses_to_send_echo_request(localstate);
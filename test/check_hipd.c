@@ -32,7 +32,13 @@ int main(void)
 {
     int      number_failed;
     SRunner *sr = srunner_create(NULL);
+    srunner_add_suite(sr, hipd_cookie());
+    srunner_add_suite(sr, hipd_crypto_worker());
+    srunner_add_suite(sr, hipd_hip_socket());
     srunner_add_suite(sr, hipd_lsidb());
+    srunner_add_suite(sr, hipd_maintenance());
+    srunner_add_suite(sr, hipd_msg_pool());
+    srunner_add_suite(sr, hipd_puzzle_control());
 
     srunner_add_suite(sr, hipd_modules_midauth());
 
@@ -32,12 +32,17 @@ int main(void)
 {
     int      number_failed;
     SRunner *sr = srunner_create(NULL);
+    srunner_add_suite(sr, firewall_cache());
     srunner_add_suite(sr, firewall_conntrack());
+    srunner_add_suite(sr, firewall_esp_prot_refill());
     srunner_add_suite(sr, firewall_file_buffer());
     srunner_add_suite(sr, firewall_helpers());
     srunner_add_suite(sr, firewall_line_parser());
     srunner_add_suite(sr, firewall_midauth());
+    srunner_add_suite(sr, firewall_pending_queue());
     srunner_add_suite(sr, firewall_port_bindings());
+    srunner_add_suite(sr, firewall_user_ipsec_esp());
+    srunner_add_suite(sr, firewall_user_ipsec_replay());
 
     srunner_run_all(sr, CK_NORMAL);
     number_failed = srunner_ntests_failed(sr);
@@ -39,8 +39,13 @@ int main(void)
 
     SRunner *sr = srunner_create(NULL);
     srunner_add_suite(sr, libcore_cert());
+    srunner_add_suite(sr, libcore_hash_mb());
+    srunner_add_suite(sr, libcore_hashchain());
     srunner_add_suite(sr, libcore_hit());
     srunner_add_suite(sr, libcore_hostid());
+    srunner_add_suite(sr, libcore_message());
+    srunner_add_suite(sr, libcore_modularization());
+    srunner_add_suite(sr, libcore_siphash());
     srunner_add_suite(sr, libcore_solve());
     srunner_add_suite(sr, libcore_straddr());
 
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <openssl/rsa.h>
+
+#include "libcore/builder.h"
+#include "libcore/crypto.h"
+#include "libcore/hostid.h"
+#include "libcore/protodefs.h"
+#include "libcore/solve.h"
+#include "libhipl/cookie.h"
+#include "libhipl/hidb.c"
+#include "test_suites.h"
+
+static struct local_host_id *hid;
+static struct in6_addr       ip_i, ip_r;
+
+static void setup(void)
+{
+    RSA                 *rsa      = NULL;
+    struct endpoint_hip *endpoint = NULL;
+    hip_hit_t            hit;
+    hip_lsi_t            lsi;
+
+    hip_init_hostid_db();
+
+    fail_unless((rsa = create_rsa_key(1024)) != NULL);
+    fail_unless(rsa_to_hip_endpoint(rsa, &endpoint, 0, "test") == 0);
+    fail_unless(hip_private_host_id_to_hit(&endpoint->id.host_id, &hit,
+                                           HIP_HIT_TYPE_HASH100) == 0);
+    fail_unless(add_host_id(hit, false, &lsi, &endpoint->id.host_id) == 0);
+    fail_unless((hid = hip_get_hostid_entry_by_lhi_and_algo(&hit, HIP_ANY_ALGO,
+                                                            -1)) != NULL);
+    RSA_free(rsa);
+    free(endpoint);
+
+    fail_unless(inet_pton(AF_INET6, "2001:db8::1", &ip_i) == 1);
+    fail_unless(inet_pton(AF_INET6, "2001:db8::2", &ip_r) == 1);
+}
+
+static void teardown(void)
+{
+    hip_uninit_host_id_dbs();
+}
+
+static void recreate_r1s(void)
+{
+    fail_unless(hip_recreate_all_precreated_r1_packets() == 0);
+    while (hip_r1_recreation_pending()) {
+        fail_unless(hip_continue_r1_recreation() == 0);
+    }
+}
+
+/* solves the puzzle of the HIPv1 R1 that is currently sent to ip_i */
+static void solve_r1(struct hip_common *const hdr,
+                     struct hip_solution *const solution)
+{
+    const struct hip_common *r1;
+    const struct hip_puzzle *puzzle;
+    struct puzzle_hash_input input;
+
+    fail_unless((r1 = hip_get_r1(&ip_i, &ip_r, &hid->hit, -1)) != NULL);
+    fail_unless((puzzle = hip_get_param(r1, HIP_PARAM_PUZZLE)) != NULL);
+
+    fail_unless(inet_pton(AF_INET6, "2001:10::2", &hdr->hit_sender) == 1);
+    hdr->hit_receiver = hid->hit;
+
+    memcpy(input.puzzle, puzzle->I, PUZZLE_LENGTH);
+    input.initiator_hit = hdr->hit_sender;
+    input.responder_hit = hdr->hit_receiver;
+    fail_unless(hip_solve_puzzle(&input, puzzle->K) == 0);
+
+    solution->K = puzzle->K;
+    memcpy(solution->opaque, puzzle->opaque, HIP_PUZZLE_OPAQUE_LEN);
+    memcpy(solution->I, puzzle->I, PUZZLE_LENGTH);
+    memcpy(solution->J, input.solution, PUZZLE_LENGTH);
+}
+
+START_TEST(test_r1_recreation_swaps_table)
+{
+    const struct hip_r1table *const old_table = hid->r1_table;
+    const struct hip_common        *r1;
+    unsigned int                    i;
+
+    fail_unless((r1 = hip_get_r1(&ip_i, &ip_r, &hid->hit, -1)) != NULL);
+    fail_unless(hip_recreate_all_precreated_r1_packets() == 0);
+    fail_unless(hip_r1_recreation_pending());
+
+    // I1s are answered from the old table until all R1s are recreated
+    for (i = 1; i < HIP_R1_ENTRIES; i++) {
+        fail_unless(hip_continue_r1_recreation() == 0);
+        fail_unless(hip_r1_recreation_pending());
+        fail_unless(hid->r1_table == old_table);
+        fail_unless(hip_get_r1(&ip_i, &ip_r, &hid->hit, -1) == r1);
+    }
+
+    fail_unless(hip_continue_r1_recreation() == 0);
+    fail_unless(!hip_r1_recreation_pending());
+    fail_unless(hid->r1_table != old_table);
+    fail_unless(hid->r1_shadow == NULL);
+    fail_unless(hip_get_r1(&ip_i, &ip_r, &hid->hit, -1) != r1);
+}
+END_TEST
+
+START_TEST(test_r1_recreation_restart)
+{
+    fail_unless(hip_recreate_all_precreated_r1_packets() == 0);
+    fail_unless(hip_continue_r1_recreation() == 0);
+    fail_unless(hip_continue_r1_recreation() == 0);
+    fail_unless(hid->r1_shadow_next == 2);
+
+    // a second request starts over in the same shadow table
+    fail_unless(hip_recreate_all_precreated_r1_packets() == 0);
+    fail_unless(hid->r1_shadow_next == 0);
+    fail_unless(hid->r1_shadow != NULL);
+}
+END_TEST
+
+START_TEST(test_r1_recreation_error)
+{
+    const struct hip_r1table *const old_table = hid->r1_table;
+    const uint8_t                   algo      = hid->host_id.rdata.algorithm;
+
+    fail_unless(hip_recreate_all_precreated_r1_packets() == 0);
+    fail_unless(hip_continue_r1_recreation() == 0);
+
+    // signing fails, the shadow table is dropped and the old one kept
+    hid->host_id.rdata.algorithm = 0;
+    fail_unless(hip_continue_r1_recreation() != 0);
+    hid->host_id.rdata.algorithm = algo;
+
+    fail_unless(hid->r1_shadow == NULL);
+    fail_unless(!hip_r1_recreation_pending());
+    fail_unless(hid->r1_table == old_table);
+    fail_unless(hip_get_r1(&ip_i, &ip_r, &hid->hit, -1) != NULL);
+}
+END_TEST
+
+START_TEST(test_r1_recreation_uninit)
+{
+    fail_unless(hip_recreate_all_precreated_r1_packets() == 0);
+    fail_unless(hip_continue_r1_recreation() == 0);
+
+    hip_uninit_r1(hid);
+    fail_unless(hid->r1_shadow == NULL);
+    fail_unless(hid->r1_table == NULL);
+    fail_unless(!hip_r1_recreation_pending());
+}
+END_TEST
+
+START_TEST(test_verify_cookie_after_difficulty_change)
+{
+    struct hip_common   hdr      = { 0 };
+    struct hip_solution solution = { 0 };
+
+    solve_r1(&hdr, &solution);
+    fail_unless(hip_verify_cookie(&ip_i, &ip_r, &hdr, &solution, HIP_V1, -1) == 0);
+
+    // a solution to the puzzle sent before the R1s were recreated is valid
+    fail_unless(hip_inc_cookie_difficulty() > 0);
+    recreate_r1s();
+    fail_unless(hip_verify_cookie(&ip_i, &ip_r, &hdr, &solution, HIP_V1, -1) == 0);
+
+    // but only until the R1s are recreated once more
+    recreate_r1s();
+    fail_unless(hip_verify_cookie(&ip_i, &ip_r, &hdr, &solution, HIP_V1, -1) != 0);
+    fail_unless(hip_dec_cookie_difficulty() >= 0);
+}
+END_TEST
+
+START_TEST(test_verify_cookie_unsent_puzzle)
+{
+    struct hip_common   hdr      = { 0 };
+    struct hip_solution solution = { 0 };
+
+    // a trivial puzzle that was never sent is not accepted
+    solve_r1(&hdr, &solution);
+    memset(solution.I, 0, PUZZLE_LENGTH);
+    solution.K = 0;
+    fail_unless(hip_verify_cookie(&ip_i, &ip_r, &hdr, &solution, HIP_V1, -1) != 0);
+}
+END_TEST
+
+Suite *hipd_cookie(void)
+{
+    Suite *s = suite_create("hipd/cookie");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_r1_recreation_swaps_table);
+    tcase_add_test(tc_core, test_r1_recreation_restart);
+    tcase_add_test(tc_core, test_r1_recreation_error);
+    tcase_add_test(tc_core, test_r1_recreation_uninit);
+    tcase_add_test(tc_core, test_verify_cookie_after_difficulty_change);
+    tcase_add_test(tc_core, test_verify_cookie_unsent_puzzle);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/time.h>
+
+#include "libcore/builder.h"
+#include "libcore/common.h"
+#include "libcore/protodefs.h"
+#include "libcore/state.h"
+#include "libhipl/crypto_worker.h"
+#include "libhipl/hip_socket.h"
+#include "libhipl/pkt_handling.h"
+#include "test_suites.h"
+
+static struct hip_hadb_state     entry;
+static struct hip_packet_context ctx;
+static struct hip_packet_context loop_ctx;
+static const struct timeval      wait_time = { 1, 0 };
+
+/* result passed to the done function, or 0 if it was not called */
+static int done_result;
+/* host association seen by the second handle function, NULL if it did not run */
+static struct hip_hadb_state *resumed_entry;
+
+/* runs on a worker */
+static int work(UNUSED struct hip_common *const msg, void *const arg)
+{
+    return *(int *) arg + 1;
+}
+
+static int done(UNUSED struct hip_packet_context *const context,
+                UNUSED void *const arg,
+                const int result)
+{
+    done_result = result;
+    return result < 0 ? result : 0;
+}
+
+static int offloading_handler(const uint8_t packet_type,
+                              const enum hip_state ha_state,
+                              struct hip_packet_context *context)
+{
+    int *arg = malloc(sizeof(*arg));
+
+    fail_unless(arg != NULL);
+    *arg = 41;
+    return hip_crypto_offload(packet_type, ha_state, context,
+                              offloading_handler, work, done, arg);
+}
+
+static int following_handler(UNUSED const uint8_t packet_type,
+                             UNUSED const enum hip_state ha_state,
+                             struct hip_packet_context *context)
+{
+    resumed_entry = context->hadb_entry;
+    return 0;
+}
+
+/* stops the packet handling like hip_handle_i2_in_i2_sent() */
+static int stopping_handler(UNUSED const uint8_t packet_type,
+                            UNUSED const enum hip_state ha_state,
+                            UNUSED struct hip_packet_context *context)
+{
+    return 1;
+}
+
+/* run the main loop until no more jobs complete */
+static void run_main_loop(void)
+{
+    while (hip_run_socket_events(&wait_time, &loop_ctx) > 0) {
+        if (done_result) {
+            break;
+        }
+    }
+}
+
+static void setup(void)
+{
+    memset(&entry, 0, sizeof(entry));
+    done_result   = 0;
+    resumed_entry = NULL;
+
+    fail_unless((ctx.input_msg = hip_msg_alloc()) != NULL);
+    fail_unless((ctx.output_msg = hip_msg_alloc()) != NULL);
+    hip_build_network_hdr(ctx.input_msg, HIP_I2, 0, &in6addr_any, &in6addr_any,
+                          HIP_V2);
+    ctx.hadb_entry = &entry;
+    ctx.error      = 0;
+
+    fail_unless(hip_register_handle_function(HIP_ALL, HIP_I2,
+                                             HIP_STATE_UNASSOCIATED,
+                                             offloading_handler, 100) == 0);
+    fail_unless(hip_register_handle_function(HIP_ALL, HIP_I2,
+                                             HIP_STATE_UNASSOCIATED,
+                                             following_handler, 200) == 0);
+    fail_unless(hip_register_handle_function(HIP_ALL, HIP_I2,
+                                             HIP_STATE_I2_SENT,
+                                             stopping_handler, 100) == 0);
+    fail_unless(hip_register_handle_function(HIP_ALL, HIP_I2,
+                                             HIP_STATE_I2_SENT,
+                                             following_handler, 200) == 0);
+}
+
+static void teardown(void)
+{
+    hip_uninit_crypto_workers();
+    hip_unregister_sockets();
+    hip_uninit_handle_functions();
+    free(ctx.input_msg);
+    free(ctx.output_msg);
+}
+
+START_TEST(test_hip_crypto_offload_inline)
+{
+    fail_unless(hip_init_crypto_workers(0) == 0);
+
+    fail_unless(hip_run_handle_functions(HIP_I2, HIP_STATE_UNASSOCIATED,
+                                         &ctx) == 0);
+    fail_unless(done_result == 42);
+    fail_unless(resumed_entry == &entry);
+    fail_unless(entry.crypto_job == NULL);
+}
+END_TEST
+
+START_TEST(test_hip_crypto_offload_resume)
+{
+    fail_unless(hip_init_crypto_workers(2) == 0);
+    fail_unless(hip_init_socket_events() == 0);
+
+    fail_unless(hip_run_handle_functions(HIP_I2, HIP_STATE_UNASSOCIATED,
+                                         &ctx) == HIP_HANDLE_SUSPENDED);
+    fail_unless(entry.crypto_job != NULL);
+    fail_unless(resumed_entry == NULL);
+
+    // the remaining handle functions run on the main loop
+    run_main_loop();
+    fail_unless(done_result == 42);
+    fail_unless(resumed_entry == &entry);
+    fail_unless(entry.crypto_job == NULL);
+}
+END_TEST
+
+START_TEST(test_hip_crypto_offload_cancel)
+{
+    fail_unless(hip_init_crypto_workers(1) == 0);
+    fail_unless(hip_init_socket_events() == 0);
+
+    fail_unless(hip_run_handle_functions(HIP_I2, HIP_STATE_UNASSOCIATED,
+                                         &ctx) == HIP_HANDLE_SUSPENDED);
+
+    // the host association is deleted before the job completes
+    hip_crypto_cancel(&entry);
+    fail_unless(entry.crypto_job == NULL);
+
+    run_main_loop();
+    fail_unless(done_result == -ECANCELED);
+    fail_unless(resumed_entry == NULL);
+}
+END_TEST
+
+START_TEST(test_hip_run_handle_functions_stopped)
+{
+    fail_unless(hip_run_handle_functions(HIP_I2, HIP_STATE_I2_SENT,
+                                         &ctx) == 1);
+    fail_unless(resumed_entry == NULL);
+}
+END_TEST
+
+Suite *hipd_crypto_worker(void)
+{
+    Suite *s = suite_create("hipd/crypto_worker");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_hip_crypto_offload_inline);
+    tcase_add_test(tc_core, test_hip_crypto_offload_resume);
+    tcase_add_test(tc_core, test_hip_crypto_offload_cancel);
+    tcase_add_test(tc_core, test_hip_run_handle_functions_stopped);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
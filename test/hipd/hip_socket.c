@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "libcore/common.h"
+#include "libcore/protodefs.h"
+#include "libhipl/hip_socket.h"
+#include "test_suites.h"
+
+/* more messages than one wakeup drains from a socket */
+#define NUM_MESSAGES 40
+
+static int                       first[2], second[2];
+static struct hip_packet_context ctx;
+static const struct timeval      no_wait = { 0, 0 };
+
+/* order in which the handlers ran */
+static int handled[2 * NUM_MESSAGES];
+static int num_handled;
+
+static void consume(const int fd, const int id)
+{
+    char byte;
+
+    fail_unless(read(fd, &byte, sizeof(byte)) == sizeof(byte));
+    handled[num_handled++] = id;
+}
+
+static int handle_first(UNUSED struct hip_packet_context *context)
+{
+    consume(first[0], 1);
+    return 0;
+}
+
+static int handle_second(UNUSED struct hip_packet_context *context)
+{
+    consume(second[0], 2);
+    return 0;
+}
+
+static void send_messages(const int fd, const int num)
+{
+    for (int i = 0; i < num; i++) {
+        fail_unless(write(fd, "x", 1) == 1);
+    }
+}
+
+static void setup(void)
+{
+    fail_unless(socketpair(AF_UNIX, SOCK_DGRAM, 0, first) == 0);
+    fail_unless(socketpair(AF_UNIX, SOCK_DGRAM, 0, second) == 0);
+    num_handled = 0;
+}
+
+static void teardown(void)
+{
+    hip_unregister_sockets();
+    close(first[0]);
+    close(first[1]);
+    close(second[0]);
+    close(second[1]);
+}
+
+START_TEST(test_hip_run_socket_events_idle)
+{
+    fail_unless(hip_register_socket(first[0], handle_first, 100) == 0);
+    fail_unless(hip_init_socket_events() == 0);
+
+    fail_unless(hip_run_socket_events(&no_wait, &ctx) == 0);
+    fail_unless(num_handled == 0);
+}
+END_TEST
+
+START_TEST(test_hip_run_socket_events_batch)
+{
+    int drained;
+
+    fail_unless(hip_register_socket(first[0], handle_first, 100) == 0);
+    fail_unless(hip_init_socket_events() == 0);
+    send_messages(first[1], NUM_MESSAGES);
+
+    // a single wakeup drains a bounded batch from the socket
+    fail_unless(hip_run_socket_events(&no_wait, &ctx) == 1);
+    drained = num_handled;
+    fail_unless(drained > 1 && drained < NUM_MESSAGES);
+
+    // the rest is picked up by the next wakeup
+    fail_unless(hip_run_socket_events(&no_wait, &ctx) == 1);
+    fail_unless(num_handled == NUM_MESSAGES);
+    fail_unless(hip_run_socket_events(&no_wait, &ctx) == 0);
+}
+END_TEST
+
+START_TEST(test_hip_run_socket_events_priority)
+{
+    // registered after the loop was set up and out of priority order
+    fail_unless(hip_init_socket_events() == 0);
+    fail_unless(hip_register_socket(second[0], handle_second, 200) == 0);
+    fail_unless(hip_register_socket(first[0], handle_first, 100) == 0);
+
+    send_messages(second[1], 2);
+    send_messages(first[1], 2);
+
+    fail_unless(hip_run_socket_events(&no_wait, &ctx) == 2);
+    fail_unless(num_handled == 4);
+    fail_unless(handled[0] == 1 && handled[1] == 1);
+    fail_unless(handled[2] == 2 && handled[3] == 2);
+}
+END_TEST
+
+Suite *hipd_hip_socket(void)
+{
+    Suite *s = suite_create("hipd/hip_socket");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_hip_run_socket_events_idle);
+    tcase_add_test(tc_core, test_hip_run_socket_events_batch);
+    tcase_add_test(tc_core, test_hip_run_socket_events_priority);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "libcore/state.h"
+#include "libhipl/hipd.h"
+#include "libhipl/maintenance.h"
+#include "test_suites.h"
+
+#define NUM_RETRANS 100
+/* spacing of the test deadlines in microseconds */
+#define SPACING     5000
+/* time that may pass while a test runs in microseconds */
+#define SLACK       (SPACING / 2)
+
+static struct hip_hadb_state  entry;
+static struct hip_msg_retrans retrans[NUM_RETRANS];
+
+static void setup(void)
+{
+    for (int i = 0; i < NUM_RETRANS; i++) {
+        retrans[i].entry       = &entry;
+        retrans[i].timer_index = -1;
+    }
+}
+
+static void teardown(void)
+{
+    hip_uninit_retransmission_timers();
+}
+
+static uint64_t timeout_usec(void)
+{
+    struct timeval timeout;
+
+    hip_retransmission_timeout(&timeout);
+    return (uint64_t) timeout.tv_sec * 1000000 + timeout.tv_usec;
+}
+
+/* schedules a retransmission that is due after the given time */
+static void schedule(struct hip_msg_retrans *const r, const uint64_t backoff)
+{
+    gettimeofday(&r->last_transmit, NULL);
+    r->current_backoff = backoff;
+    fail_unless(hip_schedule_retransmission(r) == 0);
+}
+
+START_TEST(test_retransmission_timeout_idle)
+{
+    fail_unless(timeout_usec() == HIP_SELECT_TIMEOUT_USEC);
+
+    // retransmissions later than the maintenance interval do not matter
+    schedule(&retrans[0], 2 * HIP_SELECT_TIMEOUT_USEC);
+    fail_unless(timeout_usec() == HIP_SELECT_TIMEOUT_USEC);
+
+    hip_unschedule_retransmission(&retrans[0]);
+    fail_unless(retrans[0].timer_index == -1);
+    fail_unless(timeout_usec() == HIP_SELECT_TIMEOUT_USEC);
+}
+END_TEST
+
+START_TEST(test_retransmission_timeout_due)
+{
+    schedule(&retrans[0], 0);
+    fail_unless(timeout_usec() == 0);
+
+    // rescheduling moves the deadline
+    schedule(&retrans[0], HIP_RETRANSMIT_BACKOFF_MIN);
+    fail_unless(timeout_usec() <= HIP_RETRANSMIT_BACKOFF_MIN);
+    fail_unless(timeout_usec() > HIP_RETRANSMIT_BACKOFF_MIN - SLACK);
+}
+END_TEST
+
+START_TEST(test_retransmission_timeout_order)
+{
+    uint64_t     expected;
+    unsigned int i, j, k;
+
+    // schedule in an order that is not sorted by deadline
+    for (i = 0; i < NUM_RETRANS; i++) {
+        schedule(&retrans[i], (1 + (i * 37) % NUM_RETRANS) * SPACING);
+    }
+
+    // remove them in yet another order, the earliest one decides the timeout
+    for (i = 0; i < NUM_RETRANS; i++) {
+        k = (i * 61) % NUM_RETRANS;
+        hip_unschedule_retransmission(&retrans[k]);
+
+        expected = HIP_SELECT_TIMEOUT_USEC;
+        for (j = 0; j < NUM_RETRANS; j++) {
+            if (retrans[j].timer_index >= 0 &&
+                retrans[j].current_backoff < expected) {
+                expected = retrans[j].current_backoff;
+            }
+        }
+
+        fail_unless(timeout_usec() <= expected);
+        fail_unless(timeout_usec() + SLACK > expected);
+    }
+}
+END_TEST
+
+Suite *hipd_maintenance(void)
+{
+    Suite *s = suite_create("hipd/maintenance");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_retransmission_timeout_idle);
+    tcase_add_test(tc_core, test_retransmission_timeout_due);
+    tcase_add_test(tc_core, test_retransmission_timeout_order);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcore/common.h"
+#include "libcore/protodefs.h"
+#include "libhipl/msg_pool.h"
+#include "test_suites.h"
+
+static void teardown(void)
+{
+    hip_uninit_msg_pool();
+}
+
+START_TEST(test_hip_msg_pool_reuse)
+{
+    struct hip_common *msg1, *msg2;
+
+    fail_unless((msg1 = hip_msg_pool_get(100)) != NULL);
+    fail_unless(hip_msg_pool_in_use() == 1);
+    hip_msg_pool_put(msg1);
+    fail_unless(hip_msg_pool_in_use() == 0);
+
+    // a released buffer is handed out again for the same size class
+    fail_unless((msg2 = hip_msg_pool_get(128)) == msg1);
+    hip_msg_pool_put(msg2);
+}
+END_TEST
+
+START_TEST(test_hip_msg_pool_size_classes)
+{
+    struct hip_common *small, *large;
+
+    fail_unless((small = hip_msg_pool_get(40)) != NULL);
+    hip_msg_pool_put(small);
+
+    // a larger message does not get the small buffer back
+    fail_unless((large = hip_msg_pool_get(HIP_MAX_NETWORK_PACKET)) != NULL);
+    fail_unless(large != small);
+    memset(large, 0xff, HIP_MAX_NETWORK_PACKET);
+    hip_msg_pool_put(large);
+}
+END_TEST
+
+START_TEST(test_hip_msg_pool_too_large)
+{
+    fail_unless(hip_msg_pool_get(HIP_MAX_NETWORK_PACKET + 1) == NULL);
+    fail_unless(hip_msg_pool_in_use() == 0);
+}
+END_TEST
+
+START_TEST(test_hip_msg_pool_many)
+{
+    struct hip_common *msgs[100];
+    unsigned int       i, j;
+
+    // more buffers than fit into one slab
+    for (i = 0; i < ARRAY_SIZE(msgs); i++) {
+        fail_unless((msgs[i] = hip_msg_pool_get(1024)) != NULL);
+        memset(msgs[i], i, 1024);
+    }
+    fail_unless(hip_msg_pool_in_use() == ARRAY_SIZE(msgs));
+
+    for (i = 0; i < ARRAY_SIZE(msgs); i++) {
+        for (j = 0; j < 1024; j++) {
+            fail_unless(((uint8_t *) msgs[i])[j] == (uint8_t) i);
+        }
+        hip_msg_pool_put(msgs[i]);
+    }
+    fail_unless(hip_msg_pool_in_use() == 0);
+}
+END_TEST
+
+START_TEST(test_hip_msg_pool_put_null)
+{
+    hip_msg_pool_put(NULL);
+    fail_unless(hip_msg_pool_in_use() == 0);
+}
+END_TEST
+
+Suite *hipd_msg_pool(void)
+{
+    Suite *s = suite_create("hipd/msg_pool");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, NULL, teardown);
+    tcase_add_test(tc_core, test_hip_msg_pool_reuse);
+    tcase_add_test(tc_core, test_hip_msg_pool_size_classes);
+    tcase_add_test(tc_core, test_hip_msg_pool_too_large);
+    tcase_add_test(tc_core, test_hip_msg_pool_many);
+    tcase_add_test(tc_core, test_hip_msg_pool_put_null);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libcore/protodefs.h"
+#include "libhipl/puzzle_control.h"
+#include "test_suites.h"
+
+/* lets the controller forget the load of previous tests */
+static void setup(void)
+{
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        hip_puzzle_control_update(0);
+    }
+}
+
+static void receive(const uint8_t packet_type, const unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        hip_puzzle_control_count(packet_type);
+    }
+}
+
+START_TEST(test_hip_puzzle_control_idle)
+{
+    receive(HIP_I1, 10);
+    receive(HIP_I2, 1);
+    fail_unless(hip_puzzle_control_update(0) == false);
+    fail_unless(hip_puzzle_control_boost() == 0);
+}
+END_TEST
+
+START_TEST(test_hip_puzzle_control_i2_flood)
+{
+    receive(HIP_I2, 1000);
+    fail_unless(hip_puzzle_control_update(0) == true);
+    fail_unless(hip_puzzle_control_boost() == 1);
+
+    // the boost is not raised again before the new R1s are out
+    receive(HIP_I2, 1000);
+    fail_unless(hip_puzzle_control_update(0) == false);
+    receive(HIP_I2, 1000);
+    fail_unless(hip_puzzle_control_update(0) == true);
+    fail_unless(hip_puzzle_control_boost() == 2);
+}
+END_TEST
+
+START_TEST(test_hip_puzzle_control_backlog)
+{
+    fail_unless(hip_puzzle_control_update(100) == true);
+    fail_unless(hip_puzzle_control_boost() == 1);
+}
+END_TEST
+
+START_TEST(test_hip_puzzle_control_other_packets)
+{
+    receive(HIP_R1, 10000);
+    receive(HIP_UPDATE, 10000);
+    fail_unless(hip_puzzle_control_update(0) == false);
+    fail_unless(hip_puzzle_control_boost() == 0);
+}
+END_TEST
+
+START_TEST(test_hip_puzzle_control_calm_down)
+{
+    int changes = 0, i;
+
+    fail_unless(hip_puzzle_control_update(100) == true);
+
+    // the boost is lowered once, after the load stayed low for a while
+    fail_unless(hip_puzzle_control_update(0) == false);
+    for (i = 0; i < 100; i++) {
+        changes += hip_puzzle_control_update(0);
+    }
+    fail_unless(changes == 1);
+    fail_unless(hip_puzzle_control_boost() == 0);
+}
+END_TEST
+
+START_TEST(test_hip_puzzle_control_get_load)
+{
+    struct hip_puzzle_load load = { 0 };
+    int                    i;
+
+    for (i = 0; i < 50; i++) {
+        receive(HIP_I1, 20);
+        receive(HIP_I2, 4);
+        hip_puzzle_control_update(1);
+    }
+    hip_puzzle_control_get_load(&load);
+    fail_unless(load.boost == 0);
+    fail_unless(load.i1_rate >= 19 && load.i1_rate <= 20);
+    fail_unless(load.i2_rate >= 3 && load.i2_rate <= 4);
+    fail_unless(load.backlog == 1);
+}
+END_TEST
+
+Suite *hipd_puzzle_control(void)
+{
+    Suite *s = suite_create("hipd/puzzle_control");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, NULL);
+    tcase_add_test(tc_core, test_hip_puzzle_control_idle);
+    tcase_add_test(tc_core, test_hip_puzzle_control_i2_flood);
+    tcase_add_test(tc_core, test_hip_puzzle_control_backlog);
+    tcase_add_test(tc_core, test_hip_puzzle_control_other_packets);
+    tcase_add_test(tc_core, test_hip_puzzle_control_calm_down);
+    tcase_add_test(tc_core, test_hip_puzzle_control_get_load);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
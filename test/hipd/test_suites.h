@@ -28,7 +28,13 @@
 
 #include <check.h>
 
+Suite *hipd_cookie(void);
+Suite *hipd_crypto_worker(void);
+Suite *hipd_hip_socket(void);
 Suite *hipd_lsidb(void);
+Suite *hipd_maintenance(void);
+Suite *hipd_msg_pool(void);
+Suite *hipd_puzzle_control(void);
 
 Suite *hipd_modules_midauth(void);
 
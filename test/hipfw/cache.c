@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcore/builder.h"
+#include "libcore/icomm.h"
+#include "libcore/protodefs.h"
+#include "hipfw/cache.h"
+#include "test_suites.h"
+
+static void setup_ha(struct hip_hadb_user_info_state *const ha,
+                     const char *const hit_peer,
+                     const char *const lsi_peer,
+                     const char *const ip_peer)
+{
+    memset(ha, 0, sizeof(*ha));
+    inet_pton(AF_INET6, "2001:12:bd2d:d23e:4a09:b2ab:6414:e110", &ha->hit_our);
+    inet_pton(AF_INET6, hit_peer, &ha->hit_peer);
+    inet_pton(AF_INET, "1.0.0.1", &ha->lsi_our);
+    inet_pton(AF_INET, lsi_peer, &ha->lsi_peer);
+    inet_pton(AF_INET6, "::ffff:192.0.2.1", &ha->ip_our);
+    inet_pton(AF_INET6, ip_peer, &ha->ip_peer);
+    ha->state = HIP_STATE_ESTABLISHED;
+}
+
+static void send_ha_update(const struct hip_hadb_user_info_state *const ha)
+{
+    struct hip_common *msg = hip_msg_alloc();
+
+    fail_if(msg == NULL);
+    fail_if(hip_build_user_hdr(msg, HIP_MSG_FW_HA_UPDATE, 0));
+    fail_if(hip_build_param_contents(msg, ha, HIP_PARAM_HA_INFO, sizeof(*ha)));
+    fail_if(hipfw_cache_handle_ha_update(msg));
+    free(msg);
+}
+
+START_TEST(test_hipfw_cache_db_match_lsi)
+{
+    struct hip_hadb_user_info_state ha1, ha2, match;
+
+    hipfw_cache_init_hldb();
+    setup_ha(&ha1, "2001:10:f039:6bc5:cab3:0727:7fbc:9dcb", "1.0.0.2",
+             "::ffff:192.0.2.2");
+    setup_ha(&ha2, "2001:10:f039:6bc5:cab3:0727:7fbc:9dcc", "1.0.0.3",
+             "::ffff:192.0.2.3");
+    send_ha_update(&ha1);
+    send_ha_update(&ha2);
+
+    fail_unless(hipfw_cache_db_match(&ha1.lsi_our, &ha1.lsi_peer,
+                                     FW_CACHE_LSI, &match) == 0);
+    fail_unless(match.lsi_peer.s_addr == ha1.lsi_peer.s_addr);
+    fail_unless(hipfw_cache_db_match(&ha2.lsi_our, &ha2.lsi_peer,
+                                     FW_CACHE_LSI, &match) == 0);
+    fail_unless(match.lsi_peer.s_addr == ha2.lsi_peer.s_addr);
+    fail_unless(hipfw_cache_db_match(&ha1.lsi_peer, &ha1.lsi_our,
+                                     FW_CACHE_LSI, &match) == -1);
+    fail_unless(hipfw_cache_db_match(NULL, &ha2.lsi_peer,
+                                     FW_CACHE_LSI, &match) == 0);
+    fail_unless(match.lsi_peer.s_addr == ha2.lsi_peer.s_addr);
+
+    hipfw_cache_delete_hldb(1);
+}
+END_TEST
+
+START_TEST(test_hipfw_cache_db_match_ip_after_update)
+{
+    struct hip_hadb_user_info_state ha, match;
+    struct in6_addr                 old_ip;
+
+    hipfw_cache_init_hldb();
+    setup_ha(&ha, "2001:10:f039:6bc5:cab3:0727:7fbc:9dcb", "1.0.0.2",
+             "::ffff:192.0.2.2");
+    send_ha_update(&ha);
+    fail_if(hipfw_cache_db_match(&ha.ip_our, &ha.ip_peer, FW_CACHE_IP, NULL));
+
+    // the peer moves to another locator
+    old_ip = ha.ip_peer;
+    inet_pton(AF_INET6, "::ffff:198.51.100.2", &ha.ip_peer);
+    send_ha_update(&ha);
+
+    fail_unless(hipfw_cache_db_match(&ha.ip_our, &old_ip, FW_CACHE_IP,
+                                     &match) == -1);
+    fail_unless(hipfw_cache_db_match(&ha.ip_our, &ha.ip_peer, FW_CACHE_IP,
+                                     &match) == 0);
+    fail_unless(IN6_ARE_ADDR_EQUAL(&match.ip_peer, &ha.ip_peer));
+    fail_if(hipfw_cache_db_match(&ha.lsi_our, &ha.lsi_peer, FW_CACHE_LSI, NULL));
+
+    hipfw_cache_delete_hldb(1);
+}
+END_TEST
+
+START_TEST(test_hipfw_cache_db_match_shared_ip)
+{
+    struct hip_hadb_user_info_state  ha1, ha2, match;
+    struct hip_hadb_user_info_state *moved, *kept;
+    struct in6_addr                  shared_ip;
+
+    // two peer HITs behind the same locator
+    hipfw_cache_init_hldb();
+    setup_ha(&ha1, "2001:10:f039:6bc5:cab3:0727:7fbc:9dcb", "1.0.0.2",
+             "::ffff:192.0.2.2");
+    setup_ha(&ha2, "2001:10:f039:6bc5:cab3:0727:7fbc:9dcc", "1.0.0.3",
+             "::ffff:192.0.2.2");
+    send_ha_update(&ha1);
+    send_ha_update(&ha2);
+    shared_ip = ha1.ip_peer;
+
+    // moving the indexed HA away passes the index entry on to the other one
+    fail_if(hipfw_cache_db_match(&ha1.ip_our, &shared_ip, FW_CACHE_IP, &match));
+    if (IN6_ARE_ADDR_EQUAL(&match.hit_peer, &ha1.hit_peer)) {
+        moved = &ha1;
+        kept  = &ha2;
+    } else {
+        moved = &ha2;
+        kept  = &ha1;
+    }
+    inet_pton(AF_INET6, "::ffff:198.51.100.2", &moved->ip_peer);
+    send_ha_update(moved);
+
+    fail_if(hipfw_cache_db_match(&ha1.ip_our, &shared_ip, FW_CACHE_IP, &match));
+    fail_unless(IN6_ARE_ADDR_EQUAL(&match.hit_peer, &kept->hit_peer));
+
+    hipfw_cache_delete_hldb(1);
+}
+END_TEST
+
+START_TEST(test_hipfw_cache_db_match_copy)
+{
+    struct hip_hadb_user_info_state ha, match;
+    struct in6_addr                 old_ip;
+
+    hipfw_cache_init_hldb();
+    setup_ha(&ha, "2001:10:f039:6bc5:cab3:0727:7fbc:9dcb", "1.0.0.2",
+             "::ffff:192.0.2.2");
+    send_ha_update(&ha);
+    fail_if(hipfw_cache_db_match(&ha.lsi_our, &ha.lsi_peer, FW_CACHE_LSI, &match));
+
+    // later updates of the cache do not change the copy handed out before
+    old_ip = ha.ip_peer;
+    inet_pton(AF_INET6, "::ffff:198.51.100.2", &ha.ip_peer);
+    ha.state = HIP_STATE_CLOSING;
+    send_ha_update(&ha);
+
+    fail_unless(IN6_ARE_ADDR_EQUAL(&match.ip_peer, &old_ip));
+    fail_unless(match.state != HIP_STATE_CLOSING);
+
+    hipfw_cache_delete_hldb(1);
+}
+END_TEST
+
+Suite *firewall_cache(void)
+{
+    Suite *s = suite_create("hipfw/cache");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_hipfw_cache_db_match_lsi);
+    tcase_add_test(tc_core, test_hipfw_cache_db_match_ip_after_update);
+    tcase_add_test(tc_core, test_hipfw_cache_db_match_shared_ip);
+    tcase_add_test(tc_core, test_hipfw_cache_db_match_copy);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -153,6 +153,77 @@ START_TEST(test_hip_fw_conntrack_periodic_cleanup_glitched_packet_time)
 }
 END_TEST
 
+START_TEST(test_hip_fw_conntrack_periodic_cleanup_order)
+{
+    const struct hip_fw_context ctx  = { 0 };
+    struct hip_data             data = { { { { 0 } } } };
+    struct connection          *first, *second;
+
+    mock_time = true;
+
+    cleanup_interval   = 0;
+    connection_timeout = 10;
+
+    mock_time_next = 1;
+    first          = setup_connection();
+    mock_time_next = 2;
+    fail_if(insert_new_connection(&data, &ctx) != 0);
+    second = conn_list->next->data;
+
+    // activity moves the older connection behind the newer one
+    touch_connection(first, 5);
+    fail_unless(conn_list->data == second && conn_list_tail->data == first,
+                "Connections not ordered by activity");
+
+    // activity reported late is still sorted in
+    touch_connection(second, 3);
+    fail_unless(conn_list->data == second && conn_list_tail->data == first,
+                "Connection with older timestamp moved to the tail");
+
+    mock_time_next = 13;
+    hip_fw_conntrack_periodic_cleanup();
+    fail_unless(conn_list && conn_list->data == first && !conn_list->next,
+                "Only the idle connection should have timed out");
+
+    mock_time_next = 15;
+    hip_fw_conntrack_periodic_cleanup();
+    fail_unless(conn_list == NULL && conn_list_tail == NULL,
+                "Idle connection was not removed.");
+}
+END_TEST
+
+START_TEST(test_hip_fw_conntrack_periodic_cleanup_unread_counters)
+{
+    struct in6_addr    dest;
+    struct connection *conn;
+    struct esp_tuple  *esp_tuple;
+
+    mock_time   = true;
+    mock_system = true;
+    mock_popen  = true; // the rule counters cannot be read
+
+    assert(inet_pton(AF_INET6, "3ffe::1", &dest));
+    cleanup_interval   = 0;
+    connection_timeout = 2;
+    mock_time_next     = 1;
+    conn               = setup_connection();
+    esp_tuple          = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+
+    esp_speedup         = 1;
+    hip_userspace_ipsec = 0;
+    conn->original.hook = NF_IP_LOCAL_IN;
+    fail_if(fw_manage_esp_rule(esp_tuple,
+                               hip_ll_get(&esp_tuple->dst_addresses, 0),
+                               true) != 0);
+
+    // the traffic may bypass userspace, so the connection is kept
+    mock_time_next = 3;
+    hip_fw_conntrack_periodic_cleanup();
+    fail_if(conn_list == NULL,
+            "Connection was removed although its rule counter was not read");
+}
+END_TEST
+
 START_TEST(test_parse_iptables_esp_rule)
 {
     struct {
@@ -201,20 +272,115 @@ START_TEST(test_parse_iptables_esp_rule)
 }
 END_TEST
 
-START_TEST(test_fw_manage_esp_rule_not_enabled)
+START_TEST(test_esp_rule_counter_name)
+{
+    char name[NFACCT_NAME_MAX];
+
+    esp_rule_counter_name(0xAABBCCDD, name);
+    fail_if(strcmp(name, "hipfw-AABBCCDD") != 0,
+            "Unexpected counter name %s", name);
+}
+END_TEST
+
+START_TEST(test_fw_manage_esp_rule_ids)
 {
     mock_system = true;
 
-    struct in6_addr dest;
+    struct in6_addr     dest, other;
+    struct esp_address *first, *second;
     assert(inet_pton(AF_INET6, "3ffe::1", &dest));
+    assert(inet_pton(AF_INET6, "::3ffe:0:0:1", &other));
 
     struct connection *const conn      = setup_connection();
     struct esp_tuple  *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
 
+    esp_speedup         = 1;
+    hip_userspace_ipsec = 0;
+    conn->original.hook = NF_IP_LOCAL_IN;
+
+    // addresses that look alike still get rules of their own
+    fail_if(update_esp_address(esp_tuple, &other, NULL) != 0);
+    first  = get_esp_address(&esp_tuple->dst_addresses, &dest);
+    second = get_esp_address(&esp_tuple->dst_addresses, &other);
+    fail_if(fw_manage_esp_rule(esp_tuple, first, true) != 0);
+    fail_if(first->rule_id == 0 || second->rule_id == 0,
+            "Installed rule without id");
+    fail_if(first->rule_id == second->rule_id, "Rules share an id");
+    fail_if(total_esp_rules_count != 2, "Unexpected number of rules");
+
+    // an address is covered by one rule at most
+    fail_if(fw_manage_esp_rule(esp_tuple, first, true) != 0);
+    fail_if(total_esp_rules_count != 2, "Rule was inserted twice");
+
+    fail_if(fw_manage_esp_rule(esp_tuple, first, false) != 0);
+    fail_if(first->rule_id != 0, "Removed rule kept its id");
+    fail_if(fw_manage_esp_rule(esp_tuple, first, false) == 0,
+            "Removed a rule that was not set up");
+    fail_if(total_esp_rules_count != 1, "Unexpected number of rules");
+}
+END_TEST
+
+START_TEST(test_detect_esp_rule_activity_counters)
+{
+    mock_system = true;
+
+    struct in6_addr             dest, other;
+    struct esp_address         *first, *second;
+    struct hipfw_nfacct_counter counter;
+    struct esp_rule_counters    counters = { &counter, 1, 0 };
+    assert(inet_pton(AF_INET6, "3ffe::1", &dest));
+    assert(inet_pton(AF_INET6, "3ffe::2", &other));
+
+    struct connection *const conn      = setup_connection();
+    struct esp_tuple  *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+
+    esp_speedup         = 1;
+    hip_userspace_ipsec = 0;
+    conn->original.hook = NF_IP_LOCAL_IN;
+
+    fail_if(update_esp_address(esp_tuple, &other, NULL) != 0);
+    second = get_esp_address(&esp_tuple->dst_addresses, &other);
+    first  = get_esp_address(&esp_tuple->dst_addresses, &dest);
+    fail_if(fw_manage_esp_rule(esp_tuple, first, true) != 0);
+    fail_if(second->rule_id >= first->rule_id);
+
+    esp_rule_counter_name(second->rule_id, counter.name);
+    counter.packets   = 1;
+    counters.rule_seq = esp_rule_seq;
+    conn->timestamp   = 1;
+
+    // the counter of the first rule is missing
+    fail_if(detect_esp_rule_activity(5, &counters) != -1,
+            "Missing counter not reported");
+    fail_if(conn->timestamp != 5, "Activity not detected");
+
+    // rules set up after the counters were read have no counter yet
+    counters.rule_seq = second->rule_id;
+    fail_if(detect_esp_rule_activity(6, &counters) != 2,
+            "Unexpected number of rules found");
+    fail_if(conn->timestamp != 6, "Activity not detected");
+
+    counters.count = -EIO;
+    fail_if(detect_esp_rule_activity(7, &counters) != -1,
+            "Read error not reported");
+}
+END_TEST
+
+START_TEST(test_fw_manage_esp_rule_not_enabled)
+{
+    mock_system = true;
+
+    struct in6_addr dest;
+    assert(inet_pton(AF_INET6, "3ffe::1", &dest));
+
+    struct connection  *const conn      = setup_connection();
+    struct esp_tuple   *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct esp_address *const esp_addr  = hip_ll_get(&esp_tuple->dst_addresses, 0);
+
     esp_speedup         = 0;
     conn->original.hook = NF_IP_LOCAL_IN;
 
-    fail_if(fw_manage_esp_rule(esp_tuple, &dest, true) == 0,
+    fail_if(fw_manage_esp_rule(esp_tuple, esp_addr, true) == 0,
             "Success, even though esp speedup is disabled");
     fail_if(mock_system_last, "Rule was created even though esp speedup is disabled");
 }
@@ -225,23 +391,24 @@ START_TEST(test_fw_manage_esp_rule_needs_userspace)
     struct in6_addr dest;
     assert(inet_pton(AF_INET6, "3ffe::1", &dest));
 
-    struct connection *const conn      = setup_connection();
-    struct esp_tuple  *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct connection  *const conn      = setup_connection();
+    struct esp_tuple   *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct esp_address *const esp_addr  = hip_ll_get(&esp_tuple->dst_addresses, 0);
 
     esp_speedup         = 1;
     conn->original.hook = NF_IP_LOCAL_IN;
 
     esp_tuple->esp_prot_tfm = ESP_PROT_TFM_PLAIN;
-    fail_if(fw_manage_esp_rule(esp_tuple, &dest, true) == 0,
+    fail_if(fw_manage_esp_rule(esp_tuple, esp_addr, true) == 0,
             "Added rule even though ESP transforms requested");
 
     esp_tuple->esp_prot_tfm     = ESP_PROT_TFM_UNUSED; // reset
     esp_tuple->tuple->esp_relay = 1;
-    fail_if(fw_manage_esp_rule(esp_tuple, &dest, true) == 0,
+    fail_if(fw_manage_esp_rule(esp_tuple, esp_addr, true) == 0,
             "Added rule even though connection is relayed");
 
     hip_userspace_ipsec = 1;
-    fail_if(fw_manage_esp_rule(esp_tuple, &dest, true) == 0,
+    fail_if(fw_manage_esp_rule(esp_tuple, esp_addr, true) == 0,
             "Added rule even though userspace IPSEC requested");
 }
 END_TEST
@@ -257,14 +424,15 @@ START_TEST(test_fw_manage_esp_rule_inet6)
     struct in6_addr dest;
     assert(inet_pton(AF_INET6, "3ffe::1", &dest));
 
-    struct connection *const conn      = setup_connection();
-    struct esp_tuple  *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct connection  *const conn      = setup_connection();
+    struct esp_tuple   *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct esp_address *const esp_addr  = hip_ll_get(&esp_tuple->dst_addresses, 0);
 
     esp_speedup         = 1;
     hip_userspace_ipsec = 0;
     conn->original.hook = NF_IP_LOCAL_IN;
 
-    fail_if(fw_manage_esp_rule(esp_tuple, &dest, true) != 0);
+    fail_if(fw_manage_esp_rule(esp_tuple, esp_addr, true) != 0);
     fail_if(strcmp(mock_system_last, expected) != 0, "Unexpected rule was generated");
 }
 END_TEST
@@ -280,14 +448,15 @@ START_TEST(test_fw_manage_esp_rule_inet4)
     struct in6_addr dest;
     assert(inet_pton(AF_INET6, "::ffff:192.168.1.1", &dest));
 
-    struct connection *const conn      = setup_connection();
-    struct esp_tuple  *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct connection  *const conn      = setup_connection();
+    struct esp_tuple   *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct esp_address *const esp_addr  = hip_ll_get(&esp_tuple->dst_addresses, 0);
 
     esp_speedup         = 1;
     hip_userspace_ipsec = 0;
     conn->original.hook = NF_IP_FORWARD;
 
-    fail_if(fw_manage_esp_rule(esp_tuple, &dest, true) != 0);
+    fail_if(fw_manage_esp_rule(esp_tuple, esp_addr, true) != 0);
     fail_if(strcmp(mock_system_last, expected) != 0, "Unexpected rule was generated");
 }
 END_TEST
@@ -304,21 +473,166 @@ START_TEST(test_fw_manage_esp_rule_inet4_udp)
     struct in6_addr dest;
     assert(inet_pton(AF_INET6, "::ffff:192.168.1.1", &dest));
 
-    struct connection *const conn      = setup_connection();
-    struct esp_tuple  *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct connection  *const conn      = setup_connection();
+    struct esp_tuple   *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct esp_address *const esp_addr  = hip_ll_get(&esp_tuple->dst_addresses, 0);
 
     esp_speedup         = 1;
     hip_userspace_ipsec = 0;
     conn->original.hook = NF_IP_LOCAL_OUT;
     conn->udp_encap     = true;
 
-    fail_if(fw_manage_esp_rule(esp_tuple, &dest, true) != 0,
+    fail_if(fw_manage_esp_rule(esp_tuple, esp_addr, true) != 0,
             "Adding an iptables rule failed");
     fail_if(!mock_system_last, "No iptables command was executed");
     fail_if(strcmp(mock_system_last, expected) != 0, "Unexpected rule was generated");
 }
 END_TEST
 
+START_TEST(test_get_tuple_by_esp_index)
+{
+    struct in6_addr dest, other;
+    assert(inet_pton(AF_INET6, "3ffe::1", &dest));
+    assert(inet_pton(AF_INET6, "3ffe::2", &other));
+
+    struct connection *const conn = setup_connection();
+    setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    setup_esp_tuple(0x11223344, &other, conn);
+
+    fail_unless(get_tuple_by_esp(&dest, 0xAABBCCDD) == &conn->original,
+                "ESP tuple not found by SPI and destination");
+    fail_unless(get_tuple_by_esp(&other, 0x11223344) == &conn->original,
+                "Second ESP tuple not found by SPI and destination");
+    fail_unless(get_tuple_by_esp(&other, 0xAABBCCDD) == NULL,
+                "ESP tuple found for wrong destination");
+    fail_unless(get_tuple_by_esp(NULL, 0x11223344) == &conn->original,
+                "ESP tuple not found by SPI only");
+
+    remove_connection(conn);
+    fail_unless(get_tuple_by_esp(&dest, 0xAABBCCDD) == NULL,
+                "Removed ESP tuple still indexed");
+}
+END_TEST
+
+START_TEST(test_get_tuple_by_esp_spi_update)
+{
+    struct in6_addr dest;
+    assert(inet_pton(AF_INET6, "3ffe::1", &dest));
+
+    struct connection *const conn      = setup_connection();
+    struct esp_tuple *const  esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+
+    set_esp_tuple_spi(esp_tuple, 0x11223344);
+
+    fail_unless(get_tuple_by_esp(&dest, 0xAABBCCDD) == NULL,
+                "ESP tuple found by old SPI");
+    fail_unless(get_tuple_by_esp(&dest, 0x11223344) == &conn->original,
+                "ESP tuple not found by new SPI");
+}
+END_TEST
+
+START_TEST(test_set_esp_tuple_spi_rules)
+{
+    mock_system = true;
+
+    struct in6_addr dest;
+    uint32_t        old_rule;
+    assert(inet_pton(AF_INET6, "3ffe::1", &dest));
+
+    struct connection  *const conn      = setup_connection();
+    struct esp_tuple   *const esp_tuple = setup_esp_tuple(0xAABBCCDD, &dest, conn);
+    struct esp_address *const esp_addr  = hip_ll_get(&esp_tuple->dst_addresses, 0);
+
+    esp_speedup         = 1;
+    hip_userspace_ipsec = 0;
+    conn->original.hook = NF_IP_LOCAL_IN;
+    fail_if(fw_manage_esp_rule(esp_tuple, esp_addr, true) != 0);
+    old_rule = esp_addr->rule_id;
+
+    // the rule for the old SPI is replaced
+    set_esp_tuple_spi(esp_tuple, 0x11223344);
+    fail_if(esp_addr->rule_id == 0 || esp_addr->rule_id == old_rule,
+            "Rule for the new SPI not set up");
+    fail_if(total_esp_rules_count != 1, "Rule for the old SPI not removed");
+    fail_if(!strstr(mock_system_last, "-I HIPFW-INPUT") ||
+            !strstr(mock_system_last, "0x11223344"),
+            "Unexpected rule: %s", mock_system_last);
+}
+END_TEST
+
+START_TEST(test_get_tuple_by_esp_duplicate_key)
+{
+    const struct hip_fw_context ctx  = { 0 };
+    struct hip_data             data = { { { { 0 } } } };
+    struct connection          *first, *second;
+    struct in6_addr             dest;
+
+    assert(inet_pton(AF_INET6, "3ffe::1", &dest));
+
+    first = setup_connection();
+    setup_esp_tuple(0xAABBCCDD, &dest, first);
+    fail_if(insert_new_connection(&data, &ctx) != 0);
+    second = conn_list->next->data;
+    setup_esp_tuple(0xAABBCCDD, &dest, second);
+
+    fail_unless(get_tuple_by_esp(&dest, 0xAABBCCDD) == &first->original,
+                "Older ESP tuple lost precedence");
+
+    remove_connection(first);
+    fail_unless(get_tuple_by_esp(&dest, 0xAABBCCDD) == &second->original,
+                "Remaining ESP tuple not found after removing duplicate");
+
+    remove_connection(second);
+    fail_unless(get_tuple_by_esp(&dest, 0xAABBCCDD) == NULL,
+                "Removed ESP tuple still indexed");
+}
+END_TEST
+
+START_TEST(test_get_tuple_by_hits)
+{
+    struct connection *const conn    = setup_connection();
+    const struct in6_addr    src_hit = conn->original.hip_tuple->data->src_hit;
+    const struct in6_addr    dst_hit = conn->original.hip_tuple->data->dst_hit;
+
+    fail_unless(get_tuple_by_hits(&src_hit, &dst_hit) == &conn->original,
+                "Original direction tuple not found");
+    fail_unless(get_tuple_by_hits(&dst_hit, &src_hit) == &conn->reply,
+                "Reply direction tuple not found");
+
+    remove_connection(conn);
+    fail_unless(get_tuple_by_hits(&src_hit, &dst_hit) == NULL,
+                "Removed HIP tuple still indexed");
+}
+END_TEST
+
+START_TEST(test_update_peer_opp_info)
+{
+    const struct hip_fw_context ctx  = { 0 };
+    struct hip_data             data = { { { { 0 } } } };
+    struct hip_data             r1   = { { { { 0 } } } };
+    struct in6_addr             peer_ip, phit;
+
+    assert(inet_pton(AF_INET6, "3ffe::1", &peer_ip));
+    hip_opportunistic_ipv6_to_hit(&peer_ip, &phit, HIP_HIT_TYPE_HASH100);
+
+    inet_pton(AF_INET6, "2001:12:bd2d:d23e:4a09:b2ab:6414:e110", &data.src_hit);
+    data.dst_hit = phit;
+    fail_if(insert_new_connection(&data, &ctx) != 0);
+
+    // R1 from the real peer HIT to the initiator
+    inet_pton(AF_INET6, "2001:10:f039:6bc5:cab3:0727:7fbc:9dcb", &r1.src_hit);
+    r1.dst_hit = data.src_hit;
+    update_peer_opp_info(&r1, &peer_ip);
+
+    fail_unless(get_tuple_by_hits(&data.src_hit, &phit) == NULL,
+                "Tuple still found by pseudo HIT");
+    fail_unless(get_tuple_by_hits(&data.src_hit, &r1.src_hit) != NULL,
+                "Original direction tuple not found by real HIT");
+    fail_unless(get_tuple_by_hits(&r1.src_hit, &data.src_hit) != NULL,
+                "Reply direction tuple not found by real HIT");
+}
+END_TEST
+
 Suite *firewall_conntrack(void)
 {
     Suite *s = suite_create("hipfw/conntrack");
@@ -326,13 +640,24 @@ Suite *firewall_conntrack(void)
     TCase *tc_conntrack = tcase_create("Conntrack");
     tcase_add_test(tc_conntrack, test_hip_fw_conntrack_periodic_cleanup_timeout);
     tcase_add_test(tc_conntrack, test_parse_iptables_esp_rule);
+    tcase_add_test(tc_conntrack, test_esp_rule_counter_name);
     tcase_add_test(tc_conntrack, test_hip_fw_conntrack_periodic_cleanup_glitched_system_time);
     tcase_add_test(tc_conntrack, test_hip_fw_conntrack_periodic_cleanup_glitched_packet_time);
+    tcase_add_test(tc_conntrack, test_hip_fw_conntrack_periodic_cleanup_order);
+    tcase_add_test(tc_conntrack, test_hip_fw_conntrack_periodic_cleanup_unread_counters);
     tcase_add_test(tc_conntrack, test_fw_manage_esp_rule_not_enabled);
     tcase_add_test(tc_conntrack, test_fw_manage_esp_rule_needs_userspace);
     tcase_add_test(tc_conntrack, test_fw_manage_esp_rule_inet6);
     tcase_add_test(tc_conntrack, test_fw_manage_esp_rule_inet4);
     tcase_add_test(tc_conntrack, test_fw_manage_esp_rule_inet4_udp);
+    tcase_add_test(tc_conntrack, test_fw_manage_esp_rule_ids);
+    tcase_add_test(tc_conntrack, test_detect_esp_rule_activity_counters);
+    tcase_add_test(tc_conntrack, test_get_tuple_by_esp_index);
+    tcase_add_test(tc_conntrack, test_get_tuple_by_esp_spi_update);
+    tcase_add_test(tc_conntrack, test_set_esp_tuple_spi_rules);
+    tcase_add_test(tc_conntrack, test_get_tuple_by_esp_duplicate_key);
+    tcase_add_test(tc_conntrack, test_get_tuple_by_hits);
+    tcase_add_test(tc_conntrack, test_update_peer_opp_info);
     suite_add_tcase(s, tc_conntrack);
 
     return s;
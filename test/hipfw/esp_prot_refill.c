@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _BSD_SOURCE
+
+#include <check.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <openssl/sha.h>
+
+#include "libcore/hashchain.h"
+#include "libcore/hashchain_store.h"
+#include "hipfw/esp_prot_refill.h"
+#include "test_suites.h"
+
+#define ITEMS_PER_SHELF 4
+#define HCHAIN_LENGTH   16
+
+static struct hchain_store store;
+static struct hchain_store *const stores[] = { &store };
+
+static void setup(void)
+{
+    int function_id, hash_length_id;
+
+    hcstore_init(&store, ITEMS_PER_SHELF, 0.5);
+    function_id    = hcstore_register_function(&store, (hash_function) SHA1);
+    hash_length_id = hcstore_register_hash_length(&store, function_id, 20);
+    hcstore_register_hash_item_length(&store, function_id, hash_length_id,
+                                      HCHAIN_LENGTH);
+    hcstore_register_hash_item_hierarchy(&store, function_id, hash_length_id,
+                                         HCHAIN_LENGTH, 1);
+    fail_unless(hcstore_refill(&store, 0) == ITEMS_PER_SHELF);
+    fail_if(esp_prot_refill_init(stores, 1, 0));
+}
+
+static void teardown(void)
+{
+    esp_prot_refill_uninit();
+    hcstore_uninit(&store, 0);
+}
+
+static void take_items(const int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        hchain_free(hcstore_get_hash_item(&store, 0, 0, HCHAIN_LENGTH));
+    }
+}
+
+/* collects for up to five seconds until @a count items have been added */
+static int collect_items(const int count)
+{
+    int added = 0, i;
+
+    for (i = 0; i < 500 && added < count; i++) {
+        added += esp_prot_refill_collect(&store);
+        usleep(10000);
+    }
+
+    return added;
+}
+
+START_TEST(test_esp_prot_refill_low_watermark)
+{
+    take_items(3);
+    fail_unless(esp_prot_refill_collect(&store) == 0);
+
+    fail_unless(collect_items(3) == 3);
+    fail_unless(hip_ll_get_size(&store.hchain_shelves[0][0].hchains[0][0])
+                == ITEMS_PER_SHELF);
+
+    // the store is full, nothing more is handed over
+    usleep(50000);
+    fail_unless(esp_prot_refill_collect(&store) == 0);
+}
+END_TEST
+
+START_TEST(test_esp_prot_refill_above_watermark)
+{
+    take_items(1);
+    fail_unless(esp_prot_refill_collect(&store) == 0);
+
+    usleep(50000);
+    fail_if(esp_prot_refill_ready());
+}
+END_TEST
+
+Suite *firewall_esp_prot_refill(void)
+{
+    Suite *s = suite_create("hipfw/esp_prot_refill");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_esp_prot_refill_low_watermark);
+    tcase_add_test(tc_core, test_esp_prot_refill_above_watermark);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
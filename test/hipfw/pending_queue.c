@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hipfw/hipfw_defines.h"
+#include "hipfw/pending_queue.h"
+#include "test_suites.h"
+
+static struct in6_addr local;
+static struct in6_addr peer;
+
+static unsigned char released[16];
+static unsigned int  released_count;
+
+static void setup(void)
+{
+    inet_pton(AF_INET6, "2001:12:bd2d:d23e:4a09:b2ab:6414:e110", &local);
+    inet_pton(AF_INET6, "2001:1d:d78c:5683:5fe2:cc3:2a0d:e5b9", &peer);
+    released_count = 0;
+
+    fail_if(hipfw_pending_init());
+}
+
+static void teardown(void)
+{
+    hipfw_pending_uninit();
+    pending_queue_len     = 16;
+    pending_queue_size    = 1024 * 1024;
+    pending_queue_timeout = 10;
+}
+
+/* remembers the first byte of each released packet */
+static void record_packet(const hip_ipq_packet_msg *packet, void *arg)
+{
+    fail_unless(arg == &released_count);
+    fail_unless(packet->data_len == 1);
+    released[released_count++] = packet->payload[0];
+}
+
+static int enqueue(const unsigned char id)
+{
+    unsigned char      data = id;
+    hip_ipq_packet_msg msg  = { 0 };
+
+    msg.data_len = sizeof(data);
+    msg.payload  = &data;
+
+    return hipfw_pending_enqueue(&local, &peer, &msg);
+}
+
+START_TEST(test_hipfw_pending_flush_in_order)
+{
+    fail_unless(enqueue(1) == 1);
+    fail_unless(enqueue(2) == 0);
+    fail_unless(enqueue(3) == 0);
+
+    // other pairs are not released
+    fail_unless(hipfw_pending_flush(&peer, &local, record_packet,
+                                    &released_count) == 0);
+
+    fail_unless(hipfw_pending_flush(&local, &peer, record_packet,
+                                    &released_count) == 3);
+    fail_unless(released[0] == 1 && released[1] == 2 && released[2] == 3);
+
+    // the queue is gone, so the next packet triggers a new base exchange
+    fail_unless(hipfw_pending_flush(&local, &peer, record_packet,
+                                    &released_count) == 0);
+    fail_unless(enqueue(4) == 1);
+}
+END_TEST
+
+START_TEST(test_hipfw_pending_len_drops_oldest)
+{
+    pending_queue_len = 2;
+
+    fail_unless(enqueue(1) == 1);
+    fail_unless(enqueue(2) == 0);
+    fail_unless(enqueue(3) == 0);
+
+    fail_unless(hipfw_pending_flush(&local, &peer, record_packet,
+                                    &released_count) == 2);
+    fail_unless(released[0] == 2 && released[1] == 3);
+}
+END_TEST
+
+START_TEST(test_hipfw_pending_retrigger_after_timeout)
+{
+    pending_queue_timeout = 1;
+
+    fail_unless(enqueue(1) == 1);
+    fail_unless(enqueue(2) == 0);
+
+    // the base exchange failed, the next packet triggers another one
+    sleep(1);
+    fail_unless(enqueue(3) == 1);
+    fail_unless(enqueue(4) == 0);
+
+    fail_unless(hipfw_pending_flush(&local, &peer, record_packet,
+                                    &released_count) == 2);
+    fail_unless(released[0] == 3 && released[1] == 4);
+}
+END_TEST
+
+START_TEST(test_hipfw_pending_size_limit)
+{
+    pending_queue_size = 0;
+
+    fail_unless(enqueue(1) == -1);
+    fail_unless(hipfw_pending_flush(&local, &peer, record_packet,
+                                    &released_count) == 0);
+}
+END_TEST
+
+START_TEST(test_hipfw_pending_disabled)
+{
+    pending_queue_len = 0;
+
+    fail_unless(enqueue(1) == -1);
+    fail_unless(enqueue(2) == -1);
+}
+END_TEST
+
+Suite *firewall_pending_queue(void)
+{
+    Suite *s = suite_create("hipfw/pending_queue");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_hipfw_pending_flush_in_order);
+    tcase_add_test(tc_core, test_hipfw_pending_len_drops_oldest);
+    tcase_add_test(tc_core, test_hipfw_pending_retrigger_after_timeout);
+    tcase_add_test(tc_core, test_hipfw_pending_size_limit);
+    tcase_add_test(tc_core, test_hipfw_pending_disabled);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
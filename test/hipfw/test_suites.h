@@ -28,11 +28,16 @@
 
 #include <check.h>
 
+Suite *firewall_cache(void);
 Suite *firewall_conntrack(void);
+Suite *firewall_esp_prot_refill(void);
 Suite *firewall_file_buffer(void);
 Suite *firewall_helpers(void);
 Suite *firewall_line_parser(void);
 Suite *firewall_midauth(void);
+Suite *firewall_pending_queue(void);
 Suite *firewall_port_bindings(void);
+Suite *firewall_user_ipsec_esp(void);
+Suite *firewall_user_ipsec_replay(void);
 
 #endif /* HIPL_TEST_FIREWALL_TEST_SUITES_H */
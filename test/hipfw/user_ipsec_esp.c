@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <openssl/evp.h>
+
+#include "config.h"
+#include "libcore/common.h"
+#include "libcore/protodefs.h"
+#include "hipfw/user_ipsec_esp.c"
+#include "hipfw/user_ipsec_sadb.c"
+#include "test_suites.h"
+
+#define PAYLOAD_LEN 37
+
+static struct hip_crypto_key auth_key;
+static struct hip_crypto_key enc_key;
+static struct hip_sa_entry   out_entry;
+static struct hip_sa_entry   in_entry;
+static const unsigned char   payload[PAYLOAD_LEN] = "AEAD test payload, not block aligned";
+/* leaves room for the padding and the ESP tail */
+static unsigned char plaintext[PAYLOAD_LEN + 16];
+static unsigned char decrypted[sizeof(plaintext)];
+static unsigned char packet[sizeof(struct hip_esp) + AEAD_IV_LENGTH +
+                            sizeof(plaintext) + AEAD_ICV_LENGTH];
+static uint16_t      packet_len;
+
+static void init_entry(struct hip_sa_entry *const entry, const int direction,
+                       const int ealg)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->direction = direction;
+    entry->ealg      = ealg;
+    fail_unless((entry->auth_key = malloc(sizeof(*entry->auth_key))) != NULL);
+    fail_unless((entry->enc_key = malloc(sizeof(*entry->enc_key))) != NULL);
+    memcpy(entry->auth_key, &auth_key, sizeof(auth_key));
+    memcpy(entry->enc_key, &enc_key, sizeof(enc_key));
+    fail_unless(aead_ctx_init(entry, direction) == 0);
+}
+
+/* encrypts the payload into ::packet with the outbound SA */
+static void encrypt_packet(void)
+{
+    struct hip_esp *const esp = (struct hip_esp *) packet;
+
+    esp->esp_spi = htonl(0x1234);
+    esp->esp_seq = htonl(1);
+    memcpy(plaintext, payload, PAYLOAD_LEN);
+    packet_len = 0;
+    fail_unless(aead_encrypt(plaintext, IPPROTO_TCP, PAYLOAD_LEN, packet,
+                             &packet_len, &out_entry) == 0);
+    packet_len += sizeof(struct hip_esp);
+}
+
+/* decrypts ::packet with the inbound SA */
+static int decrypt_packet(void)
+{
+    uint8_t  type = 0;
+    uint16_t len  = 0;
+    int      err;
+
+    memset(decrypted, 0, sizeof(decrypted));
+    if (!(err = aead_decrypt(packet, packet_len, decrypted, &type, &len,
+                             &in_entry))) {
+        fail_unless(type == IPPROTO_TCP);
+        fail_unless(len == PAYLOAD_LEN);
+        fail_unless(!memcmp(decrypted, payload, PAYLOAD_LEN));
+    }
+    return err;
+}
+
+static void setup(const int ealg)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(auth_key.key); i++) {
+        auth_key.key[i] = i;
+        enc_key.key[i]  = 0xff - i;
+    }
+    init_entry(&out_entry, HIP_SPI_DIRECTION_OUT, ealg);
+    init_entry(&in_entry, HIP_SPI_DIRECTION_IN, ealg);
+}
+
+static void teardown(void)
+{
+    sa_entry_free(&out_entry);
+    sa_entry_free(&in_entry);
+}
+
+#ifdef HAVE_EVP_AES_GCM
+static void setup_aes_gcm(void)
+{
+    setup(HIP_ESP_AES_GCM);
+}
+
+START_TEST(test_aead_nonce)
+{
+    const unsigned char *const iv         = &packet[sizeof(struct hip_esp)];
+    const unsigned char *const ciphertext = iv + AEAD_IV_LENGTH;
+    const uint64_t             counter    = out_entry.aead_iv;
+    uint16_t                   elen;
+    unsigned char              nonce[AEAD_NONCE_LENGTH];
+    unsigned char              expected[sizeof(plaintext)];
+    unsigned char              icv[AEAD_ICV_LENGTH];
+    EVP_CIPHER_CTX            *ctx;
+    int                        len;
+
+    encrypt_packet();
+    elen = packet_len - sizeof(struct hip_esp) - AEAD_IV_LENGTH - AEAD_ICV_LENGTH;
+
+    // the explicit IV is the big-endian counter of the SA
+    fail_unless(out_entry.aead_iv == counter + 1);
+    fail_unless(ntohl(((const uint32_t *) iv)[0]) == (uint32_t) (counter >> 32));
+    fail_unless(ntohl(((const uint32_t *) iv)[1]) == (uint32_t) counter);
+
+    // the nonce is the salt from the authentication key followed by the IV
+    memcpy(nonce, auth_key.key, AEAD_SALT_LENGTH);
+    memcpy(&nonce[AEAD_SALT_LENGTH], iv, AEAD_IV_LENGTH);
+    fail_unless((ctx = EVP_CIPHER_CTX_new()) != NULL);
+    fail_unless(EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, NULL, NULL) == 1);
+    fail_unless(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN,
+                                    AEAD_NONCE_LENGTH, NULL) == 1);
+    fail_unless(EVP_EncryptInit_ex(ctx, NULL, NULL, enc_key.key, nonce) == 1);
+    fail_unless(EVP_EncryptUpdate(ctx, NULL, &len, packet,
+                                  sizeof(struct hip_esp)) == 1);
+    fail_unless(EVP_EncryptUpdate(ctx, expected, &len, plaintext, elen) == 1);
+    fail_unless(EVP_EncryptFinal_ex(ctx, expected + len, &len) == 1);
+    fail_unless(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG,
+                                    AEAD_ICV_LENGTH, icv) == 1);
+    EVP_CIPHER_CTX_free(ctx);
+
+    fail_unless(!memcmp(ciphertext, expected, elen));
+    fail_unless(!memcmp(ciphertext + elen, icv, AEAD_ICV_LENGTH));
+
+    fail_unless(decrypt_packet() == 0);
+
+    // the next packet uses the next IV
+    encrypt_packet();
+    fail_unless(ntohl(((const uint32_t *) iv)[1]) == (uint32_t) (counter + 1));
+    fail_unless(decrypt_packet() == 0);
+}
+END_TEST
+
+START_TEST(test_aead_tampered_ciphertext)
+{
+    encrypt_packet();
+    packet[sizeof(struct hip_esp) + AEAD_IV_LENGTH] ^= 1;
+    fail_unless(decrypt_packet() == 1);
+}
+END_TEST
+
+START_TEST(test_aead_tampered_header)
+{
+    // the ESP header is authenticated as additional data
+    encrypt_packet();
+    packet[sizeof(uint32_t)] ^= 1;
+    fail_unless(decrypt_packet() == 1);
+}
+END_TEST
+
+START_TEST(test_aead_tampered_iv)
+{
+    encrypt_packet();
+    packet[sizeof(struct hip_esp)] ^= 1;
+    fail_unless(decrypt_packet() == 1);
+}
+END_TEST
+
+START_TEST(test_aead_tampered_icv)
+{
+    encrypt_packet();
+    packet[packet_len - 1] ^= 1;
+    fail_unless(decrypt_packet() == 1);
+}
+END_TEST
+
+START_TEST(test_aead_update_to_non_aead)
+{
+    fail_unless(sa_entry_set(&out_entry, HIP_SPI_DIRECTION_OUT, 0x1234, 1,
+                             &in6addr_loopback, &in6addr_loopback, NULL, NULL,
+                             0, 0, 0, HIP_ESP_AES_SHA1, &auth_key, &enc_key,
+                             0, ESP_PROT_TFM_UNUSED, 0, 0, NULL, 1) == 0);
+    fail_unless(out_entry.aead_ctx == NULL);
+
+    // switching back sets up the AEAD context even though the keys are equal
+    fail_unless(sa_entry_set(&out_entry, HIP_SPI_DIRECTION_OUT, 0x1234, 1,
+                             &in6addr_loopback, &in6addr_loopback, NULL, NULL,
+                             0, 0, 0, HIP_ESP_AES_GCM, &auth_key, &enc_key,
+                             0, ESP_PROT_TFM_UNUSED, 0, 0, NULL, 1) == 0);
+    fail_unless(out_entry.aead_ctx != NULL);
+    encrypt_packet();
+    fail_unless(decrypt_packet() == 0);
+}
+END_TEST
+#endif /* HAVE_EVP_AES_GCM */
+
+#ifdef HAVE_EVP_CHACHA20_POLY1305
+static void setup_chacha20_poly1305(void)
+{
+    setup(HIP_ESP_CHACHA20_POLY1305);
+}
+
+START_TEST(test_aead_chacha20_poly1305)
+{
+    encrypt_packet();
+    fail_unless(decrypt_packet() == 0);
+
+    packet[sizeof(uint32_t)] ^= 1;
+    fail_unless(decrypt_packet() == 1);
+}
+END_TEST
+#endif /* HAVE_EVP_CHACHA20_POLY1305 */
+
+Suite *firewall_user_ipsec_esp(void)
+{
+    Suite *s = suite_create("hipfw/user_ipsec_esp");
+
+#ifdef HAVE_EVP_AES_GCM
+    TCase *tc_aes_gcm = tcase_create("AES-GCM");
+    tcase_add_checked_fixture(tc_aes_gcm, setup_aes_gcm, teardown);
+    tcase_add_test(tc_aes_gcm, test_aead_nonce);
+    tcase_add_test(tc_aes_gcm, test_aead_tampered_ciphertext);
+    tcase_add_test(tc_aes_gcm, test_aead_tampered_header);
+    tcase_add_test(tc_aes_gcm, test_aead_tampered_iv);
+    tcase_add_test(tc_aes_gcm, test_aead_tampered_icv);
+    tcase_add_test(tc_aes_gcm, test_aead_update_to_non_aead);
+    suite_add_tcase(s, tc_aes_gcm);
+#endif /* HAVE_EVP_AES_GCM */
+
+#ifdef HAVE_EVP_CHACHA20_POLY1305
+    TCase *tc_chacha = tcase_create("ChaCha20-Poly1305");
+    tcase_add_checked_fixture(tc_chacha, setup_chacha20_poly1305, teardown);
+    tcase_add_test(tc_chacha, test_aead_chacha20_poly1305);
+    suite_add_tcase(s, tc_chacha);
+#endif /* HAVE_EVP_CHACHA20_POLY1305 */
+
+    return s;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hipfw/user_ipsec_replay.h"
+#include "test_suites.h"
+
+static struct hip_replay_window window;
+
+static void setup(void)
+{
+    hip_replay_init(&window);
+}
+
+/* checks a sequence number and records it if it is accepted */
+static int receive(const uint32_t seq)
+{
+    uint64_t esn;
+
+    if (hip_replay_check(&window, seq, &esn)) {
+        return -1;
+    }
+    hip_replay_update(&window, esn);
+    return 0;
+}
+
+START_TEST(test_hip_replay_duplicates)
+{
+    fail_unless(receive(0) == -1);
+    fail_unless(receive(1) == 0);
+    fail_unless(receive(1) == -1);
+    fail_unless(receive(3) == 0);
+    fail_unless(receive(2) == 0);
+    fail_unless(receive(2) == -1);
+    fail_unless(receive(3) == -1);
+}
+END_TEST
+
+START_TEST(test_hip_replay_window_edge)
+{
+    const uint32_t top = 10 * HIP_REPLAY_WINDOW_SIZE;
+    const uint32_t win = HIP_REPLAY_WINDOW_SIZE - 64;
+
+    fail_unless(receive(top) == 0);
+    fail_unless(receive(top - win + 1) == 0);
+    fail_unless(receive(top - win) == -1);
+
+    // a large jump forgets everything behind the new window
+    fail_unless(receive(top + 5 * HIP_REPLAY_WINDOW_SIZE) == 0);
+    fail_unless(receive(top) == -1);
+    fail_unless(receive(top + 5 * HIP_REPLAY_WINDOW_SIZE - 1) == 0);
+}
+END_TEST
+
+START_TEST(test_hip_replay_unauthenticated)
+{
+    uint64_t esn;
+
+    // a checked packet that fails authentication does not move the window
+    fail_unless(receive(100) == 0);
+    fail_unless(hip_replay_check(&window, 5000, &esn) == 0);
+    fail_unless(receive(99) == 0);
+    fail_unless(receive(5000) == 0);
+}
+END_TEST
+
+START_TEST(test_hip_replay_esn_wrap)
+{
+    uint64_t esn;
+
+    // sequence numbers more than 2^31 ahead are not accepted
+    fail_unless(receive(UINT32_MAX - 1) == -1);
+    fail_unless(receive(INT32_MAX) == 0);
+    fail_unless(receive(UINT32_MAX - 1) == 0);
+    fail_unless(receive(2) == 0);
+    fail_unless(window.top == (UINT64_C(1) << 32) + 2);
+
+    // late packets from before the wrap are mapped to the old subspace
+    fail_unless(hip_replay_check(&window, UINT32_MAX, &esn) == 0);
+    fail_unless(esn == UINT32_MAX);
+    hip_replay_update(&window, esn);
+    fail_unless(receive(UINT32_MAX) == -1);
+    fail_unless(receive(UINT32_MAX - 1) == -1);
+    fail_unless(receive(0) == 0);
+    fail_unless(receive(2) == -1);
+}
+END_TEST
+
+Suite *firewall_user_ipsec_replay(void)
+{
+    Suite *s = suite_create("hipfw/user_ipsec_replay");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, NULL);
+    tcase_add_test(tc_core, test_hip_replay_duplicates);
+    tcase_add_test(tc_core, test_hip_replay_window_edge);
+    tcase_add_test(tc_core, test_hip_replay_unauthenticated);
+    tcase_add_test(tc_core, test_hip_replay_esn_wrap);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -233,6 +233,46 @@ START_TEST(test_ipv6_checksum_hipv2)
 }
 END_TEST
 
+START_TEST(test_checksum_split_packet)
+{
+    struct hip_common  *i1 = NULL;
+    hip_hit_t           src_hit, dst_hit;
+    struct sockaddr_in6 src_addr = { 0 }, dst_addr = { 0 };
+    struct iovec        iov[2];
+    uint8_t             dh_group[] = { HIP_DH_OAKLEY_5 };
+    uint16_t            checksum;
+
+    fail_unless((i1 = hip_msg_alloc()) != NULL);
+    fail_unless(inet_pton(AF_INET6, src_hit_test_str_v2, &src_hit) == 1);
+    fail_unless(inet_pton(AF_INET6, dst_hit_test_str_v2, &dst_hit) == 1);
+    src_addr.sin6_family = AF_INET6;
+    dst_addr.sin6_family = AF_INET6;
+    fail_unless(inet_pton(AF_INET6, src_ipv6_test_bis_str, &src_addr.sin6_addr) == 1);
+    fail_unless(inet_pton(AF_INET6, dst_ipv6_test_bis_str, &dst_addr.sin6_addr) == 1);
+
+    hip_build_network_hdr(i1, HIP_I1, 0, &src_hit, &dst_hit, HIP_V2);
+    hip_calc_hdr_len(i1);
+    fail_unless(hip_build_param_list(i1, HIP_PARAM_DH_GROUP_LIST, dh_group,
+                                     sizeof(dh_group), sizeof(uint8_t)) == 0);
+    hip_zero_msg_checksum(i1);
+
+    checksum = hip_checksum_packet((char *) i1,
+                                   (struct sockaddr *) &src_addr,
+                                   (struct sockaddr *) &dst_addr);
+
+    // header and parameters in separate buffers give the same checksum
+    iov[0].iov_base = i1;
+    iov[0].iov_len  = sizeof(struct hip_common);
+    iov[1].iov_base = i1 + 1;
+    iov[1].iov_len  = hip_get_msg_total_len(i1) - sizeof(struct hip_common);
+    fail_unless(hip_checksum_packet_iov(iov, 2,
+                                        (struct sockaddr *) &src_addr,
+                                        (struct sockaddr *) &dst_addr) == checksum);
+
+    free(i1);
+}
+END_TEST
+
 Suite *libcore_gpl_checksum(void)
 {
     Suite *s = suite_create("libcore/checksum");
@@ -243,6 +283,7 @@ Suite *libcore_gpl_checksum(void)
     tcase_add_test(tc_core, test_ipv6_checksum_hipv1);
     tcase_add_test(tc_core, test_ipv4_checksum_hipv2);
     tcase_add_test(tc_core, test_ipv6_checksum_hipv2);
+    tcase_add_test(tc_core, test_checksum_split_packet);
     suite_add_tcase(s, tc_core);
 
     return s;
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/sha.h>
+
+#include "libcore/hash_mb.h"
+#include "libcore/hashtree.h"
+#include "test_suites.h"
+
+#define NUM_MESSAGES 19
+#define MAX_LENGTH   200
+
+static enum hash_mb_engine default_engine;
+
+static void setup(void)
+{
+    default_engine = hash_mb_get_engine();
+}
+
+static void teardown(void)
+{
+    hash_mb_set_engine(default_engine);
+}
+
+START_TEST(test_hash_mb_sha1)
+{
+    static unsigned char messages[NUM_MESSAGES][MAX_LENGTH];
+    unsigned char        digests[NUM_MESSAGES][SHA_DIGEST_LENGTH];
+    unsigned char        expected[SHA_DIGEST_LENGTH];
+    const unsigned char *data[NUM_MESSAGES];
+    unsigned char       *out[NUM_MESSAGES];
+    const int            engines[] = { HASH_MB_SCALAR, HASH_MB_SSE2,
+                                       HASH_MB_AVX2 };
+    unsigned             e, i, num, length;
+
+    for (i = 0; i < NUM_MESSAGES; i++) {
+        for (length = 0; length < MAX_LENGTH; length++) {
+            messages[i][length] = random();
+        }
+        data[i] = messages[i];
+        out[i]  = digests[i];
+    }
+
+    for (e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        if (hash_mb_set_engine(engines[e])) {
+            continue;
+        }
+
+        // cover all padding cases and partially filled lanes
+        for (length = 0; length < MAX_LENGTH; length++) {
+            for (num = 1; num <= NUM_MESSAGES; num += 3) {
+                fail_unless(hash_mb_sha1(data, length, out, num) == 0);
+
+                for (i = 0; i < num; i++) {
+                    SHA1(messages[i], length, expected);
+                    fail_unless(memcmp(digests[i], expected,
+                                       SHA_DIGEST_LENGTH) == 0);
+                }
+            }
+        }
+    }
+}
+END_TEST
+
+/* wrappers that hide the default generators from htree_calc_nodes() */
+static int leaf_generator(const unsigned char *data,
+                          const int data_length,
+                          const unsigned char *secret,
+                          const int secret_length,
+                          unsigned char *dst_buffer,
+                          const struct htree_gen_args *gen_args)
+{
+    return htree_leaf_generator(data, data_length, secret, secret_length,
+                                dst_buffer, gen_args);
+}
+
+static int node_generator(const unsigned char *left_node,
+                          const unsigned char *right_node,
+                          const int node_length,
+                          unsigned char *dst_buffer,
+                          const struct htree_gen_args *gen_args)
+{
+    return htree_node_generator(left_node, right_node, node_length,
+                                dst_buffer, gen_args);
+}
+
+START_TEST(test_hash_mb_htree_nodes)
+{
+    const int         num_leaves = 37;
+    struct hash_tree *tree       = NULL;
+    unsigned char    *nodes      = NULL;
+    int               size;
+
+    // a tree with secrets and an incomplete leaf set
+    fail_unless((tree = htree_init(num_leaves, 20, 20, 20, NULL, 0)) != NULL);
+    fail_unless(htree_add_random_data(tree, num_leaves) == 0);
+    fail_unless(htree_add_random_secrets(tree) == 0);
+    fail_unless(htree_calc_nodes(tree, htree_leaf_generator,
+                                 htree_node_generator, NULL) == 0);
+
+    size = (2 * tree->leaf_set_size - 1) * tree->node_length;
+    fail_unless((nodes = malloc(size)) != NULL);
+    memcpy(nodes, tree->nodes, size);
+    memset(tree->nodes, 0, size);
+
+    // the multi-buffer path computes the same nodes as the generators
+    fail_unless(htree_calc_nodes(tree, leaf_generator, node_generator,
+                                 NULL) == 0);
+    fail_unless(memcmp(nodes, tree->nodes, size) == 0);
+    fail_unless(tree->root == &tree->nodes[size - tree->node_length]);
+
+    free(nodes);
+    htree_free(tree);
+}
+END_TEST
+
+Suite *libcore_hash_mb(void)
+{
+    Suite *s = suite_create("libcore/hash_mb");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_hash_mb_sha1);
+    tcase_add_test(tc_core, test_hash_mb_htree_nodes);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/sha.h>
+
+#include "libcore/hashchain.h"
+#include "test_suites.h"
+
+#define HASH_LENGTH 20
+
+/* pops all elements and checks that each one hashes to its predecessor */
+static void check_traversal(struct hash_chain *hchain, const int length)
+{
+    unsigned char  previous[HASH_LENGTH];
+    unsigned char *element = NULL;
+    int            i;
+
+    fail_unless(hchain != NULL);
+    fail_unless(hchain_get_num_remaining(hchain) == length);
+
+    element = hchain_pop(hchain);
+    fail_unless(element != NULL);
+    fail_unless(memcmp(element, hchain_get_anchor(hchain), HASH_LENGTH) == 0);
+
+    for (i = 1; i < length; i++) {
+        memcpy(previous, element, HASH_LENGTH);
+        element = hchain_pop(hchain);
+        fail_unless(element != NULL);
+        fail_unless(hchain_verify(element, previous, (hash_function) SHA1,
+                                  HASH_LENGTH, 1, NULL, 0) == 1);
+    }
+
+    fail_unless(memcmp(element, hchain_get_seed(hchain), HASH_LENGTH) == 0);
+    fail_unless(hchain_get_num_remaining(hchain) == 0);
+    fail_unless(hchain_pop(hchain) == NULL);
+
+    hchain_free(hchain);
+}
+
+START_TEST(test_hchain_stored_traversal)
+{
+    check_traversal(hchain_create((hash_function) SHA1, HASH_LENGTH, 100, 0,
+                                  NULL), 100);
+}
+END_TEST
+
+START_TEST(test_hchain_pebbled_traversal)
+{
+    const int lengths[] = { 1, 2, 3, 64, 1000, 4099 };
+    unsigned  i;
+
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        check_traversal(hchain_create_pebbled((hash_function) SHA1,
+                                              HASH_LENGTH, lengths[i], 0,
+                                              NULL), lengths[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_hchain_create_multi)
+{
+    struct hash_chain *hchains[11];
+    int                pebbled, i;
+
+    // more chains than the multi-buffer engine has lanes
+    for (pebbled = 0; pebbled <= 1; pebbled++) {
+        fail_unless(hchain_create_multi((hash_function) SHA1, HASH_LENGTH, 50,
+                                        0, NULL, pebbled, hchains, 11) == 0);
+        for (i = 0; i < 11; i++) {
+            check_traversal(hchains[i], 50);
+        }
+    }
+}
+END_TEST
+
+Suite *libcore_hashchain(void)
+{
+    Suite *s = suite_create("libcore/hashchain");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_hchain_stored_traversal);
+    tcase_add_test(tc_core, test_hchain_pebbled_traversal);
+    tcase_add_test(tc_core, test_hchain_create_multi);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
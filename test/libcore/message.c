@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "libcore/builder.h"
+#include "libcore/hip_udp.h"
+#include "libcore/message.h"
+#include "libcore/protodefs.h"
+#include "test_suites.h"
+
+#define NUM_CTXS (HIP_CONTROL_MSG_BATCH + 4)
+
+static int                       receiver = -1, sender = -1;
+static struct sockaddr_in        receiver_addr;
+static struct hip_packet_context ctxs[NUM_CTXS];
+
+static void setup(void)
+{
+    const int on  = 1;
+    socklen_t len = sizeof(receiver_addr);
+
+    fail_unless((receiver = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+    fail_unless((sender = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+    fail_unless(setsockopt(receiver, IPPROTO_IP, IP_PKTINFO, &on,
+                           sizeof(on)) == 0);
+
+    memset(&receiver_addr, 0, sizeof(receiver_addr));
+    receiver_addr.sin_family      = AF_INET;
+    receiver_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fail_unless(bind(receiver, (struct sockaddr *) &receiver_addr,
+                     sizeof(receiver_addr)) == 0);
+    fail_unless(getsockname(receiver, (struct sockaddr *) &receiver_addr,
+                            &len) == 0);
+
+    for (int i = 0; i < NUM_CTXS; i++) {
+        fail_unless((ctxs[i].input_msg = hip_msg_alloc()) != NULL);
+    }
+}
+
+static void teardown(void)
+{
+    close(receiver);
+    close(sender);
+    for (int i = 0; i < NUM_CTXS; i++) {
+        free(ctxs[i].input_msg);
+    }
+}
+
+/* send a HIP control message as it is encapsulated in UDP */
+static void send_control_msg(const uint8_t type)
+{
+    uint8_t            buf[HIP_UDP_ZERO_BYTES_LEN + HIP_MAX_PACKET] = { 0 };
+    struct hip_common *msg = (struct hip_common *) (buf + HIP_UDP_ZERO_BYTES_LEN);
+    struct in6_addr    hit;
+    int                len;
+
+    fail_unless(inet_pton(AF_INET6, "2001:10::1", &hit) == 1);
+    hip_build_network_hdr(msg, type, 0, &hit, &in6addr_any, HIP_V2);
+    hip_calc_hdr_len(msg);
+    len = HIP_UDP_ZERO_BYTES_LEN + hip_get_msg_total_len(msg);
+
+    fail_unless(sendto(sender, buf, len, 0,
+                       (struct sockaddr *) &receiver_addr,
+                       sizeof(receiver_addr)) == len);
+}
+
+START_TEST(test_hip_read_control_msgs_batch)
+{
+    send_control_msg(HIP_I1);
+    send_control_msg(HIP_I2);
+    fail_unless(sendto(sender, "junk", 4, 0,
+                       (struct sockaddr *) &receiver_addr,
+                       sizeof(receiver_addr)) == 4);
+
+    fail_unless(hip_read_control_msgs(receiver, ctxs, NUM_CTXS,
+                                      HIP_UDP_ZERO_BYTES_LEN, 1) == 3);
+
+    fail_unless(ctxs[0].error == 0);
+    fail_unless(hip_get_msg_type(ctxs[0].input_msg) == HIP_I1);
+    fail_unless(ctxs[1].error == 0);
+    fail_unless(hip_get_msg_type(ctxs[1].input_msg) == HIP_I2);
+    fail_unless(ctxs[1].msg_ports.dst_port == hip_get_local_nat_udp_port());
+    fail_unless(IN6_IS_ADDR_V4MAPPED(&ctxs[1].src_addr));
+    fail_unless(IN6_IS_ADDR_V4MAPPED(&ctxs[1].dst_addr));
+    // the malformed message is flagged, not dropped silently
+    fail_unless(ctxs[2].error != 0);
+
+    // nothing queued, the call does not block
+    fail_unless(hip_read_control_msgs(receiver, ctxs, NUM_CTXS,
+                                      HIP_UDP_ZERO_BYTES_LEN, 1) == 0);
+}
+END_TEST
+
+START_TEST(test_hip_read_control_msgs_limit)
+{
+    for (int i = 0; i < NUM_CTXS; i++) {
+        send_control_msg(HIP_I1);
+    }
+
+    fail_unless(hip_read_control_msgs(receiver, ctxs, NUM_CTXS,
+                                      HIP_UDP_ZERO_BYTES_LEN, 1)
+                == HIP_CONTROL_MSG_BATCH);
+    fail_unless(hip_read_control_msgs(receiver, ctxs, 2,
+                                      HIP_UDP_ZERO_BYTES_LEN, 1) == 2);
+    fail_unless(hip_read_control_msgs(receiver, ctxs, NUM_CTXS,
+                                      HIP_UDP_ZERO_BYTES_LEN, 1)
+                == NUM_CTXS - HIP_CONTROL_MSG_BATCH - 2);
+    for (int i = 0; i < NUM_CTXS - HIP_CONTROL_MSG_BATCH - 2; i++) {
+        fail_unless(ctxs[i].error == 0);
+    }
+}
+END_TEST
+
+Suite *libcore_message(void)
+{
+    Suite *s = suite_create("libcore/message");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_hip_read_control_msgs_batch);
+    tcase_add_test(tc_core, test_hip_read_control_msgs_limit);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
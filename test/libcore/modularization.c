@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+
+#include "libcore/modularization.h"
+#include "test_suites.h"
+
+static struct modular_state *state;
+
+static void setup(void)
+{
+    state = lmod_init_state();
+}
+
+static void teardown(void)
+{
+    lmod_uninit_state(state);
+    lmod_uninit_state_slots();
+}
+
+static int *new_item(const int value)
+{
+    int *item = malloc(sizeof(*item));
+
+    *item = value;
+    return item;
+}
+
+START_TEST(test_lmod_register_state_slot)
+{
+    const int slot = lmod_register_state_slot("first");
+
+    fail_unless(slot >= 0);
+    fail_unless(lmod_register_state_slot("second") != slot);
+    fail_unless(lmod_register_state_slot("first") == slot);
+    fail_unless(lmod_register_state_slot(NULL) == -1);
+}
+END_TEST
+
+START_TEST(test_lmod_get_state_item_by_slot)
+{
+    const int slot = lmod_register_state_slot("first");
+    int      *item = new_item(1);
+
+    fail_unless(lmod_get_state_item_by_slot(state, slot) == NULL);
+    fail_unless(lmod_add_state_item(state, item, "first") == slot);
+    fail_unless(lmod_get_state_item_by_slot(state, slot) == item);
+    fail_unless(lmod_get_state_item(state, "first") == item);
+    fail_unless(lmod_get_state_item_by_slot(state, -1) == NULL);
+    fail_unless(lmod_get_state_item_by_slot(NULL, slot) == NULL);
+}
+END_TEST
+
+START_TEST(test_lmod_add_state_item_late_slot)
+{
+    int *item1 = new_item(1);
+    int *item2 = new_item(2);
+    int  slot;
+
+    // the state was created before these slots existed
+    fail_unless(lmod_add_state_item(state, item1, "first") >= 0);
+    fail_unless((slot = lmod_add_state_item(state, item2, "second")) >= 0);
+    fail_unless(lmod_get_state_item_by_slot(state, slot) == item2);
+    fail_unless(lmod_get_state_item(state, "first") == item1);
+    fail_unless(lmod_get_state_item(state, "missing") == NULL);
+}
+END_TEST
+
+START_TEST(test_lmod_add_state_item_duplicate)
+{
+    int *item1 = new_item(1);
+    int *item2 = new_item(2);
+
+    fail_unless(lmod_add_state_item(state, item1, "first") >= 0);
+    fail_unless(lmod_add_state_item(state, item2, "first") == -1);
+    fail_unless(lmod_get_state_item(state, "first") == item1);
+    free(item2);
+}
+END_TEST
+
+Suite *libcore_modularization(void)
+{
+    Suite *s = suite_create("libcore/modularization");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_lmod_register_state_slot);
+    tcase_add_test(tc_core, test_lmod_get_state_item_by_slot);
+    tcase_add_test(tc_core, test_lmod_add_state_item_late_slot);
+    tcase_add_test(tc_core, test_lmod_add_state_item_duplicate);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
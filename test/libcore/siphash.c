@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+
+#include "libcore/siphash.h"
+#include "test_suites.h"
+
+/* key 00 01 .. 0f and messages 00 01 .. (len - 1) from the reference
+ * implementation of SipHash-2-4 */
+static void setup_vector(uint8_t key[HIP_SIPHASH_KEY_LEN], uint8_t msg[16])
+{
+    unsigned int i;
+
+    for (i = 0; i < HIP_SIPHASH_KEY_LEN; i++) {
+        key[i] = i;
+    }
+    for (i = 0; i < 16; i++) {
+        msg[i] = i;
+    }
+}
+
+START_TEST(test_hip_siphash_reference_vectors)
+{
+    uint8_t key[HIP_SIPHASH_KEY_LEN];
+    uint8_t msg[16];
+
+    setup_vector(key, msg);
+
+    fail_unless(hip_siphash(key, msg, 0)  == 0x726fdb47dd0e0e31ULL, NULL);
+    fail_unless(hip_siphash(key, msg, 1)  == 0x74f839c593dc67fdULL, NULL);
+    fail_unless(hip_siphash(key, msg, 7)  == 0xab0200f58b01d137ULL, NULL);
+    fail_unless(hip_siphash(key, msg, 8)  == 0x93f5f5799a932462ULL, NULL);
+    fail_unless(hip_siphash(key, msg, 15) == 0xa129ca6149be45e5ULL, NULL);
+}
+END_TEST
+
+START_TEST(test_hip_siphash_key_dependent)
+{
+    uint8_t  key[HIP_SIPHASH_KEY_LEN];
+    uint8_t  msg[16];
+    uint64_t hash;
+
+    setup_vector(key, msg);
+    hash    = hip_siphash(key, msg, sizeof(msg));
+    key[0] ^= 1;
+
+    fail_unless(hip_siphash(key, msg, sizeof(msg)) != hash, NULL);
+}
+END_TEST
+
+Suite *libcore_siphash(void)
+{
+    Suite *s = suite_create("libcore/siphash");
+
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_hip_siphash_reference_vectors);
+    tcase_add_test(tc_core, test_hip_siphash_key_dependent);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
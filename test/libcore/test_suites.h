@@ -30,8 +30,13 @@
 
 Suite *libcore_cert(void);
 Suite *libcore_crypto(void);
+Suite *libcore_hash_mb(void);
+Suite *libcore_hashchain(void);
 Suite *libcore_hit(void);
 Suite *libcore_hostid(void);
+Suite *libcore_message(void);
+Suite *libcore_modularization(void);
+Suite *libcore_siphash(void);
 Suite *libcore_solve(void);
 Suite *libcore_straddr(void);
 
@@ -81,6 +81,7 @@
 
 #include <check.h>
 #include <dlfcn.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -190,3 +191,26 @@ int system(const char *command)
 
     return EXIT_SUCCESS;
 }
+
+/*** popen(3) ***/
+
+bool mock_popen = false; /**< popen(3) mock enabled? */
+
+/**
+ * popen(3) mock function. Controlled by the ::mock_popen flag.
+ * Fails as if no process could be created, if enabled.
+ *
+ * @param command The command to run.
+ * @param type    "r" or "w".
+ * @return        NULL with errno set to EAGAIN.
+ */
+FILE *popen(const char *command, const char *type)
+{
+    if (!mock_popen) {
+        FILE *(*original)(const char *, const char *) = get_original(popen, "popen");
+        return original(command, type);
+    }
+
+    errno = EAGAIN;
+    return NULL;
+}
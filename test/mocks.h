@@ -36,6 +36,8 @@ extern time_t mock_time_next;
 extern bool  mock_system;
 extern char *mock_system_last;
 
+extern bool mock_popen;
+
 extern bool         mock_ipq;
 extern unsigned int mock_ipq_pkt_len;
 
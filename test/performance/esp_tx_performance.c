@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Compare the transmit throughput of sending ESP-sized packets with one
+ * sendto() call per packet, as userspace IPsec used to do, and with one
+ * sendmmsg() call per batch of packets. The packets are sent over a UDP
+ * socket to the loopback interface, so that no root privileges are needed
+ * for raw sockets.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define PACKET_SIZE 1400
+#define BATCH_SIZE  16
+
+static unsigned char packets[BATCH_SIZE][PACKET_SIZE];
+
+static double elapsed(const struct timeval *const start)
+{
+    struct timeval end;
+
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start->tv_sec) + (end.tv_usec - start->tv_usec) / 1e6;
+}
+
+static double time_sendto(const int sock, const struct sockaddr_in *const dst,
+                          const unsigned int count)
+{
+    struct timeval start;
+    unsigned int   i;
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+        if (sendto(sock, packets[i % BATCH_SIZE], PACKET_SIZE, 0,
+                   (const struct sockaddr *) dst, sizeof(*dst)) < 0 &&
+            errno != ENOBUFS) {
+            perror("sendto");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return elapsed(&start);
+}
+
+static double time_sendmmsg(const int sock, struct sockaddr_in *const dst,
+                            const unsigned int count)
+{
+    struct mmsghdr msgs[BATCH_SIZE];
+    struct iovec   iov[BATCH_SIZE];
+    struct timeval start;
+    unsigned int   i, sent;
+    int            ret;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < BATCH_SIZE; i++) {
+        iov[i].iov_base             = packets[i];
+        iov[i].iov_len              = PACKET_SIZE;
+        msgs[i].msg_hdr.msg_name    = dst;
+        msgs[i].msg_hdr.msg_namelen = sizeof(*dst);
+        msgs[i].msg_hdr.msg_iov     = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i += BATCH_SIZE) {
+        for (sent = 0; sent < BATCH_SIZE; sent += ret) {
+            ret = sendmmsg(sock, &msgs[sent], BATCH_SIZE - sent, 0);
+            if (ret < 0) {
+                if (errno != ENOBUFS) {
+                    perror("sendmmsg");
+                    exit(EXIT_FAILURE);
+                }
+                ret = 1;
+            }
+        }
+    }
+
+    return elapsed(&start);
+}
+
+int main(void)
+{
+    const unsigned int count = 500000;
+    struct sockaddr_in dst;
+    socklen_t          len  = sizeof(dst);
+    int                sink = -1, sock = -1;
+    double             t_sendto, t_sendmmsg;
+
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family      = AF_INET;
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // the receiver never reads, the kernel drops what does not fit
+    if ((sink = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+        bind(sink, (struct sockaddr *) &dst, sizeof(dst)) ||
+        getsockname(sink, (struct sockaddr *) &dst, &len) ||
+        (sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        perror("socket setup");
+        return EXIT_FAILURE;
+    }
+
+    memset(packets, 0xA5, sizeof(packets));
+
+    printf("Sending %u packets of %d bytes over loopback:\n", count, PACKET_SIZE);
+
+    t_sendto   = time_sendto(sock, &dst, count);
+    t_sendmmsg = time_sendmmsg(sock, &dst, count);
+
+    printf("  ==> sendto():               %8.0f packets/s, %6.0f Mbit/s\n",
+           count / t_sendto, count * PACKET_SIZE * 8 / t_sendto / 1e6);
+    printf("  ==> sendmmsg() (batch %2d):  %8.0f packets/s, %6.0f Mbit/s\n",
+           BATCH_SIZE, count / t_sendmmsg,
+           count * PACKET_SIZE * 8 / t_sendmmsg / 1e6);
+
+    close(sock);
+    close(sink);
+
+    return EXIT_SUCCESS;
+}
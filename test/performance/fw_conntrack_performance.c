@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Measure how ESP packet lookups in the hipfw connection tracker scale with
+ * the number of tracked ESP tuples. The indexed lookup is compared to a
+ * linear walk of the ESP tuple list.
+ */
+
+#define _BSD_SOURCE
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "libcore/debug.h"
+#include "hipfw/conntrack.c"
+
+/**
+ * Create a connection with @a count ESP tuples. Each ESP tuple gets a
+ * random SPI and a distinct destination address.
+ *
+ * @param count number of ESP tuples to create
+ * @param spis  receives the SPIs of the ESP tuples
+ * @param dsts  receives the destination addresses of the ESP tuples
+ * @return      the connection
+ */
+static struct connection *setup_esp_tuples(const unsigned int count,
+                                           uint32_t *const spis,
+                                           struct in6_addr *const dsts)
+{
+    struct hip_fw_context ctx      = { 0 };
+    struct hip_data       data     = { { { { 0 } } } };
+    struct hip_esp_info   esp_info = { 0 };
+    struct connection    *conn;
+    unsigned int          i;
+    int                   err;
+
+    err = insert_new_connection(&data, &ctx);
+    assert(err == 0);
+    conn = conn_list->data;
+
+    for (i = 0; i < count; i += 1) {
+        spis[i] = (uint32_t) random() | 1;
+        inet_pton(AF_INET6, "3ffe::", &dsts[i]);
+        dsts[i].s6_addr32[3] = htonl(i);
+
+        ctx.src          = dsts[i];
+        esp_info.new_spi = htonl(spis[i]);
+        err              = esp_tuple_from_esp_info(&esp_info, &ctx,
+                                                   &conn->reply);
+        assert(err == 0);
+    }
+
+    return conn;
+}
+
+/**
+ * Look up an ESP tuple by SPI and destination address by walking
+ * ::esp_list, as done before the ESP index was introduced.
+ *
+ * @param dst_addr the destination address
+ * @param spi      the SPI
+ * @return         the matching tuple or NULL
+ */
+static struct tuple *esp_list_scan(const struct in6_addr *const dst_addr,
+                                   const uint32_t spi)
+{
+    const struct dlist *list;
+
+    for (list = esp_list; list; list = list->next) {
+        const struct esp_tuple *const esp_tuple = list->data;
+
+        if (esp_tuple->spi == spi &&
+            get_esp_address(&esp_tuple->dst_addresses, dst_addr)) {
+            return esp_tuple->tuple;
+        }
+    }
+
+    return NULL;
+}
+
+static double time_get_tuple_by_esp(const unsigned int iterations,
+                                    const unsigned int count,
+                                    const bool indexed)
+{
+    clock_t          start, end;
+    unsigned int     i;
+    uint32_t        *spis = calloc(count, sizeof(*spis));
+    struct in6_addr *dsts = calloc(count, sizeof(*dsts));
+    struct tuple    *tuple;
+
+    assert(spis && dsts);
+    setup_esp_tuples(count, spis, dsts);
+
+    start = clock();
+    for (i = 0; i < iterations; i += 1) {
+        const unsigned int j = i % count;
+
+        if (indexed) {
+            tuple = get_tuple_by_esp(&dsts[j], spis[j]);
+        } else {
+            tuple = esp_list_scan(&dsts[j], spis[j]);
+        }
+        assert(tuple != NULL);
+    }
+    end = clock();
+
+    hip_fw_uninit_conntrack();
+    free(spis);
+    free(dsts);
+
+    return (((double) (end - start)) / CLOCKS_PER_SEC) / iterations;
+}
+
+int main(void)
+{
+    const unsigned int iterations = 100000;
+    const unsigned int counts[]   = { 10, 100, 1000, 10000 };
+    unsigned int       i;
+
+    hip_set_logdebug(LOGDEBUG_NONE);
+    srandom(time(NULL));
+
+    printf("Testing ESP tuple lookup by SPI and destination address:\n"
+           "  - call get_tuple_by_esp() to\n"
+           "    - look up the ESP index\n"
+           "  - walk the ESP tuple list for comparison\n");
+
+    for (i = 0; i < sizeof(counts) / sizeof(*counts); i += 1) {
+        printf("  ==> %5u ESP tuples: time_get_tuple_by_esp(%d): %fs, "
+               "list walk: %fs\n", counts[i], iterations,
+               time_get_tuple_by_esp(iterations, counts[i], true),
+               time_get_tuple_by_esp(iterations, counts[i], false));
+    }
+
+    return 0;
+}
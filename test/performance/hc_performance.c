@@ -39,11 +39,12 @@
 
 static void print_usage(void)
 {
-    printf("Usage: hc_performance -c|t -s|m [-lhvn NUM]\n"
+    printf("Usage: hc_performance -c|t -s|m [-p] [-lhvn NUM]\n"
            "-c = do hash-chain performance tests\n"
            "-t = do hash-tree performance tests\n"
            "-s = use SHA1 hash-function\n"
            "-m = use MD5 hash-function\n"
+           "-p = use pebbled hash-chains\n"
            "-l [NUM] = create hash-chain with length NUM\n"
            "-h [NUM] = create hash elements of length NUM\n"
            "-v [NUM] = verify NUM elements\n"
@@ -86,6 +87,7 @@ int main(int argc, char **argv)
     struct hash_chain     *hchain         = NULL;
     struct hash_tree      *htree          = NULL;
     struct statistics_data creation_stats = { 0 }, verify_stats = { 0 };
+    struct statistics_data traversal_stats = { 0 };
     uint64_t               timediff       = 0;
     uint32_t               num_items      = 0;
     double                 min            = 0.0, max = 0.0, avg = 0.0;
@@ -105,12 +107,16 @@ int main(int argc, char **argv)
     int                    verify_length = 64;
     int                    test_hc       = 0;
     int                    test_ht       = 0;
+    int                    pebbled       = 0;
+    int                    j;
 
     const hash_function hash_functions[2] = { (hash_function) SHA1,
                                               (hash_function) MD5 };
     hash_function       hash_func = NULL;
+    struct hash_chain *(*create)(const hash_function, const int, const int,
+                                 const int, struct hash_tree *) = hchain_create;
 
-    while ((c = getopt(argc, argv, "ctsml:h:v:n:")) != -1) {
+    while ((c = getopt(argc, argv, "ctsmpl:h:v:n:")) != -1) {
         switch (c) {
         case 'c':
             test_hc = 1;
@@ -124,6 +130,10 @@ int main(int argc, char **argv)
         case 'm':
             hash_func = hash_functions[1];
             break;
+        case 'p':
+            pebbled = 1;
+            create  = hchain_create_pebbled;
+            break;
         case 'l':
             hchain_length = atoi(optarg);
             break;
@@ -162,13 +172,13 @@ int main(int argc, char **argv)
                "Hash chain performance test\n"
                "-------------------------------\n\n");
 
-        printf("Creating %d hash chains of length %d with element length %d\n",
-               count, hchain_length, hash_length);
+        printf("Creating %d %shash chains of length %d with element length %d\n",
+               count, pebbled ? "pebbled " : "", hchain_length, hash_length);
 
         for (i = 0; i < count; i++) {
             gettimeofday(&start_time, NULL);
-            if ((hchain = hchain_create(hash_func, hash_length,
-                                        hchain_length, 0, NULL))) {
+            if ((hchain = create(hash_func, hash_length,
+                                 hchain_length, 0, NULL))) {
                 gettimeofday(&stop_time, NULL);
                 timediff = calc_timeval_diff(&start_time, &stop_time);
                 add_statistics_item(&creation_stats, timediff);
@@ -186,6 +196,36 @@ int main(int argc, char **argv)
 
         printf("\n");
 
+        printf("Traversing %d %shash chains of length %d with element length %d\n",
+               count, pebbled ? "pebbled " : "", hchain_length, hash_length);
+
+        for (i = 0; i < count; i++) {
+            if (!(hchain = create(hash_func, hash_length,
+                                  hchain_length, 0, NULL))) {
+                printf("ERROR creating hchain!\n");
+                exit(1);
+            }
+
+            gettimeofday(&start_time, NULL);
+            for (j = 0; j < hchain_length; j++) {
+                if (!hchain_pop(hchain)) {
+                    printf("ERROR traversing hchain!\n");
+                    exit(1);
+                }
+            }
+            gettimeofday(&stop_time, NULL);
+            timediff = calc_timeval_diff(&start_time, &stop_time);
+            add_statistics_item(&traversal_stats, timediff);
+            hchain_free(hchain);
+        }
+
+        calc_statistics(&traversal_stats, &num_items, &min, &max, &avg, &std_dev,
+                        STATS_IN_MSECS);
+        printf("traversal statistics - num_data_items: %u, min: %.3fms, max: %.3fms, avg: %.3fms, std_dev: %.3fms\n",
+               num_items, min, max, avg, std_dev);
+
+        printf("\n");
+
         printf("Verifying %d hash chains of length %d with element length %d\n",
                count, verify_length, hash_length);
 
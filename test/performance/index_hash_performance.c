@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2013 Aalto University and RWTH Aachen University.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Compare the cost of the hash functions used to index the userspace IPsec
+ * databases: SHA-1, as previously used, and SipHash-2-4. The inputs have the
+ * size of the keys of the SA database (a HIT pair) and the link database
+ * (a destination address and an SPI).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <openssl/rand.h>
+
+#include "libcore/builder.h"
+#include "libcore/debug.h"
+#include "libcore/protodefs.h"
+#include "libcore/siphash.h"
+
+/* prevents the compiler from optimizing the hash calls away */
+static volatile unsigned long sink;
+
+static double time_sha1(const unsigned int iterations,
+                        const uint8_t *const input, const int len)
+{
+    clock_t        start, end;
+    union hip_hash hash;
+    unsigned int   i;
+
+    start = clock();
+    for (i = 0; i < iterations; i += 1) {
+        hip_build_digest(HIP_DIGEST_SHA1, input, len, hash.serialized);
+        sink ^= hash.chunked[0];
+    }
+    end = clock();
+
+    return (((double) (end - start)) / CLOCKS_PER_SEC) / iterations;
+}
+
+static double time_siphash(const unsigned int iterations,
+                           const uint8_t *const key,
+                           const uint8_t *const input, const int len)
+{
+    clock_t      start, end;
+    unsigned int i;
+
+    start = clock();
+    for (i = 0; i < iterations; i += 1) {
+        sink ^= hip_siphash(key, input, len);
+    }
+    end = clock();
+
+    return (((double) (end - start)) / CLOCKS_PER_SEC) / iterations;
+}
+
+int main(void)
+{
+    const unsigned int iterations = 1000000;
+    const int          lengths[]  = { 2 * sizeof(struct in6_addr),
+                                      sizeof(struct in6_addr) + sizeof(uint32_t) };
+    const char *const  names[]    = { "HIT pair", "address and SPI" };
+    uint8_t            key[HIP_SIPHASH_KEY_LEN];
+    uint8_t            input[2 * sizeof(struct in6_addr)];
+    unsigned int       i;
+
+    hip_set_logdebug(LOGDEBUG_NONE);
+
+    if (RAND_bytes(key, sizeof(key)) <= 0 ||
+        RAND_bytes(input, sizeof(input)) <= 0) {
+        printf("ERROR generating random input!\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Testing userspace IPsec index hash functions:\n"
+           "  - SHA-1 via hip_build_digest()\n"
+           "  - SipHash-2-4 via hip_siphash()\n");
+
+    for (i = 0; i < sizeof(lengths) / sizeof(*lengths); i += 1) {
+        printf("  ==> %-15s (%2d bytes): SHA-1: %.1fns, SipHash: %.1fns\n",
+               names[i], lengths[i],
+               time_sha1(iterations, input, lengths[i]) * 1e9,
+               time_siphash(iterations, key, input, lengths[i]) * 1e9);
+    }
+
+    return EXIT_SUCCESS;
+}